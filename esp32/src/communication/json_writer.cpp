@@ -0,0 +1,210 @@
+#include "json_writer.h"
+#include <ArduinoJson.h>
+
+// Float bit patterns bounding ArduinoJson's plain notation: above the largest
+// float not over 1e-5, and below 1e7
+static const uint32_t PLAIN_MIN_BITS = 0x3727C5AC;
+static const uint32_t PLAIN_END_BITS = 0x4B189680;
+
+static const uint32_t POWERS_OF_TEN[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+void JsonWriter::string(const char* value) {
+    raw('"');
+    // Runs without special characters are copied in one go
+    const char* run = value;
+    for (; *value; value++) {
+        char escaped;
+        switch (*value) {
+            case '"': escaped = '"'; break;
+            case '\\': escaped = '\\'; break;
+            case '\b': escaped = 'b'; break;
+            case '\f': escaped = 'f'; break;
+            case '\n': escaped = 'n'; break;
+            case '\r': escaped = 'r'; break;
+            case '\t': escaped = 't'; break;
+            default: continue;
+        }
+        _write(run, value - run);
+        raw('\\');
+        raw(escaped);
+        run = value + 1;
+    }
+    _write(run, value - run);
+    raw('"');
+}
+
+void JsonWriter::uinteger(uint32_t value) {
+    _digits(value, 0);
+}
+
+void JsonWriter::integer(int32_t value) {
+    if (value < 0) {
+        raw('-');
+        _digits(0u - (uint32_t)value, 0);
+    } else {
+        _digits(value, 0);
+    }
+}
+
+void JsonWriter::boolean(bool value) {
+    if (value) {
+        raw("true");
+    } else {
+        raw("false");
+    }
+}
+
+void JsonWriter::number(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t magnitude = bits & 0x7FFFFFFF;
+    if (magnitude >= 0x7F800000) {
+        raw("null"); // NaN and infinity
+        return;
+    }
+    if (magnitude == 0) {
+        raw('0');
+        return;
+    }
+    if (magnitude <= PLAIN_MIN_BITS || magnitude >= PLAIN_END_BITS) {
+        _numberWithExponent(value);
+        return;
+    }
+    if (bits & 0x80000000) {
+        raw('-');
+    }
+    
+    // ArduinoJson splits the double into integral and decimal parts, each a
+    // u32, with 9 significant decimal places less one per integral digit
+    // past the first. The float is exactly mantissa * 2^-shift, so this is
+    // done in integers; the one double product, fraction times 10^places,
+    // is rounded to 53 bits the way the FPU would round it.
+    uint64_t mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+    int32_t exponent = (int32_t)(magnitude >> 23) - 150;
+    uint32_t integral;
+    uint64_t fraction = 0;
+    uint8_t shift = 0;
+    if (exponent >= 0) {
+        integral = (uint32_t)(mantissa << exponent);
+    } else {
+        shift = (uint8_t)-exponent;
+        integral = shift < 64 ? (uint32_t)(mantissa >> shift) : 0;
+        fraction = mantissa & ((1ULL << shift) - 1);
+    }
+    
+    uint8_t places = 9;
+    for (uint32_t rest = integral; rest >= 10; rest /= 10) {
+        places--;
+    }
+    uint32_t limit = POWERS_OF_TEN[places];
+    
+    uint32_t decimal = 0;
+    if (fraction != 0) {
+        uint64_t product = fraction * limit; // Under 2^54
+        if (product >> 53) {
+            uint64_t dropped = product & 1;
+            uint64_t kept = product >> 1;
+            if (dropped && (kept & 1)) {
+                kept++; // Ties to even
+            }
+            product = kept << 1;
+        }
+        decimal = (uint32_t)(product >> shift);
+        uint64_t remainder = product & ((1ULL << shift) - 1);
+        if (remainder >= (1ULL << (shift - 1))) {
+            decimal++; // ArduinoJson rounds on the remainder past the last place
+        }
+    }
+    if (decimal >= limit) {
+        decimal = 0;
+        integral++;
+    }
+    while (places > 0 && decimal % 10 == 0) {
+        decimal /= 10;
+        places--;
+    }
+    
+    _digits(integral, 0);
+    if (places > 0) {
+        raw('.');
+        _digits(decimal, places);
+    }
+}
+
+bool JsonWriter::checkNumbers(uint32_t count, float& mismatch) {
+    // LSB sizes: m/s² and g at ±2 to ±16 g, dps at ±250 to ±2000, °C (MPU6050)
+    static const float STEPS[] = {
+        9.80665f / 16384, 9.80665f / 2048, 1.0f / 16384, 1.0f / 4096, 1.0f / 2048,
+        1.0f / 131, 1.0f / 65.5f, 1.0f / 16.4f, 1.0f / 340
+    };
+    static const uint32_t STEP_COUNT = sizeof(STEPS) / sizeof(STEPS[0]);
+    
+    StaticJsonDocument<16> number;
+    char expected[32];
+    char actual[32];
+    uint32_t state = 0x9E3779B9;
+    for (uint32_t i = 0; i < count; i++) {
+        // xorshift32
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        
+        float value;
+        if (i & 1) {
+            uint32_t bits = PLAIN_MIN_BITS + 1 + state % (PLAIN_END_BITS - PLAIN_MIN_BITS - 1);
+            bits |= (i & 2) << 30;
+            memcpy(&value, &bits, sizeof(value));
+        } else {
+            value = (int16_t)(state >> 16) * STEPS[(i / 2) % STEP_COUNT];
+        }
+        
+        number.set(value);
+        size_t expectedLength = serializeJson(number, expected, sizeof(expected));
+        JsonWriter out(actual, sizeof(actual));
+        out.number(value);
+        if (out.length() != expectedLength || memcmp(actual, expected, expectedLength) != 0) {
+            mismatch = value;
+            return false;
+        }
+    }
+    return true;
+}
+
+void JsonWriter::_digits(uint32_t value, uint8_t width) {
+    // Filled from the end, two digits at a time
+    char text[10];
+    char* begin = text + sizeof(text);
+    while (value >= 100) {
+        const char* pair = DIGIT_PAIRS + (value % 100) * 2;
+        value /= 100;
+        *--begin = pair[1];
+        *--begin = pair[0];
+    }
+    if (value >= 10) {
+        const char* pair = DIGIT_PAIRS + value * 2;
+        *--begin = pair[1];
+        *--begin = pair[0];
+    } else {
+        *--begin = '0' + value;
+    }
+    while (text + sizeof(text) - begin < width) {
+        *--begin = '0';
+    }
+    _write(begin, text + sizeof(text) - begin);
+}
+
+void JsonWriter::_numberWithExponent(float value) {
+    // Out of range for a sensor reading in practice; ArduinoJson formats these itself
+    StaticJsonDocument<16> number;
+    number.set(value);
+    char text[32];
+    size_t length = serializeJson(number, text, sizeof(text));
+    _write(text, length);
+}
@@ -0,0 +1,71 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Kept free of Arduino dependencies so the host tools can build it as is
+// (see esp32/tools/json_bench.cpp); only ArduinoJson itself is needed.
+
+// Streams JSON text straight into a buffer for documents whose layout is
+// fixed at compile time, such as sensor frames (JSON_FAST_FRAMES). Keys and
+// punctuation go in as constant fragments; values are formatted with integer
+// arithmetic. The output is byte for byte what serializeJson() would give for
+// the same fields in the same order, floats included, so consumers can't tell
+// the two apart. Once the buffer is full further writes are dropped and
+// overflowed() is set.
+class JsonWriter {
+public:
+    JsonWriter(char* buffer, size_t capacity) : _buffer(buffer), _capacity(capacity), _length(0), _overflowed(false) {}
+    
+    // A constant fragment such as ",\"x\":"; the length is known at compile time
+    template <size_t N>
+    void raw(const char (&fragment)[N]) { _write(fragment, N - 1); }
+    void raw(char c) {
+        if (_length < _capacity) {
+            _buffer[_length++] = c;
+        } else {
+            _overflowed = true;
+        }
+    }
+    
+    // Quoted and escaped as ArduinoJson 6 does
+    void string(const char* value);
+    void uinteger(uint32_t value);
+    void integer(int32_t value);
+    void boolean(bool value);
+    // As ArduinoJson 6 prints a float stored as a double: up to 9 decimal
+    // places, trailing zeros dropped, exponent outside 1e-5..1e7, null for
+    // NaN and infinity
+    void number(float value);
+    
+    // Compares number() with serializeJson() on count floats: random bit
+    // patterns in plain notation, and 16-bit readings at common IMU scales.
+    // Run on the target, whose float and double arithmetic the host bench
+    // can't vouch for; false, with the first value that differs, on a mismatch.
+    static bool checkNumbers(uint32_t count, float& mismatch);
+    
+    const char* data() const { return _buffer; }
+    size_t length() const { return _length; }
+    bool overflowed() const { return _overflowed; }
+    
+private:
+    char* _buffer;
+    size_t _capacity;
+    size_t _length;
+    bool _overflowed;
+    
+    void _write(const char* text, size_t length) {
+        if (_length + length > _capacity) {
+            _overflowed = true;
+            return;
+        }
+        memcpy(_buffer + _length, text, length);
+        _length += length;
+    }
+    void _digits(uint32_t value, uint8_t width);
+    void _numberWithExponent(float value);
+};
+
+#endif // JSON_WRITER_H
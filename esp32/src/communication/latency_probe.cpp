@@ -0,0 +1,146 @@
+#include "latency_probe.h"
+#include <esp_timer.h>
+#include "../config/config.h"
+
+// Roughly logarithmic, so p99 stays meaningful from a LAN broker up to a struggling link
+const uint16_t LatencyProbe::BUCKET_LIMITS_MS[LATENCY_PROBE_BUCKETS - 1] = {
+    1, 2, 3, 5, 7, 10, 15, 20, 30, 50, 70, 100, 150, 200, 300, 500, 700, 1000, 2000
+};
+
+LatencyProbe::LatencyProbe(MQTTClient& client)
+    : _client(client), _enabled(false), _sequence(0), _sentUs(0), _pending(false), _sent(0), _received(0),
+      _timeouts(0), _late(0), _lastUs(0), _maxUs(0), _count(0), _sinceHalving(0) {
+    memset(_buckets, 0, sizeof(_buckets));
+}
+
+void LatencyProbe::begin() {
+    _enabled = LATENCY_PROBE_ENABLED;
+    if (_enabled) {
+        Serial.printf("Latency probe every %lu ms\n", (unsigned long)LATENCY_PROBE_INTERVAL_MS);
+    }
+}
+
+void LatencyProbe::onConnected() {
+    if (!_enabled) {
+        return;
+    }
+    // Lost with the connection; the disconnect is counted elsewhere, not as a timeout
+    _pending = false;
+    _client.subscribe(MQTT_TOPIC_PROBE);
+}
+
+bool LatencyProbe::handleMessage(const char* topic, const uint8_t* payload, unsigned int length,
+                                 int64_t receivedUs) {
+    if (!_enabled || strcmp(topic, MQTT_TOPIC_PROBE) != 0) {
+        return false;
+    }
+    
+    if (deserializeJson(_doc, payload, length)) {
+        Serial.println("Malformed latency probe");
+        return true;
+    }
+    
+    // Only the outstanding probe counts; anything else arrived too late
+    if (!_pending || _doc["seq"] != _sequence || _doc["sent_us"] != _sentUs) {
+        _late++;
+        return true;
+    }
+    _pending = false;
+    _received++;
+    _record((uint32_t)(receivedUs - _sentUs));
+    return true;
+}
+
+void LatencyProbe::update() {
+    if (!_enabled || !_client.isConnected()) {
+        return;
+    }
+    
+    int64_t elapsedUs = esp_timer_get_time() - _sentUs;
+    if (_pending && elapsedUs >= LATENCY_PROBE_TIMEOUT_MS * 1000LL) {
+        _pending = false;
+        _timeouts++;
+    }
+    // One probe in flight at a time, so a slow reply can't be taken for the next one's
+    if (!_pending && (_sent == 0 || elapsedUs >= LATENCY_PROBE_INTERVAL_MS * 1000LL)) {
+        _send();
+    }
+}
+
+uint32_t LatencyProbe::getPercentile(uint16_t perMille) const {
+    if (_count == 0) {
+        return 0;
+    }
+    
+    // Interpolated within the bucket the rank falls in; the open bucket ends at the maximum
+    uint32_t rank = ((uint32_t)_count * perMille + 999) / 1000;
+    uint32_t below = 0;
+    for (uint8_t i = 0; i < LATENCY_PROBE_BUCKETS; i++) {
+        if (below + _buckets[i] < rank) {
+            below += _buckets[i];
+            continue;
+        }
+        uint32_t lowerUs = i > 0 ? BUCKET_LIMITS_MS[i - 1] * 1000UL : 0;
+        uint32_t upperUs = i < LATENCY_PROBE_BUCKETS - 1 ? BUCKET_LIMITS_MS[i] * 1000UL : _maxUs;
+        if (upperUs > _maxUs) {
+            upperUs = _maxUs;
+        }
+        if (upperUs <= lowerUs) {
+            return upperUs;
+        }
+        return lowerUs + (uint64_t)(upperUs - lowerUs) * (rank - below) / _buckets[i];
+    }
+    return _maxUs;
+}
+
+void LatencyProbe::writeStatus(JsonObject latency) const {
+    latency["interval_ms"] = LATENCY_PROBE_INTERVAL_MS;
+    latency["sent"] = _sent;
+    latency["received"] = _received;
+    latency["timeouts"] = _timeouts;
+    latency["late"] = _late;
+    latency["last_us"] = _lastUs;
+    latency["p50_us"] = getPercentile(500);
+    latency["p99_us"] = getPercentile(990);
+    latency["max_us"] = _maxUs;
+}
+
+void LatencyProbe::_send() {
+    _doc.clear();
+    _doc["seq"] = ++_sequence;
+    _sentUs = esp_timer_get_time();
+    _doc["sent_us"] = _sentUs;
+    _sent++;
+    
+    // A probe the queue refuses is left to time out, as one lost on the way would
+    size_t length = serializeJson(_doc, _buffer, sizeof(_buffer));
+    _pending = true;
+    if (length > 0 && length < sizeof(_buffer)) {
+        _client.publish(MQTT_TOPIC_PROBE, (const uint8_t*)_buffer, length, false, PublishClass::TELEMETRY,
+                        PayloadSchema::PROBE);
+    }
+}
+
+void LatencyProbe::_record(uint32_t roundTripUs) {
+    _lastUs = roundTripUs;
+    if (roundTripUs > _maxUs) {
+        _maxUs = roundTripUs;
+    }
+    
+    uint8_t bucket = 0;
+    while (bucket < LATENCY_PROBE_BUCKETS - 1 && roundTripUs > BUCKET_LIMITS_MS[bucket] * 1000UL) {
+        bucket++;
+    }
+    _buckets[bucket]++;
+    _count++;
+    
+    // Halving keeps the older probes' weight decaying geometrically
+    if (++_sinceHalving >= LATENCY_PROBE_WINDOW) {
+        _sinceHalving = 0;
+        _count = 0;
+        for (uint8_t i = 0; i < LATENCY_PROBE_BUCKETS; i++) {
+            _buckets[i] /= 2;
+            _count += _buckets[i];
+        }
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef LATENCY_PROBE_H
+#define LATENCY_PROBE_H
+
+#include <ArduinoJson.h>
+#include "mqtt_client.h"
+
+// Round-trip time buckets, by upper bound in ms; the last is open-ended
+#define LATENCY_PROBE_BUCKETS 20
+
+// End-to-end latency through the broker. Every LATENCY_PROBE_INTERVAL_MS a
+// timestamped probe goes out on MQTT_TOPIC_PROBE, which the node subscribes
+// to itself. It is queued as telemetry, so it waits behind samples and is
+// rate limited like them, and the round trip runs from queueing to the
+// broker's delivery back: one way is roughly half of it. Replies missing
+// after LATENCY_PROBE_TIMEOUT_MS count as timeouts. Round trips go into a
+// histogram that is halved every LATENCY_PROBE_WINDOW probes, so its
+// percentiles follow the recent link rather than the whole uptime, and a
+// degrading broker or WiFi shows up before telemetry starts being dropped.
+class LatencyProbe {
+public:
+    LatencyProbe(MQTTClient& client);
+    
+    void begin();
+    
+    // Call after every MQTT (re)connect; a probe in flight is abandoned
+    void onConnected();
+    
+    // Call first thing in the MQTT callback, with the time taken on entry;
+    // true if the message was a probe
+    bool handleMessage(const char* topic, const uint8_t* payload, unsigned int length, int64_t receivedUs);
+    
+    // Sends probes and times them out; call once per loop
+    void update();
+    
+    bool isEnabled() const { return _enabled; }
+    
+    // Round trip in µs below which the given per mille of recent probes fell; 0 before any
+    uint32_t getPercentile(uint16_t perMille) const;
+    
+    void writeStatus(JsonObject latency) const;
+    
+private:
+    MQTTClient& _client;
+    StaticJsonDocument<64> _doc;
+    char _buffer[64];
+    bool _enabled;
+    
+    uint32_t _sequence;
+    int64_t _sentUs;
+    bool _pending;
+    
+    uint32_t _sent;
+    uint32_t _received;
+    uint32_t _timeouts;
+    uint32_t _late;     // Replies after their timeout, or duplicates
+    uint32_t _lastUs;
+    uint32_t _maxUs;
+    
+    uint16_t _buckets[LATENCY_PROBE_BUCKETS];
+    uint16_t _count;    // Probes in the histogram
+    uint16_t _sinceHalving;
+    
+    void _send();
+    void _record(uint32_t roundTripUs);
+    
+    static const uint16_t BUCKET_LIMITS_MS[LATENCY_PROBE_BUCKETS - 1];
+};
+
+#endif // LATENCY_PROBE_H
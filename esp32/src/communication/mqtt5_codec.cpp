@@ -0,0 +1,438 @@
+#include "mqtt5_codec.h"
+#include <string.h>
+
+// Property identifiers (MQTT 5.0 section 2.2.2.2)
+#define PROPERTY_MESSAGE_EXPIRY 0x02
+#define PROPERTY_SERVER_KEEP_ALIVE 0x13
+#define PROPERTY_TOPIC_ALIAS_MAXIMUM 0x22
+#define PROPERTY_TOPIC_ALIAS 0x23
+#define PROPERTY_MAXIMUM_QOS 0x24
+#define PROPERTY_RETAIN_AVAILABLE 0x25
+#define PROPERTY_USER_PROPERTY 0x26
+#define PROPERTY_MAXIMUM_PACKET_SIZE 0x27
+
+// Variable byte integers are at most 4 bytes
+#define MAX_VARINT 268435455
+
+namespace {
+
+// Bounds-checked big-endian writer
+struct Writer {
+    uint8_t* out;
+    size_t capacity;
+    size_t length;
+    bool overflow;
+    
+    Writer(uint8_t* buffer, size_t size) : out(buffer), capacity(size), length(0), overflow(false) {}
+    
+    void byte(uint8_t value) {
+        if (length < capacity) {
+            out[length++] = value;
+        } else {
+            overflow = true;
+        }
+    }
+    
+    void u16(uint16_t value) {
+        byte(value >> 8);
+        byte(value & 0xFF);
+    }
+    
+    void u32(uint32_t value) {
+        u16(value >> 16);
+        u16(value & 0xFFFF);
+    }
+    
+    void varint(uint32_t value) {
+        do {
+            uint8_t next = value & 0x7F;
+            value >>= 7;
+            byte(value > 0 ? next | 0x80 : next);
+        } while (value > 0);
+    }
+    
+    void bytes(const void* data, size_t size) {
+        if (size > capacity - length) {
+            overflow = true;
+            return;
+        }
+        memcpy(out + length, data, size);
+        length += size;
+    }
+    
+    void string(const char* text) {
+        size_t size = strlen(text);
+        if (size > 0xFFFF) {
+            overflow = true;
+            return;
+        }
+        u16(size);
+        bytes(text, size);
+    }
+};
+
+struct Reader {
+    const uint8_t* in;
+    const uint8_t* end;
+    bool underflow;
+    
+    Reader(const uint8_t* buffer, size_t size) : in(buffer), end(buffer + size), underflow(false) {}
+    
+    uint8_t byte() {
+        if (in < end) {
+            return *in++;
+        }
+        underflow = true;
+        return 0;
+    }
+    
+    uint16_t u16() {
+        uint16_t high = byte();
+        return (high << 8) | byte();
+    }
+    
+    uint32_t u32() {
+        uint32_t high = u16();
+        return (high << 16) | u16();
+    }
+    
+    uint32_t varint() {
+        uint32_t value = 0;
+        for (uint8_t shift = 0; shift < 28; shift += 7) {
+            uint8_t next = byte();
+            value |= (uint32_t)(next & 0x7F) << shift;
+            if (!(next & 0x80)) {
+                return value;
+            }
+        }
+        underflow = true;
+        return 0;
+    }
+    
+    // Length-prefixed string or binary data, left in place
+    const uint8_t* field(size_t& size) {
+        size = u16();
+        if (underflow || size > (size_t)(end - in)) {
+            underflow = true;
+            return nullptr;
+        }
+        const uint8_t* start = in;
+        in += size;
+        return start;
+    }
+};
+
+size_t varintSize(uint32_t value) {
+    return value < 128 ? 1 : value < 16384 ? 2 : value < 2097152 ? 3 : 4;
+}
+
+// Writes the fixed header; false if a body of bodyLength bytes won't fit after it
+bool beginPacket(Writer& writer, uint8_t firstByte, size_t bodyLength) {
+    if (bodyLength > MAX_VARINT) {
+        return false;
+    }
+    writer.byte(firstByte);
+    writer.varint(bodyLength);
+    return !writer.overflow && writer.capacity - writer.length >= bodyLength;
+}
+
+}
+
+int MQTT5Codec::frame(const uint8_t* in, size_t length, size_t& headerLength, size_t& packetLength) {
+    uint32_t bodyLength = 0;
+    for (size_t i = 1; i <= 4; i++) {
+        if (i >= length) {
+            return 0;
+        }
+        bodyLength |= (uint32_t)(in[i] & 0x7F) << (7 * (i - 1));
+        if (!(in[i] & 0x80)) {
+            headerLength = i + 1;
+            packetLength = headerLength + bodyLength;
+            return length >= packetLength ? 1 : 0;
+        }
+    }
+    return -1;
+}
+
+size_t MQTT5Codec::headerSize(size_t bodyLength) {
+    return 1 + varintSize(bodyLength);
+}
+
+size_t MQTT5Codec::encodeConnect(const MQTT5Connect& connect, uint8_t* out, size_t capacity) {
+    bool hasUser = connect.user != nullptr;
+    bool hasPassword = hasUser && connect.password != nullptr;
+    bool hasWill = connect.willTopic != nullptr;
+    
+    size_t properties = connect.maximumPacketSize > 0 ? 5 : 0;
+    size_t body = 10 + varintSize(properties) + properties + 2 + strlen(connect.clientId);
+    if (hasWill) {
+        body += 1 + 2 + strlen(connect.willTopic) + 2 + connect.willLength;
+    }
+    if (hasUser) {
+        body += 2 + strlen(connect.user);
+    }
+    if (hasPassword) {
+        body += 2 + strlen(connect.password);
+    }
+    
+    Writer writer(out, capacity);
+    if (!beginPacket(writer, CONNECT, body)) {
+        return 0;
+    }
+    
+    uint8_t flags = 0x02; // Clean start: nothing is kept between connections
+    if (hasWill) {
+        flags |= 0x04 | (connect.willQos & 0x03) << 3 | (connect.willRetain ? 0x20 : 0);
+    }
+    if (hasUser) {
+        flags |= 0x80;
+    }
+    if (hasPassword) {
+        flags |= 0x40;
+    }
+    
+    writer.string("MQTT");
+    writer.byte(5);
+    writer.byte(flags);
+    writer.u16(connect.keepAliveSeconds);
+    writer.varint(properties);
+    if (connect.maximumPacketSize > 0) {
+        writer.byte(PROPERTY_MAXIMUM_PACKET_SIZE);
+        writer.u32(connect.maximumPacketSize);
+    }
+    
+    writer.string(connect.clientId);
+    if (hasWill) {
+        writer.byte(0); // No will properties
+        writer.string(connect.willTopic);
+        writer.u16(connect.willLength);
+        writer.bytes(connect.willPayload, connect.willLength);
+    }
+    if (hasUser) {
+        writer.string(connect.user);
+    }
+    if (hasPassword) {
+        writer.string(connect.password);
+    }
+    return writer.overflow ? 0 : writer.length;
+}
+
+size_t MQTT5Codec::encodePublish(const MQTT5Publish& publish, uint8_t* out, size_t capacity) {
+    size_t topicLength = strlen(publish.topic);
+    size_t properties = 0;
+    if (publish.messageExpiry > 0) {
+        properties += 5;
+    }
+    if (publish.topicAlias > 0) {
+        properties += 3;
+    }
+    if (publish.userKey != nullptr) {
+        properties += 1 + 2 + strlen(publish.userKey) + 2 + strlen(publish.userValue);
+    }
+    
+    size_t body = 2 + topicLength + (publish.qos > 0 ? 2 : 0) + varintSize(properties) + properties +
+                  publish.payloadLength;
+    uint8_t firstByte = PUBLISH | (publish.qos & 0x03) << 1 | (publish.retain ? 0x01 : 0);
+    
+    Writer writer(out, capacity);
+    if (!beginPacket(writer, firstByte, body)) {
+        return 0;
+    }
+    
+    writer.string(publish.topic);
+    if (publish.qos > 0) {
+        writer.u16(publish.packetId);
+    }
+    writer.varint(properties);
+    if (publish.messageExpiry > 0) {
+        writer.byte(PROPERTY_MESSAGE_EXPIRY);
+        writer.u32(publish.messageExpiry);
+    }
+    if (publish.topicAlias > 0) {
+        writer.byte(PROPERTY_TOPIC_ALIAS);
+        writer.u16(publish.topicAlias);
+    }
+    if (publish.userKey != nullptr) {
+        writer.byte(PROPERTY_USER_PROPERTY);
+        writer.string(publish.userKey);
+        writer.string(publish.userValue);
+    }
+    writer.bytes(publish.payload, publish.payloadLength);
+    return writer.overflow ? 0 : writer.length;
+}
+
+size_t MQTT5Codec::encodeSubscribe(uint16_t packetId, const char* filter, uint8_t qos, uint8_t* out, size_t capacity) {
+    size_t body = 2 + 1 + 2 + strlen(filter) + 1;
+    Writer writer(out, capacity);
+    if (!beginPacket(writer, SUBSCRIBE, body)) {
+        return 0;
+    }
+    writer.u16(packetId);
+    writer.byte(0); // No properties
+    writer.string(filter);
+    writer.byte(qos & 0x03);
+    return writer.overflow ? 0 : writer.length;
+}
+
+size_t MQTT5Codec::encodePuback(uint16_t packetId, uint8_t* out, size_t capacity) {
+    // Success with no properties may leave out the reason code
+    Writer writer(out, capacity);
+    if (!beginPacket(writer, PUBACK, 2)) {
+        return 0;
+    }
+    writer.u16(packetId);
+    return writer.overflow ? 0 : writer.length;
+}
+
+size_t MQTT5Codec::encodeEmpty(uint8_t type, uint8_t* out, size_t capacity) {
+    Writer writer(out, capacity);
+    if (!beginPacket(writer, type, 0)) {
+        return 0;
+    }
+    return writer.length;
+}
+
+bool MQTT5Codec::decodeConnack(const uint8_t* body, size_t length, MQTT5Connack& connack) {
+    memset(&connack, 0, sizeof(connack));
+    connack.maximumQos = 2;
+    connack.retainAvailable = true;
+    
+    Reader reader(body, length);
+    connack.sessionPresent = reader.byte() & 0x01;
+    connack.reasonCode = reader.byte();
+    if (reader.underflow) {
+        return false;
+    }
+    
+    // A 3.1.1 broker answers with just the two bytes
+    if (length == 2) {
+        connack.legacy = true;
+        return true;
+    }
+    
+    uint32_t propertiesLength = reader.varint();
+    if (reader.underflow || propertiesLength > (size_t)(reader.end - reader.in)) {
+        return false;
+    }
+    const uint8_t* end = reader.in + propertiesLength;
+    Reader properties(reader.in, propertiesLength);
+    while (properties.in < end) {
+        uint8_t id = properties.byte();
+        switch (id) {
+            case PROPERTY_TOPIC_ALIAS_MAXIMUM:
+                connack.topicAliasMaximum = properties.u16();
+                break;
+            case PROPERTY_MAXIMUM_PACKET_SIZE:
+                connack.maximumPacketSize = properties.u32();
+                break;
+            case PROPERTY_MAXIMUM_QOS:
+                connack.maximumQos = properties.byte();
+                break;
+            case PROPERTY_RETAIN_AVAILABLE:
+                connack.retainAvailable = properties.byte() != 0;
+                break;
+            case PROPERTY_SERVER_KEEP_ALIVE:
+                connack.serverKeepAlive = properties.u16();
+                break;
+            default:
+                if (!_skipProperty(id, properties.in, end)) {
+                    return false;
+                }
+                break;
+        }
+        if (properties.underflow) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MQTT5Codec::decodePublish(uint8_t firstByte, const uint8_t* body, size_t length, MQTT5Publish& publish) {
+    memset(&publish, 0, sizeof(publish));
+    publish.qos = (firstByte >> 1) & 0x03;
+    publish.retain = firstByte & 0x01;
+    
+    Reader reader(body, length);
+    publish.topic = (const char*)reader.field(publish.topicLength);
+    if (publish.qos > 0) {
+        publish.packetId = reader.u16();
+    }
+    uint32_t propertiesLength = reader.varint();
+    if (reader.underflow || publish.qos > 2 || propertiesLength > (size_t)(reader.end - reader.in)) {
+        return false;
+    }
+    
+    const uint8_t* end = reader.in + propertiesLength;
+    Reader properties(reader.in, propertiesLength);
+    while (properties.in < end) {
+        uint8_t id = properties.byte();
+        switch (id) {
+            case PROPERTY_MESSAGE_EXPIRY:
+                publish.messageExpiry = properties.u32();
+                break;
+            case PROPERTY_TOPIC_ALIAS:
+                publish.topicAlias = properties.u16();
+                break;
+            case PROPERTY_USER_PROPERTY:
+                // Only the first is kept
+                if (publish.userKey == nullptr) {
+                    publish.userKey = (const char*)properties.field(publish.userKeyLength);
+                    publish.userValue = (const char*)properties.field(publish.userValueLength);
+                } else if (!_skipProperty(id, properties.in, end)) {
+                    return false;
+                }
+                break;
+            default:
+                if (!_skipProperty(id, properties.in, end)) {
+                    return false;
+                }
+                break;
+        }
+        if (properties.underflow) {
+            return false;
+        }
+    }
+    
+    publish.payload = end;
+    publish.payloadLength = reader.end - end;
+    return true;
+}
+
+bool MQTT5Codec::_skipProperty(uint8_t id, const uint8_t*& in, const uint8_t* end) {
+    Reader reader(in, end - in);
+    size_t size;
+    switch (id) {
+        // Byte
+        case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+            reader.byte();
+            break;
+        // Two byte integer
+        case 0x13: case 0x21: case 0x22: case 0x23:
+            reader.u16();
+            break;
+        // Four byte integer
+        case 0x02: case 0x11: case 0x18: case 0x27:
+            reader.u32();
+            break;
+        // Variable byte integer (subscription identifier)
+        case 0x0B:
+            reader.varint();
+            break;
+        // UTF-8 string or binary data
+        case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F:
+            reader.field(size);
+            break;
+        // String pair
+        case PROPERTY_USER_PROPERTY:
+            reader.field(size);
+            reader.field(size);
+            break;
+        default:
+            return false;
+    }
+    if (reader.underflow) {
+        return false;
+    }
+    in = reader.in;
+    return true;
+}
@@ -0,0 +1,95 @@
+#ifndef MQTT5_CODEC_H
+#define MQTT5_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Kept free of Arduino dependencies so the host tools can build it as is
+// (see esp32/tools/mqtt5_check.cpp).
+
+struct MQTT5Connect {
+    const char* clientId;
+    const char* user;             // nullptr for none
+    const char* password;         // Only sent with a user
+    const char* willTopic;        // nullptr for no Last Will
+    const uint8_t* willPayload;
+    size_t willLength;
+    uint8_t willQos;
+    bool willRetain;
+    uint16_t keepAliveSeconds;
+    uint32_t maximumPacketSize;   // Largest packet we accept; 0 = no limit
+};
+
+struct MQTT5Connack {
+    bool legacy;                  // A 3.1.1 CONNACK: the broker does not speak MQTT 5
+    bool sessionPresent;
+    uint8_t reasonCode;           // 0 = accepted; for legacy, the 3.1.1 return code
+    uint16_t topicAliasMaximum;   // Aliases we may use; 0 = none
+    uint32_t maximumPacketSize;   // 0 = no limit
+    uint8_t maximumQos;
+    bool retainAvailable;
+    uint16_t serverKeepAlive;     // 0 = keep ours
+};
+
+// Encoding takes null-terminated strings; decoding points into the packet,
+// so its strings are not terminated and come with their lengths
+struct MQTT5Publish {
+    const char* topic;            // Empty when an established alias stands in for it
+    size_t topicLength;
+    uint16_t topicAlias;          // 0 = none
+    uint32_t messageExpiry;       // Seconds; 0 = never
+    const char* userKey;          // One user property, or nullptr
+    size_t userKeyLength;
+    const char* userValue;
+    size_t userValueLength;
+    const uint8_t* payload;
+    size_t payloadLength;
+    uint8_t qos;
+    bool retain;
+    uint16_t packetId;            // QoS 1 and 2 only
+};
+
+// The subset of MQTT 5.0 the firmware uses: QoS 0 publishing with topic
+// aliases, message expiry and a user property; QoS 0 subscriptions; keepalive.
+// All encoders return the packet size, or 0 if it does not fit in capacity.
+class MQTT5Codec {
+public:
+    // First byte of each packet type (flags included where they are fixed)
+    static const uint8_t CONNECT = 0x10;
+    static const uint8_t CONNACK = 0x20;
+    static const uint8_t PUBLISH = 0x30;
+    static const uint8_t PUBACK = 0x40;
+    static const uint8_t SUBSCRIBE = 0x82;
+    static const uint8_t SUBACK = 0x90;
+    static const uint8_t PINGREQ = 0xC0;
+    static const uint8_t PINGRESP = 0xD0;
+    static const uint8_t DISCONNECT = 0xE0;
+    
+    // CONNACK refusals meaning "not MQTT 5": a 3.1.1 broker's return code, and MQTT 5's own
+    static const uint8_t LEGACY_UNACCEPTABLE_PROTOCOL = 0x01;
+    static const uint8_t REASON_UNSUPPORTED_PROTOCOL = 0x84;
+    
+    // Splits the first packet off a stream buffer: 1 when it is complete, with
+    // the fixed header and whole packet sizes set; 0 if more bytes are needed;
+    // -1 if the length field is malformed
+    static int frame(const uint8_t* in, size_t length, size_t& headerLength, size_t& packetLength);
+    
+    static size_t encodeConnect(const MQTT5Connect& connect, uint8_t* out, size_t capacity);
+    static size_t encodePublish(const MQTT5Publish& publish, uint8_t* out, size_t capacity);
+    static size_t encodeSubscribe(uint16_t packetId, const char* filter, uint8_t qos, uint8_t* out, size_t capacity);
+    static size_t encodePuback(uint16_t packetId, uint8_t* out, size_t capacity);
+    // PINGREQ, or DISCONNECT with the normal reason
+    static size_t encodeEmpty(uint8_t type, uint8_t* out, size_t capacity);
+    
+    // Decoders take the packet body after the fixed header; false if malformed
+    static bool decodeConnack(const uint8_t* body, size_t length, MQTT5Connack& connack);
+    static bool decodePublish(uint8_t firstByte, const uint8_t* body, size_t length, MQTT5Publish& publish);
+    
+    // Size of the fixed header for a given body size
+    static size_t headerSize(size_t bodyLength);
+    
+private:
+    static bool _skipProperty(uint8_t id, const uint8_t*& in, const uint8_t* end);
+};
+
+#endif // MQTT5_CODEC_H
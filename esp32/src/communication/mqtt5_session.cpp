@@ -0,0 +1,331 @@
+#include "mqtt5_session.h"
+
+static const char SCHEMA_PROPERTY[] = "schema";
+
+MQTT5Session::MQTT5Session(Client& client)
+    : _client(client), _host(nullptr), _port(0), _callback(nullptr), _state(MQTT5_STATE_DISCONNECTED),
+      _requestedKeepAlive(15), _keepAlive(15), _lastIn(0), _lastOut(0), _pingOutstanding(false),
+      _nextPacketId(1), _aliasLimit(0), _maximumPacketSize(0), _retainAvailable(true),
+      _aliasCount(0), _aliasSavedBytes(0), _rxLength(0) {
+}
+
+void MQTT5Session::setServer(const char* host, uint16_t port) {
+    _host = host;
+    _port = port;
+}
+
+MQTT5Session::Result MQTT5Session::connect(const char* clientId, const char* user, const char* password,
+                                           const char* willTopic, uint8_t willQos, bool willRetain,
+                                           const char* willMessage) {
+    if (connected()) {
+        _close(MQTT5_STATE_DISCONNECTED);
+    }
+    _rxLength = 0;
+    _aliasCount = 0;
+    _pingOutstanding = false;
+    
+    if (!_client.connect(_host, _port)) {
+        _state = MQTT5_STATE_CONNECT_FAILED;
+        return Result::FAILED;
+    }
+    
+    MQTT5Connect request;
+    request.clientId = clientId;
+    request.user = user;
+    request.password = password;
+    request.willTopic = willTopic;
+    request.willPayload = (const uint8_t*)willMessage;
+    request.willLength = willMessage ? strlen(willMessage) : 0;
+    request.willQos = willQos;
+    request.willRetain = willRetain;
+    request.keepAliveSeconds = _requestedKeepAlive;
+    request.maximumPacketSize = sizeof(_rx); // Larger packets are dropped by the broker, not sent
+    
+    size_t length = MQTT5Codec::encodeConnect(request, _tx, sizeof(_tx));
+    if (length == 0 || _client.write(_tx, length) != length) {
+        _close(MQTT5_STATE_CONNECT_FAILED);
+        return Result::FAILED;
+    }
+    
+    // Wait for the CONNACK, which is always the first packet back
+    unsigned long start = millis();
+    size_t headerLength = 0;
+    size_t packetLength = 0;
+    int framed = 0;
+    while ((framed = MQTT5Codec::frame(_rx, _rxLength, headerLength, packetLength)) == 0) {
+        if (!_client.connected() && _client.available() == 0) {
+            // Older brokers may hang up on a protocol level they don't know, but
+            // so does a broker restarting; the caller decides after a few
+            Serial.print(" closed without CONNACK,");
+            _close(MQTT5_STATE_CONNECTION_LOST);
+            return Result::CLOSED;
+        }
+        if (millis() - start >= MQTT_TIMEOUT_MS) {
+            _close(MQTT5_STATE_CONNECTION_TIMEOUT);
+            return Result::FAILED;
+        }
+        if (!_receive()) {
+            delay(1);
+        }
+    }
+    
+    MQTT5Connack connack;
+    if (framed < 0 || _rx[0] != MQTT5Codec::CONNACK ||
+        !MQTT5Codec::decodeConnack(_rx + headerLength, packetLength - headerLength, connack)) {
+        _close(MQTT5_STATE_CONNECT_FAILED);
+        return Result::FAILED;
+    }
+    _consume(packetLength);
+    
+    if (connack.legacy || connack.reasonCode == MQTT5Codec::REASON_UNSUPPORTED_PROTOCOL) {
+        _close(connack.reasonCode);
+        return Result::UNSUPPORTED;
+    }
+    if (connack.reasonCode != 0) {
+        _close(connack.reasonCode);
+        return Result::REFUSED;
+    }
+    
+    _aliasLimit = connack.topicAliasMaximum < MQTT5_TOPIC_ALIASES ? connack.topicAliasMaximum : MQTT5_TOPIC_ALIASES;
+    _maximumPacketSize = connack.maximumPacketSize;
+    _retainAvailable = connack.retainAvailable;
+    _keepAlive = connack.serverKeepAlive > 0 ? connack.serverKeepAlive : _requestedKeepAlive;
+    _lastIn = _lastOut = millis();
+    _state = MQTT5_STATE_CONNECTED;
+    
+    // Anything that arrived right behind the CONNACK
+    _dispatch();
+    return Result::CONNECTED;
+}
+
+void MQTT5Session::disconnect() {
+    if (connected()) {
+        size_t length = MQTT5Codec::encodeEmpty(MQTT5Codec::DISCONNECT, _tx, sizeof(_tx));
+        _client.write(_tx, length);
+    }
+    _close(MQTT5_STATE_DISCONNECTED);
+}
+
+bool MQTT5Session::connected() {
+    if (_state != MQTT5_STATE_CONNECTED) {
+        return false;
+    }
+    if (!_client.connected()) {
+        _close(MQTT5_STATE_CONNECTION_LOST);
+        return false;
+    }
+    return true;
+}
+
+bool MQTT5Session::loop() {
+    if (!connected()) {
+        return false;
+    }
+    
+    // Ping when either direction has been idle for the keepalive; no answer
+    // by the next one means the connection is gone
+    unsigned long now = millis();
+    unsigned long keepAliveMs = _keepAlive * 1000UL;
+    if (keepAliveMs > 0 && (now - _lastIn > keepAliveMs || now - _lastOut > keepAliveMs)) {
+        if (_pingOutstanding) {
+            _close(MQTT5_STATE_CONNECTION_TIMEOUT);
+            return false;
+        }
+        if (!_write(MQTT5Codec::encodeEmpty(MQTT5Codec::PINGREQ, _tx, sizeof(_tx)))) {
+            return false;
+        }
+        _pingOutstanding = true;
+        _lastIn = now;
+    }
+    
+    while (_receive()) {
+        _dispatch();
+        if (!connected()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MQTT5Session::subscribe(const char* filter) {
+    if (!connected()) {
+        return false;
+    }
+    uint16_t packetId = _nextPacketId++;
+    if (_nextPacketId == 0) {
+        _nextPacketId = 1;
+    }
+    return _write(MQTT5Codec::encodeSubscribe(packetId, filter, 0, _tx, sizeof(_tx)));
+}
+
+bool MQTT5Session::publish(const char* topic, const uint8_t* payload, size_t length, bool retained,
+                           bool useAlias, uint32_t expirySeconds, const char* schema) {
+    if (!connected()) {
+        return false;
+    }
+    
+    MQTT5Publish message;
+    memset(&message, 0, sizeof(message));
+    message.topic = topic;
+    message.payload = payload;
+    message.payloadLength = length;
+    message.retain = retained && _retainAvailable;
+    message.messageExpiry = expirySeconds;
+    if (schema != nullptr) {
+        message.userKey = SCHEMA_PROPERTY;
+        message.userValue = schema;
+    }
+    
+    // An established alias replaces the topic; a new one is sent along with it
+    size_t topicLength = strlen(topic);
+    bool newAlias = false;
+    if (useAlias && topicLength < MQTT5_ALIAS_TOPIC_MAX) {
+        message.topicAlias = _findAlias(topic);
+        if (message.topicAlias > 0) {
+            message.topic = "";
+        } else if (_aliasCount < _aliasLimit) {
+            message.topicAlias = _aliasCount + 1;
+            newAlias = true;
+        }
+    }
+    
+    size_t packetLength = MQTT5Codec::encodePublish(message, _tx, sizeof(_tx));
+    if (packetLength == 0 || (_maximumPacketSize > 0 && packetLength > _maximumPacketSize)) {
+        return false;
+    }
+    if (!_write(packetLength)) {
+        return false;
+    }
+    
+    // Only counted once the broker has the mapping
+    if (newAlias) {
+        strlcpy(_aliases[_aliasCount++], topic, MQTT5_ALIAS_TOPIC_MAX);
+    } else if (message.topicAlias > 0) {
+        _aliasSavedBytes += topicLength;
+    }
+    return true;
+}
+
+bool MQTT5Session::_receive() {
+    int available = _client.available();
+    if (available <= 0) {
+        return false;
+    }
+    
+    // A packet larger than the buffer can't arrive: the broker knows our maximum
+    size_t space = sizeof(_rx) - _rxLength;
+    if (space == 0) {
+        Serial.println("MQTT5: receive buffer overrun");
+        _close(MQTT5_STATE_CONNECTION_LOST);
+        return false;
+    }
+    int received = _client.read(_rx + _rxLength, (size_t)available < space ? available : space);
+    if (received <= 0) {
+        return false;
+    }
+    _rxLength += received;
+    _lastIn = millis();
+    return true;
+}
+
+void MQTT5Session::_dispatch() {
+    size_t headerLength;
+    size_t packetLength;
+    int framed;
+    while (_state == MQTT5_STATE_CONNECTED &&
+           (framed = MQTT5Codec::frame(_rx, _rxLength, headerLength, packetLength)) != 0) {
+        if (framed < 0) {
+            _close(MQTT5_STATE_CONNECTION_LOST);
+            return;
+        }
+        _handlePacket(_rx, headerLength, packetLength);
+        _consume(packetLength);
+    }
+}
+
+void MQTT5Session::_handlePacket(uint8_t* packet, size_t headerLength, size_t packetLength) {
+    uint8_t* body = packet + headerLength;
+    size_t bodyLength = packetLength - headerLength;
+    
+    switch (packet[0] & 0xF0) {
+        case MQTT5Codec::PUBLISH: {
+            MQTT5Publish message;
+            // We allow no incoming aliases, so every message names its topic
+            if (!MQTT5Codec::decodePublish(packet[0], body, bodyLength, message) || message.topicLength == 0) {
+                Serial.println("MQTT5: malformed PUBLISH ignored");
+                return;
+            }
+            if (message.qos == 1) {
+                size_t length = MQTT5Codec::encodePuback(message.packetId, _tx, sizeof(_tx));
+                if (!_write(length)) {
+                    return;
+                }
+            }
+            
+            // Shift the topic over its length prefix to terminate it in place
+            char* topic = (char*)body + 1;
+            memmove(topic, message.topic, message.topicLength);
+            topic[message.topicLength] = '\0';
+            if (_callback) {
+                _callback(topic, (uint8_t*)message.payload, message.payloadLength);
+            }
+            break;
+        }
+        
+        case MQTT5Codec::PINGRESP:
+            _pingOutstanding = false;
+            break;
+        
+        case MQTT5Codec::SUBACK:
+            // Packet id, properties, then one reason code per filter
+            if (bodyLength >= 4 && body[bodyLength - 1] >= 0x80) {
+                Serial.printf("MQTT5: subscription refused, reason 0x%02X\n", body[bodyLength - 1]);
+            }
+            break;
+        
+        case MQTT5Codec::DISCONNECT:
+            Serial.printf("MQTT5: broker disconnected, reason 0x%02X\n", bodyLength > 0 ? body[0] : 0);
+            _close(MQTT5_STATE_CONNECTION_LOST);
+            break;
+        
+        default:
+            break;
+    }
+}
+
+void MQTT5Session::_consume(size_t length) {
+    if (length >= _rxLength) {
+        _rxLength = 0;
+        return;
+    }
+    memmove(_rx, _rx + length, _rxLength - length);
+    _rxLength -= length;
+}
+
+uint16_t MQTT5Session::_findAlias(const char* topic) const {
+    for (uint8_t i = 0; i < _aliasCount; i++) {
+        if (strcmp(_aliases[i], topic) == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+bool MQTT5Session::_write(size_t length) {
+    if (length == 0) {
+        return false;
+    }
+    if (_client.write(_tx, length) != length) {
+        _close(MQTT5_STATE_CONNECTION_LOST);
+        return false;
+    }
+    _lastOut = millis();
+    return true;
+}
+
+void MQTT5Session::_close(int state) {
+    _client.stop();
+    _state = state;
+    _rxLength = 0;
+    _aliasCount = 0;
+}
@@ -0,0 +1,104 @@
+#ifndef MQTT5_SESSION_H
+#define MQTT5_SESSION_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <PubSubClient.h> // MQTT_MAX_PACKET_SIZE, shared by both protocol paths
+#include "mqtt5_codec.h"
+#include "../config/config.h"
+
+// Longest topic that can be given an alias; longer ones are always sent in full
+#define MQTT5_ALIAS_TOPIC_MAX 96
+
+// state() values; positive values are the broker's CONNACK reason code
+#define MQTT5_STATE_CONNECTION_TIMEOUT -4
+#define MQTT5_STATE_CONNECTION_LOST -3
+#define MQTT5_STATE_CONNECT_FAILED -2
+#define MQTT5_STATE_DISCONNECTED -1
+#define MQTT5_STATE_CONNECTED 0
+
+// MQTT 5 client session over an existing Client, with the same shape as the
+// PubSubClient calls MQTTClient makes so either can carry a connection.
+// Publishing is QoS 0 only. Topics published with useAlias are given one of
+// up to MQTT5_TOPIC_ALIASES aliases (or fewer if the broker allows fewer) on
+// first use, and are sent as the two-byte alias from then on. Aliases only
+// live as long as the connection.
+class MQTT5Session {
+public:
+    typedef void (*Callback)(char* topic, uint8_t* payload, unsigned int length);
+    
+    enum class Result : uint8_t {
+        CONNECTED,
+        UNSUPPORTED, // The broker refused MQTT 5 (3.1.1 CONNACK or reason 0x84); try 3.1.1
+        CLOSED,      // Hung up before any CONNACK: an old broker, or just a broker restart or blip
+        REFUSED,     // Refused for another reason (see state())
+        FAILED       // No TCP connection, or no CONNACK in time
+    };
+    
+    MQTT5Session(Client& client);
+    
+    void setServer(const char* host, uint16_t port);
+    void setCallback(Callback callback) { _callback = callback; }
+    void setKeepAlive(uint16_t seconds) { _requestedKeepAlive = seconds; }
+    
+    // Blocks until the CONNACK arrives or MQTT_TIMEOUT_MS passes
+    Result connect(const char* clientId, const char* user, const char* password,
+                   const char* willTopic, uint8_t willQos, bool willRetain, const char* willMessage);
+    void disconnect();
+    bool connected();
+    
+    // Reads and dispatches incoming packets and keeps the connection alive
+    bool loop();
+    
+    bool subscribe(const char* filter);
+    
+    // expirySeconds 0 never expires; schema, if given, is sent as the
+    // "schema" user property
+    bool publish(const char* topic, const uint8_t* payload, size_t length, bool retained,
+                 bool useAlias, uint32_t expirySeconds, const char* schema);
+    
+    int state() const { return _state; }
+    
+    uint8_t getAliasCount() const { return _aliasCount; }
+    uint16_t getAliasLimit() const { return _aliasLimit; }
+    // Topic bytes not sent thanks to aliases, since boot
+    uint32_t getAliasSavedBytes() const { return _aliasSavedBytes; }
+    
+private:
+    Client& _client;
+    const char* _host;
+    uint16_t _port;
+    Callback _callback;
+    int _state;
+    
+    uint16_t _requestedKeepAlive;
+    uint16_t _keepAlive; // The broker may override ours
+    unsigned long _lastIn;
+    unsigned long _lastOut;
+    bool _pingOutstanding;
+    uint16_t _nextPacketId;
+    
+    // Limits from the CONNACK
+    uint16_t _aliasLimit;
+    uint32_t _maximumPacketSize;
+    bool _retainAvailable;
+    
+    // Alias n stands for _aliases[n - 1]
+    char _aliases[MQTT5_TOPIC_ALIASES][MQTT5_ALIAS_TOPIC_MAX];
+    uint8_t _aliasCount;
+    uint32_t _aliasSavedBytes;
+    
+    uint8_t _rx[MQTT_MAX_PACKET_SIZE];
+    size_t _rxLength;
+    uint8_t _tx[MQTT_MAX_PACKET_SIZE];
+    
+    bool _receive();
+    void _dispatch();
+    void _handlePacket(uint8_t* packet, size_t headerLength, size_t packetLength);
+    void _consume(size_t length);
+    uint16_t _findAlias(const char* topic) const;
+    bool _write(size_t length);
+    void _close(int state);
+};
+
+#endif // MQTT5_SESSION_H
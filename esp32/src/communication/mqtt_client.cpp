@@ -1,25 +1,62 @@
 #include "mqtt_client.h"
 #include <WiFi.h>
+#include "../utils/trace_buffer.h"
+
+// Retained on the presence topic by the broker if we drop off without a clean disconnect
+static const char PRESENCE_OFFLINE[] = "{\"status\":\"offline\"}";
+
+// Names for the queue status report, indexed by PublishClass
+static const char* const PUBLISH_CLASS_NAMES[] = { "control", "status", "telemetry", "bulk" };
+
+// Schema ids for the MQTT 5 "schema" user property, indexed by PayloadSchema;
+// kept short as they go with every message
+static const char* const SCHEMA_IDS[] = {
+    nullptr, "sensor/1", "batch/2", "status/2", "delta/1", "ack/1", "config/1", "streams/1", "presence/1", "trace/1",
+    "history/1", "trigger/1", "probe/1"
+};
+
+static_assert(sizeof(SCHEMA_IDS) / sizeof(SCHEMA_IDS[0]) == (size_t)PayloadSchema::COUNT,
+              "SCHEMA_IDS must match PayloadSchema");
 
 // Static member initialisation
 MQTTClient* MQTTClient::_instance = nullptr;
 
-MQTTClient::MQTTClient() : _mqttClient(_wifiClient), _lastConnectionAttempt(0) {
+MQTTClient::MQTTClient()
+    : _mqttClient(_wifiClient), _session(_wifiClient), _useMQTT5(MQTT_PROTOCOL >= 5), _closedBeforeConnack(0), _lastConnectionAttempt(0), _connectionCount(0), _statusLosses(0), _configGeneration(0), _port(0),
+      _queues{
+          PublishQueue(_controlStorage, sizeof(_controlStorage), DropPolicy::DROP_NEWEST,
+                       MQTT_RATE_CONTROL_BPS, MQTT_MAX_PACKET_SIZE),
+          PublishQueue(_statusStorage, sizeof(_statusStorage), DropPolicy::DROP_NEWEST,
+                       MQTT_RATE_STATUS_BPS, MQTT_MAX_PACKET_SIZE),
+          PublishQueue(_telemetryStorage, sizeof(_telemetryStorage), DropPolicy::DROP_OLDEST,
+                       MQTT_RATE_TELEMETRY_BPS, MQTT_MAX_PACKET_SIZE),
+          PublishQueue(_bulkStorage, sizeof(_bulkStorage), DropPolicy::DROP_NEWEST,
+                       MQTT_RATE_BULK_BPS, MQTT_MAX_PACKET_SIZE)
+      } {
     _instance = this;
-    _clientId = _generateClientId();
+    _clientId[0] = '\0';
+    _server[0] = '\0';
 }
 
 bool MQTTClient::begin() {
-    _mqttClient.setServer(MQTT_SERVER, MQTT_PORT);
+    _generateClientId();
+    
+    // PubSubClient keeps the pointer, so it gets a copy that config changes can't touch
+    strlcpy(_server, RuntimeConfig::getString(ConfigParam::BROKER_HOST), sizeof(_server));
+    _port = RuntimeConfig::getUInt(ConfigParam::BROKER_PORT);
+    _mqttClient.setServer(_server, _port);
     _mqttClient.setCallback(_staticCallback);
     _mqttClient.setKeepAlive(15);
+    _session.setServer(_server, _port);
+    _session.setCallback(_staticCallback);
+    _session.setKeepAlive(15);
     return true;
 }
 
 bool MQTTClient::connect() {
     if (!_isValidConfig()) {
         Serial.println("ERROR: MQTT server not configured!");
-        Serial.println("Please update MQTT_SERVER in config.h");
+        Serial.println("Please update MQTT_SERVER in config.h or set mqtt.server");
         return false;
     }
     
@@ -27,42 +64,62 @@ bool MQTTClient::connect() {
         return true;
     }
     
-    // Avoid rapid reconnection attempts
+    // Avoid rapid reconnection attempts (but allow first attempt)
     unsigned long now = millis();
-    if (now - _lastConnectionAttempt < MQTT_TIMEOUT_MS) {
+    if (_lastConnectionAttempt != 0 && now - _lastConnectionAttempt < MQTT_TIMEOUT_MS) {
         return false;
     }
     _lastConnectionAttempt = now;
     
     Serial.print("Attempting MQTT connection...");
+    TRACE_BEGIN(TraceEvent::MQTT_CONNECT, 0);
     
-    bool connected;
-    if (strlen(MQTT_USER) > 0) {
-        connected = _mqttClient.connect(_clientId.c_str(), MQTT_USER, MQTT_PASSWORD);
-    } else {
-        connected = _mqttClient.connect(_clientId.c_str());
+    // Register the Last Will so presence flips to offline when the session is lost
+    const char* user = strlen(MQTT_USER) > 0 ? MQTT_USER : nullptr;
+    const char* password = strlen(MQTT_USER) > 0 ? MQTT_PASSWORD : nullptr;
+    bool connected = false;
+    if (_useMQTT5) {
+        MQTT5Session::Result result = _session.connect(_clientId, user, password,
+                                                       MQTT_TOPIC_PRESENCE, 1, true, PRESENCE_OFFLINE);
+        // A hang-up alone may be a WiFi blip or a broker restart, so only a run
+        // of them counts as a broker without MQTT 5, like an outright refusal
+        _closedBeforeConnack = result == MQTT5Session::Result::CLOSED ? _closedBeforeConnack + 1 : 0;
+        if (result == MQTT5Session::Result::UNSUPPORTED || _closedBeforeConnack >= MQTT5_FALLBACK_CLOSES) {
+            // The broker only changes on restart, so this is not retried
+            Serial.print(" no MQTT 5, falling back to 3.1.1...");
+            _useMQTT5 = false;
+        } else {
+            connected = result == MQTT5Session::Result::CONNECTED;
+        }
+    }
+    if (!_useMQTT5) {
+        connected = _mqttClient.connect(_clientId, user, password,
+                                        MQTT_TOPIC_PRESENCE, 1, true, PRESENCE_OFFLINE);
     }
+    TRACE_END(TraceEvent::MQTT_CONNECT, connected);
     
     if (connected) {
-        Serial.println(" connected!");
+        Serial.printf(" connected (MQTT %s)!\n", _useMQTT5 ? "5" : "3.1.1");
         Serial.print("Client ID: ");
         Serial.println(_clientId);
         
+        // Small control messages (acks, sync exchanges) shouldn't wait on Nagle
+        _wifiClient.setNoDelay(true);
+        
         // Subscribe to command topic by default
         subscribeToCommands();
         
-        // Publish connection status
-        DynamicJsonDocument statusDoc(256);
-        statusDoc["status"] = "connected";
-        statusDoc["client_id"] = _clientId;
-        statusDoc["firmware_version"] = FIRMWARE_VERSION;
-        statusDoc["timestamp"] = millis();
-        publishStatus(statusDoc);
+        // Anything queued for status predates the snapshot that follows a reconnect
+        _queues[(size_t)PublishClass::STATUS].clear();
+        
+        // Announce presence; the full status snapshot is sent by the status reporter
+        _publishPresence(true);
+        _connectionCount++;
         
         return true;
     } else {
         Serial.print(" failed, rc=");
-        Serial.print(_mqttClient.state());
+        Serial.print(_state());
         Serial.println(" will retry later");
         return false;
     }
@@ -70,117 +127,307 @@ bool MQTTClient::connect() {
 
 void MQTTClient::disconnect() {
     if (isConnected()) {
-        // Publish disconnection status
-        DynamicJsonDocument statusDoc(256);
-        statusDoc["status"] = "disconnecting";
-        statusDoc["client_id"] = _clientId;
-        statusDoc["timestamp"] = millis();
-        publishStatus(statusDoc);
+        // A clean disconnect discards the Last Will, so publish offline ourselves
+        _publishPresence(false);
         
-        _mqttClient.disconnect();
+        if (_useMQTT5) {
+            _session.disconnect();
+        } else {
+            _mqttClient.disconnect();
+        }
         Serial.println("MQTT disconnected");
     }
 }
 
 bool MQTTClient::isConnected() {
-    return _mqttClient.connected();
+    return _useMQTT5 ? _session.connected() : _mqttClient.connected();
 }
 
 void MQTTClient::loop() {
-    _mqttClient.loop();
+    TRACE_BEGIN(TraceEvent::MQTT_LOOP, 0);
+    bool connected;
+    if (_useMQTT5) {
+        connected = _session.loop();
+    } else {
+        connected = _mqttClient.loop();
+    }
+    _applyConfig();
+    _drainQueues();
+    TRACE_END(TraceEvent::MQTT_LOOP, connected);
 }
 
-bool MQTTClient::publish(const String& topic, const String& payload, bool retained) {
+bool MQTTClient::publish(const char* topic, const char* payload, bool retained, PublishClass publishClass,
+                         PayloadSchema schema) {
+    return publish(topic, (const uint8_t*)payload, strlen(payload), retained, publishClass, schema);
+}
+
+bool MQTTClient::publish(const char* topic, const uint8_t* payload, size_t length, bool retained,
+                         PublishClass publishClass, PayloadSchema schema) {
     if (!isConnected()) {
-        Serial.println("MQTT publish failed: Not connected - " + topic);
+        Serial.printf("MQTT publish failed: Not connected - %s\n", topic);
         return false;
     }
     
-    // Debug payload size
-    Serial.printf("MQTT publishing to %s (size: %d bytes)\n", topic.c_str(), payload.length());
+    if (length > getPayloadLimit(topic)) {
+        Serial.printf("MQTT payload too large for %s: %u bytes (limit: %u)\n", topic, (unsigned)length,
+                      (unsigned)getPayloadLimit(topic));
+        return false;
+    }
     
-    bool result = _mqttClient.publish(topic.c_str(), payload.c_str(), retained);
-    if (result) {
-        Serial.println("MQTT published: " + topic + " -> " + payload);
-    } else {
-        Serial.println("MQTT publish failed: " + topic);
-        Serial.printf("  Payload size: %d bytes\n", payload.length());
-        Serial.printf("  MQTT state: %d\n", _mqttClient.state());
+    if (!_queues[(size_t)publishClass].push(topic, payload, length, retained, schema)) {
+        Serial.printf("MQTT %s queue full, dropped: %s\n", PUBLISH_CLASS_NAMES[(size_t)publishClass], topic);
+        return false;
     }
-    return result;
+    
+    // Send what the rate limits allow straight away rather than waiting for loop()
+    _drainQueues();
+    return true;
 }
 
-bool MQTTClient::publishSensorData(const String& sensorType, const DynamicJsonDocument& data) {
-    String topic = String(MQTT_TOPIC_SENSORS) + "/" + sensorType;
-    
-    String payload;
-    serializeJson(data, payload);
-    
-    return publish(topic, payload);
+PublishQueue::Stats MQTTClient::getQueueStats(PublishClass publishClass) const {
+    return _queues[(size_t)publishClass].getStats();
+}
+
+void MQTTClient::writeQueueStatus(JsonObject queues) const {
+    for (size_t i = 0; i < (size_t)PublishClass::COUNT; i++) {
+        _queues[i].writeStatus(queues.createNestedObject(PUBLISH_CLASS_NAMES[i]));
+    }
+}
+
+void MQTTClient::writeProtocolStatus(JsonObject mqtt) const {
+    mqtt["protocol"] = _useMQTT5 ? "5" : "3.1.1";
+    if (_useMQTT5) {
+        JsonObject aliases = mqtt.createNestedObject("aliases");
+        aliases["used"] = _session.getAliasCount();
+        aliases["limit"] = _session.getAliasLimit();
+        aliases["saved_bytes"] = _session.getAliasSavedBytes();
+    }
+}
+
+bool MQTTClient::publishSensorData(const char* sensorType, const char* sensorName, const JsonDocument& data) {
+    snprintf(_topicBuffer, sizeof(_topicBuffer), "%s/%s/%s", MQTT_TOPIC_SENSORS, sensorType, sensorName);
+    return _publishJson(_topicBuffer, data, false, PublishClass::TELEMETRY, PayloadSchema::SENSOR);
 }
 
-bool MQTTClient::publishStatus(const DynamicJsonDocument& status) {
-    String topic = MQTT_TOPIC_STATUS;
+bool MQTTClient::publishSensorData(const char* sensorType, const char* sensorName, const char* json, size_t length) {
+    snprintf(_topicBuffer, sizeof(_topicBuffer), "%s/%s/%s", MQTT_TOPIC_SENSORS, sensorType, sensorName);
+    return publish(_topicBuffer, (const uint8_t*)json, length, false, PublishClass::TELEMETRY, PayloadSchema::SENSOR);
+}
+
+bool MQTTClient::publishSensorBatch(const char* sensorType, const char* sensorName, const uint8_t* payload, size_t length) {
+    snprintf(_topicBuffer, sizeof(_topicBuffer), "%s/%s/%s/batch", MQTT_TOPIC_SENSORS, sensorType, sensorName);
+    return publish(_topicBuffer, payload, length, false, PublishClass::TELEMETRY, PayloadSchema::BATCH);
+}
+
+bool MQTTClient::publishStatus(const JsonDocument& status) {
+    return _publishJson(MQTT_TOPIC_STATUS, status, true, PublishClass::STATUS, PayloadSchema::STATUS);
+}
+
+bool MQTTClient::publishStatusSection(const char* name, JsonObjectConst section, uint32_t sequence) {
+    snprintf(_topicBuffer, sizeof(_topicBuffer), "%s/%s", MQTT_TOPIC_STATUS_SECTION, name);
     
-    String payload;
-    serializeJson(status, payload);
+    // Wrapped by hand, so the section needn't be copied into a document of its own
+    int prefix = snprintf(_payloadBuffer, sizeof(_payloadBuffer), "{\"seq\":%u,\"%s\":", (unsigned)sequence, name);
+    size_t capacity = sizeof(_payloadBuffer) - prefix - 1; // Room for the closing brace
+    size_t length = serializeJson(section, _payloadBuffer + prefix, capacity);
+    if (length >= capacity - 1) {
+        Serial.printf("MQTT payload too large for %s (limit: %u bytes)\n", _topicBuffer, (unsigned)sizeof(_payloadBuffer));
+        return false;
+    }
+    _payloadBuffer[prefix + length] = '}';
     
-    return publish(topic, payload, true);
+    return publish(_topicBuffer, (const uint8_t*)_payloadBuffer, prefix + length + 1, true,
+                   PublishClass::STATUS, PayloadSchema::STATUS);
 }
 
-bool MQTTClient::subscribe(const String& topic) {
+bool MQTTClient::publishStatusDelta(const JsonDocument& delta) {
+    return _publishJson(MQTT_TOPIC_STATUS_DELTA, delta, false, PublishClass::STATUS, PayloadSchema::DELTA);
+}
+
+bool MQTTClient::publishCommandAck(const JsonDocument& ack) {
+    return _publishJson(MQTT_TOPIC_COMMAND_ACK, ack, false, PublishClass::CONTROL, PayloadSchema::ACK);
+}
+
+bool MQTTClient::publishConfig(const JsonDocument& config) {
+    return _publishJson(MQTT_TOPIC_CONFIG, config, true, PublishClass::STATUS, PayloadSchema::CONFIG);
+}
+
+bool MQTTClient::publishStreams(const JsonDocument& streams) {
+    return _publishJson(MQTT_TOPIC_STREAMS, streams, true, PublishClass::STATUS, PayloadSchema::STREAMS);
+}
+
+bool MQTTClient::publishTrace(const uint8_t* chunk, size_t length) {
+    return publish(MQTT_TOPIC_TRACE, chunk, length, false, PublishClass::BULK, PayloadSchema::TRACE);
+}
+
+bool MQTTClient::publishHistory(const uint8_t* chunk, size_t length) {
+    return publish(MQTT_TOPIC_HISTORY, chunk, length, false, PublishClass::BULK, PayloadSchema::HISTORY);
+}
+
+bool MQTTClient::publishTriggerEvent(const JsonDocument& event) {
+    return _publishJson(MQTT_TOPIC_TRIGGER, event, false, PublishClass::STATUS, PayloadSchema::TRIGGER);
+}
+
+bool MQTTClient::publishBurst(const uint8_t* chunk, size_t length) {
+    return publish(MQTT_TOPIC_BURST, chunk, length, false, PublishClass::BULK, PayloadSchema::HISTORY);
+}
+
+bool MQTTClient::subscribe(const char* topic) {
     if (!isConnected()) {
         return false;
     }
     
-    bool result = _mqttClient.subscribe(topic.c_str());
+    bool result = _useMQTT5 ? _session.subscribe(topic) : _mqttClient.subscribe(topic);
     if (result) {
-        Serial.println("MQTT subscribed to: " + topic);
+        Serial.printf("MQTT subscribed to: %s\n", topic);
     } else {
-        Serial.println("MQTT subscribe failed: " + topic);
+        Serial.printf("MQTT subscribe failed: %s\n", topic);
     }
     return result;
 }
 
 bool MQTTClient::subscribeToCommands() {
-    String topic = String(MQTT_TOPIC_COMMANDS) + "/#";
-    return subscribe(topic);
+    return subscribe(MQTT_TOPIC_COMMANDS "/#");
 }
 
 void MQTTClient::setCallback(MQTTCallback callback) {
     _userCallback = callback;
 }
 
-String MQTTClient::getClientId() {
-    return _clientId;
-}
-
 void MQTTClient::_staticCallback(char* topic, byte* payload, unsigned int length) {
+    // Either client hands us its own buffer; pass it through without copying
     if (_instance) {
-        String topicStr = String(topic);
-        String payloadStr = "";
-        for (unsigned int i = 0; i < length; i++) {
-            payloadStr += (char)payload[i];
-        }
-        _instance->_handleCallback(topicStr, payloadStr);
+        _instance->_handleCallback(topic, payload, length);
     }
 }
 
-void MQTTClient::_handleCallback(const String& topic, const String& payload) {
-    Serial.println("MQTT received: " + topic + " -> " + payload);
+void MQTTClient::_handleCallback(const char* topic, const uint8_t* payload, unsigned int length) {
+#if MQTT_DEBUG_LOGGING
+    // MessagePack is binary; only its size is logged
+    size_t topicLength = strlen(topic);
+    if (topicLength >= 8 && strcmp(topic + topicLength - 8, "/msgpack") == 0) {
+        Serial.printf("MQTT received: %s (%u bytes)\n", topic, length);
+    } else {
+        Serial.printf("MQTT received: %s -> %.*s\n", topic, (int)length, (const char*)payload);
+    }
+#endif
     
     if (_userCallback) {
-        _userCallback(topic, payload);
+        _userCallback(topic, payload, length);
     }
 }
 
+bool MQTTClient::_publishJson(const char* topic, const JsonDocument& doc, bool retained, PublishClass publishClass,
+                              PayloadSchema schema) {
+    size_t length = serializeJson(doc, _payloadBuffer, sizeof(_payloadBuffer));
+    if (length >= sizeof(_payloadBuffer) - 1) {
+        Serial.printf("MQTT payload too large for %s (limit: %u bytes)\n", topic, (unsigned)sizeof(_payloadBuffer));
+        return false;
+    }
+    
+    return publish(topic, (const uint8_t*)_payloadBuffer, length, retained, publishClass, schema);
+}
+
+void MQTTClient::_applyConfig() {
+    uint32_t generation = RuntimeConfig::getGeneration();
+    if (generation == _configGeneration) {
+        return;
+    }
+    _configGeneration = generation;
+    _queues[(size_t)PublishClass::TELEMETRY].setRate(RuntimeConfig::getUInt(ConfigParam::TELEMETRY_RATE));
+}
+
+void MQTTClient::_drainQueues() {
+    // Strict priority between classes; a class held back by its rate limit
+    // does not block the classes below it
+    for (size_t i = 0; i < (size_t)PublishClass::COUNT; i++) {
+        PublishQueue& queue = _queues[i];
+        PublishQueue::Message message;
+        while (queue.front(message)) {
+            if (!isConnected()) {
+                return; // Keep the backlog for the next connection
+            }
+            if (!queue.acquire(message.length)) {
+                break;
+            }
+            
+            if (_send(message.topic, message.payload, message.length, message.retained,
+                      (PublishClass)i, message.schema)) {
+                queue.popSent();
+            } else if (isConnected()) {
+                queue.popFailed(); // Rejected outright (e.g. too large); retrying won't help
+                if (message.schema == PayloadSchema::STATUS || message.schema == PayloadSchema::DELTA) {
+                    _statusLosses++;
+                }
+            } else {
+                return;
+            }
+        }
+    }
+}
+
+bool MQTTClient::_send(const char* topic, const uint8_t* payload, size_t length, bool retained,
+                       PublishClass publishClass, PayloadSchema schema) {
+#if MQTT_DEBUG_LOGGING
+    // Payload echo is debug-only: Serial.printf allocates for long lines
+    Serial.printf("MQTT publishing to %s (size: %u bytes)\n", topic, (unsigned)length);
+#endif
+    
+    TRACE_BEGIN(TraceEvent::MQTT_PUBLISH, length < 0xFFFF ? length : 0xFFFF);
+    bool result;
+    if (_useMQTT5) {
+        // Telemetry repeats a few topics at a high rate: those go by alias, and
+        // a sample nobody has received within the expiry is not worth delivering
+        bool telemetry = publishClass == PublishClass::TELEMETRY;
+        result = _session.publish(topic, payload, length, retained, telemetry,
+                                  telemetry ? MQTT5_TELEMETRY_EXPIRY_S : 0, SCHEMA_IDS[(size_t)schema]);
+    } else {
+        result = _mqttClient.publish(topic, payload, length, retained);
+    }
+    TRACE_END(TraceEvent::MQTT_PUBLISH, result);
+    if (result) {
+#if MQTT_DEBUG_LOGGING
+        Serial.printf("MQTT published: %s -> %.*s\n", topic, (int)length, (const char*)payload);
+#endif
+    } else {
+        Serial.printf("MQTT publish failed: %s\n", topic);
+        Serial.printf("  Payload size: %u bytes\n", (unsigned)length);
+        Serial.printf("  MQTT state: %d\n", _state());
+    }
+    return result;
+}
+
+bool MQTTClient::_publishPresence(bool online) {
+    // Presence bypasses the queues: it must go out before anything queued
+    // after a connect, and before a clean disconnect
+    if (!online) {
+        return _send(MQTT_TOPIC_PRESENCE, (const uint8_t*)PRESENCE_OFFLINE, strlen(PRESENCE_OFFLINE), true,
+                     PublishClass::CONTROL, PayloadSchema::PRESENCE);
+    }
+    
+    StaticJsonDocument<256> presenceDoc;
+    presenceDoc["status"] = "online";
+    presenceDoc["client_id"] = (const char*)_clientId;
+    presenceDoc["firmware_version"] = FIRMWARE_VERSION;
+    presenceDoc["timestamp"] = millis();
+    size_t length = serializeJson(presenceDoc, _payloadBuffer, sizeof(_payloadBuffer));
+    return _send(MQTT_TOPIC_PRESENCE, (const uint8_t*)_payloadBuffer, length, true,
+                 PublishClass::CONTROL, PayloadSchema::PRESENCE);
+}
+
+int MQTTClient::_state() {
+    // Both use the same codes for connection failures; positive values are the broker's refusal
+    return _useMQTT5 ? _session.state() : _mqttClient.state();
+}
+
 bool MQTTClient::_isValidConfig() {
-    return (strlen(MQTT_SERVER) > 0 && strcmp(MQTT_SERVER, "192.168.1.100") != 0);
+    return (strlen(_server) > 0 && strcmp(_server, "192.168.1.100") != 0);
 }
 
-String MQTTClient::_generateClientId() {
-    String clientId = MQTT_CLIENT_ID_PREFIX;
-    clientId += WiFi.macAddress();
-    clientId.replace(":", "");
-    return clientId;
+void MQTTClient::_generateClientId() {
+    // MAC address without separators, read once at startup
+    uint8_t mac[6];
+    WiFi.macAddress(mac);
+    snprintf(_clientId, sizeof(_clientId), "%s%02X%02X%02X%02X%02X%02X", MQTT_CLIENT_ID_PREFIX,
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
 }
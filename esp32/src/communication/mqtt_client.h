@@ -4,10 +4,17 @@
 #include <PubSubClient.h>
 #include <WiFiClient.h>
 #include <ArduinoJson.h>
+#include "publish_queue.h"
+#include "mqtt5_session.h"
+#include "../utils/runtime_config.h"
 #include "../config/config.h"
 
+// PUBLISH bytes besides topic and payload: fixed header (PubSubClient reserves
+// 5), topic length, and for MQTT 5 the properties (expiry, alias, schema id)
+#define MQTT_PUBLISH_OVERHEAD 40
+
 class MQTTClient;
-typedef std::function<void(const String& topic, const String& payload)> MQTTCallback;
+typedef std::function<void(const char* topic, const uint8_t* payload, unsigned int length)> MQTTCallback;
 
 class MQTTClient {
 public:
@@ -20,29 +27,106 @@ public:
     
     void loop();
     
-    bool publish(const String& topic, const String& payload, bool retained = false);
-    bool publishSensorData(const String& sensorType, const DynamicJsonDocument& data);
-    bool publishStatus(const DynamicJsonDocument& status);
+    // Publishes are queued per class and sent highest class first, within each
+    // class's rate limit. True means accepted, not yet delivered.
+    bool publish(const char* topic, const char* payload, bool retained = false,
+                 PublishClass publishClass = PublishClass::TELEMETRY, PayloadSchema schema = PayloadSchema::NONE);
+    bool publish(const char* topic, const uint8_t* payload, size_t length, bool retained = false,
+                 PublishClass publishClass = PublishClass::TELEMETRY, PayloadSchema schema = PayloadSchema::NONE);
+    // Largest payload that fits one MQTT_MAX_PACKET_SIZE packet on the topic;
+    // publish() refuses anything bigger rather than queue it to fail on the wire
+    static size_t getPayloadLimit(const char* topic) {
+        return MQTT_MAX_PACKET_SIZE - MQTT_PUBLISH_OVERHEAD - strlen(topic);
+    }
+    // Published to MQTT_TOPIC_SENSORS/<type>/<name> so each instance has its own stream
+    bool publishSensorData(const char* sensorType, const char* sensorName, const JsonDocument& data);
+    // The same frame already serialised, e.g. by a JsonWriter
+    bool publishSensorData(const char* sensorType, const char* sensorName, const char* json, size_t length);
+    // Encoded TelemetryBatch behind a TelemetryDatagram header, to MQTT_TOPIC_SENSORS/<type>/<name>/batch
+    bool publishSensorBatch(const char* sensorType, const char* sensorName, const uint8_t* payload, size_t length);
+    bool publishStatus(const JsonDocument& status);
+    // One top-level object of a status snapshot, retained on
+    // MQTT_TOPIC_STATUS_SECTION/<name> as {"seq":N,"<name>":{...}}
+    bool publishStatusSection(const char* name, JsonObjectConst section, uint32_t sequence);
+    bool publishStatusDelta(const JsonDocument& delta);
+    bool publishCommandAck(const JsonDocument& ack);
+    // Current parameter values, retained on MQTT_TOPIC_CONFIG
+    bool publishConfig(const JsonDocument& config);
+    // Stream announcement, retained on MQTT_TOPIC_STREAMS
+    bool publishStreams(const JsonDocument& streams);
+    // One trace dump chunk (see utils/trace_format.h) on MQTT_TOPIC_TRACE
+    bool publishTrace(const uint8_t* chunk, size_t length);
+    // One history transfer chunk (see utils/history_format.h) on MQTT_TOPIC_HISTORY
+    bool publishHistory(const uint8_t* chunk, size_t length);
+    // Trigger event on MQTT_TOPIC_TRIGGER, then its burst in history chunks on MQTT_TOPIC_BURST
+    bool publishTriggerEvent(const JsonDocument& event);
+    bool publishBurst(const uint8_t* chunk, size_t length);
     
-    bool subscribe(const String& topic);
+    bool subscribe(const char* topic);
     bool subscribeToCommands();
     
     void setCallback(MQTTCallback callback);
     
-    String getClientId();
+    const char* getClientId() const { return _clientId; }
+    
+    // Per-class delivery, drop and latency counters
+    PublishQueue::Stats getQueueStats(PublishClass publishClass) const;
+    void writeQueueStatus(JsonObject queues) const;
+    // For bulk senders that should wait rather than fill a queue
+    bool isQueueEmpty(PublishClass publishClass) const { return _queues[(size_t)publishClass].isEmpty(); }
+    
+    // 5 or 4 (3.1.1); 5 until a connect shows the broker lacks it
+    uint8_t getProtocolVersion() const { return _useMQTT5 ? 5 : 4; }
+    // Protocol in use and, for MQTT 5, topic alias usage
+    void writeProtocolStatus(JsonObject mqtt) const;
+    
+    // Incremented on every successful connect, so callers can detect reconnects
+    uint32_t getConnectionCount() const { return _connectionCount; }
+    // Incremented when a queued status snapshot or delta fails to send; a
+    // consumer merging deltas is out of step from then on
+    uint32_t getStatusLosses() const { return _statusLosses; }
     
 private:
     WiFiClient _wifiClient;
-    PubSubClient _mqttClient;
-    String _clientId;
+    PubSubClient _mqttClient;  // MQTT 3.1.1
+    MQTT5Session _session;     // MQTT 5, on the same socket
+    bool _useMQTT5;
+    uint8_t _closedBeforeConnack;  // MQTT 5 connects in a row the broker hung up on
+    char _clientId[40];
     MQTTCallback _userCallback;
     unsigned long _lastConnectionAttempt;
+    uint32_t _connectionCount;
+    uint32_t _statusLosses;
+    uint32_t _configGeneration;
+    
+    // Copied at begin(): the broker only changes on restart
+    char _server[CONFIG_STRING_MAX];
+    uint16_t _port;
+    
+    // Preallocated buffers so publishing never touches the heap
+    char _topicBuffer[128];
+    char _payloadBuffer[MQTT_MAX_PACKET_SIZE];
+    
+    // Outbound queues, indexed by PublishClass; word-aligned for the record headers
+    alignas(4) uint8_t _controlStorage[MQTT_QUEUE_CONTROL_BYTES];
+    alignas(4) uint8_t _statusStorage[MQTT_QUEUE_STATUS_BYTES];
+    alignas(4) uint8_t _telemetryStorage[MQTT_QUEUE_TELEMETRY_BYTES];
+    alignas(4) uint8_t _bulkStorage[MQTT_QUEUE_BULK_BYTES];
+    PublishQueue _queues[(size_t)PublishClass::COUNT];
     
     static void _staticCallback(char* topic, byte* payload, unsigned int length);
-    void _handleCallback(const String& topic, const String& payload);
+    void _handleCallback(const char* topic, const uint8_t* payload, unsigned int length);
     
+    bool _publishJson(const char* topic, const JsonDocument& doc, bool retained, PublishClass publishClass,
+                      PayloadSchema schema);
+    bool _send(const char* topic, const uint8_t* payload, size_t length, bool retained,
+               PublishClass publishClass, PayloadSchema schema);
+    int _state();
+    void _drainQueues();
+    void _applyConfig();
+    bool _publishPresence(bool online);
     bool _isValidConfig();
-    String _generateClientId();
+    void _generateClientId();
     
     static MQTTClient* _instance;
 };
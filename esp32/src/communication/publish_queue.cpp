@@ -0,0 +1,177 @@
+#include "publish_queue.h"
+
+PublishQueue::PublishQueue(uint8_t* storage, size_t capacity, DropPolicy policy,
+                           uint32_t rateBytesPerSecond, uint32_t burstBytes)
+    : _storage(storage), _capacity(capacity & ~(size_t)3), _head(0), _tail(0),
+      _wrapAt(capacity & ~(size_t)3), _count(0), _policy(policy),
+      _rate(rateBytesPerSecond), _burst(burstBytes), _tokens(burstBytes),
+      _lastRefillUs(micros()), _refillRemainder(0), _stats(), _latencySumUs(0) {
+}
+
+bool PublishQueue::push(const char* topic, const uint8_t* payload, size_t length, bool retained,
+                        PayloadSchema schema) {
+    size_t topicLength = strlen(topic) + 1;
+    size_t size = (sizeof(RecordHeader) + topicLength + length + 3) & ~(size_t)3;
+    if (size > _capacity || size > UINT16_MAX) {
+        _stats.dropped++;
+        return false;
+    }
+    
+    uint8_t* record = _allocate(size);
+    while (record == nullptr && _policy == DropPolicy::DROP_OLDEST && _count > 0) {
+        _pop();
+        _stats.dropped++;
+        record = _allocate(size);
+    }
+    if (record == nullptr) {
+        _stats.dropped++;
+        return false;
+    }
+    
+    RecordHeader header;
+    header.enqueuedUs = micros();
+    header.size = size;
+    header.topicLength = topicLength;
+    header.payloadLength = length;
+    header.retained = retained;
+    header.schema = (uint8_t)schema;
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), topic, topicLength);
+    memcpy(record + sizeof(header) + topicLength, payload, length);
+    
+    if (_count > _stats.peakDepth) {
+        _stats.peakDepth = _count;
+    }
+    return true;
+}
+
+bool PublishQueue::front(Message& message) const {
+    if (_count == 0) {
+        return false;
+    }
+    
+    const uint8_t* record = _storage + _head;
+    RecordHeader header = _headerAt(_head);
+    message.topic = reinterpret_cast<const char*>(record + sizeof(RecordHeader));
+    message.payload = record + sizeof(RecordHeader) + header.topicLength;
+    message.length = header.payloadLength;
+    message.retained = header.retained;
+    message.schema = (PayloadSchema)header.schema;
+    return true;
+}
+
+bool PublishQueue::acquire(size_t length) {
+    if (_rate == 0) {
+        return true;
+    }
+    
+    // Refill by elapsed time, carrying the fractional byte between calls
+    uint32_t now = micros();
+    uint64_t scaled = (uint64_t)(now - _lastRefillUs) * _rate + _refillRemainder;
+    _lastRefillUs = now;
+    _refillRemainder = scaled % 1000000;
+    uint64_t tokens = _tokens + scaled / 1000000;
+    _tokens = tokens > _burst ? _burst : (uint32_t)tokens;
+    
+    // A message larger than the burst still goes once the bucket is full
+    if (_tokens < length && _tokens < _burst) {
+        return false;
+    }
+    _tokens = _tokens > length ? _tokens - length : 0;
+    return true;
+}
+
+void PublishQueue::popSent() {
+    uint32_t latency = micros() - _headerAt(_head).enqueuedUs;
+    _latencySumUs += latency;
+    if (latency > _stats.latencyMaxUs) {
+        _stats.latencyMaxUs = latency;
+    }
+    _stats.sent++;
+    _pop();
+}
+
+void PublishQueue::popFailed() {
+    _stats.failed++;
+    _pop();
+}
+
+void PublishQueue::clear() {
+    _stats.dropped += _count;
+    _count = 0;
+    _head = _tail = 0;
+    _wrapAt = _capacity;
+}
+
+PublishQueue::Stats PublishQueue::getStats() const {
+    Stats stats = _stats;
+    stats.depth = _count;
+    stats.latencyAvgUs = _stats.sent > 0 ? (uint32_t)(_latencySumUs / _stats.sent) : 0;
+    return stats;
+}
+
+void PublishQueue::writeStatus(JsonObject queue) const {
+    Stats stats = getStats();
+    queue["sent"] = stats.sent;
+    queue["dropped"] = stats.dropped;
+    queue["failed"] = stats.failed;
+    queue["depth"] = stats.depth;
+    queue["peak"] = stats.peakDepth;
+    queue["latency_ms"] = stats.latencyAvgUs / 1000;
+    queue["latency_max_ms"] = stats.latencyMaxUs / 1000;
+}
+
+PublishQueue::RecordHeader PublishQueue::_headerAt(size_t offset) const {
+    // Copied rather than cast, as the caller's storage may not be aligned
+    // for the 32-bit timestamp
+    RecordHeader header;
+    memcpy(&header, _storage + offset, sizeof(header));
+    return header;
+}
+
+uint8_t* PublishQueue::_allocate(size_t size) {
+    if (_count == 0) {
+        _head = _tail = 0;
+        _wrapAt = _capacity;
+    }
+    
+    size_t at;
+    if (_tail > _head || _count == 0) {
+        // Free space is [tail, capacity) and [0, head)
+        if (_capacity - _tail >= size) {
+            at = _tail;
+        } else if (_head >= size) {
+            _wrapAt = _tail;
+            at = 0;
+        } else {
+            return nullptr;
+        }
+    } else {
+        // Wrapped (or full): free space is [tail, head)
+        if (_head - _tail < size) {
+            return nullptr;
+        }
+        at = _tail;
+    }
+    
+    _tail = at + size;
+    _count++;
+    return _storage + at;
+}
+
+void PublishQueue::_pop() {
+    if (_count == 0) {
+        return;
+    }
+    
+    _head += _headerAt(_head).size;
+    _count--;
+    
+    if (_count == 0) {
+        _head = _tail = 0;
+        _wrapAt = _capacity;
+    } else if (_head >= _wrapAt) {
+        _head = 0;
+        _wrapAt = _capacity;
+    }
+}
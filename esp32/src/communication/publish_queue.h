@@ -0,0 +1,119 @@
+#ifndef PUBLISH_QUEUE_H
+#define PUBLISH_QUEUE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Highest priority first
+enum class PublishClass : uint8_t {
+    CONTROL,   // Command acknowledgements
+    STATUS,    // Status snapshots and deltas
+    TELEMETRY, // Sensor data
+    BULK,      // Trace dumps and history transfers, paced by the caller
+    COUNT
+};
+
+// What a payload contains, sent as a schema id where the protocol allows (MQTT 5)
+enum class PayloadSchema : uint8_t {
+    NONE,
+    SENSOR,    // JSON sensor frame
+    BATCH,     // Encoded TelemetryBatch
+    STATUS,    // Status snapshot
+    DELTA,     // Status delta
+    ACK,       // Command acknowledgement
+    CONFIG,    // Runtime parameter values
+    STREAMS,   // Stream announcement
+    PRESENCE,
+    TRACE,     // Trace dump chunk
+    HISTORY,   // History transfer or triggered burst chunk
+    TRIGGER,   // Trigger event
+    PROBE,     // Latency probe
+    COUNT
+};
+
+enum class DropPolicy : uint8_t {
+    DROP_NEWEST, // Refuse the new message, so the caller sees the failure
+    DROP_OLDEST  // Evict the oldest queued messages to make room
+};
+
+// Outbound queue for one publish class: a bounded ring of variable-length
+// records in caller-provided storage, a token bucket in bytes per second, and
+// delivery statistics. Not thread-safe; used from the loop task only.
+class PublishQueue {
+public:
+    struct Message {
+        const char* topic;
+        const uint8_t* payload;
+        size_t length;
+        bool retained;
+        PayloadSchema schema;
+    };
+    
+    struct Stats {
+        uint32_t sent;
+        uint32_t dropped;
+        uint32_t failed;
+        uint16_t depth;
+        uint16_t peakDepth;
+        uint32_t latencyAvgUs;
+        uint32_t latencyMaxUs;
+    };
+    
+    // rateBytesPerSecond 0 disables rate limiting for the class. storage
+    // should be 4-byte aligned; headers are copied out either way.
+    PublishQueue(uint8_t* storage, size_t capacity, DropPolicy policy,
+                 uint32_t rateBytesPerSecond, uint32_t burstBytes);
+    
+    bool push(const char* topic, const uint8_t* payload, size_t length, bool retained,
+              PayloadSchema schema = PayloadSchema::NONE);
+    bool front(Message& message) const;
+    
+    // Takes tokens for the front message if the bucket allows it now
+    bool acquire(size_t length);
+    
+    // Takes effect from the next refill; the bucket keeps its current tokens
+    void setRate(uint32_t rateBytesPerSecond) { _rate = rateBytesPerSecond; _refillRemainder = 0; }
+    
+    // Removes the front message, recording it as sent, failed or dropped
+    void popSent();
+    void popFailed();
+    void clear();
+    
+    bool isEmpty() const { return _count == 0; }
+    Stats getStats() const;
+    void writeStatus(JsonObject queue) const;
+    
+private:
+    struct RecordHeader {
+        uint32_t enqueuedUs;
+        uint16_t size;          // Whole record, padded to 4 bytes
+        uint16_t topicLength;   // Including the terminator
+        uint16_t payloadLength;
+        uint8_t retained;
+        uint8_t schema;
+    };
+    
+    uint8_t* _storage;
+    size_t _capacity;
+    size_t _head;
+    size_t _tail;
+    size_t _wrapAt; // Records end here before wrapping to the start of storage
+    uint16_t _count;
+    DropPolicy _policy;
+    
+    // Token bucket
+    uint32_t _rate;
+    uint32_t _burst;
+    uint32_t _tokens;
+    uint32_t _lastRefillUs;
+    uint32_t _refillRemainder;
+    
+    Stats _stats;
+    uint64_t _latencySumUs;
+    
+    RecordHeader _headerAt(size_t offset) const;
+    uint8_t* _allocate(size_t size);
+    void _pop();
+};
+
+#endif // PUBLISH_QUEUE_H
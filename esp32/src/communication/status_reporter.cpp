@@ -0,0 +1,226 @@
+#include "status_reporter.h"
+#include "../utils/runtime_config.h"
+#include <math.h>
+
+// Fields that change on every report and carry no information of their own;
+// deltas include the top-level ones for ordering but never trigger on them.
+static const char* const VOLATILE_KEYS[] = { "timestamp", "uptime", "last_update" };
+
+// Noisy gauges only count as changed once they move by at least the deadband,
+// scaled by the status.deadband_scale parameter (0 reports every change).
+// Matched on the enclosing object's key (nullptr for any) and the field name.
+struct StatusDeadband {
+    const char* parent;
+    const char* key;
+    float deadband;
+};
+
+static const StatusDeadband DEADBANDS[] = {
+    { "wifi", "rssi", 4.0f },
+    { "memory", "free_heap", 4096.0f },
+    { "memory", "largest_free_block", 4096.0f },
+    { "memory", "fragmentation", 5.0f },
+    { "allocations", "count", 1000.0f },
+    { "allocations", "frees", 1000.0f },
+    { "allocations", "bytes", 65536.0f },
+    { "bus0", "transactions", 1000.0f },
+    { "bus0", "utilization", 5.0f },
+    { "bus1", "transactions", 1000.0f },
+    { "bus1", "utilization", 5.0f },
+    { "control", "sent", 100.0f },
+    { "status", "sent", 100.0f },
+    { "telemetry", "sent", 1000.0f },
+    { "bulk", "sent", 100.0f },
+    { "control", "latency_ms", 20.0f },
+    { "status", "latency_ms", 20.0f },
+    { "telemetry", "latency_ms", 20.0f },
+    { "bulk", "latency_ms", 20.0f },
+    { "telemetry", "depth", 4.0f },
+    { "aliases", "saved_bytes", 65536.0f },
+    { "udp", "sent", 1000.0f },
+    { "udp", "bytes", 65536.0f },
+    { nullptr, "samples", 1000.0f }, // Per-sensor counters under "streams"
+    { nullptr, "frames", 100.0f },
+    { nullptr, "span_ms", 1000.0f }, // History per sensor, which follows the sampling rate
+    { "sync", "offset_ms", 1.0f },
+    { "sync", "delay_us", 5000.0f },
+    { "sync", "error_us", 1000.0f },
+    { "sync", "exchanges", 100.0f },
+    { "sync", "beacons", 100.0f },
+    { "sync", "lateness_us", 200.0f },
+    { "latency", "sent", 100.0f },
+    { "latency", "received", 100.0f },
+    { "latency", "last_us", 5000.0f },
+    { "latency", "p50_us", 2000.0f },
+    { "latency", "p99_us", 5000.0f },
+};
+
+StatusReporter::StatusReporter(MQTTClient& client)
+    : _client(client), _sequence(0), _connectionCount(0), _statusLosses(0), _lastSnapshot(0), _lastFailure(0),
+      _snapshotFailures(0), _snapshotRequested(true) {
+}
+
+bool StatusReporter::needsSnapshot() const {
+    return _snapshotRequested ||
+           _client.getConnectionCount() != _connectionCount ||
+           _client.getStatusLosses() != _statusLosses ||
+           millis() - _lastSnapshot >= RuntimeConfig::getUInt(ConfigParam::SNAPSHOT_INTERVAL);
+}
+
+bool StatusReporter::isSnapshotDue() const {
+    return needsSnapshot() &&
+           (_lastFailure == 0 || millis() - _lastFailure >= RuntimeConfig::getUInt(ConfigParam::STATUS_INTERVAL));
+}
+
+bool StatusReporter::report(const JsonDocument& status) {
+    if (!_client.isConnected()) {
+        return false;
+    }
+    
+    if (needsSnapshot()) {
+        return _publishSnapshot(status);
+    }
+    
+    _delta.clear();
+    JsonObject delta = _delta.to<JsonObject>();
+    if (!_diff(status.as<JsonObjectConst>(), _reported.as<JsonObjectConst>(), delta, nullptr)) {
+        return true; // Nothing worth sending
+    }
+    
+    delta["seq"] = _sequence + 1;
+    delta["timestamp"] = status["timestamp"];
+    delta["uptime"] = status["uptime"];
+    
+    if (_delta.overflowed()) {
+        Serial.println("Status delta too large, sending full snapshot");
+        return _publishSnapshot(status);
+    }
+    
+    if (!_client.publishStatusDelta(_delta)) {
+        return false;
+    }
+    _sequence++;
+    
+    // Advance the baseline by what was actually sent, so values held back by a
+    // deadband are still compared against what consumers last saw
+    _merge(_reported.as<JsonObject>(), _delta.as<JsonObjectConst>());
+    if (_reported.overflowed() || _reported.memoryUsage() > _reported.capacity() * 3 / 4) {
+        // Merging leaks replaced strings in the pool; rebase on the next report
+        _snapshotRequested = true;
+    }
+    return true;
+}
+
+bool StatusReporter::_publishSnapshot(const JsonDocument& status) {
+    _reported.clear();
+    _reported.set(status);
+    uint32_t sequence = _sequence + 1;
+    
+    // Sections first and the core last (see the header). On a failure the
+    // retry sends them all again under the same seq.
+    _core.clear();
+    _core["seq"] = sequence;
+    JsonArray sections = _core.createNestedArray("sections");
+    bool queued = true;
+    for (JsonPairConst pair : _reported.as<JsonObjectConst>()) {
+        if (pair.value().is<JsonObjectConst>()) {
+            sections.add(pair.key().c_str());
+            queued = queued && _client.publishStatusSection(pair.key().c_str(), pair.value().as<JsonObjectConst>(), sequence);
+        } else {
+            _core[pair.key()] = pair.value();
+        }
+    }
+    
+    if (!queued || _core.overflowed() || !_client.publishStatus(_core)) {
+        _snapshotFailures++;
+        _lastFailure = millis();
+        if (_lastFailure == 0) {
+            _lastFailure = 1; // 0 means no failure pending
+        }
+        return false;
+    }
+    
+    _sequence++;
+    _connectionCount = _client.getConnectionCount();
+    _statusLosses = _client.getStatusLosses();
+    _lastSnapshot = millis();
+    _lastFailure = 0;
+    _snapshotRequested = false;
+    return true;
+}
+
+bool StatusReporter::_diff(JsonObjectConst current, JsonObjectConst previous, JsonObject delta, const char* parent) {
+    bool changed = false;
+    
+    for (JsonPairConst pair : current) {
+        const char* key = pair.key().c_str();
+        if (_isVolatile(key)) {
+            continue;
+        }
+        
+        JsonVariantConst value = pair.value();
+        JsonVariantConst last = previous[key];
+        
+        if (value.is<JsonObjectConst>() && last.is<JsonObjectConst>()) {
+            JsonObject nested = delta.createNestedObject(pair.key());
+            if (_diff(value.as<JsonObjectConst>(), last.as<JsonObjectConst>(), nested, key)) {
+                changed = true;
+            } else {
+                delta.remove(key);
+            }
+        } else if (value != last && !_withinDeadband(parent, key, value, last)) {
+            delta[pair.key()] = value;
+            changed = true;
+        }
+    }
+    
+    // Fields that disappeared are sent as null
+    for (JsonPairConst pair : previous) {
+        const char* key = pair.key().c_str();
+        if (!_isVolatile(key) && strcmp(key, "seq") != 0 && !current.containsKey(key)) {
+            delta[pair.key()] = nullptr;
+            changed = true;
+        }
+    }
+    
+    return changed;
+}
+
+void StatusReporter::_merge(JsonObject target, JsonObjectConst delta) {
+    for (JsonPairConst pair : delta) {
+        const char* key = pair.key().c_str();
+        JsonVariantConst value = pair.value();
+        
+        if (value.isNull()) {
+            target.remove(key);
+        } else if (value.is<JsonObjectConst>() && target[key].is<JsonObject>()) {
+            _merge(target[key].as<JsonObject>(), value.as<JsonObjectConst>());
+        } else {
+            target[pair.key()] = value;
+        }
+    }
+}
+
+bool StatusReporter::_isVolatile(const char* key) {
+    for (size_t i = 0; i < sizeof(VOLATILE_KEYS) / sizeof(VOLATILE_KEYS[0]); i++) {
+        if (strcmp(key, VOLATILE_KEYS[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool StatusReporter::_withinDeadband(const char* parent, const char* key, JsonVariantConst current, JsonVariantConst previous) {
+    if (parent == nullptr || !current.is<float>() || !previous.is<float>()) {
+        return false;
+    }
+    
+    for (size_t i = 0; i < sizeof(DEADBANDS) / sizeof(DEADBANDS[0]); i++) {
+        const StatusDeadband& entry = DEADBANDS[i];
+        if ((entry.parent == nullptr || strcmp(parent, entry.parent) == 0) && strcmp(key, entry.key) == 0) {
+            float deadband = entry.deadband * RuntimeConfig::getFloat(ConfigParam::DEADBAND_SCALE);
+            return fabsf(current.as<float>() - previous.as<float>()) < deadband;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,64 @@
+#ifndef STATUS_REPORTER_H
+#define STATUS_REPORTER_H
+
+#include <ArduinoJson.h>
+#include "mqtt_client.h"
+
+// Incremental status reporting. A full snapshot is published (retained) after
+// every MQTT (re)connect and every status.snapshot_ms; in between only
+// the fields that changed since the last report go out on MQTT_TOPIC_STATUS_DELTA.
+// Liveness comes from the presence topic and its Last Will, not the report rate.
+//
+// A whole snapshot outgrows one MQTT packet, so it is split: each top-level
+// object is retained on MQTT_TOPIC_STATUS_SECTION/<name> as {"seq":N,"<name>":{...}},
+// then the scalar fields go on MQTT_TOPIC_STATUS with "seq" and a "sections"
+// list. The core goes last, so once a consumer has it, every section it lists
+// has been sent with the same "seq"; sections not listed are stale.
+//
+// Every snapshot and delta carries a "seq" number. A consumer applies a delta by
+// merging it into its copy of the snapshot (null removes a field); on a gap in
+// "seq" it waits for the next retained snapshot.
+//
+// A delta is merged into the baseline when it is queued. If it is later lost
+// (send failure, or the queue cleared on reconnect) the baseline is ahead of
+// consumers, so either event brings a new snapshot.
+class StatusReporter {
+public:
+    StatusReporter(MQTTClient& client);
+    
+    // True after a (re)connect or when a refresh is due
+    bool needsSnapshot() const;
+    // As needsSnapshot(), but false for one status.interval after a failed
+    // snapshot, so the loop doesn't rebuild and retry it on every pass
+    bool isSnapshotDue() const;
+    void requestSnapshot() { _snapshotRequested = true; }
+    
+    // Publishes a snapshot or a delta against what consumers last received
+    bool report(const JsonDocument& status);
+    
+    uint32_t getSequence() const { return _sequence; }
+    // Snapshots that could not be queued (too large, or the status queue full)
+    uint32_t getSnapshotFailures() const { return _snapshotFailures; }
+    
+private:
+    MQTTClient& _client;
+    StaticJsonDocument<5120> _reported;  // Baseline as seen by consumers
+    StaticJsonDocument<512> _core;       // Snapshot fields outside the sections
+    StaticJsonDocument<1024> _delta;
+    uint32_t _sequence;
+    uint32_t _connectionCount;
+    uint32_t _statusLosses;      // MQTTClient::getStatusLosses() at the last snapshot
+    unsigned long _lastSnapshot;
+    unsigned long _lastFailure;  // 0 once a snapshot has gone out
+    uint32_t _snapshotFailures;
+    bool _snapshotRequested;
+    
+    bool _publishSnapshot(const JsonDocument& status);
+    
+    static bool _diff(JsonObjectConst current, JsonObjectConst previous, JsonObject delta, const char* parent);
+    static void _merge(JsonObject target, JsonObjectConst delta);
+    static bool _isVolatile(const char* key);
+    static bool _withinDeadband(const char* parent, const char* key, JsonVariantConst current, JsonVariantConst previous);
+};
+
+#endif // STATUS_REPORTER_H
@@ -0,0 +1,254 @@
+#include "sync_clock.h"
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "../config/config.h"
+
+SyncClock::SyncClock(MQTTClient& client)
+    : _client(client), _mode(SYNC_MODE_OFF), _periodUs(SYNC_PERIOD_MS * 1000UL),
+      _beaconSequence(0), _lastBeaconUs(0), _beaconTimeUs(0), _coordinatorRestarts(0), _requestSequence(0), _requestUs(0), _requestPending(false),
+      _lostRequests(0), _lastTick(0), _missedTicks(0), _latenessUs(0), _maxLatenessUs(0) {
+}
+
+void SyncClock::begin() {
+    _mode = SYNC_MODE;
+    _estimator.reset();
+    if (_mode != SYNC_MODE_OFF) {
+        Serial.printf("Sync %s, %lu ms grid\n", _modeToString(_mode), (unsigned long)getPeriodMs());
+    }
+}
+
+void SyncClock::onConnected() {
+    if (_mode == SYNC_MODE_COORDINATOR) {
+        _client.subscribe(MQTT_TOPIC_SYNC_REQUEST);
+        _publishBeacon();
+    } else if (_mode == SYNC_MODE_FOLLOWER) {
+        _client.subscribe(MQTT_TOPIC_SYNC_BEACON);
+        _client.subscribe(MQTT_TOPIC_SYNC_RESPONSE "/" DEVICE_ID);
+    }
+}
+
+bool SyncClock::handleMessage(const char* topic, const uint8_t* payload, unsigned int length, int64_t receivedUs) {
+    if (_mode == SYNC_MODE_OFF || strncmp(topic, MQTT_TOPIC_SYNC "/", sizeof(MQTT_TOPIC_SYNC)) != 0) {
+        return false;
+    }
+    
+    if (deserializeJson(_doc, payload, length)) {
+        Serial.printf("Malformed sync message on %s\n", topic);
+        return true;
+    }
+    
+    if (_mode == SYNC_MODE_FOLLOWER && strcmp(topic, MQTT_TOPIC_SYNC_BEACON) == 0) {
+        _handleBeacon(receivedUs);
+    } else if (_mode == SYNC_MODE_FOLLOWER && strcmp(topic, MQTT_TOPIC_SYNC_RESPONSE "/" DEVICE_ID) == 0) {
+        _handleResponse(receivedUs);
+    } else if (_mode == SYNC_MODE_COORDINATOR && strcmp(topic, MQTT_TOPIC_SYNC_REQUEST) == 0) {
+        _handleRequest(receivedUs);
+    }
+    return true;
+}
+
+void SyncClock::update() {
+    // Ticks skipped while unlocked were not missed; start counting afresh
+    if (!isLocked()) {
+        _lastTick = 0;
+    }
+    
+    if (_mode == SYNC_MODE_COORDINATOR && _client.isConnected() &&
+        esp_timer_get_time() - _lastBeaconUs >= SYNC_BEACON_INTERVAL_MS * 1000LL) {
+        _publishBeacon();
+    }
+}
+
+bool SyncClock::isLocked() const {
+    if (_mode == SYNC_MODE_COORDINATOR) {
+        return true;
+    }
+    return _mode == SYNC_MODE_FOLLOWER && _estimator.isValid() &&
+           _estimator.getErrorBound(esp_timer_get_time()) < _periodUs / 2;
+}
+
+uint32_t SyncClock::waitForTick(void (*idle)()) {
+    uint32_t tick = _nextTick(esp_timer_get_time());
+    
+    // Sleep in slices so MQTT stays serviced (and sync replies are timestamped
+    // promptly); the target is recomputed as the estimate may change meanwhile.
+    // A response can shift the offset and a beacon the period: a target now
+    // more than a period away, or more than a period past, is not the next tick,
+    // so it is picked again.
+    int64_t target = _toLocal((int64_t)tick * _periodUs);
+    int64_t remaining = target - esp_timer_get_time();
+    while (remaining > (int64_t)SPIN_US) {
+        uint32_t sliceMs = (remaining - SPIN_US) / 1000;
+        vTaskDelay(pdMS_TO_TICKS(sliceMs == 0 ? 1 : sliceMs > IDLE_SLICE_MS ? IDLE_SLICE_MS : sliceMs));
+        if (idle) {
+            idle();
+        }
+        int64_t now = esp_timer_get_time();
+        target = _toLocal((int64_t)tick * _periodUs);
+        remaining = target - now;
+        if (remaining > (int64_t)_periodUs || remaining < -(int64_t)_periodUs) {
+            tick = _nextTick(now);
+            target = _toLocal((int64_t)tick * _periodUs);
+            remaining = target - now;
+        }
+    }
+    
+    int64_t now;
+    while ((now = esp_timer_get_time()) < target) {
+    }
+    
+    if (_lastTick != 0 && tick > _lastTick + 1) {
+        _missedTicks += tick - _lastTick - 1;
+    }
+    _latenessUs = now - target;
+    if (_latenessUs > _maxLatenessUs) {
+        _maxLatenessUs = _latenessUs;
+    }
+    _lastTick = tick;
+    return tick;
+}
+
+uint32_t SyncClock::getErrorBound() const {
+    if (_mode == SYNC_MODE_COORDINATOR) {
+        return _latenessUs;
+    }
+    uint32_t bound = _estimator.getErrorBound(esp_timer_get_time());
+    return bound > UINT32_MAX - _latenessUs ? UINT32_MAX : bound + _latenessUs;
+}
+
+void SyncClock::writeStatus(JsonObject sync) const {
+    sync["mode"] = _modeToString(_mode);
+    if (_mode == SYNC_MODE_OFF) {
+        return;
+    }
+    
+    sync["locked"] = isLocked();
+    sync["period_ms"] = getPeriodMs();
+    if (_mode == SYNC_MODE_FOLLOWER) {
+        int64_t now = esp_timer_get_time();
+        sync["offset_ms"] = _estimator.getOffset(now) / 1000.0;
+        sync["delay_us"] = _estimator.getDelay(now);
+        sync["error_us"] = _estimator.isValid() ? _estimator.getErrorBound(now) : 0;
+        sync["exchanges"] = _estimator.getExchangeCount();
+        sync["lost"] = _lostRequests;
+        sync["coordinator_restarts"] = _coordinatorRestarts;
+    } else {
+        sync["beacons"] = _beaconSequence;
+    }
+    sync["lateness_us"] = _latenessUs;
+    sync["lateness_max_us"] = _maxLatenessUs;
+    sync["missed_ticks"] = _missedTicks;
+}
+
+uint32_t SyncClock::_nextTick(int64_t localUs) const {
+    // Never a tick already returned, should the estimate step backwards
+    uint32_t tick = (uint32_t)(_toCoordinator(localUs) / _periodUs) + 1;
+    return _lastTick != 0 && tick <= _lastTick ? _lastTick + 1 : tick;
+}
+
+int64_t SyncClock::_toCoordinator(int64_t localUs) const {
+    return _mode == SYNC_MODE_FOLLOWER ? _estimator.toCoordinator(localUs) : localUs;
+}
+
+int64_t SyncClock::_toLocal(int64_t coordinatorUs) const {
+    return _mode == SYNC_MODE_FOLLOWER ? _estimator.toLocal(coordinatorUs) : coordinatorUs;
+}
+
+void SyncClock::_publishBeacon() {
+    _doc.clear();
+    _doc["seq"] = ++_beaconSequence;
+    _doc["period_us"] = _periodUs;
+    _lastBeaconUs = esp_timer_get_time();
+    _doc["t"] = _lastBeaconUs;
+    _publish(MQTT_TOPIC_SYNC_BEACON);
+}
+
+void SyncClock::_handleBeacon(int64_t receivedUs) {
+    // A coordinator that restarted has a new clock: exchanges with the old one
+    // would keep being picked for their small delay, with the wrong offset
+    uint32_t sequence = _doc["seq"];
+    int64_t beaconUs = _doc["t"].as<int64_t>();
+    if (_beaconSequence != 0 && (sequence <= _beaconSequence || beaconUs <= _beaconTimeUs)) {
+        Serial.println("Sync coordinator restarted, discarding the clock estimate");
+        _estimator.reset();
+        _requestPending = false;
+        _lastTick = 0;
+        _coordinatorRestarts++;
+    }
+    _beaconSequence = sequence;
+    _beaconTimeUs = beaconUs;
+    
+    // The coordinator sets the grid; a change invalidates tick numbers seen so far
+    uint32_t period = _doc["period_us"] | _periodUs;
+    if (period != _periodUs && period >= 1000) {
+        Serial.printf("Sync grid changed to %lu ms\n", (unsigned long)(period / 1000));
+        _periodUs = period;
+        _lastTick = 0;
+    }
+    _lastBeaconUs = receivedUs;
+    
+    if (_requestPending) {
+        _lostRequests++;
+    }
+    
+    _doc.clear();
+    _doc["node"] = DEVICE_ID;
+    _doc["seq"] = ++_requestSequence;
+    _requestUs = esp_timer_get_time();
+    _doc["t1"] = _requestUs;
+    _requestPending = _publish(MQTT_TOPIC_SYNC_REQUEST);
+}
+
+void SyncClock::_handleRequest(int64_t receivedUs) {
+    const char* node = _doc["node"];
+    if (node == nullptr || strlen(node) > 40) {
+        return;
+    }
+    
+    char topic[sizeof(MQTT_TOPIC_SYNC_RESPONSE) + 48];
+    snprintf(topic, sizeof(topic), "%s/%s", MQTT_TOPIC_SYNC_RESPONSE, node);
+    
+    // The request fields are copied before the document is reused
+    uint32_t sequence = _doc["seq"];
+    int64_t t1 = _doc["t1"].as<int64_t>();
+    _doc.clear();
+    _doc["seq"] = sequence;
+    _doc["t1"] = t1;
+    _doc["t2"] = receivedUs;
+    _doc["t3"] = esp_timer_get_time();
+    _publish(topic);
+}
+
+void SyncClock::_handleResponse(int64_t receivedUs) {
+    // Only the outstanding request counts; a late reply has an inflated delay anyway
+    if (!_requestPending || _doc["seq"] != _requestSequence || _doc["t1"] != _requestUs) {
+        return;
+    }
+    _requestPending = false;
+    
+    bool wasLocked = isLocked();
+    if (!_estimator.addExchange(_requestUs, _doc["t2"].as<int64_t>(), _doc["t3"].as<int64_t>(), receivedUs)) {
+        Serial.println("Sync exchange rejected (negative delay)");
+        return;
+    }
+    if (!wasLocked && isLocked()) {
+        int64_t now = esp_timer_get_time();
+        Serial.printf("Sync locked: offset %.3f ms, error bound %lu us\n",
+                      _estimator.getOffset(now) / 1000.0, (unsigned long)_estimator.getErrorBound(now));
+    }
+}
+
+bool SyncClock::_publish(const char* topic) {
+    size_t length = serializeJson(_doc, _buffer, sizeof(_buffer));
+    return length > 0 && length < sizeof(_buffer) &&
+           _client.publish(topic, (const uint8_t*)_buffer, length, false, PublishClass::CONTROL);
+}
+
+const char* SyncClock::_modeToString(uint8_t mode) {
+    switch (mode) {
+        case SYNC_MODE_FOLLOWER: return "follower";
+        case SYNC_MODE_COORDINATOR: return "coordinator";
+        default: return "off";
+    }
+}
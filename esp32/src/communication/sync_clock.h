@@ -0,0 +1,101 @@
+#ifndef SYNC_CLOCK_H
+#define SYNC_CLOCK_H
+
+#include <ArduinoJson.h>
+#include "mqtt_client.h"
+#include "../utils/sync_estimator.h"
+
+// Sync modes for SYNC_MODE
+#define SYNC_MODE_OFF 0
+#define SYNC_MODE_FOLLOWER 1
+#define SYNC_MODE_COORDINATOR 2
+
+// Shared sampling grid across nodes. One node per site is the coordinator:
+// its clock defines grid instants at every multiple of SYNC_PERIOD_MS, and
+// every SYNC_BEACON_INTERVAL_MS it publishes a beacon on MQTT_TOPIC_SYNC_BEACON.
+// Followers answer each beacon with a timestamped request; the coordinator's
+// reply completes a two-way exchange that SyncEstimator turns into an offset
+// and an error bound that accounts for the broker round trip.
+//
+// While locked, the loop sleeps until the next grid instant (waitForTick) and
+// samples first thing, so every node samples tick N at the same instant to
+// within its reported bound. A follower stays locked while its bound is under
+// half a period, which keeps tick numbers unambiguous across nodes.
+class SyncClock {
+public:
+    SyncClock(MQTTClient& client);
+    
+    void begin();
+    
+    // Call after every MQTT (re)connect
+    void onConnected();
+    
+    // Call first thing in the MQTT callback, with the time taken on entry;
+    // true if the message was a sync message
+    bool handleMessage(const char* topic, const uint8_t* payload, unsigned int length, int64_t receivedUs);
+    
+    // Coordinator beacons and lock tracking; call once per loop
+    void update();
+    
+    bool isEnabled() const { return _mode != SYNC_MODE_OFF; }
+    bool isLocked() const;
+    
+    // Sleeps until the next grid instant and returns its tick number. idle is
+    // called every few milliseconds meanwhile (e.g. to service MQTT); ticks
+    // passed by without a call are counted as missed. If the estimate or the
+    // grid moves during the wait, the tick is picked again, so the wait never
+    // exceeds about a period.
+    uint32_t waitForTick(void (*idle)());
+    
+    uint32_t getPeriodMs() const { return _periodUs / 1000; }
+    
+    // Clock error bound now plus how late the last tick was woken, in µs
+    uint32_t getErrorBound() const;
+    
+    void writeStatus(JsonObject sync) const;
+    
+private:
+    MQTTClient& _client;
+    SyncEstimator _estimator;
+    StaticJsonDocument<256> _doc;
+    char _buffer[160];
+    uint8_t _mode;
+    uint32_t _periodUs;
+    
+    // Beacons (sent by the coordinator, received by followers)
+    uint32_t _beaconSequence;
+    int64_t _lastBeaconUs;
+    int64_t _beaconTimeUs;         // Coordinator time in the last beacon
+    uint32_t _coordinatorRestarts; // Beacon sequence or time went backwards
+    
+    // Follower's outstanding request
+    uint32_t _requestSequence;
+    int64_t _requestUs;
+    bool _requestPending;
+    uint32_t _lostRequests;
+    
+    // Grid wakeups
+    uint32_t _lastTick;
+    uint32_t _missedTicks;
+    uint32_t _latenessUs;
+    uint32_t _maxLatenessUs;
+    
+    uint32_t _nextTick(int64_t localUs) const;
+    int64_t _toCoordinator(int64_t localUs) const;
+    int64_t _toLocal(int64_t coordinatorUs) const;
+    
+    void _publishBeacon();
+    void _handleBeacon(int64_t receivedUs);
+    void _handleRequest(int64_t receivedUs);
+    void _handleResponse(int64_t receivedUs);
+    bool _publish(const char* topic);
+    
+    static const char* _modeToString(uint8_t mode);
+    
+    // The last stretch before a tick is spun rather than slept, as the
+    // scheduler tick is 1 ms; the idle callback runs at least this often
+    static const uint32_t SPIN_US = 2000;
+    static const uint32_t IDLE_SLICE_MS = 5;
+};
+
+#endif // SYNC_CLOCK_H
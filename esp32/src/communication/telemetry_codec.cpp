@@ -0,0 +1,354 @@
+#include "telemetry_codec.h"
+#include <string.h>
+
+namespace {
+
+// Bounds-checked little-endian and varint writer
+struct Writer {
+    uint8_t* out;
+    size_t capacity;
+    size_t length;
+    bool overflow;
+    
+    Writer(uint8_t* buffer, size_t size) : out(buffer), capacity(size), length(0), overflow(false) {}
+    
+    void byte(uint8_t value) {
+        if (length < capacity) {
+            out[length++] = value;
+        } else {
+            overflow = true;
+        }
+    }
+    
+    void u16(uint16_t value) {
+        byte(value & 0xFF);
+        byte(value >> 8);
+    }
+    
+    void u32(uint32_t value) {
+        u16(value & 0xFFFF);
+        u16(value >> 16);
+    }
+    
+    void varint(uint32_t value) {
+        while (value >= 0x80) {
+            byte((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        byte(value);
+    }
+    
+    void zigzag(int32_t value) {
+        varint(((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+    }
+};
+
+struct Reader {
+    const uint8_t* in;
+    size_t length;
+    size_t position;
+    bool underflow;
+    
+    Reader(const uint8_t* buffer, size_t size) : in(buffer), length(size), position(0), underflow(false) {}
+    
+    uint8_t byte() {
+        if (position < length) {
+            return in[position++];
+        }
+        underflow = true;
+        return 0;
+    }
+    
+    uint16_t u16() {
+        uint16_t low = byte();
+        return low | (uint16_t)(byte() << 8);
+    }
+    
+    uint32_t u32() {
+        uint32_t low = u16();
+        return low | ((uint32_t)u16() << 16);
+    }
+    
+    uint32_t varint() {
+        uint32_t value = 0;
+        for (uint8_t shift = 0; shift < 35; shift += 7) {
+            uint8_t next = byte();
+            value |= (uint32_t)(next & 0x7F) << shift;
+            if (!(next & 0x80)) {
+                return value;
+            }
+        }
+        underflow = true;
+        return 0;
+    }
+    
+    int32_t zigzag() {
+        uint32_t value = varint();
+        return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+    }
+};
+
+}
+
+void TelemetryBatch::reset(uint8_t batchLayout, uint8_t channelCount) {
+    layout = batchLayout;
+    channels = channelCount > TELEMETRY_BATCH_MAX_CHANNELS ? TELEMETRY_BATCH_MAX_CHANNELS : channelCount;
+    count = 0;
+    capacity = TELEMETRY_BATCH_MAX_SAMPLES;
+}
+
+bool TelemetryBatch::add(uint32_t timestamp, const int16_t* sample) {
+    if (isFull()) {
+        return false;
+    }
+    timestamps[count] = timestamp;
+    memcpy(values[count], sample, channels * sizeof(int16_t));
+    count++;
+    return true;
+}
+
+TelemetryCodec::TelemetryCodec() {
+    memset(_hashTable, 0, sizeof(_hashTable));
+}
+
+size_t TelemetryCodec::encode(const TelemetryBatch& batch, uint8_t* out, size_t capacity, bool delta, bool lz) {
+    if (batch.count == 0 || capacity < HEADER_SIZE) {
+        return 0;
+    }
+    
+    size_t bodyLength = _encodeBody(batch, delta, _body, sizeof(_body));
+    if (bodyLength == 0 && batch.count > 0 && batch.channels > 0) {
+        return 0;
+    }
+    
+    // Keep the LZ output only if it saves something
+    uint8_t flags = delta ? FLAG_DELTA : 0;
+    size_t storedLength = 0;
+    if (lz) {
+        storedLength = lzCompress(_body, bodyLength, out + HEADER_SIZE, capacity - HEADER_SIZE);
+        if (storedLength > 0 && storedLength < bodyLength) {
+            flags |= FLAG_LZ;
+        }
+    }
+    if (!(flags & FLAG_LZ)) {
+        if (bodyLength > capacity - HEADER_SIZE) {
+            return 0;
+        }
+        memcpy(out + HEADER_SIZE, _body, bodyLength);
+        storedLength = bodyLength;
+    }
+    
+    Writer header(out, HEADER_SIZE);
+    header.byte(VERSION);
+    header.byte(flags);
+    header.byte(batch.layout);
+    header.byte(batch.channels);
+    header.u16(batch.count);
+    header.u32(batch.timestamps[0]);
+    header.u16(bodyLength);
+    
+    return HEADER_SIZE + storedLength;
+}
+
+bool TelemetryCodec::decode(const uint8_t* in, size_t length, TelemetryBatch& batch) {
+    Reader header(in, length);
+    uint8_t version = header.byte();
+    uint8_t flags = header.byte();
+    uint8_t layout = header.byte();
+    uint8_t channels = header.byte();
+    uint16_t count = header.u16();
+    uint32_t firstTimestamp = header.u32();
+    uint16_t bodyLength = header.u16();
+    
+    if (header.underflow || version != VERSION || count == 0 || count > TELEMETRY_BATCH_MAX_SAMPLES ||
+        channels > TELEMETRY_BATCH_MAX_CHANNELS || bodyLength > sizeof(_body)) {
+        return false;
+    }
+    
+    const uint8_t* body = in + HEADER_SIZE;
+    if (flags & FLAG_LZ) {
+        if (lzDecompress(body, length - HEADER_SIZE, _body, sizeof(_body)) != bodyLength) {
+            return false;
+        }
+        body = _body;
+    } else if (length - HEADER_SIZE != bodyLength) {
+        return false;
+    }
+    
+    batch.reset(layout, channels);
+    batch.count = count;
+    batch.timestamps[0] = firstTimestamp;
+    return _decodeBody(body, bodyLength, flags & FLAG_DELTA, batch);
+}
+
+void TelemetryDatagram::writeHeader(uint8_t* out) const {
+    Writer header(out, HEADER_SIZE);
+    header.byte(VERSION);
+    header.byte(stream);
+    header.u16(session);
+    header.u32(sequence);
+}
+
+bool TelemetryDatagram::readHeader(const uint8_t* in, size_t length) {
+    Reader header(in, length);
+    uint8_t version = header.byte();
+    stream = header.byte();
+    session = header.u16();
+    sequence = header.u32();
+    return !header.underflow && version == VERSION && length > HEADER_SIZE;
+}
+
+size_t TelemetryCodec::_encodeBody(const TelemetryBatch& batch, bool delta, uint8_t* out, size_t capacity) {
+    Writer writer(out, capacity);
+    
+    for (uint16_t i = 1; i < batch.count; i++) {
+        if (delta) {
+            writer.varint(batch.timestamps[i] - batch.timestamps[i - 1]);
+        } else {
+            writer.u16(batch.timestamps[i] - batch.timestamps[0]);
+        }
+    }
+    
+    for (uint8_t channel = 0; channel < batch.channels; channel++) {
+        int32_t previous = 0;
+        for (uint16_t i = 0; i < batch.count; i++) {
+            int32_t value = batch.values[i][channel];
+            if (delta) {
+                writer.zigzag(value - previous);
+                previous = value;
+            } else {
+                writer.u16((uint16_t)value);
+            }
+        }
+    }
+    
+    return writer.overflow ? 0 : writer.length;
+}
+
+bool TelemetryCodec::_decodeBody(const uint8_t* in, size_t length, bool delta, TelemetryBatch& batch) {
+    Reader reader(in, length);
+    
+    for (uint16_t i = 1; i < batch.count; i++) {
+        batch.timestamps[i] = delta ? batch.timestamps[i - 1] + reader.varint()
+                                    : batch.timestamps[0] + reader.u16();
+    }
+    
+    for (uint8_t channel = 0; channel < batch.channels; channel++) {
+        int32_t previous = 0;
+        for (uint16_t i = 0; i < batch.count; i++) {
+            if (delta) {
+                previous += reader.zigzag();
+                batch.values[i][channel] = (int16_t)previous;
+            } else {
+                batch.values[i][channel] = (int16_t)reader.u16();
+            }
+        }
+    }
+    
+    return !reader.underflow && reader.position == length;
+}
+
+size_t TelemetryCodec::lzCompress(const uint8_t* in, size_t length, uint8_t* out, size_t capacity) {
+    memset(_hashTable, 0, sizeof(_hashTable));
+    
+    Writer writer(out, capacity);
+    size_t position = 0;
+    size_t literalStart = 0;
+    
+    // Literals go out in runs of at most LZ_MAX_LITERALS
+    auto flushLiterals = [&](size_t end) {
+        while (literalStart < end) {
+            size_t run = end - literalStart;
+            if (run > LZ_MAX_LITERALS) {
+                run = LZ_MAX_LITERALS;
+            }
+            writer.byte(run - 1);
+            for (size_t i = 0; i < run; i++) {
+                writer.byte(in[literalStart + i]);
+            }
+            literalStart += run;
+        }
+    };
+    
+    while (position + 2 < length && !writer.overflow) {
+        uint32_t key = in[position] | (in[position + 1] << 8) | ((uint32_t)in[position + 2] << 16);
+        uint16_t hash = (uint16_t)((key * 2654435761u) >> (32 - LZ_HASH_BITS));
+        size_t candidate = _hashTable[hash];
+        _hashTable[hash] = (uint16_t)(position + 1);
+        
+        if (candidate == 0 || position - (candidate - 1) > LZ_MAX_DISTANCE ||
+            memcmp(in + candidate - 1, in + position, 3) != 0) {
+            position++;
+            continue;
+        }
+        
+        size_t reference = candidate - 1;
+        size_t matchLength = 3;
+        while (position + matchLength < length && matchLength < LZ_MAX_MATCH &&
+               in[reference + matchLength] == in[position + matchLength]) {
+            matchLength++;
+        }
+        
+        flushLiterals(position);
+        size_t distance = position - reference - 1;
+        size_t encodedLength = matchLength - 2;
+        if (encodedLength < 7) {
+            writer.byte((encodedLength << 5) | (distance >> 8));
+        } else {
+            writer.byte((7 << 5) | (distance >> 8));
+            writer.byte(encodedLength - 7);
+        }
+        writer.byte(distance & 0xFF);
+        
+        position += matchLength;
+        literalStart = position;
+    }
+    
+    flushLiterals(length);
+    return writer.overflow ? 0 : writer.length;
+}
+
+size_t TelemetryCodec::lzDecompress(const uint8_t* in, size_t length, uint8_t* out, size_t capacity) {
+    size_t inPosition = 0;
+    size_t outPosition = 0;
+    
+    while (inPosition < length) {
+        uint8_t control = in[inPosition++];
+        
+        if (control < 0x20) {
+            size_t run = control + 1;
+            if (inPosition + run > length || outPosition + run > capacity) {
+                return 0;
+            }
+            memcpy(out + outPosition, in + inPosition, run);
+            inPosition += run;
+            outPosition += run;
+            continue;
+        }
+        
+        size_t matchLength = control >> 5;
+        if (matchLength == 7) {
+            if (inPosition >= length) {
+                return 0;
+            }
+            matchLength += in[inPosition++];
+        }
+        matchLength += 2;
+        
+        if (inPosition >= length) {
+            return 0;
+        }
+        size_t distance = (((size_t)(control & 0x1F) << 8) | in[inPosition++]) + 1;
+        if (distance > outPosition || outPosition + matchLength > capacity) {
+            return 0;
+        }
+        
+        // Byte by byte: matches may overlap their own output
+        for (size_t i = 0; i < matchLength; i++) {
+            out[outPosition] = out[outPosition - distance];
+            outPosition++;
+        }
+    }
+    
+    return outPosition;
+}
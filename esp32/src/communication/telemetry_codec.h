@@ -0,0 +1,107 @@
+#ifndef TELEMETRY_CODEC_H
+#define TELEMETRY_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Kept free of Arduino dependencies so the host tools can build it as is
+// (see esp32/tools/telemetry_bench.cpp).
+
+#define TELEMETRY_BATCH_MAX_SAMPLES 32
+#define TELEMETRY_BATCH_MAX_CHANNELS 10
+
+// Channel layouts; the README documents the channels and units of each
+#define TELEMETRY_LAYOUT_IMU 1
+
+// A run of integer samples from one sensor, in fixed-point channel units
+struct TelemetryBatch {
+    uint8_t layout;
+    uint8_t channels;
+    uint16_t count;
+    uint16_t capacity; // Full at this many samples; reset() restores the maximum
+    uint32_t timestamps[TELEMETRY_BATCH_MAX_SAMPLES]; // ms
+    int16_t values[TELEMETRY_BATCH_MAX_SAMPLES][TELEMETRY_BATCH_MAX_CHANNELS];
+    
+    void reset(uint8_t batchLayout, uint8_t channelCount);
+    bool add(uint32_t timestamp, const int16_t* sample); // False when full
+    bool isFull() const { return count >= capacity || count >= TELEMETRY_BATCH_MAX_SAMPLES; }
+};
+
+// Binary batch encoding. Layout, little-endian:
+//
+//   0  u8   version (1)
+//   1  u8   flags: FLAG_DELTA, FLAG_LZ
+//   2  u8   channel layout
+//   3  u8   channel count
+//   4  u16  sample count
+//   6  u32  timestamp of the first sample (ms)
+//   10 u16  body length before LZ
+//   12 body, LZ-compressed when FLAG_LZ is set
+//
+// The body is column-major: timestamp offsets for samples 1..n-1, then each
+// channel in turn. With FLAG_DELTA every value is the zigzag LEB128 varint of
+// its difference from the previous sample (the first against 0); without it,
+// timestamps are u16 offsets from the first and values are i16.
+//
+// The LZ stage uses the LZF format: a control byte below 0x20 is followed by
+// that many plus one literal bytes; otherwise its top 3 bits are the match
+// length minus 2 (7 meaning an extra length byte follows), and the low 5 bits
+// plus the next byte are the match distance minus 1.
+class TelemetryCodec {
+public:
+    static const uint8_t VERSION = 1;
+    static const uint8_t FLAG_DELTA = 0x01;
+    static const uint8_t FLAG_LZ = 0x02;
+    static const size_t HEADER_SIZE = 12;
+    static const size_t MAX_BODY_SIZE = TELEMETRY_BATCH_MAX_SAMPLES * (5 + TELEMETRY_BATCH_MAX_CHANNELS * 3);
+    static const size_t MAX_ENCODED_SIZE = HEADER_SIZE + MAX_BODY_SIZE;
+    
+    TelemetryCodec();
+    
+    // Returns the encoded size, or 0 if it does not fit in capacity. The LZ
+    // stage is only kept when it makes the batch smaller.
+    size_t encode(const TelemetryBatch& batch, uint8_t* out, size_t capacity, bool delta = true, bool lz = true);
+    
+    // For consumers and host tools; false on a malformed or truncated batch
+    bool decode(const uint8_t* in, size_t length, TelemetryBatch& batch);
+    
+    // Raw LZ stage; both return 0 if the output does not fit
+    size_t lzCompress(const uint8_t* in, size_t length, uint8_t* out, size_t capacity);
+    static size_t lzDecompress(const uint8_t* in, size_t length, uint8_t* out, size_t capacity);
+    
+private:
+    static const uint8_t LZ_HASH_BITS = 10;
+    static const size_t LZ_MAX_DISTANCE = 8192;
+    static const size_t LZ_MAX_MATCH = 7 + 255 + 2;
+    static const size_t LZ_MAX_LITERALS = 32;
+    
+    uint16_t _hashTable[1 << LZ_HASH_BITS]; // Position + 1 of the last occurrence; 0 = none
+    uint8_t _body[MAX_BODY_SIZE];
+    
+    static size_t _encodeBody(const TelemetryBatch& batch, bool delta, uint8_t* out, size_t capacity);
+    static bool _decodeBody(const uint8_t* in, size_t length, bool delta, TelemetryBatch& batch);
+};
+
+// Framing of one encoded batch, both as a UDP datagram (see udp_stream.h) and
+// as an MQTT batch message, little-endian:
+//
+//   0  u8   version (1)
+//   1  u8   stream id, as announced on MQTT_TOPIC_STREAMS
+//   2  u16  session, random per boot, so a receiver can tell a restart from loss
+//   4  u32  sequence number, per stream, counting every batch since boot on
+//           either transport, including ones that failed to send
+//   8  encoded batch
+struct TelemetryDatagram {
+    static const uint8_t VERSION = 1;
+    static const size_t HEADER_SIZE = 8;
+    static const size_t MAX_SIZE = HEADER_SIZE + TelemetryCodec::MAX_ENCODED_SIZE;
+    
+    uint8_t stream;
+    uint16_t session;
+    uint32_t sequence;
+    
+    void writeHeader(uint8_t* out) const;
+    bool readHeader(const uint8_t* in, size_t length); // False on a short or unknown datagram
+};
+
+#endif // TELEMETRY_CODEC_H
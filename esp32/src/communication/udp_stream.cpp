@@ -0,0 +1,101 @@
+#include "udp_stream.h"
+#include <WiFi.h>
+
+// WiFiUDP buffers one datagram of up to this size before sending it
+static_assert(TelemetryDatagram::MAX_SIZE <= 1460, "A batch datagram must fit WiFiUDP's buffer");
+
+UDPStream::UDPStream()
+    : _port(0), _resolved(false), _linkUp(false), _configGeneration(0), _lastResolveAttempt(0),
+      _sent(0), _failed(0), _bytes(0) {
+    _host[0] = '\0';
+}
+
+void UDPStream::update(bool wifiConnected) {
+    uint32_t generation = RuntimeConfig::getGeneration();
+    if (generation != _configGeneration) {
+        _configGeneration = generation;
+        const char* host = RuntimeConfig::getString(ConfigParam::UDP_COLLECTOR);
+        uint16_t port = RuntimeConfig::getUInt(ConfigParam::UDP_PORT);
+        if (strcmp(host, _host) != 0 || port != _port) {
+            strlcpy(_host, host, sizeof(_host));
+            _port = port;
+            _resolved = false;
+            _lastResolveAttempt = 0;
+        }
+    }
+    
+    // A new connection may come with a different DNS answer
+    if (wifiConnected && !_linkUp) {
+        _resolved = false;
+        _lastResolveAttempt = 0;
+    }
+    _linkUp = wifiConnected;
+    
+    if (_linkUp && isEnabled() && !_resolved &&
+        (_lastResolveAttempt == 0 || millis() - _lastResolveAttempt >= RESOLVE_RETRY_MS)) {
+        _lastResolveAttempt = millis();
+        _resolve();
+    }
+}
+
+bool UDPStream::isSelected(const char* sensorName) const {
+    // "*" or a comma-separated list of sensor names
+    const char* list = RuntimeConfig::getString(ConfigParam::UDP_STREAMS);
+    if (strcmp(list, "*") == 0) {
+        return true;
+    }
+    
+    size_t nameLength = strlen(sensorName);
+    while (*list) {
+        while (*list == ' ' || *list == ',') {
+            list++;
+        }
+        const char* end = list;
+        while (*end && *end != ',' && *end != ' ') {
+            end++;
+        }
+        if ((size_t)(end - list) == nameLength && strncmp(list, sensorName, nameLength) == 0) {
+            return true;
+        }
+        list = end;
+    }
+    return false;
+}
+
+bool UDPStream::send(const uint8_t* datagram, size_t length) {
+    // A datagram the stack can't take now is lost
+    if (!isReady() || !_udp.beginPacket(_address, _port) ||
+        _udp.write(datagram, length) != length || !_udp.endPacket()) {
+        _failed++;
+        return false;
+    }
+    
+    _sent++;
+    _bytes += length;
+    return true;
+}
+
+void UDPStream::writeStatus(JsonObject udp) const {
+    // Copied: the status baseline outlives this pass, and _host changes on reconfigure
+    udp["collector"] = (char*)_host;
+    udp["port"] = _port;
+    udp["resolved"] = _resolved;
+    udp["sent"] = _sent;
+    udp["failed"] = _failed;
+    udp["bytes"] = _bytes;
+}
+
+void UDPStream::_resolve() {
+    // IP literals need no lookup
+    if (_address.fromString(_host)) {
+        _resolved = true;
+        return;
+    }
+    
+    if (WiFi.hostByName(_host, _address) == 1) {
+        _resolved = true;
+        Serial.printf("UDP collector %s resolved to %s\n", _host, _address.toString().c_str());
+    } else {
+        Serial.printf("Failed to resolve UDP collector %s, retrying in %lus\n", _host, RESOLVE_RETRY_MS / 1000);
+    }
+}
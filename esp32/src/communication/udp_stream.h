@@ -0,0 +1,61 @@
+#ifndef UDP_STREAM_H
+#define UDP_STREAM_H
+
+#include <WiFiUdp.h>
+#include <ArduinoJson.h>
+#include "telemetry_codec.h"
+#include "../utils/runtime_config.h"
+#include "../config/config.h"
+
+// Stream ids are sensor positions; later sensors always use MQTT
+#define UDP_STREAM_MAX 8
+
+// Telemetry batches as UDP datagrams to a collector, for high-rate streams
+// where losing a batch is better than waiting behind one on a TCP connection.
+// Each datagram is one encoded batch behind a TelemetryDatagram header, whose
+// per-stream sequence numbers (written by the caller, shared with batches
+// sent over MQTT) let the collector count what was lost.
+//
+// The collector (udp.collector, udp.port) and the sensors sent this way
+// (udp.streams) are runtime parameters. Commands, status and the stream
+// announcement on MQTT_TOPIC_STREAMS stay on MQTT.
+class UDPStream {
+public:
+    UDPStream();
+    
+    // Picks up parameter changes and resolves the collector while WiFi is up.
+    // Call once per loop; a host name lookup blocks, so it is retried sparingly.
+    void update(bool wifiConnected);
+    
+    // A collector is configured, so selected streams use UDP
+    bool isEnabled() const { return _host[0] != '\0'; }
+    // Whether the sensor's batches go over UDP rather than MQTT
+    bool isSelected(const char* sensorName) const;
+    // The collector is resolved and WiFi is up
+    bool isReady() const { return _resolved && _linkUp; }
+    
+    // Sends one datagram, header included; nothing is retried
+    bool send(const uint8_t* datagram, size_t length);
+    
+    void writeStatus(JsonObject udp) const;
+    
+private:
+    WiFiUDP _udp;
+    IPAddress _address;
+    char _host[CONFIG_STRING_MAX];
+    uint16_t _port;
+    bool _resolved;
+    bool _linkUp;
+    uint32_t _configGeneration;
+    unsigned long _lastResolveAttempt;
+    
+    uint32_t _sent;
+    uint32_t _failed;
+    uint32_t _bytes;
+    
+    void _resolve();
+    
+    static const unsigned long RESOLVE_RETRY_MS = 30000;
+};
+
+#endif // UDP_STREAM_H
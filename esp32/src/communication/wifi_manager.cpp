@@ -1,19 +1,51 @@
 #include "wifi_manager.h"
+#include <esp_wifi.h>
+#include <esp_netif.h>
+#include <esp_netif_net_stack.h>
+#include <lwip/pbuf.h>
+#include <lwip/tcpip.h>
+#include "../utils/nvs_cache.h"
+#include "../utils/boot_profile.h"
+#include "../utils/trace_buffer.h"
 
-WiFiManager::WiFiManager() : _lastConnectionAttempt(0) {
+static const char WIFI_CACHE_KEY[] = "wifi";
+static const char STA_NETIF_KEY[] = "WIFI_STA_DEF";
+
+// Ethernet header and ARP payload of a probe
+static const size_t ARP_FRAME_LENGTH = 42;
+
+// Static member initialisation
+volatile bool WiFiManager::_checkRunning = false;
+volatile bool WiFiManager::_addressConflict = false;
+volatile uint32_t WiFiManager::_probeAddress = 0;
+netif_input_fn WiFiManager::_originalInput = nullptr;
+
+WiFiManager::WiFiManager()
+    : _state(State::IDLE), _lastConnectionAttempt(0), _checkStarted(0), _staticBoots(0), _probesSent(0),
+      _addressSet(false), _cached() {
     _ssid = WIFI_SSID;
     _password = WIFI_PASSWORD;
 }
 
 bool WiFiManager::begin() {
+    // The cache in NVS replaces the core's own credential store
+    WiFi.persistent(false);
     WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(true);
+    WiFi.onEvent(_onEvent);
+    
+    if (!_isValidCredentials()) {
+        Serial.println("ERROR: WiFi credentials not configured!");
+        Serial.println("Please update WIFI_SSID and WIFI_PASSWORD in config.h");
+        return false;
+    }
+    
+    connect();
     return true;
 }
 
 bool WiFiManager::connect() {
     if (!_isValidCredentials()) {
-        Serial.println("ERROR: WiFi credentials not configured!");
-        Serial.println("Please update WIFI_SSID and WIFI_PASSWORD in config.h");
         return false;
     }
     
@@ -21,6 +53,10 @@ bool WiFiManager::connect() {
         return true;
     }
     
+    if (_state == State::CONNECTING_FAST || _state == State::CHECKING_ADDRESS || _state == State::CONNECTING) {
+        return false;
+    }
+    
     // Avoid rapid reconnection attempts (but allow first attempt)
     unsigned long now = millis();
     if (_lastConnectionAttempt != 0 && now - _lastConnectionAttempt < 5000) {
@@ -28,61 +64,130 @@ bool WiFiManager::connect() {
     }
     _lastConnectionAttempt = now;
     
-    // Debugging, just in case WiFi is wonky
-    Serial.println();
-    Serial.println("=== WiFi Connection Attempt ===");
-    Serial.print("Connecting to SSID: ");
-    Serial.println(_ssid);
-    Serial.print("ESP32 MAC: ");
-    Serial.println(WiFi.macAddress());
-    
-    WiFi.mode(WIFI_STA);
-    delay(100);
-    WiFi.disconnect(true);
-    delay(500);
-    
-    Serial.println("Initiating connection...");
-    WiFi.begin(_ssid.c_str(), _password.c_str());
-    
-    unsigned long startTime = millis();
-    int connectTimeoutMs = 60000; 
-    
-    while (WiFi.status() != WL_CONNECTED && (millis() - startTime) < connectTimeoutMs) {
-        delay(250);
-        Serial.print(".");
+    if (!_startFastConnect()) {
+        _startFullConnect();
     }
+    return false;
+}
+
+void WiFiManager::update() {
+    bool connected = _isLinkUp();
+    unsigned long elapsed = millis() - _lastConnectionAttempt;
     
-    if (WiFi.status() == WL_CONNECTED) {
-        Serial.println();
-        _printConnectionInfo();
-        return true;
-    } else {
-        Serial.println();
-        Serial.printf("Connection failed after %d seconds\n", connectTimeoutMs / 1000);
-        Serial.printf("Final status: %s (%d)\n", 
-                     _getStatusString(WiFi.status()).c_str(), WiFi.status());
+    switch (_state) {
+        case State::CONNECTING_FAST:
+            if (_staticBoots > 0 && !_addressSet && _isAssociated()) {
+                // Association says nothing about the address: ask who else has it
+                _checkRunning = false;
+                _addressConflict = false;
+                _probesSent = 1;
+                _checkStarted = millis();
+                _state = State::CHECKING_ADDRESS;
+                tcpip_callback(_startAddressCheck, nullptr);
+            } else if (connected) {
+                _onConnected();
+            } else if (elapsed >= WIFI_FAST_CONNECT_TIMEOUT_MS) {
+                // The AP may have moved channel, or the cached address be refused
+                _fallBack("WiFi fast connect failed");
+            }
+            break;
         
-        // Add more debugging info
-        Serial.println("Debugging info:");
-        Serial.printf("  - WiFi mode: %d\n", WiFi.getMode());
-        Serial.printf("  - Credentials: SSID='%s', PWD_LEN=%d\n", _ssid.c_str(), _password.length());
-        return false;
+        case State::CHECKING_ADDRESS: {
+            unsigned long checking = millis() - _checkStarted;
+            if (!_isAssociated()) {
+                tcpip_callback(_stopAddressCheck, nullptr);
+                _fallBack("WiFi lost while checking the cached address");
+            } else if (_addressConflict) {
+                // The lease was given to someone else since it was cached
+                tcpip_callback(_stopAddressCheck, nullptr);
+                _fallBack("Cached IP address is in use by another host");
+            } else if (checking >= WIFI_ADDRESS_CHECK_MS) {
+                tcpip_callback(_stopAddressCheck, nullptr);
+                if (_checkRunning) {
+                    _commitAddress();
+                } else {
+                    _fallBack("Cached IP address could not be checked");
+                }
+            } else if (_probesSent < WIFI_ADDRESS_PROBES &&
+                       checking >= _probesSent * WIFI_ADDRESS_CHECK_MS / WIFI_ADDRESS_PROBES) {
+                _probesSent++;
+                tcpip_callback(_sendAddressProbe, nullptr);
+            }
+            break;
+        }
+        
+        case State::CONNECTING:
+            if (connected) {
+                _onConnected();
+            } else if (elapsed >= WIFI_TIMEOUT_MS) {
+                Serial.printf("WiFi connection failed after %d seconds\n", WIFI_TIMEOUT_MS / 1000);
+                Serial.printf("Final status: %s (%d)\n", 
+                             _getStatusString(WiFi.status()).c_str(), WiFi.status());
+                _state = State::IDLE;
+            }
+            break;
+        
+        case State::CONNECTED:
+            if (!connected) {
+                Serial.println("WiFi connection lost");
+                _state = State::IDLE;
+            }
+            break;
+        
+        case State::IDLE:
+            // The core's auto-reconnect may get there first
+            if (connected) {
+                _onConnected();
+            } else {
+                connect();
+            }
+            break;
     }
 }
 
 void WiFiManager::disconnect() {
     WiFi.disconnect();
+    _state = State::IDLE;
     Serial.println("WiFi disconnected");
 }
 
 bool WiFiManager::isConnected() {
+    // Not until a cached address has been checked, so nothing talks from it before then
+    return _state != State::CHECKING_ADDRESS && _isLinkUp();
+}
+
+bool WiFiManager::_isLinkUp() {
     return WiFi.status() == WL_CONNECTED;
 }
 
+bool WiFiManager::_isAssociated() {
+    // Without an address the core never reports WL_CONNECTED
+    wifi_ap_record_t ap;
+    return esp_wifi_sta_get_ap_info(&ap) == ESP_OK;
+}
+
+void WiFiManager::_commitAddress() {
+    // Posts the got-IP event, which takes the core to WL_CONNECTED
+    esp_netif_ip_info_t info;
+    info.ip.addr = _cached.ip;
+    info.netmask.addr = _cached.subnet;
+    info.gw.addr = _cached.gateway;
+    _addressSet = true;
+    _state = State::CONNECTING_FAST;
+    if (esp_netif_set_ip_info(esp_netif_get_handle_from_ifkey(STA_NETIF_KEY), &info) != ESP_OK) {
+        _fallBack("Failed to set the cached IP address");
+    }
+}
+
 String WiFiManager::getLocalIP() {
     return WiFi.localIP().toString();
 }
 
+void WiFiManager::getLocalIP(char* buffer, size_t length) {
+    IPAddress ip = WiFi.localIP();
+    snprintf(buffer, length, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+}
+
 String WiFiManager::getMacAddress() {
     return WiFi.macAddress();
 }
@@ -96,6 +201,181 @@ void WiFiManager::setCredentials(const char* ssid, const char* password) {
     _password = password;
 }
 
+bool WiFiManager::_startFastConnect() {
+#if WIFI_FAST_CONNECT
+    Cache cache;
+    if (!NVSCache::load(WIFI_CACHE_KEY, &cache, sizeof(cache))) {
+        return false;
+    }
+    
+    Serial.printf("WiFi fast connect to %s (channel %u, BSSID %02X:%02X:%02X:%02X:%02X:%02X)\n",
+                  _ssid.c_str(), cache.channel, cache.bssid[0], cache.bssid[1], cache.bssid[2],
+                  cache.bssid[3], cache.bssid[4], cache.bssid[5]);
+                  
+    // Zero addresses select DHCP, after a cached address that was too old or in use
+    _staticBoots = 0;
+    _addressSet = false;
+#if WIFI_CACHE_STATIC_IP
+    if (cache.ip != 0 && cache.staticBoots < WIFI_STATIC_IP_MAX_BOOTS) {
+        _staticBoots = cache.staticBoots + 1;
+        cache.staticBoots = _staticBoots;
+        NVSCache::store(WIFI_CACHE_KEY, &cache, sizeof(cache));
+        WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet), IPAddress(cache.dns));
+        
+        // Static mode keeps DHCP off; the address itself waits for the probe
+        esp_netif_ip_info_t none;
+        memset(&none, 0, sizeof(none));
+        esp_netif_set_ip_info(esp_netif_get_handle_from_ifkey(STA_NETIF_KEY), &none);
+        _cached = cache;
+        _probeAddress = cache.ip;
+    } else {
+        WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+    }
+#endif
+    WiFi.begin(_ssid.c_str(), _password.c_str(), cache.channel, cache.bssid);
+    
+    _state = State::CONNECTING_FAST;
+    BootProfile::setFastConnect(true);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void WiFiManager::_startFullConnect() {
+    Serial.print("Connecting to SSID: ");
+    Serial.println(_ssid);
+    
+    // Zero addresses switch the interface back to DHCP after a cached static config
+    WiFi.disconnect();
+    WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+    WiFi.begin(_ssid.c_str(), _password.c_str());
+    
+    _staticBoots = 0;
+    _state = State::CONNECTING;
+    BootProfile::setFastConnect(false);
+}
+
+void WiFiManager::_fallBack(const char* reason) {
+    Serial.print(reason);
+    Serial.println(", falling back to full connect");
+    NVSCache::remove(WIFI_CACHE_KEY);
+    _lastConnectionAttempt = millis();
+    _startFullConnect();
+}
+
+void WiFiManager::_onEvent(arduino_event_id_t event) {
+    // Runs on the core's event task: keep it to the trace
+    TRACE_INSTANT(TraceEvent::WIFI_EVENT, event);
+}
+
+struct netif* WiFiManager::_stationNetif() {
+    esp_netif_t* handle = esp_netif_get_handle_from_ifkey(STA_NETIF_KEY);
+    return handle != nullptr ? (struct netif*)esp_netif_get_netif_impl(handle) : nullptr;
+}
+
+void WiFiManager::_startAddressCheck(void* context) {
+    // Runs on the lwIP thread: watch incoming ARP from now on, then probe
+    struct netif* netif = _stationNetif();
+    if (netif == nullptr) {
+        return;
+    }
+    if (netif->input != _inspectInput) {
+        _originalInput = netif->input;
+        netif->input = _inspectInput;
+    }
+    _checkRunning = true;
+    _sendAddressProbe(context);
+}
+
+void WiFiManager::_sendAddressProbe(void* context) {
+    // Runs on the lwIP thread. An RFC 5227 probe: a broadcast request for the
+    // address from sender 0.0.0.0, which hosts answer without caching it.
+    (void)context;
+    struct netif* netif = _stationNetif();
+    if (netif == nullptr) {
+        return;
+    }
+    struct pbuf* packet = pbuf_alloc(PBUF_RAW, ARP_FRAME_LENGTH, PBUF_RAM);
+    if (packet == nullptr) {
+        return;
+    }
+    
+    static const uint8_t ARP_REQUEST[] = { 0x00, 0x01, 0x08, 0x00, 6, 4, 0x00, 0x01 }; // Ethernet, IPv4
+    uint8_t* frame = (uint8_t*)packet->payload;
+    memset(frame, 0xFF, 6);
+    memcpy(frame + 6, netif->hwaddr, 6);
+    frame[12] = 0x08; // ARP
+    frame[13] = 0x06;
+    uint8_t* arp = frame + 14;
+    memcpy(arp, ARP_REQUEST, sizeof(ARP_REQUEST));
+    memcpy(arp + 8, netif->hwaddr, 6);
+    memset(arp + 14, 0, 10); // Sender address and target hardware address
+    uint32_t target = _probeAddress;
+    memcpy(arp + 24, &target, 4);
+    
+    netif->linkoutput(netif, packet);
+    pbuf_free(packet);
+}
+
+void WiFiManager::_stopAddressCheck(void* context) {
+    // _originalInput stays set: the driver task may be inside _inspectInput
+    (void)context;
+    struct netif* netif = _stationNetif();
+    if (netif != nullptr && netif->input == _inspectInput) {
+        netif->input = _originalInput;
+    }
+}
+
+err_t WiFiManager::_inspectInput(struct pbuf* packet, struct netif* netif) {
+    // Runs on the WiFi driver task for every frame received during the check.
+    // A conflict is any ARP from another host that has the address (a reply or
+    // an announcement), or that is probing for it too.
+    const uint8_t* frame = (const uint8_t*)packet->payload;
+    if (packet->len >= ARP_FRAME_LENGTH && frame[12] == 0x08 && frame[13] == 0x06) {
+        const uint8_t* arp = frame + 14;
+        uint32_t sender;
+        uint32_t target;
+        memcpy(&sender, arp + 14, 4);
+        memcpy(&target, arp + 24, 4);
+        uint32_t address = _probeAddress;
+        if (memcmp(arp + 8, netif->hwaddr, 6) != 0 &&
+            (sender == address || (sender == 0 && target == address))) {
+            _addressConflict = true;
+        }
+    }
+    return _originalInput(packet, netif);
+}
+
+void WiFiManager::_onConnected() {
+    _state = State::CONNECTED;
+    BootProfile::mark(BootPhase::WIFI_CONNECTED);
+    _printConnectionInfo();
+    _saveCache();
+}
+
+void WiFiManager::_saveCache() {
+#if WIFI_FAST_CONNECT
+    const uint8_t* bssid = WiFi.BSSID();
+    if (bssid == nullptr) {
+        return;
+    }
+    
+    Cache cache;
+    memcpy(cache.bssid, bssid, sizeof(cache.bssid));
+    cache.channel = (uint8_t)WiFi.channel();
+    cache.staticBoots = _staticBoots;
+    cache.ip = (uint32_t)WiFi.localIP();
+    cache.gateway = (uint32_t)WiFi.gatewayIP();
+    cache.subnet = (uint32_t)WiFi.subnetMask();
+    cache.dns = (uint32_t)WiFi.dnsIP();
+    
+    if (!NVSCache::store(WIFI_CACHE_KEY, &cache, sizeof(cache))) {
+        Serial.println("Failed to cache WiFi connection details");
+    }
+#endif
+}
+
 bool WiFiManager::_isValidCredentials() {
     return (_ssid.length() > 0 && _ssid != "YOUR_WIFI_SSID" &&
             _password.length() > 0 && _password != "YOUR_WIFI_PASSWORD");
@@ -123,4 +403,4 @@ String WiFiManager::_getStatusString(int status) {
         case WL_DISCONNECTED: return "Disconnected";
         default: return "Unknown";
     }
-}
\ No newline at end of file
+}
@@ -2,27 +2,87 @@
 #define WIFI_MANAGER_H
 
 #include <WiFi.h>
+#include <lwip/netif.h>
 #include "../config/config.h"
 
+// Non-blocking station manager. With WIFI_FAST_CONNECT the BSSID, channel and
+// IP configuration of the last good connection are cached in NVS, so the next
+// boot joins without a scan (and without DHCP when WIFI_CACHE_STATIC_IP is set).
+// If that fails within WIFI_FAST_CONNECT_TIMEOUT_MS it falls back to a full connect.
+//
+// A cached address is only a guess that the lease still holds. The station
+// joins without it, and the manager sends RFC 5227 ARP probes for it (sender
+// 0.0.0.0, so no cache learns it early). Any ARP from another host with that
+// address, or probing for it, falls back to DHCP; otherwise the address is set
+// after WIFI_ADDRESS_CHECK_MS. After WIFI_STATIC_IP_MAX_BOOTS reuses the next
+// fast connect takes a fresh lease from DHCP anyway.
 class WiFiManager {
 public:
     WiFiManager();
     
-    bool begin();
-    bool connect();
+    bool begin();      // Starts connecting in the background
+    bool connect();    // Starts an attempt if none is running; true if already connected
+    void update();     // Call from loop(): completes, times out and retries attempts
     void disconnect();
     bool isConnected();
     
     String getLocalIP();
+    void getLocalIP(char* buffer, size_t length); // Heap-free variant for periodic reports
     String getMacAddress();
     int getSignalStrength();
     
     void setCredentials(const char* ssid, const char* password);
     
 private:
+    enum class State {
+        IDLE,
+        CONNECTING_FAST,
+        CHECKING_ADDRESS,  // Joined without an address; probing for the cached one
+        CONNECTING,
+        CONNECTED
+    };
+    
+    // Last good connection, as stored in NVS
+    struct Cache {
+        uint8_t bssid[6];
+        uint8_t channel;
+        uint8_t staticBoots;  // Fast connects that reused the IP since DHCP assigned it
+        uint32_t ip;
+        uint32_t gateway;
+        uint32_t subnet;
+        uint32_t dns;
+    };
+    
     String _ssid;
     String _password;
+    State _state;
     unsigned long _lastConnectionAttempt;
+    unsigned long _checkStarted;
+    uint8_t _staticBoots;  // As in the cache; 0 when the address came from DHCP
+    uint8_t _probesSent;
+    bool _addressSet;      // The cached address passed its check and is on the interface
+    Cache _cached;
+    
+    // Shared with the lwIP thread and the WiFi driver task
+    static volatile bool _checkRunning;
+    static volatile bool _addressConflict;
+    static volatile uint32_t _probeAddress;
+    static netif_input_fn _originalInput;
+    
+    bool _isLinkUp();
+    bool _isAssociated();
+    void _commitAddress();
+    bool _startFastConnect();
+    void _startFullConnect();
+    void _fallBack(const char* reason);
+    void _onConnected();
+    static void _onEvent(arduino_event_id_t event);
+    static struct netif* _stationNetif();
+    static void _startAddressCheck(void* context);
+    static void _sendAddressProbe(void* context);
+    static void _stopAddressCheck(void* context);
+    static err_t _inspectInput(struct pbuf* packet, struct netif* netif);
+    void _saveCache();
     
     bool _isValidCredentials();
     void _printConnectionInfo();
@@ -0,0 +1,110 @@
+#include "command_batch.h"
+
+CommandBatch::CommandBatch() {
+    memset(&_result, 0, sizeof(_result));
+    _result.failedIndex = -1;
+}
+
+void CommandBatch::writeAck(JsonDocument& ack) const {
+    ack.clear();
+    if (_result.id != 0) {
+        ack["id"] = _result.id;
+    }
+    
+    if (_result.applied == _result.count && _result.error == nullptr) {
+        ack["status"] = "applied";
+    } else {
+        ack["status"] = _result.applied == 0 ? "rejected" : "partial";
+    }
+    ack["count"] = _result.count;
+    ack["applied"] = _result.applied;
+    
+    if (_result.error) {
+        ack["error"] = _result.error;
+        if (_result.failedIndex >= 0) {
+            ack["failed_index"] = _result.failedIndex;
+        }
+    }
+    ack["timestamp"] = millis();
+}
+
+bool CommandBatch::_execute(DeviceLookup lookup, void* registry, const uint8_t* payload, size_t length, Encoding encoding) {
+    memset(&_result, 0, sizeof(_result));
+    _result.failedIndex = -1;
+    
+    DeserializationError error = (encoding == Encoding::MSGPACK)
+        ? deserializeMsgPack(_doc, payload, length)
+        : deserializeJson(_doc, payload, length);
+    if (error) {
+        Serial.printf("Failed to parse command batch: %s\n", error.c_str());
+        return _reject(-1, "parse error");
+    }
+    
+    JsonArrayConst entries;
+    if (_doc.is<JsonArrayConst>()) {
+        entries = _doc.as<JsonArrayConst>();
+    } else {
+        _result.id = _doc["id"] | 0;
+        entries = _doc["commands"].as<JsonArrayConst>();
+    }
+    
+    if (entries.isNull() || entries.size() == 0) {
+        return _reject(-1, "no commands");
+    }
+    if (entries.size() > COMMAND_BATCH_MAX_ENTRIES) {
+        return _reject(-1, "too many commands");
+    }
+    _result.count = entries.size();
+    
+    // Check everything first so a bad entry leaves every device untouched
+    uint8_t index = 0;
+    for (JsonVariantConst entry : entries) {
+        const char* name;
+        JsonVariantConst command;
+        if (entry.is<JsonArrayConst>()) {
+            name = entry[0];
+            command = entry[1];
+        } else {
+            name = entry["device"];
+            command = entry["command"];
+        }
+        
+        if (name == nullptr || command.isNull()) {
+            return _reject(index, "malformed entry");
+        }
+        
+        DeviceBase* device = lookup(registry, name);
+        if (device == nullptr) {
+            return _reject(index, "unknown device");
+        }
+        if (!device->isReady()) {
+            return _reject(index, "device not ready");
+        }
+        if (!device->validateCommand(command)) {
+            return _reject(index, "invalid command");
+        }
+        
+        _targets[index] = device;
+        _commands[index] = command;
+        index++;
+    }
+    
+    // Apply back to back to keep the skew between devices small
+    for (uint8_t i = 0; i < _result.count; i++) {
+        if (_targets[i]->handleCommand(_commands[i])) {
+            _result.applied++;
+        } else if (_result.failedIndex < 0) {
+            _result.failedIndex = i;
+            _result.error = "command failed";
+        }
+    }
+    
+    return _result.error == nullptr;
+}
+
+bool CommandBatch::_reject(int8_t index, const char* error) {
+    _result.failedIndex = index;
+    _result.error = error;
+    Serial.printf("Command batch rejected: %s (entry %d)\n", error, index);
+    return false;
+}
@@ -0,0 +1,60 @@
+#ifndef COMMAND_BATCH_H
+#define COMMAND_BATCH_H
+
+#include <ArduinoJson.h>
+#include "device_base.h"
+
+#define COMMAND_BATCH_MAX_ENTRIES 32
+
+// Several device commands in one MQTT message, applied all-or-nothing: every
+// entry is checked (device exists, is ready, accepts the command) before any is
+// applied, and then they are applied back to back with a single acknowledgement.
+//
+// Payload, as JSON or MessagePack:
+//   {"id": 42, "commands": [{"device": "led1", "command": {"state": true}}, ...]}
+// Entries may also be compact pairs, ["led1", {"state": true}], and the
+// wrapper object may be dropped when no id is needed.
+class CommandBatch {
+public:
+    enum class Encoding {
+        JSON,
+        MSGPACK
+    };
+    
+    struct Result {
+        uint32_t id;          // Echoed from the request, 0 if absent
+        uint8_t count;
+        uint8_t applied;
+        int8_t failedIndex;   // First failing entry, -1 if none
+        const char* error;    // Static string, null on success
+    };
+    
+    CommandBatch();
+    
+    // Registry is DeviceManager or StaticDeviceRegistry (anything with findDevice())
+    template <typename Registry>
+    bool execute(Registry& registry, const uint8_t* payload, size_t length, Encoding encoding) {
+        return _execute(&_lookup<Registry>, &registry, payload, length, encoding);
+    }
+    
+    const Result& getResult() const { return _result; }
+    void writeAck(JsonDocument& ack) const;
+    
+private:
+    typedef DeviceBase* (*DeviceLookup)(void* registry, const char* name);
+    
+    StaticJsonDocument<2048> _doc;
+    DeviceBase* _targets[COMMAND_BATCH_MAX_ENTRIES];
+    JsonVariantConst _commands[COMMAND_BATCH_MAX_ENTRIES];
+    Result _result;
+    
+    bool _execute(DeviceLookup lookup, void* registry, const uint8_t* payload, size_t length, Encoding encoding);
+    bool _reject(int8_t index, const char* error);
+    
+    template <typename Registry>
+    static DeviceBase* _lookup(void* registry, const char* name) {
+        return static_cast<Registry*>(registry)->findDevice(name);
+    }
+};
+
+#endif // COMMAND_BATCH_H
@@ -2,6 +2,7 @@
 #define DEVICE_BASE_H
 
 #include <ArduinoJson.h>
+#include "../utils/json_arena.h"
 
 enum class DeviceType {
     LED,
@@ -21,25 +22,34 @@ enum class DeviceStatus {
 
 class DeviceBase {
 public:
-    DeviceBase(const String& name, DeviceType type) 
-        : _name(name), _type(type), _status(DeviceStatus::UNINITIALIZED) {}
+    // Names are interned: pass a string literal or other static-lifetime string
+    DeviceBase(const char* name, DeviceType type) 
+        : _name(name), _type(type), _status(DeviceStatus::UNINITIALIZED), _lastCommand(0) {}
     
     virtual ~DeviceBase() = default;
     
     // Interface methods to be implemented by derived classes
     virtual bool begin() = 0;
-    virtual bool handleCommand(const DynamicJsonDocument& command) = 0;
-    virtual DynamicJsonDocument getStatusAsJson() = 0;
+    virtual bool handleCommand(JsonVariantConst command) = 0;
+    virtual ArenaJsonDocument getStatusAsJson() = 0;
     
-    // Common interface
-    virtual bool isReady() const { return _status == DeviceStatus::READY; }
-    virtual DeviceStatus getStatus() const { return _status; }
-    virtual String getName() const { return _name; }
-    virtual DeviceType getType() const { return _type; }
-    virtual String getTypeString() const { return _deviceTypeToString(_type); }
+    // Checks a command without side effects, so batches can be rejected before
+    // any device has changed
+    virtual bool validateCommand(JsonVariantConst command) const { return !command.isNull(); }
+    
+    // Called every loop; only devices that keep software timers need to override it
+    virtual void update() {}
+    
+    // Common interface (non-virtual so registries can inline them)
+    bool isReady() const { return _status == DeviceStatus::READY; }
+    DeviceStatus getStatus() const { return _status; }
+    const char* getStatusString() const { return _deviceStatusToString(_status); }
+    const char* getName() const { return _name; }
+    DeviceType getType() const { return _type; }
+    const char* getTypeString() const { return _deviceTypeToString(_type); }
     
 protected:
-    String _name;
+    const char* _name;
     DeviceType _type;
     DeviceStatus _status;
     unsigned long _lastCommand;
@@ -47,7 +57,16 @@ protected:
     void _setStatus(DeviceStatus status) { _status = status; }
     
 private:
-    String _deviceTypeToString(DeviceType type) const {
+    static const char* _deviceStatusToString(DeviceStatus status) {
+        switch (status) {
+            case DeviceStatus::READY: return "ready";
+            case DeviceStatus::ERROR: return "error";
+            case DeviceStatus::BUSY: return "busy";
+            default: return "uninitialized";
+        }
+    }
+    
+    static const char* _deviceTypeToString(DeviceType type) {
         switch (type) {
             case DeviceType::LED: return "led";
             case DeviceType::RELAY: return "relay";
@@ -1,5 +1,4 @@
 #include "device_manager.h"
-#include "led_device.h"
 #include "../config/config.h"
 
 DeviceManager::DeviceManager() : _lastUpdate(0) {
@@ -16,7 +15,7 @@ bool DeviceManager::begin() {
     bool allSuccess = true;
     for (auto& device : _devices) {
         if (!device->begin()) {
-            Serial.printf("Failed to initialize device: %s\n", device->getName().c_str());
+            Serial.printf("Failed to initialize device: %s\n", device->getName());
             allSuccess = false;
         }
     }
@@ -28,19 +27,9 @@ bool DeviceManager::begin() {
 void DeviceManager::update() {
     unsigned long now = millis();
     
-    // Update devices that need periodic updates (like blinking LEDs)
+    // Devices with hardware-timed behaviour leave update() as a no-op
     for (auto& device : _devices) {
-        if (device->getType() == DeviceType::LED) {
-            auto ledDevice = std::static_pointer_cast<LEDDevice>(device);
-            ledDevice->update();
-        }
-        
-        // If we add any other devices that need periodic updates
-        // we can handle them here as well:
-        // e.g. if (device->getType() == DeviceType::SOME_OTHER_TYPE) {
-        //     auto otherDevice = std::static_pointer_cast<OtherDeviceType>(device);
-        //     otherDevice->update();
-        // }
+        device->update();
     }
     
     _lastUpdate = now;
@@ -54,124 +43,128 @@ bool DeviceManager::addDevice(std::shared_ptr<DeviceBase> device) {
     
     // Check for duplicate names
     for (const auto& existingDevice : _devices) {
-        if (existingDevice->getName() == device->getName()) {
-            Serial.printf("Device with name '%s' already exists\n", device->getName().c_str());
+        if (strcmp(existingDevice->getName(), device->getName()) == 0) {
+            Serial.printf("Device with name '%s' already exists\n", device->getName());
             return false;
         }
     }
     
     _devices.push_back(device);
-    Serial.printf("Added device: %s (%s)\n", device->getName().c_str(), device->getTypeString().c_str());
+    Serial.printf("Added device: %s (%s)\n", device->getName(), device->getTypeString());
     return true;
 }
 
-bool DeviceManager::removeDevice(const String& name) {
+bool DeviceManager::removeDevice(const char* name) {
     auto it = std::find_if(_devices.begin(), _devices.end(),
-        [&name](const std::shared_ptr<DeviceBase>& device) {
-            return device->getName() == name;
+        [name](const std::shared_ptr<DeviceBase>& device) {
+            return strcmp(device->getName(), name) == 0;
         });
     
     if (it != _devices.end()) {
-        Serial.printf("Removed device: %s\n", (*it)->getName().c_str());
+        Serial.printf("Removed device: %s\n", (*it)->getName());
         _devices.erase(it);
         return true;
     }
     
-    Serial.printf("Device not found: %s\n", name.c_str());
+    Serial.printf("Device not found: %s\n", name);
     return false;
 }
 
-std::shared_ptr<DeviceBase> DeviceManager::getDevice(const String& name) {
+std::shared_ptr<DeviceBase> DeviceManager::getDevice(const char* name) {
     for (auto& device : _devices) {
-        if (device->getName() == name) {
+        if (strcmp(device->getName(), name) == 0) {
             return device;
         }
     }
     return nullptr;
 }
 
-bool DeviceManager::handleCommand(const String& deviceName, const DynamicJsonDocument& command) {
+DeviceBase* DeviceManager::findDevice(const char* name) {
+    for (auto& device : _devices) {
+        if (strcmp(device->getName(), name) == 0) {
+            return device.get();
+        }
+    }
+    return nullptr;
+}
+
+bool DeviceManager::handleCommand(const char* deviceName, JsonVariantConst command) {
     auto device = getDevice(deviceName);
     if (!device) {
-        Serial.printf("Device not found: %s\n", deviceName.c_str());
+        Serial.printf("Device not found: %s\n", deviceName);
         return false;
     }
     
     if (!device->isReady()) {
-        Serial.printf("Device not ready: %s\n", deviceName.c_str());
+        Serial.printf("Device not ready: %s\n", deviceName);
         return false;
     }
     
     return device->handleCommand(command);
 }
 
-bool DeviceManager::handleCommand(const String& topic, const String& payload) {
+bool DeviceManager::handleCommand(const char* topic, const uint8_t* payload, size_t length) {
     // Extract device name from topic
-    String deviceName = _extractDeviceNameFromTopic(topic);
-    if (deviceName.isEmpty()) {
-        Serial.printf("Could not extract device name from topic: %s\n", topic.c_str());
+    const char* deviceName = extractDeviceNameFromTopic(topic);
+    if (deviceName == nullptr || *deviceName == '\0') {
+        Serial.printf("Could not extract device name from topic: %s\n", topic);
         return false;
     }
     
     // Parse JSON payload
-    DynamicJsonDocument command(512);
-    DeserializationError error = deserializeJson(command, payload);
+    DeserializationError error = deserializeJson(_commandDoc, payload, length);
     if (error) {
         Serial.printf("Failed to parse command JSON: %s\n", error.c_str());
         return false;
     }
     
-    return handleCommand(deviceName, command);
+    return handleCommand(deviceName, _commandDoc.as<JsonVariantConst>());
 }
 
-DynamicJsonDocument DeviceManager::getStatusReport() {
-    DynamicJsonDocument doc(1024);
+void DeviceManager::getStatusReport(JsonObject report) {
+    report["device_count"] = _devices.size();
+    report["last_update"] = _lastUpdate;
+    report["timestamp"] = millis();
     
-    doc["device_count"] = _devices.size();
-    doc["last_update"] = _lastUpdate;
-    doc["timestamp"] = millis();
-    
-    JsonArray devicesArray = doc.createNestedArray("devices");
+    JsonArray devicesArray = report.createNestedArray("devices");
     for (auto& device : _devices) {
         JsonObject deviceInfo = devicesArray.createNestedObject();
         deviceInfo["name"] = device->getName();
         deviceInfo["type"] = device->getTypeString();
-        deviceInfo["status"] = (device->getStatus() == DeviceStatus::READY) ? "ready" :
-                              (device->getStatus() == DeviceStatus::ERROR) ? "error" :
-                              (device->getStatus() == DeviceStatus::BUSY) ? "busy" : "uninitialized";
+        deviceInfo["status"] = device->getStatusString();
     }
-    
-    return doc;
 }
 
-DynamicJsonDocument DeviceManager::getDeviceStatus(const String& name) {
+ArenaJsonDocument DeviceManager::getDeviceStatus(const char* name) {
     auto device = getDevice(name);
     if (device) {
         return device->getStatusAsJson();
     }
     
-    DynamicJsonDocument emptyDoc(128);
-    emptyDoc["error"] = "Device not found: " + name;
+    ArenaJsonDocument emptyDoc(128);
+    emptyDoc["error"] = String("Device not found: ") + name;
     return emptyDoc;
 }
 
-String DeviceManager::_extractDeviceNameFromTopic(const String& topic) {
+const char* DeviceManager::extractDeviceNameFromTopic(const char* topic) {
     // Expected format: liminal/commands/{device_id}/{device_name}
     // or: liminal/commands/{device_id}/{device_type}/{device_name}
+    // The returned pointer aliases the topic string, so no copy is made.
     
-    String commandsPrefix = String(MQTT_TOPIC_COMMANDS) + "/";
+    static const char commandsPrefix[] = MQTT_TOPIC_COMMANDS "/";
+    const size_t prefixLength = sizeof(commandsPrefix) - 1;
     
-    if (!topic.startsWith(commandsPrefix)) {
-        return "";
+    if (strncmp(topic, commandsPrefix, prefixLength) != 0) {
+        return nullptr;
     }
     
     // Remove the prefix to get the remaining path
-    String remaining = topic.substring(commandsPrefix.length());
+    const char* remaining = topic + prefixLength;
     
     // Split by '/' and take the last part as device name
-    int lastSlash = remaining.lastIndexOf('/');
-    if (lastSlash >= 0) {
-        return remaining.substring(lastSlash + 1);
+    const char* lastSlash = strrchr(remaining, '/');
+    if (lastSlash != nullptr) {
+        return lastSlash + 1;
     } else {
         // If no slash, the entire remaining string is the device name
         return remaining;
@@ -15,27 +15,30 @@ public:
     
     // Device management
     bool addDevice(std::shared_ptr<DeviceBase> device);
-    bool removeDevice(const String& name);
-    std::shared_ptr<DeviceBase> getDevice(const String& name);
+    bool removeDevice(const char* name);
+    std::shared_ptr<DeviceBase> getDevice(const char* name);
+    DeviceBase* findDevice(const char* name); // No reference counting, for hot paths
     
     // Command handling
-    bool handleCommand(const String& deviceName, const DynamicJsonDocument& command);
-    bool handleCommand(const String& topic, const String& payload); // Parse from MQTT topic/payload
+    bool handleCommand(const char* deviceName, JsonVariantConst command);
+    bool handleCommand(const char* topic, const uint8_t* payload, size_t length); // Parse from MQTT topic/payload
     
-    // Status reporting
-    DynamicJsonDocument getStatusReport();
-    DynamicJsonDocument getDeviceStatus(const String& name);
+    // Status reporting (written into the caller's document to avoid a heap copy)
+    void getStatusReport(JsonObject report);
+    ArenaJsonDocument getDeviceStatus(const char* name);
     size_t getDeviceCount() const { return _devices.size(); }
     
     // Iteration support
     std::vector<std::shared_ptr<DeviceBase>>::iterator devices_begin() { return _devices.begin(); }
     std::vector<std::shared_ptr<DeviceBase>>::iterator devices_end() { return _devices.end(); }
     
+    // Topic parsing shared with StaticDeviceRegistry; the result aliases the topic
+    static const char* extractDeviceNameFromTopic(const char* topic);
+    
 private:
     std::vector<std::shared_ptr<DeviceBase>> _devices;
     unsigned long _lastUpdate;
-    
-    String _extractDeviceNameFromTopic(const String& topic);
+    StaticJsonDocument<512> _commandDoc; // Reused for every incoming command
 };
 
 #endif // DEVICE_MANAGER_H
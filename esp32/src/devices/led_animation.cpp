@@ -0,0 +1,163 @@
+#include "led_animation.h"
+#include "../config/config.h"
+
+namespace {
+
+// Preset steps, with durations in thousandths of the period
+struct PresetStep {
+    uint8_t level;
+    uint16_t permille;
+    bool fade;
+};
+
+struct Preset {
+    const char* name;
+    uint32_t defaultPeriodMs; // 0 for the sample interval
+    const PresetStep* steps;
+    uint8_t count;
+};
+
+const PresetStep BREATHE_STEPS[] = {
+    {255, 500, true},
+    {0, 500, true}
+};
+
+// Double pulse once per sample interval
+const PresetStep HEARTBEAT_STEPS[] = {
+    {255, 80, false},
+    {0, 120, false},
+    {255, 80, false},
+    {0, 720, false}
+};
+
+const PresetStep ALARM_STEPS[] = {
+    {255, 500, false},
+    {0, 500, false}
+};
+
+const Preset PRESETS[] = {
+    {"breathe", 3000, BREATHE_STEPS, sizeof(BREATHE_STEPS) / sizeof(BREATHE_STEPS[0])},
+    {"heartbeat", 0, HEARTBEAT_STEPS, sizeof(HEARTBEAT_STEPS) / sizeof(HEARTBEAT_STEPS[0])},
+    {"alarm", 200, ALARM_STEPS, sizeof(ALARM_STEPS) / sizeof(ALARM_STEPS[0])}
+};
+
+}
+
+uint32_t LEDAnimation::_sampleIntervalMs = SENSOR_READ_INTERVAL_MS;
+
+LEDAnimation::LEDAnimation() : _count(0), _repeat(-1), _name("custom") {}
+
+bool LEDAnimation::compile(JsonVariantConst spec) {
+    clear();
+    
+    if (spec.is<const char*>()) {
+        return loadPreset(spec.as<const char*>());
+    }
+    
+    if (!spec.is<JsonObjectConst>()) {
+        return false;
+    }
+    
+    int repeat = spec["repeat"] | -1;
+    if (repeat == 0 || repeat < -1) {
+        return false;
+    }
+    
+    if (spec.containsKey("preset")) {
+        if (spec.containsKey("period_ms") && !spec["period_ms"].is<uint32_t>()) {
+            return false;
+        }
+        return loadPreset(spec["preset"] | "", spec["period_ms"] | 0, repeat);
+    }
+    
+    JsonArrayConst keyframes = spec["keyframes"];
+    if (keyframes.isNull() || keyframes.size() == 0) {
+        return false;
+    }
+    
+    for (JsonVariantConst keyframe : keyframes) {
+        bool added;
+        if (keyframe.is<JsonArrayConst>()) {
+            added = keyframe.size() == 2 && keyframe[0].is<uint8_t>() && keyframe[1].is<uint32_t>() &&
+                    _addKeyframe(keyframe[0], keyframe[1], true);
+        } else {
+            added = keyframe["level"].is<uint8_t>() && keyframe["ms"].is<uint32_t>() &&
+                    _addKeyframe(keyframe["level"], keyframe["ms"], keyframe["fade"] | true);
+        }
+        
+        if (!added) {
+            clear();
+            return false;
+        }
+    }
+    
+    // A pass must take time, or a repeating animation would spin
+    if (getPeriod() == 0) {
+        clear();
+        return false;
+    }
+    
+    _repeat = repeat;
+    return true;
+}
+
+bool LEDAnimation::loadPreset(const char* preset, uint32_t periodMs, int repeat) {
+    clear();
+    
+    for (const Preset& candidate : PRESETS) {
+        if (strcmp(candidate.name, preset) != 0) {
+            continue;
+        }
+        
+        uint32_t period = periodMs > 0 ? periodMs : candidate.defaultPeriodMs;
+        if (period == 0) {
+            period = _sampleIntervalMs;
+        }
+        // Clamped so period * permille cannot overflow
+        if (period > LED_ANIMATION_MAX_PERIOD_MS) {
+            period = LED_ANIMATION_MAX_PERIOD_MS;
+        }
+        for (uint8_t i = 0; i < candidate.count; i++) {
+            const PresetStep& step = candidate.steps[i];
+            _addKeyframe(step.level, period * step.permille / 1000, step.fade);
+        }
+        
+        // As for keyframes: a period too short to round to whole
+        // milliseconds would leave a pass that takes no time
+        if (getPeriod() == 0) {
+            clear();
+            return false;
+        }
+        _repeat = repeat;
+        _name = candidate.name;
+        return true;
+    }
+    
+    return false;
+}
+
+void LEDAnimation::clear() {
+    _count = 0;
+    _repeat = -1;
+    _name = "custom";
+}
+
+uint32_t LEDAnimation::getPeriod() const {
+    uint32_t period = 0;
+    for (uint8_t i = 0; i < _count; i++) {
+        period += _keyframes[i].durationMs;
+    }
+    return period;
+}
+
+bool LEDAnimation::_addKeyframe(uint8_t level, uint32_t durationMs, bool fade) {
+    if (_count >= LED_ANIMATION_MAX_KEYFRAMES) {
+        return false;
+    }
+    
+    LEDKeyframe& keyframe = _keyframes[_count++];
+    keyframe.level = level;
+    keyframe.durationMs = durationMs;
+    keyframe.fade = fade && durationMs > 0;
+    return true;
+}
@@ -0,0 +1,55 @@
+#ifndef LED_ANIMATION_H
+#define LED_ANIMATION_H
+
+#include <ArduinoJson.h>
+
+#define LED_ANIMATION_MAX_KEYFRAMES 16
+#define LED_ANIMATION_MAX_PERIOD_MS 3600000 // Preset periods are clamped to an hour
+
+// One step of an animation: reach a brightness, either by a hardware fade
+// over the keyframe's duration or by jumping to it and holding
+struct LEDKeyframe {
+    uint32_t durationMs;
+    uint8_t level; // 0-255
+    bool fade;
+};
+
+// A keyframe sequence compiled from a command into a fixed table, so playback
+// never parses JSON or allocates. Accepted forms:
+//
+//   "breathe"                                          preset, default period
+//   {"preset": "heartbeat", "period_ms": 1000, "repeat": -1}
+//   {"keyframes": [[255, 400], {"level": 0, "ms": 600, "fade": false}], "repeat": 3}
+//
+// A compact [level, ms] pair fades. repeat is the number of passes, -1 for forever.
+// "heartbeat" defaults to the live sample interval, set with setSampleInterval().
+class LEDAnimation {
+public:
+    LEDAnimation();
+    
+    // Returns false, leaving the animation empty, if the spec is malformed
+    bool compile(JsonVariantConst spec);
+    bool loadPreset(const char* preset, uint32_t periodMs = 0, int repeat = -1);
+    void clear();
+    
+    uint8_t size() const { return _count; }
+    const LEDKeyframe& operator[](uint8_t index) const { return _keyframes[index]; }
+    int getRepeat() const { return _repeat; }
+    uint32_t getPeriod() const;
+    const char* getName() const { return _name; } // Preset name, or "custom"
+    
+    // Called whenever the adaptive sampling rate changes
+    static void setSampleInterval(uint32_t intervalMs) { _sampleIntervalMs = intervalMs; }
+    
+private:
+    LEDKeyframe _keyframes[LED_ANIMATION_MAX_KEYFRAMES];
+    uint8_t _count;
+    int _repeat;
+    const char* _name;
+    
+    static uint32_t _sampleIntervalMs;
+    
+    bool _addKeyframe(uint8_t level, uint32_t durationMs, bool fade);
+};
+
+#endif // LED_ANIMATION_H
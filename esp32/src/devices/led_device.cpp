@@ -1,27 +1,97 @@
 #include "led_device.h"
 #include "../config/config.h"
 
-LEDDevice::LEDDevice(const String& name, uint8_t pin, bool activeLow)
+uint8_t LEDDevice::_nextChannel = 0;
+uint8_t LEDDevice::_blinkTimersInUse = 0;
+bool LEDDevice::_timerStarted = false;
+portMUX_TYPE LEDDevice::_allocLock = portMUX_INITIALIZER_UNLOCKED;
+
+LEDDevice::LEDDevice(const char* name, uint8_t pin, bool activeLow)
     : DeviceBase(name, DeviceType::LED), _pin(pin), _activeLow(activeLow),
-      _currentState(false), _brightness(255), _isBlinking(false),
-      _blinkOnTime(0), _blinkOffTime(0), _lastBlinkChange(0),
-      _blinkCycles(0), _remainingCycles(0), _blinkState(false) {
+      _currentState(false), _brightness(255), _channel(LEDC_CHANNEL_MAX),
+      _isBlinking(false), _blinkOnTime(0), _blinkOffTime(0), _blinkStarted(0),
+      _blinkCycles(0), _blinkTimer(LEDC_TIMER_MAX), _blinkEndTimer(nullptr),
+      _animationTimer(nullptr), _isAnimating(false), _animationStep(0),
+      _animationPassesLeft(0), _animationDeadline(0) {
     
-    _pwmCapable = _isPWMPin(pin);
+    vPortCPUInitializeMutex(&_lock);
+    _animationMutex = xSemaphoreCreateMutexStatic(&_animationMutexBuffer);
+}
+
+LEDDevice::~LEDDevice() {
+    if (_blinkEndTimer) {
+        esp_timer_stop(_blinkEndTimer);
+        esp_timer_delete(_blinkEndTimer);
+    }
+    if (_animationTimer) {
+        esp_timer_stop(_animationTimer);
+        esp_timer_delete(_animationTimer);
+    }
 }
 
 bool LEDDevice::begin() {
-    Serial.printf("Initializing LED '%s' on pin %d\n", _name.c_str(), _pin);
+    Serial.printf("Initializing LED '%s' on pin %d\n", _name, _pin);
+    
+    if (_nextChannel >= LEDC_CHANNEL_MAX) {
+        Serial.printf("No LEDC channel left for LED '%s'\n", _name);
+        _setStatus(DeviceStatus::ERROR);
+        return false;
+    }
     
-    pinMode(_pin, OUTPUT);
-    _writePin(false); // Start with LED off
+    // The steady timer and the fade service are shared by every LED
+    if (!_timerStarted) {
+        ledc_timer_config_t timerConfig = {};
+        timerConfig.speed_mode = SPEED_MODE;
+        timerConfig.duty_resolution = STEADY_RESOLUTION;
+        timerConfig.timer_num = STEADY_TIMER;
+        timerConfig.freq_hz = LED_PWM_FREQUENCY_HZ;
+        timerConfig.clk_cfg = LEDC_AUTO_CLK;
+        if (ledc_timer_config(&timerConfig) != ESP_OK || ledc_fade_func_install(0) != ESP_OK) {
+            Serial.println("Failed to configure LEDC timer");
+            _setStatus(DeviceStatus::ERROR);
+            return false;
+        }
+        _timerStarted = true;
+    }
+    
+    // Active-low LEDs are handled by inverting the channel output
+    ledc_channel_config_t channelConfig = {};
+    channelConfig.gpio_num = _pin;
+    channelConfig.speed_mode = SPEED_MODE;
+    channelConfig.channel = (ledc_channel_t)_nextChannel;
+    channelConfig.intr_type = LEDC_INTR_DISABLE;
+    channelConfig.timer_sel = STEADY_TIMER;
+    channelConfig.duty = 0; // Start with LED off
+    channelConfig.hpoint = 0;
+    channelConfig.flags.output_invert = _activeLow;
+    if (ledc_channel_config(&channelConfig) != ESP_OK) {
+        Serial.printf("Failed to configure LEDC channel for LED '%s' on pin %d\n", _name, _pin);
+        _setStatus(DeviceStatus::ERROR);
+        return false;
+    }
+    _channel = (ledc_channel_t)_nextChannel++;
+    
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = _onBlinkEnd;
+    timerArgs.arg = this;
+    timerArgs.dispatch_method = ESP_TIMER_TASK;
+    timerArgs.name = "led_blink";
+    esp_timer_create_args_t animationArgs = timerArgs;
+    animationArgs.callback = _onAnimationStep;
+    animationArgs.name = "led_anim";
+    if (esp_timer_create(&timerArgs, &_blinkEndTimer) != ESP_OK ||
+        esp_timer_create(&animationArgs, &_animationTimer) != ESP_OK) {
+        Serial.printf("Failed to create timers for LED '%s'\n", _name);
+        _setStatus(DeviceStatus::ERROR);
+        return false;
+    }
     
     _setStatus(DeviceStatus::READY);
-    Serial.printf("LED '%s' initialized successfully\n", _name.c_str());
+    Serial.printf("LED '%s' initialized successfully (LEDC channel %d)\n", _name, _channel);
     return true;
 }
 
-bool LEDDevice::handleCommand(const DynamicJsonDocument& command) {
+bool LEDDevice::handleCommand(JsonVariantConst command) {
     if (!isReady()) {
         Serial.println("LED device not ready for commands");
         return false;
@@ -31,21 +101,22 @@ bool LEDDevice::handleCommand(const DynamicJsonDocument& command) {
     _lastCommand = millis();
     
     bool success = false;
+    uint32_t fadeMs = command["fade_ms"] | 0;
     
     // Handle different command types
     if (command.containsKey("state")) {
         bool state = command["state"].as<bool>();
-        success = setState(state);
-        Serial.printf("LED '%s' state command: %s\n", _name.c_str(), state ? "ON" : "OFF");
+        success = setState(state, fadeMs);
+        Serial.printf("LED '%s' state command: %s\n", _name, state ? "ON" : "OFF");
     }
     else if (command.containsKey("toggle")) {
-        success = toggle();
-        Serial.printf("LED '%s' toggled to: %s\n", _name.c_str(), _currentState ? "ON" : "OFF");
+        success = toggle(fadeMs);
+        Serial.printf("LED '%s' toggled to: %s\n", _name, _currentState ? "ON" : "OFF");
     }
-    else if (command.containsKey("brightness") && _pwmCapable) {
+    else if (command.containsKey("brightness")) {
         uint8_t brightness = command["brightness"].as<uint8_t>();
-        success = setBrightness(brightness);
-        Serial.printf("LED '%s' brightness set to: %d\n", _name.c_str(), brightness);
+        success = setBrightness(brightness, fadeMs);
+        Serial.printf("LED '%s' brightness set to: %d\n", _name, brightness);
     }
     else if (command.containsKey("blink")) {
         JsonObjectConst blinkCmd = command["blink"];
@@ -54,15 +125,26 @@ bool LEDDevice::handleCommand(const DynamicJsonDocument& command) {
         int cycles = blinkCmd["cycles"] | -1;
         success = blink(onTime, offTime, cycles);
         Serial.printf("LED '%s' blink started: on=%lu, off=%lu, cycles=%d\n", 
-                     _name.c_str(), onTime, offTime, cycles);
+                     _name, onTime, offTime, cycles);
     }
     else if (command.containsKey("stop_blink")) {
         stopBlink();
         success = true;
-        Serial.printf("LED '%s' blink stopped\n", _name.c_str());
+        Serial.printf("LED '%s' blink stopped\n", _name);
+    }
+    else if (command.containsKey("animation")) {
+        LEDAnimation animation;
+        success = animation.compile(command["animation"]) && playAnimation(animation);
+        Serial.printf("LED '%s' animation %s: %s, %u keyframes\n", _name,
+                     success ? "started" : "rejected", animation.getName(), (unsigned)animation.size());
+    }
+    else if (command.containsKey("stop_animation")) {
+        stopAnimation();
+        success = true;
+        Serial.printf("LED '%s' animation stopped\n", _name);
     }
     else {
-        Serial.printf("Unknown command for LED '%s'\n", _name.c_str());
+        Serial.printf("Unknown command for LED '%s'\n", _name);
         success = false;
     }
     
@@ -70,20 +152,33 @@ bool LEDDevice::handleCommand(const DynamicJsonDocument& command) {
     return success;
 }
 
-DynamicJsonDocument LEDDevice::getStatusAsJson() {
-    DynamicJsonDocument doc(512);
+bool LEDDevice::validateCommand(JsonVariantConst command) const {
+    // Mirrors the command selection in handleCommand(), with the same range
+    // checks, so a batch is refused up front rather than applied in part
+    if (command.containsKey("state") || command.containsKey("toggle") || command.containsKey("brightness")) {
+        return true;
+    }
+    if (command.containsKey("blink")) {
+        JsonObjectConst blinkCmd = command["blink"];
+        return _isValidBlink(blinkCmd["on_time"] | 500, blinkCmd["off_time"] | 500);
+    }
+    return command.containsKey("stop_blink") ||
+           (command.containsKey("animation") && LEDAnimation().compile(command["animation"])) ||
+           command.containsKey("stop_animation");
+}
+
+ArenaJsonDocument LEDDevice::getStatusAsJson() {
+    ArenaJsonDocument doc(512);
     
     doc["device_name"] = _name;
     doc["device_type"] = getTypeString();
     doc["pin"] = _pin;
+    doc["channel"] = (int)_channel;
     doc["state"] = _currentState;
     doc["brightness"] = _brightness;
-    doc["pwm_capable"] = _pwmCapable;
     doc["is_blinking"] = _isBlinking;
     doc["active_low"] = _activeLow;
-    doc["status"] = (_status == DeviceStatus::READY) ? "ready" : 
-                   (_status == DeviceStatus::BUSY) ? "busy" : 
-                   (_status == DeviceStatus::ERROR) ? "error" : "uninitialized";
+    doc["status"] = getStatusString();
     doc["last_command"] = _lastCommand;
     doc["timestamp"] = millis();
     
@@ -91,121 +186,248 @@ DynamicJsonDocument LEDDevice::getStatusAsJson() {
         JsonObject blinkInfo = doc.createNestedObject("blink_info");
         blinkInfo["on_time"] = _blinkOnTime;
         blinkInfo["off_time"] = _blinkOffTime;
-        blinkInfo["remaining_cycles"] = _remainingCycles;
+        blinkInfo["remaining_cycles"] = _remainingCycles();
+    }
+    
+    doc["is_animating"] = _isAnimating;
+    if (_isAnimating) {
+        JsonObject animationInfo = doc.createNestedObject("animation_info");
+        animationInfo["name"] = _animation.getName();
+        animationInfo["keyframes"] = _animation.size();
+        animationInfo["period_ms"] = _animation.getPeriod();
+        animationInfo["repeat"] = _animation.getRepeat();
     }
     
     return doc;
 }
 
-bool LEDDevice::setState(bool state) {
+bool LEDDevice::setState(bool state, uint32_t fadeMs) {
     stopBlink();
+    stopAnimation();
     _currentState = state;
-    _writePin(state);
-    return true;
+    return _applyLevel(fadeMs);
 }
 
-bool LEDDevice::toggle() {
-    return setState(!_currentState);
+bool LEDDevice::toggle(uint32_t fadeMs) {
+    return setState(!_currentState, fadeMs);
 }
 
-bool LEDDevice::setBrightness(uint8_t brightness) {
-    if (!_pwmCapable) {
-        Serial.printf("LED '%s' on pin %d does not support PWM brightness control\n", 
-                     _name.c_str(), _pin);
-        return false;
-    }
-    
+bool LEDDevice::setBrightness(uint8_t brightness, uint32_t fadeMs) {
     _brightness = brightness;
     
-    if (_currentState && !_isBlinking) {
-        // Apply brightness immediately if LED is on and not blinking
-        uint8_t pwmValue = _activeLow ? (255 - brightness) : brightness;
-        analogWrite(_pin, pwmValue);
+    // Takes effect immediately if the LED is on and not blinking or animating
+    if (_currentState && !_isBlinking && !_isAnimating) {
+        return _applyLevel(fadeMs);
     }
     
     return true;
 }
 
 bool LEDDevice::blink(unsigned long onTime, unsigned long offTime, int cycles) {
-    _isBlinking = true;
+    unsigned long period = onTime + offTime;
+    if (!_isValidBlink(onTime, offTime)) {
+        Serial.printf("LED '%s' blink period must be %u-%u ms with a non-zero on time\n",
+                     _name, BLINK_MIN_PERIOD_MS, BLINK_MAX_PERIOD_MS);
+        return false;
+    }
+    
+    stopBlink();
+    stopAnimation();
+    
+    ledc_timer_t timer = _claimBlinkTimer();
+    if (timer == LEDC_TIMER_MAX) {
+        Serial.printf("No LEDC timer free to blink LED '%s'\n", _name);
+        return false;
+    }
+    
+    // One timer period is one blink: the REF_TICK divider (8 fractional bits)
+    // sets the period, and the duty sets the on time
+    ledc_timer_config_t timerConfig = {};
+    timerConfig.speed_mode = SPEED_MODE;
+    timerConfig.duty_resolution = (ledc_timer_bit_t)BLINK_RESOLUTION_BITS;
+    timerConfig.timer_num = timer;
+    timerConfig.freq_hz = 1;
+    timerConfig.clk_cfg = LEDC_USE_REF_TICK;
+    uint32_t divider = (uint32_t)((uint64_t)period * 1000 * 256 / (1u << BLINK_RESOLUTION_BITS));
+    uint32_t duty = (uint32_t)((uint64_t)onTime * (1u << BLINK_RESOLUTION_BITS) / period);
+    
+    if (ledc_timer_config(&timerConfig) != ESP_OK ||
+        ledc_timer_set(SPEED_MODE, timer, divider, BLINK_RESOLUTION_BITS, LEDC_REF_TICK) != ESP_OK) {
+        Serial.printf("Failed to configure blink timer for LED '%s'\n", _name);
+        _releaseBlinkTimer(timer);
+        return false;
+    }
+    
+    // Restarting the counter makes the first phase a full "on" period
+    ledc_fade_stop(SPEED_MODE, _channel);
+    ledc_bind_channel_timer(SPEED_MODE, _channel, timer);
+    ledc_set_duty(SPEED_MODE, _channel, duty);
+    ledc_update_duty(SPEED_MODE, _channel);
+    ledc_timer_rst(SPEED_MODE, timer);
+    
+    _blinkTimer = timer;
     _blinkOnTime = onTime;
     _blinkOffTime = offTime;
     _blinkCycles = cycles;
-    _remainingCycles = cycles;
-    _lastBlinkChange = millis();
-    _blinkState = true; // Start with LED on
+    _blinkStarted = millis();
+    _isBlinking = true;
+    
+    // A finite blink ends after its last off phase
+    if (cycles > 0) {
+        esp_timer_start_once(_blinkEndTimer, (uint64_t)cycles * period * 1000);
+    }
     
-    _writePin(true);
     return true;
 }
 
 void LEDDevice::stopBlink() {
-    if (_isBlinking) {
-        _isBlinking = false;
-        _writePin(_currentState);
+    // The end-of-blink timer may race a command; only one of them tears down
+    portENTER_CRITICAL(&_lock);
+    bool wasBlinking = _isBlinking;
+    _isBlinking = false;
+    portEXIT_CRITICAL(&_lock);
+    
+    if (!wasBlinking) {
+        return;
     }
+    
+    esp_timer_stop(_blinkEndTimer);
+    ledc_bind_channel_timer(SPEED_MODE, _channel, STEADY_TIMER);
+    _applyLevel(0);
+    _releaseBlinkTimer(_blinkTimer);
+    _blinkTimer = LEDC_TIMER_MAX;
 }
 
-void LEDDevice::update() {
-    if (_isBlinking) {
-        _updateBlink();
+bool LEDDevice::playAnimation(const LEDAnimation& animation) {
+    if (_channel == LEDC_CHANNEL_MAX || animation.size() == 0) {
+        return false;
     }
+    
+    stopBlink();
+    stopAnimation();
+    
+    xSemaphoreTake(_animationMutex, portMAX_DELAY);
+    _animation = animation;
+    _animationStep = 0;
+    _animationPassesLeft = animation.getRepeat();
+    _animationDeadline = esp_timer_get_time();
+    _isAnimating = true;
+    _playKeyframe();
+    xSemaphoreGive(_animationMutex);
+    
+    return true;
 }
 
-void LEDDevice::_writePin(bool state) {
-    if (_pwmCapable && state && _brightness < 255) {
-        // Use PWM for brightness control
-        uint8_t pwmValue = _activeLow ? (255 - _brightness) : _brightness;
-        analogWrite(_pin, pwmValue);
-    } else {
-        // Digital on/off
-        bool pinState = _activeLow ? !state : state;
-        digitalWrite(_pin, pinState ? HIGH : LOW);
+void LEDDevice::stopAnimation() {
+    xSemaphoreTake(_animationMutex, portMAX_DELAY);
+    bool wasAnimating = _isAnimating;
+    _isAnimating = false;
+    esp_timer_stop(_animationTimer);
+    xSemaphoreGive(_animationMutex);
+    
+    if (wasAnimating) {
+        _applyLevel(0);
     }
 }
 
-bool LEDDevice::_isPWMPin(uint8_t pin) {
-    // ESP32 pins that support PWM (most GPIO pins do)
-    // Exclude pins that are typically used for other purposes
-    if (pin >= 0 && pin <= 33) {
-        // Exclude pins that are typically not available or have special functions
-        switch (pin) {
-            case 6: case 7: case 8: case 9: case 10: case 11: // Flash pins
-                return false;
-            default:
-                return true;
+void LEDDevice::_playKeyframe() {
+    // The last pass has ended: hand the LED back to its steady state
+    if (_animationStep >= _animation.size()) {
+        _isAnimating = false;
+        _applyLevel(0);
+        return;
+    }
+    
+    const LEDKeyframe& keyframe = _animation[_animationStep];
+    _writeLevel(keyframe.level, keyframe.fade ? keyframe.durationMs : 0);
+    
+    // Deadlines accumulate from the start, so late callbacks never add drift
+    _animationDeadline += (int64_t)keyframe.durationMs * 1000;
+    
+    if (++_animationStep >= _animation.size()) {
+        if (_animationPassesLeft > 0) {
+            _animationPassesLeft--;
+        }
+        if (_animationPassesLeft != 0) {
+            _animationStep = 0;
         }
     }
-    return false;
-}
-
-void LEDDevice::_updateBlink() {
-    unsigned long now = millis();
-    unsigned long elapsed = now - _lastBlinkChange;
-    
-    bool shouldChange = false;
-    if (_blinkState && elapsed >= _blinkOnTime) {
-        // Currently on, switch to off
-        shouldChange = true;
-        _blinkState = false;
-    } else if (!_blinkState && elapsed >= _blinkOffTime) {
-        // Currently off, switch to on
-        shouldChange = true;
-        _blinkState = true;
-        
-        // Decrement cycle count when completing a full cycle (off->on)
-        if (_remainingCycles > 0) {
-            _remainingCycles--;
+    
+    int64_t delay = _animationDeadline - esp_timer_get_time();
+    esp_timer_start_once(_animationTimer, delay > 0 ? (uint64_t)delay : 1);
+}
+
+void LEDDevice::_onAnimationStep(void* arg) {
+    LEDDevice* led = static_cast<LEDDevice*>(arg);
+    
+    xSemaphoreTake(led->_animationMutex, portMAX_DELAY);
+    if (led->_isAnimating) {
+        led->_playKeyframe();
+    }
+    xSemaphoreGive(led->_animationMutex);
+}
+
+bool LEDDevice::_applyLevel(uint32_t fadeMs) {
+    return _writeLevel(_currentState ? _brightness : 0, fadeMs);
+}
+
+bool LEDDevice::_writeLevel(uint8_t level, uint32_t fadeMs) {
+    if (_channel == LEDC_CHANNEL_MAX) {
+        return false;
+    }
+    
+    uint32_t duty = (uint32_t)level * STEADY_MAX_DUTY / 255;
+    
+    if (fadeMs > 0) {
+        if (ledc_set_fade_with_time(SPEED_MODE, _channel, duty, fadeMs) != ESP_OK) {
+            return false;
         }
+        return ledc_fade_start(SPEED_MODE, _channel, LEDC_FADE_NO_WAIT) == ESP_OK;
     }
     
-    if (shouldChange) {
-        _lastBlinkChange = now;
-        _writePin(_blinkState);
-        
-        // Check if we've completed all cycles
-        if (_remainingCycles == 0) {
-            stopBlink();
+    ledc_fade_stop(SPEED_MODE, _channel);
+    if (ledc_set_duty(SPEED_MODE, _channel, duty) != ESP_OK) {
+        return false;
+    }
+    return ledc_update_duty(SPEED_MODE, _channel) == ESP_OK;
+}
+
+bool LEDDevice::_isValidBlink(unsigned long onTime, unsigned long offTime) {
+    // Each term is bounded first so the sum can't wrap
+    return onTime > 0 && onTime <= BLINK_MAX_PERIOD_MS && offTime <= BLINK_MAX_PERIOD_MS &&
+           onTime + offTime >= BLINK_MIN_PERIOD_MS && onTime + offTime <= BLINK_MAX_PERIOD_MS;
+}
+
+int LEDDevice::_remainingCycles() const {
+    if (_blinkCycles < 0) {
+        return -1;
+    }
+    unsigned long completed = (millis() - _blinkStarted) / (_blinkOnTime + _blinkOffTime);
+    return completed >= (unsigned long)_blinkCycles ? 0 : _blinkCycles - (int)completed;
+}
+
+void LEDDevice::_onBlinkEnd(void* arg) {
+    static_cast<LEDDevice*>(arg)->stopBlink();
+}
+
+ledc_timer_t LEDDevice::_claimBlinkTimer() {
+    ledc_timer_t claimed = LEDC_TIMER_MAX;
+    portENTER_CRITICAL(&_allocLock);
+    for (int timer = STEADY_TIMER + 1; timer < LEDC_TIMER_MAX; timer++) {
+        if (!(_blinkTimersInUse & (1u << timer))) {
+            _blinkTimersInUse |= (1u << timer);
+            claimed = (ledc_timer_t)timer;
+            break;
         }
     }
+    portEXIT_CRITICAL(&_allocLock);
+    return claimed;
+}
+
+void LEDDevice::_releaseBlinkTimer(ledc_timer_t timer) {
+    if (timer < LEDC_TIMER_MAX) {
+        portENTER_CRITICAL(&_allocLock);
+        _blinkTimersInUse &= ~(1u << timer);
+        portEXIT_CRITICAL(&_allocLock);
+    }
 }
@@ -1,49 +1,101 @@
 #ifndef LED_DEVICE_H
 #define LED_DEVICE_H
 
+#include <driver/ledc.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include "device_base.h"
+#include "led_animation.h"
 
+// An LED driven by its own LEDC channel. Brightness changes can fade in
+// hardware, and blinking runs the channel from a low-frequency LEDC timer,
+// so no CPU work is done per blink edge. A finite blink is ended by a single
+// one-shot esp_timer. Keyframe animations chain hardware fades from an
+// esp_timer armed for each keyframe's absolute deadline, so loop load never
+// skews them and an idle LED costs nothing. At most 8 LEDs, and 3 blinking
+// at once.
 class LEDDevice : public DeviceBase {
 public:
-    LEDDevice(const String& name, uint8_t pin, bool activeLow = false);
+    LEDDevice(const char* name, uint8_t pin, bool activeLow = false);
+    ~LEDDevice();
     
     bool begin() override;
-    bool handleCommand(const DynamicJsonDocument& command) override;
-    DynamicJsonDocument getStatusAsJson() override;
+    bool handleCommand(JsonVariantConst command) override;
+    bool validateCommand(JsonVariantConst command) const override;
+    ArenaJsonDocument getStatusAsJson() override;
     
-    // LED-specific methods
-    bool setState(bool state);
+    // LED-specific methods; fadeMs > 0 ramps to the new level in hardware
+    bool setState(bool state, uint32_t fadeMs = 0);
     bool getState() const { return _currentState; }
-    bool toggle();
+    bool toggle(uint32_t fadeMs = 0);
     
-    bool setBrightness(uint8_t brightness); // 0-255, requires PWM pin
+    bool setBrightness(uint8_t brightness, uint32_t fadeMs = 0); // 0-255
     uint8_t getBrightness() const { return _brightness; }
     
+    // Blinks run at full brightness; periods from 16 ms to 16 s
     bool blink(unsigned long onTime, unsigned long offTime, int cycles = -1);
     void stopBlink();
     bool isBlinking() const { return _isBlinking; }
     
-    void update();
+    // Replaces any blink or running animation; levels are absolute brightness
+    bool playAnimation(const LEDAnimation& animation);
+    void stopAnimation();
+    bool isAnimating() const { return _isAnimating; }
     
 private:
     uint8_t _pin;
     bool _activeLow;
     bool _currentState;
     uint8_t _brightness;
-    bool _pwmCapable;
+    ledc_channel_t _channel;
     
     // Blinking state
-    bool _isBlinking;
+    volatile bool _isBlinking;
     unsigned long _blinkOnTime;
     unsigned long _blinkOffTime;
-    unsigned long _lastBlinkChange;
+    unsigned long _blinkStarted;
     int _blinkCycles;
-    int _remainingCycles;
-    bool _blinkState;
+    ledc_timer_t _blinkTimer;
+    esp_timer_handle_t _blinkEndTimer;
+    portMUX_TYPE _lock;
     
-    void _writePin(bool state);
-    bool _isPWMPin(uint8_t pin);
-    void _updateBlink();
+    // Animation state; playback steps run on the esp_timer task under the mutex
+    LEDAnimation _animation;
+    esp_timer_handle_t _animationTimer;
+    SemaphoreHandle_t _animationMutex;
+    StaticSemaphore_t _animationMutexBuffer;
+    volatile bool _isAnimating;
+    uint8_t _animationStep;
+    int _animationPassesLeft; // -1 for forever
+    int64_t _animationDeadline; // esp_timer time at which the current keyframe ends
+    
+    bool _applyLevel(uint32_t fadeMs);
+    bool _writeLevel(uint8_t level, uint32_t fadeMs);
+    void _playKeyframe();
+    int _remainingCycles() const;
+    static bool _isValidBlink(unsigned long onTime, unsigned long offTime);
+    
+    static void _onBlinkEnd(void* arg);
+    static void _onAnimationStep(void* arg);
+    
+    // Channel and timer allocation, shared by every LED
+    static uint8_t _nextChannel;
+    static uint8_t _blinkTimersInUse; // Bit per timer; timer 0 is the steady timer
+    static bool _timerStarted;
+    static portMUX_TYPE _allocLock; // Blink timers are released from the esp_timer task
+    static ledc_timer_t _claimBlinkTimer();
+    static void _releaseBlinkTimer(ledc_timer_t timer);
+    
+    static const ledc_mode_t SPEED_MODE = LEDC_LOW_SPEED_MODE;
+    static const ledc_timer_t STEADY_TIMER = LEDC_TIMER_0;
+    static const ledc_timer_bit_t STEADY_RESOLUTION = LEDC_TIMER_13_BIT;
+    static const uint32_t STEADY_MAX_DUTY = (1u << 13) - 1;
+    
+    // Blink timers count the 1 MHz REF_TICK; 14 bits gives periods of 16 ms to 16.7 s
+    static const uint32_t BLINK_RESOLUTION_BITS = 14;
+    static const uint32_t BLINK_MIN_PERIOD_MS = 17;
+    static const uint32_t BLINK_MAX_PERIOD_MS = 16000;
 };
 
 #endif // LED_DEVICE_H
@@ -0,0 +1,166 @@
+#ifndef STATIC_DEVICE_REGISTRY_H
+#define STATIC_DEVICE_REGISTRY_H
+
+#include <tuple>
+#include <type_traits>
+#include "device_base.h"
+#include "device_manager.h"
+
+// Detects an override of DeviceBase::update() so only devices with software
+// timers are polled from the loop.
+template <typename T>
+class DeviceHasUpdate {
+public:
+    static const bool value = !std::is_same<decltype(&T::update), void (DeviceBase::*)()>::value;
+};
+
+// Compile-time alternative to DeviceManager. Devices are statically
+// allocated and held by reference; update and command dispatch unroll into
+// direct calls on each concrete device type.
+//
+//   LEDDevice statusLED("status_led", STATUS_LED_PIN);
+//   StaticDeviceRegistry<LEDDevice> deviceManager(statusLED);
+template <typename... Devices>
+class StaticDeviceRegistry {
+public:
+    explicit StaticDeviceRegistry(Devices&... devices) : _devices(devices...), _lastUpdate(0) {}
+    
+    bool begin() {
+        Serial.println("Initializing static device registry...");
+        bool allSuccess = _begin<0>();
+        Serial.printf("Static device registry initialized with %u devices\n", (unsigned)getDeviceCount());
+        return allSuccess;
+    }
+    
+    void update() {
+        _update<0>();
+        _lastUpdate = millis();
+    }
+    
+    DeviceBase* findDevice(const char* name) {
+        return _find<0>(name);
+    }
+    
+    bool handleCommand(const char* deviceName, JsonVariantConst command) {
+        int result = _dispatch<0>(deviceName, command);
+        if (result < 0) {
+            Serial.printf("Device not found: %s\n", deviceName);
+            return false;
+        }
+        return result == 1;
+    }
+    
+    bool handleCommand(const char* topic, const uint8_t* payload, size_t length) {
+        const char* deviceName = DeviceManager::extractDeviceNameFromTopic(topic);
+        if (deviceName == nullptr || *deviceName == '\0') {
+            Serial.printf("Could not extract device name from topic: %s\n", topic);
+            return false;
+        }
+        
+        DeserializationError error = deserializeJson(_commandDoc, payload, length);
+        if (error) {
+            Serial.printf("Failed to parse command JSON: %s\n", error.c_str());
+            return false;
+        }
+        
+        return handleCommand(deviceName, _commandDoc.as<JsonVariantConst>());
+    }
+    
+    // Visits every device; the visitor receives the concrete device type
+    template <typename Visitor>
+    void forEach(Visitor visitor) {
+        _forEach<0>(visitor);
+    }
+    
+    void getStatusReport(JsonObject report) {
+        report["device_count"] = getDeviceCount();
+        report["last_update"] = _lastUpdate;
+        report["timestamp"] = millis();
+        
+        JsonArray devicesArray = report.createNestedArray("devices");
+        forEach([&devicesArray](DeviceBase& device) {
+            JsonObject deviceInfo = devicesArray.createNestedObject();
+            deviceInfo["name"] = device.getName();
+            deviceInfo["type"] = device.getTypeString();
+            deviceInfo["status"] = device.getStatusString();
+        });
+    }
+    
+    static constexpr size_t getDeviceCount() { return sizeof...(Devices); }
+    
+private:
+    std::tuple<Devices&...> _devices;
+    unsigned long _lastUpdate;
+    StaticJsonDocument<512> _commandDoc;
+    
+    template <size_t I>
+    using DeviceAt = typename std::tuple_element<I, std::tuple<Devices...>>::type;
+    
+    template <size_t I>
+    typename std::enable_if<I == sizeof...(Devices), bool>::type _begin() { return true; }
+    
+    template <size_t I>
+    typename std::enable_if<I < sizeof...(Devices), bool>::type _begin() {
+        typedef DeviceAt<I> DeviceT;
+        DeviceT& device = std::get<I>(_devices);
+        bool success = device.DeviceT::begin();
+        if (!success) {
+            Serial.printf("Failed to initialize device: %s\n", device.getName());
+        }
+        return _begin<I + 1>() && success;
+    }
+    
+    template <size_t I>
+    typename std::enable_if<I == sizeof...(Devices)>::type _update() {}
+    
+    template <size_t I>
+    typename std::enable_if<I < sizeof...(Devices)>::type _update() {
+        typedef DeviceAt<I> DeviceT;
+        _updateDevice(std::get<I>(_devices), std::integral_constant<bool, DeviceHasUpdate<DeviceT>::value>());
+        _update<I + 1>();
+    }
+    
+    template <typename DeviceT>
+    static void _updateDevice(DeviceT& device, std::true_type) { device.DeviceT::update(); }
+    
+    template <typename DeviceT>
+    static void _updateDevice(DeviceT&, std::false_type) {}
+    
+    // Returns 1 on success, 0 on failure, -1 if no device has that name
+    template <size_t I>
+    typename std::enable_if<I == sizeof...(Devices), int>::type _dispatch(const char*, JsonVariantConst) { return -1; }
+    
+    template <size_t I>
+    typename std::enable_if<I < sizeof...(Devices), int>::type _dispatch(const char* deviceName, JsonVariantConst command) {
+        typedef DeviceAt<I> DeviceT;
+        DeviceT& device = std::get<I>(_devices);
+        if (strcmp(device.getName(), deviceName) != 0) {
+            return _dispatch<I + 1>(deviceName, command);
+        }
+        if (!device.isReady()) {
+            Serial.printf("Device not ready: %s\n", deviceName);
+            return 0;
+        }
+        return device.DeviceT::handleCommand(command) ? 1 : 0;
+    }
+    
+    template <size_t I>
+    typename std::enable_if<I == sizeof...(Devices), DeviceBase*>::type _find(const char*) { return nullptr; }
+    
+    template <size_t I>
+    typename std::enable_if<I < sizeof...(Devices), DeviceBase*>::type _find(const char* name) {
+        DeviceBase& device = std::get<I>(_devices);
+        return strcmp(device.getName(), name) == 0 ? &device : _find<I + 1>(name);
+    }
+    
+    template <size_t I, typename Visitor>
+    typename std::enable_if<I == sizeof...(Devices)>::type _forEach(Visitor&) {}
+    
+    template <size_t I, typename Visitor>
+    typename std::enable_if<I < sizeof...(Devices)>::type _forEach(Visitor& visitor) {
+        visitor(std::get<I>(_devices));
+        _forEach<I + 1>(visitor);
+    }
+};
+
+#endif // STATIC_DEVICE_REGISTRY_H
@@ -1,168 +1,764 @@
 #include <Wire.h>
-#include <Adafruit_MPU6050.h>
-#include <Adafruit_Sensor.h>
 #include <WiFi.h>
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
 
 #include <memory>
+#include <esp_timer.h>
+#include <esp_system.h>
 
 #include "config/config.h"
 #include "communication/wifi_manager.h"
 #include "communication/mqtt_client.h"
+#include "communication/status_reporter.h"
+#include "communication/telemetry_codec.h"
+#include "communication/sync_clock.h"
+#include "communication/udp_stream.h"
+#include "communication/latency_probe.h"
+#include "communication/json_writer.h"
 #include "sensors/sensor_manager.h"
+#include "sensors/static_sensor_registry.h"
 #include "sensors/imu_sensor.h"
+#include "sensors/bme280_sensor.h"
+#include "sensors/i2c_bus.h"
 #include "devices/device_manager.h"
+#include "devices/static_device_registry.h"
 #include "devices/led_device.h"
+#include "devices/command_batch.h"
 #include "utils/json_helper.h"
+#include "utils/json_arena.h"
+#include "utils/heap_monitor.h"
+#include "utils/boot_profile.h"
+#include "utils/rate_controller.h"
+#include "utils/runtime_config.h"
+#include "utils/trace_buffer.h"
+#include "utils/sample_history.h"
+#include "utils/trigger_capture.h"
 
 WiFiManager wifiManager;
 MQTTClient mqttClient;
+StatusReporter statusReporter(mqttClient);
+RateController rateController;
+SyncClock syncClock(mqttClient);
+LatencyProbe latencyProbe(mqttClient);
+UDPStream udpStream;
+
+#if USE_STATIC_REGISTRY
+// Sensor and device set fixed at compile time: no heap, direct dispatch
+IMUSensor mainIMU("main_imu");
+LEDDevice statusLED("status_led", STATUS_LED_PIN, false);
+#if BME280_ENABLED
+BME280Sensor environmentSensor("environment");
+StaticSensorRegistry<IMUSensor, BME280Sensor> sensorManager(mainIMU, environmentSensor);
+#else
+StaticSensorRegistry<IMUSensor> sensorManager(mainIMU);
+#endif
+StaticDeviceRegistry<LEDDevice> deviceManager(statusLED);
+#else
 SensorManager sensorManager;
 DeviceManager deviceManager;
+#endif
+
+CommandBatch commandBatch;
+StaticJsonDocument<256> ackDoc;
+StaticJsonDocument<1024> configDoc; // Incoming changes, then the published values
+StaticJsonDocument<1024> streamsDoc; // Room for UDP_STREAM_MAX streams
+uint32_t streamsGeneration = 0;     // Config generation the announcement reflects
+uint16_t streamSession = 0;         // Random per boot; in every batch header and the announcement
+
+#if JSON_FAST_FRAMES
+char frameBuffer[768]; // An IMU frame with magnetometer and sync fields is under 500 bytes
+bool fastFrames = true; // Cleared at boot if the writer and ArduinoJson disagree
+#endif
+
+#if TELEMETRY_BATCHING
+TelemetryCodec telemetryCodec;
+uint8_t batchBuffer[TelemetryDatagram::MAX_SIZE]; // Room for the UDP header in front of the batch
+#endif
 
 unsigned long lastSensorPublish = 0;
 unsigned long lastStatusReport = 0;
 
-void onMQTTMessage(const String& topic, const String& payload);
-void publishSensorData();
+// Sampling on the sync grid: every ticksPerSample-th tick, and the last one sampled
+uint32_t ticksPerSample = 1;
+// An armed trigger holds the IMUs at TRIGGER_SAMPLE_INTERVAL_MS, and the loop with them
+bool fullRateHeld = false;
+uint32_t lastSampleTick = 0;
+uint32_t lastSampleErrorUs = 0;
+
+// Next chunk of a trace dump going out over MQTT, or -1 when none is
+int16_t traceChunk = -1;
+
+// Chunk buffer shared by history transfers and triggered bursts
+#if HISTORY_ENABLED || TRIGGER_ENABLED
+HistoryChunkWriter chunkWriter;
+#endif
+#if HISTORY_ENABLED
+SampleHistory sampleHistory(chunkWriter);
+StaticJsonDocument<192> historyRequestDoc;
+#endif
+#if TRIGGER_ENABLED
+TriggerCapture triggerCapture(chunkWriter);
+StaticJsonDocument<384> triggerDoc;
+bool triggerEventSent = false; // The current burst's event has been queued
+#endif
+
+// Serial console line being typed
+char serialLine[16];
+uint8_t serialLineLength = 0;
+
+// Status document lives in static storage so reporting never touches the heap
+StaticJsonDocument<5120> statusDoc;
+
+void onMQTTMessage(const char* topic, const uint8_t* payload, unsigned int length);
+bool handleMessage(const char* topic, const uint8_t* payload, unsigned int length);
+void serviceTraceDump();
+void updateSensors();
+#if HISTORY_ENABLED
+void setupHistory();
+void handleHistoryRequest(const uint8_t* payload, unsigned int length);
+void serviceHistory();
+#endif
+#if TRIGGER_ENABLED
+void setupTrigger();
+void serviceTrigger();
+#endif
+void serviceSerial();
+void publishSensorData(bool due);
+bool publishSensorFrame(SensorBase& sensor, SensorCounters& counters);
+#if TELEMETRY_BATCHING
+void publishSensorBatch(SensorBase& sensor, uint8_t stream, TelemetryBatch& batch);
+#endif
+bool usesUDP(SensorBase& sensor, uint8_t stream);
 void publishStatusReport();
+void publishConfig();
+void publishStreams();
+void handleConfigSet(const uint8_t* payload, unsigned int length);
+void updateRates();
+void serviceMQTT();
+void setupI2C();
 void setupSensors();
 void setupDevices();
 
 void setup() {
   Serial.begin(SERIAL_BAUD_RATE);
   while (!Serial) delay(10);
-
+  HeapMonitor::begin();
+  JsonArena::begin();
+  
   Serial.println("=== Liminal ESP32 Firmware Starting ===");
   Serial.printf("Device ID: %s\n", DEVICE_ID);
   Serial.printf("Firmware Version: %s\n", FIRMWARE_VERSION);
   
-  // Test basic WiFi connection (bypass WiFiManager)
-  Serial.println("Testing basic WiFi connection...");
-  WiFi.mode(WIFI_STA);
-  delay(1000);
-  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-  
-  Serial.print("Connecting to WiFi");
-  int attempts = 0;
-  while (WiFi.status() != WL_CONNECTED && attempts < 120) { 
-    delay(500);
-    Serial.print(".");
-    attempts++;
-  }
-  
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.println();
-    Serial.println("WiFi connected!");
-    Serial.print("IP address: ");
-    Serial.println(WiFi.localIP());
-  } else {
-    Serial.println();
-    Serial.println("WiFi connection failed!");
-    Serial.printf("Status: %d\n", WiFi.status());
-  }
+  // Runtime parameters first: sensors, MQTT and the rate controller all read them
+  RuntimeConfig::begin();
+  syncClock.begin();
+  latencyProbe.begin();
   
-  // Initialise WiFi Manager after basic test
-  if (!wifiManager.begin()) {
-    Serial.println("Failed to initialize WiFi manager");
-  }
+  // Zero is left out so a receiver can use it for "no session yet"
+  do {
+    streamSession = esp_random() & 0xFFFF;
+  } while (streamSession == 0);
   
-  // Initialise MQTT
-  if (!mqttClient.begin()) {
-    Serial.println("Failed to initialize MQTT client");
-  }
-  mqttClient.setCallback(onMQTTMessage);
+  // Sensors first, so sampling starts before the network is up
+  setupI2C();
+  BootProfile::mark(BootPhase::I2C_READY);
   
-  // Setup sensors and devices
+  // Setup sensors and devices (the static registry is populated at compile time)
+#if !USE_STATIC_REGISTRY
   setupSensors();
   setupDevices();
+#endif
   
   // Initialise sensor and device managers
   if (!sensorManager.begin()) {
     Serial.println("Warning: Some sensors failed to initialize");
   }
+  BootProfile::mark(BootPhase::SENSORS_READY);
+#if HISTORY_ENABLED
+  setupHistory();
+#endif
+#if TRIGGER_ENABLED
+  setupTrigger();
+#endif
   
   if (!deviceManager.begin()) {
     Serial.println("Warning: Some devices failed to initialize");
   }
   
+  // WiFi connects in the background; the loop samples meanwhile
+  if (!wifiManager.begin()) {
+    Serial.println("Failed to initialize WiFi manager");
+  }
+  
+  // Initialise MQTT
+  if (!mqttClient.begin()) {
+    Serial.println("Failed to initialize MQTT client");
+  }
+  mqttClient.setCallback(onMQTTMessage);
+  
+#if JSON_FAST_FRAMES && JSON_FAST_FRAMES_CHECK > 0
+  // Last, so it doesn't hold up the first sample or the connection; no frame goes out before it
+  float mismatch;
+  if (!JsonWriter::checkNumbers(JSON_FAST_FRAMES_CHECK, mismatch)) {
+    fastFrames = false;
+    Serial.printf("JSON fast frames off: %.9g is written differently from ArduinoJson\n", mismatch);
+  }
+#endif
+  
   Serial.println("=== Setup Complete ===");
   Serial.println();
+  
+  HeapMonitor::markSteadyState();
 }
 
 void loop() {
-  // Handle WiFi connection (avoid rapid reconnection attempts)
-  static unsigned long lastWiFiAttempt = 0;
-  if (!wifiManager.isConnected()) {
-    if (millis() - lastWiFiAttempt > 30000) {
-      Serial.println("WiFi disconnected, attempting reconnection...");
-      wifiManager.connect();
-      lastWiFiAttempt = millis();
+  HeapMonitor::update();
+  
+  // On the sync grid the loop wakes at each grid instant and samples before anything else
+  bool synced = syncClock.isLocked();
+  if (synced) {
+    uint32_t tick = syncClock.waitForTick(serviceMQTT);
+    if (tick % ticksPerSample == 0) {
+      lastSampleTick = tick;
+      lastSampleErrorUs = syncClock.getErrorBound();
+      updateSensors();
     }
   }
   
+  // Drive the non-blocking WiFi connection (connection setup is allowed to allocate)
+  {
+    HEAP_SITE_EXEMPT("wifi.update");
+    wifiManager.update();
+  }
+  
+  // Collector lookup after (re)connecting or a config change may allocate too
+  {
+    HEAP_SITE_EXEMPT("udp.update");
+    udpStream.update(wifiManager.isConnected());
+  }
+  
   // Handle MQTT connection
   if (wifiManager.isConnected() && !mqttClient.isConnected()) {
-    mqttClient.connect();
+    HEAP_SITE_EXEMPT("mqtt.connect");
+    if (mqttClient.connect()) {
+      BootProfile::mark(BootPhase::MQTT_CONNECTED);
+      publishConfig();
+      publishStreams();
+      syncClock.onConnected();
+      latencyProbe.onConnected();
+    }
   }
   
   // Process MQTT messages
-  if (mqttClient.isConnected()) {
-    mqttClient.loop();
+  serviceMQTT();
+  syncClock.update();
+  latencyProbe.update();
+  serviceTraceDump();
+#if HISTORY_ENABLED
+  serviceHistory();
+#endif
+#if TRIGGER_ENABLED
+  serviceTrigger();
+#endif
+  serviceSerial();
+  
+  // Keep the stream announcement in step with the udp.* parameters
+  if (mqttClient.isConnected() && RuntimeConfig::getGeneration() != streamsGeneration) {
+    publishStreams();
   }
   
   // Update sensors and devices
-  sensorManager.update();
-  deviceManager.update();
+  if (!synced) {
+    updateSensors();
+  }
+  if (!BootProfile::has(BootPhase::FIRST_SAMPLE)) {
+    sensorManager.forEach([](SensorBase& sensor) {
+      if (sensor.getLastReadingTime() != 0) {
+        BootProfile::mark(BootPhase::FIRST_SAMPLE);
+      }
+    });
+  }
+  {
+    HEAP_SITE("devices.update");
+    deviceManager.update();
+  }
   
-  // Publish sensor data periodically
+  // Adapt sampling and publish rates to motion and link quality
+  updateRates();
+  
+  // Publish sensor data periodically; full batches go out straight away
   unsigned long now = millis();
-  if (now - lastSensorPublish >= SENSOR_READ_INTERVAL_MS) {
-    publishSensorData();
+  bool publishDue = now - lastSensorPublish >= rateController.getPublishInterval();
+  {
+    HEAP_SITE("publish.sensors");
+    publishSensorData(publishDue);
+  }
+  if (publishDue) {
     lastSensorPublish = now;
   }
   
-  // Publish status report periodically
-  if (now - lastStatusReport >= STATUS_REPORT_INTERVAL_MS) {
+  // Publish status changes periodically, and a full snapshot right after
+  // (re)connecting; a snapshot that failed waits for the next interval
+  if (now - lastStatusReport >= RuntimeConfig::getUInt(ConfigParam::STATUS_INTERVAL) ||
+      (mqttClient.isConnected() && statusReporter.isSnapshotDue())) {
+    HEAP_SITE("publish.status");
     publishStatusReport();
     lastStatusReport = now;
   }
   
-  delay(50); // Small delay to prevent excessive CPU usage
+  // Every per-pass document has gone; the next pass starts from an empty arena
+  JsonArena::reset();
+  
+  if (!synced) {
+    delay(fullRateHeld ? 1 : 50); // Small delay to prevent excessive CPU usage
+  }
+}
+
+void updateSensors() {
+  HEAP_SITE("sensors.update");
+  sensorManager.update();
+  
+#if HISTORY_ENABLED || TRIGGER_ENABLED
+  // Straight after the reads, so every sample is kept and checked, not just the published ones
+  uint8_t stream = 0;
+  sensorManager.forEach([&stream](SensorBase& sensor) {
+    uint8_t id = stream++;
+#if HISTORY_ENABLED
+    sampleHistory.capture(id, sensor);
+#endif
+#if TRIGGER_ENABLED
+    triggerCapture.capture(id, sensor);
+#endif
+    (void)id;
+  });
+#endif
+}
+
+void serviceMQTT() {
+  if (mqttClient.isConnected()) {
+    HEAP_SITE("mqtt.loop");
+    mqttClient.loop();
+  }
+}
+
+void onMQTTMessage(const char* topic, const uint8_t* payload, unsigned int length) {
+  // Sync exchanges and probes are timestamped on arrival, before anything slow such as logging
+  int64_t receivedUs = esp_timer_get_time();
+  if (syncClock.handleMessage(topic, payload, length, receivedUs) ||
+      latencyProbe.handleMessage(topic, payload, length, receivedUs)) {
+    return;
+  }
+  
+  TRACE_BEGIN(TraceEvent::COMMAND, length < 0xFFFF ? length : 0xFFFF);
+  bool handled = handleMessage(topic, payload, length);
+  TRACE_END(TraceEvent::COMMAND, handled);
 }
 
-void onMQTTMessage(const String& topic, const String& payload) {
-  Serial.printf("MQTT message received - Topic: %s, Payload: %s\n", topic.c_str(), payload.c_str());
+bool handleMessage(const char* topic, const uint8_t* payload, unsigned int length) {
+  // Topic and size only: payloads may be binary (MessagePack), and a long
+  // Serial.printf line allocates; MQTT_DEBUG_LOGGING echoes JSON payloads
+  Serial.print("MQTT message received - Topic: ");
+  Serial.print(topic);
+  Serial.printf(" (%u bytes)\n", length);
+  
+  // Batched commands are applied all-or-nothing with one acknowledgement
+  // Only the topic itself or with "/msgpack": "batchXYZ" is an ordinary device command
+  const char* suffix = strncmp(topic, MQTT_TOPIC_COMMAND_BATCH, sizeof(MQTT_TOPIC_COMMAND_BATCH) - 1) == 0
+      ? topic + sizeof(MQTT_TOPIC_COMMAND_BATCH) - 1 : nullptr;
+  if (suffix && (suffix[0] == '\0' || strcmp(suffix, "/msgpack") == 0)) {
+    CommandBatch::Encoding encoding = suffix[0] != '\0'
+        ? CommandBatch::Encoding::MSGPACK : CommandBatch::Encoding::JSON;
+    bool applied = commandBatch.execute(deviceManager, payload, length, encoding);
+    commandBatch.writeAck(ackDoc);
+    mqttClient.publishCommandAck(ackDoc);
+    return applied;
+  }
+  
+  // Runtime configuration; matched exactly, as these share the device command prefix
+  if (strcmp(topic, MQTT_TOPIC_CONFIG_GET) == 0) {
+    publishConfig();
+    return true;
+  }
+  if (strcmp(topic, MQTT_TOPIC_CONFIG_SET) == 0) {
+    handleConfigSet(payload, length);
+    return true;
+  }
+  
+  // Trace dump; the chunks go out from the loop as the bulk queue empties
+  if (strcmp(topic, MQTT_TOPIC_TRACE_GET) == 0) {
+    if (!TraceBuffer::beginDump()) {
+      return false;
+    }
+    traceChunk = 0;
+    return true;
+  }
+  
+#if HISTORY_ENABLED
+  if (strcmp(topic, MQTT_TOPIC_HISTORY_GET) == 0) {
+    handleHistoryRequest(payload, length);
+    return true;
+  }
+#endif
   
   // Handle device commands
-  if (topic.startsWith(String(MQTT_TOPIC_COMMANDS))) {
-    if (deviceManager.handleCommand(topic, payload)) {
+  if (strncmp(topic, MQTT_TOPIC_COMMANDS, sizeof(MQTT_TOPIC_COMMANDS) - 1) == 0) {
+    if (deviceManager.handleCommand(topic, payload, length)) {
       Serial.println("Device command executed successfully");
-    } else {
-      Serial.println("Failed to execute device command");
+      return true;
     }
+    Serial.println("Failed to execute device command");
+    return false;
   }
   
   // Handle system commands (future expansion)
-  // Could add commands like restart, status request, config updates, etc.
+  // Could add commands like restart, status request, etc.
+  return false;
+}
+
+void serviceTraceDump() {
+  if (traceChunk < 0) {
+    return;
+  }
+  
+  // A dump cut short by a lost connection is abandoned; ask again
+  if (!mqttClient.isConnected()) {
+    Serial.println("Trace dump abandoned: MQTT disconnected");
+    TraceBuffer::endDump();
+    traceChunk = -1;
+    return;
+  }
+  
+  // One chunk at a time, so the bulk queue always has room for it
+  if (!mqttClient.isQueueEmpty(PublishClass::BULK)) {
+    return;
+  }
+  size_t length;
+  const uint8_t* chunk = TraceBuffer::buildChunk(traceChunk, length);
+  if (mqttClient.publishTrace(chunk, length) && ++traceChunk >= TraceBuffer::getChunkCount()) {
+    TraceBuffer::endDump();
+    traceChunk = -1;
+  }
+}
+
+#if HISTORY_ENABLED
+void setupHistory() {
+  // Sensors that failed to start have no channel count yet and get no history
+  uint8_t stream = 0;
+  sensorManager.forEach([&stream](SensorBase& sensor) {
+    uint8_t id = stream++;
+    uint8_t layout;
+    uint8_t channels;
+    if (sensor.isReady() && sensor.getFixedSample(layout, channels)) {
+      sampleHistory.addStream(id, sensor.getName(), layout, channels);
+    }
+  });
+  
+  if (!sampleHistory.begin()) {
+    Serial.println("Warning: Some sample history could not be allocated");
+  }
+}
+
+void handleHistoryRequest(const uint8_t* payload, unsigned int length) {
+  // {"id": n, "sensor": "main_imu", "from_ms": a, "to_ms": b}, or "last_ms" for
+  // the most recent stretch; millis() times, as in the telemetry
+  JsonObject ack = ackDoc.to<JsonObject>();
+  ack["type"] = "history";
+  
+  DeserializationError error = deserializeJson(historyRequestDoc, payload, length);
+  if (error) {
+    ack["status"] = "rejected";
+    ack["error"] = error.c_str();
+    mqttClient.publishCommandAck(ackDoc);
+    return;
+  }
+  
+  JsonObjectConst request = historyRequestDoc.as<JsonObjectConst>();
+  uint16_t id = request["id"].as<uint16_t>();
+  uint32_t now = millis();
+  uint32_t fromMs = request["from_ms"].as<uint32_t>();
+  uint32_t toMs = request.containsKey("to_ms") ? request["to_ms"].as<uint32_t>() : now;
+  if (request.containsKey("last_ms")) {
+    fromMs = now - request["last_ms"].as<uint32_t>();
+    toMs = now;
+  }
+  
+  const char* reason = nullptr;
+  if (!sampleHistory.beginTransfer(id, request["sensor"] | (const char*)nullptr, fromMs, toMs, reason)) {
+    ack["id"] = id;
+    ack["status"] = "rejected";
+    ack["error"] = reason;
+    mqttClient.publishCommandAck(ackDoc);
+    return;
+  }
+  sampleHistory.writeTransfer(ack);
+  mqttClient.publishCommandAck(ackDoc);
+}
+
+void serviceHistory() {
+  if (!sampleHistory.isTransferring()) {
+    return;
+  }
+  
+  // A transfer cut short by a lost connection fails; the range can be asked for again
+  bool completed = false;
+  if (!mqttClient.isConnected()) {
+    Serial.println("History transfer abandoned: MQTT disconnected");
+  } else {
+    // One chunk at a time, like trace dumps, so the bulk queue always has room
+    if (!mqttClient.isQueueEmpty(PublishClass::BULK)) {
+      return;
+    }
+    size_t length;
+    const uint8_t* chunk = sampleHistory.buildChunk(length);
+    bool queued = mqttClient.publishHistory(chunk, length);
+    if (queued && !sampleHistory.isTransferComplete()) {
+      return;
+    }
+    completed = queued;
+  }
+  
+  sampleHistory.endTransfer(completed);
+  sampleHistory.writeTransfer(ackDoc.to<JsonObject>());
+  mqttClient.publishCommandAck(ackDoc);
 }
+#endif
 
-void publishSensorData() {
+#if TRIGGER_ENABLED
+void setupTrigger() {
+  // The first IMU that started
+  bool found = false;
+  uint8_t stream = 0;
+  sensorManager.forEach([&stream, &found](SensorBase& sensor) {
+    uint8_t id = stream++;
+    uint8_t layout;
+    uint8_t channels;
+    if (!found && sensor.isReady() && sensor.getFixedSample(layout, channels) && layout == TELEMETRY_LAYOUT_IMU) {
+      found = triggerCapture.begin(id, sensor.getName(), layout, channels);
+    }
+  });
+  
+  if (!found) {
+    Serial.println("Warning: No IMU for triggered capture");
+  }
+}
+
+void serviceTrigger() {
+  if (!triggerCapture.hasBurst()) {
+    return;
+  }
+  
+  // A burst outlasts a lost connection, and goes out again in full afterwards
   if (!mqttClient.isConnected()) {
+    triggerCapture.restartBurst();
+    triggerEventSent = false;
+    return;
+  }
+  
+  // The event first, so receivers know what the chunks that follow are
+  if (!triggerEventSent) {
+    triggerDoc.clear();
+    triggerCapture.writeEvent(triggerDoc.to<JsonObject>());
+    triggerEventSent = mqttClient.publishTriggerEvent(triggerDoc);
+    return;
+  }
+  
+  // Then one chunk at a time on the bulk queue, like history transfers
+  if (!mqttClient.isQueueEmpty(PublishClass::BULK)) {
     return;
   }
+  size_t length;
+  const uint8_t* chunk = triggerCapture.buildChunk(length);
+  if (!mqttClient.publishBurst(chunk, length)) {
+    triggerCapture.restartBurst();
+    return;
+  }
+  if (triggerCapture.isBurstComplete()) {
+    triggerCapture.endBurst();
+    triggerEventSent = false;
+  }
+}
+#endif
+
+void serviceSerial() {
+  // "trace" dumps the trace buffer to Serial
+  while (Serial.available() > 0) {
+    char c = Serial.read();
+    if (c != '\n' && c != '\r') {
+      if (serialLineLength < sizeof(serialLine) - 1) {
+        serialLine[serialLineLength++] = c;
+      }
+      continue;
+    }
+    serialLine[serialLineLength] = '\0';
+    if (strcmp(serialLine, "trace") == 0) {
+      TraceBuffer::dumpToSerial();
+    }
+    serialLineLength = 0;
+  }
+}
+
+void handleConfigSet(const uint8_t* payload, unsigned int length) {
+  JsonObject ack = ackDoc.to<JsonObject>();
+  ack["type"] = "config";
+  
+  DeserializationError error = deserializeJson(configDoc, payload, length);
+  if (error) {
+    ack["status"] = "rejected";
+    ack["error"] = error.c_str();
+  } else {
+    // {"id": n, "values": {...}} for a correlated ack, or just the values
+    JsonObjectConst values = configDoc.as<JsonObjectConst>();
+    if (values.containsKey("values")) {
+      ack["id"] = values["id"];
+      values = values["values"];
+    }
+    
+    if (values.isNull()) {
+      ack["status"] = "rejected";
+      ack["error"] = "expected an object";
+    } else {
+      RuntimeConfig::apply(values, ack);
+    }
+  }
+  ack["timestamp"] = millis();
+  mqttClient.publishCommandAck(ackDoc);
   
-  // Get all sensor data and publish individually
-  for (auto it = sensorManager.sensors_begin(); it != sensorManager.sensors_end(); ++it) {
-    auto& sensor = *it;
-    if (sensor->isReady()) {
-      DynamicJsonDocument data = sensor->getDataAsJson();
-      if (!mqttClient.publishSensorData(sensor->getTypeString(), data)) {
-        Serial.printf("Failed to publish data for sensor: %s\n", sensor->getName().c_str());
+  // Keep the retained copy current
+  if (ack["changed"].as<uint8_t>() > 0) {
+    publishConfig();
+  }
+}
+
+void publishSensorData(bool due) {
+  // Get all sensor data and publish individually; batches may not need MQTT
+  bool mqttConnected = mqttClient.isConnected();
+  uint8_t stream = 0;
+  sensorManager.forEach([due, mqttConnected, &stream](SensorBase& sensor) {
+    uint8_t id = stream++;
+#if TELEMETRY_BATCHING
+    TelemetryBatch* batch = sensor.getBatch();
+    if (batch) {
+      if (batch->count > 0 && (due || batch->isFull())) {
+        publishSensorBatch(sensor, id, *batch);
       }
+      return;
     }
+#else
+    (void)id;
+#endif
+    
+    // A sensor with nothing new since its last frame is skipped, so a slow
+    // sensor does not repeat the same reading on every publish interval
+    SensorCounters& counters = sensor.getCounters();
+    if (due && mqttConnected && sensor.isReady() && counters.samples != counters.lastPublished) {
+      // Samples taken since the last frame that this one leaves out
+      uint32_t fresh = counters.samples - counters.lastPublished;
+      if (fresh > 1) {
+        counters.suppressed += fresh - 1;
+      }
+      counters.lastPublished = counters.samples;
+      
+      if (publishSensorFrame(sensor, counters)) {
+        BootProfile::mark(BootPhase::FIRST_PUBLISH);
+      } else {
+        counters.publishFailures++;
+        Serial.printf("Failed to publish data for sensor: %s\n", sensor.getName());
+      }
+    }
+  });
+}
+
+bool publishSensorFrame(SensorBase& sensor, SensorCounters& counters) {
+  uint32_t seq = counters.frames++;
+  uint32_t sampleSeq = counters.samples - 1;
+  uint32_t publishMs = rateController.getPublishInterval();
+  bool synced = syncClock.isLocked();
+  // On the grid: the tick of the sample (the same instant on every node) and its error bound
+  uint32_t sampleMs = synced ? ticksPerSample * syncClock.getPeriodMs() : sensor.getUpdateInterval();
+  
+#if JSON_FAST_FRAMES
+  // Same bytes as the document below, without building it
+  JsonWriter out(frameBuffer, sizeof(frameBuffer));
+  if (fastFrames && sensor.writeFrame(out)) {
+    out.raw(",\"seq\":");
+    out.uinteger(seq);
+    out.raw(",\"sample_seq\":");
+    out.uinteger(sampleSeq);
+    out.raw(",\"publish_ms\":");
+    out.uinteger(publishMs);
+    out.raw(",\"sample_ms\":");
+    out.uinteger(sampleMs);
+    if (synced) {
+      out.raw(",\"sync_tick\":");
+      out.uinteger(lastSampleTick);
+      out.raw(",\"sync_error_us\":");
+      out.uinteger(lastSampleErrorUs);
+    }
+    out.raw('}');
+    if (out.overflowed()) {
+      Serial.printf("JSON frame for %s exceeds %u bytes\n", sensor.getName(), (unsigned)sizeof(frameBuffer));
+      return false;
+    }
+    return mqttClient.publishSensorData(sensor.getTypeString(), sensor.getName(), out.data(), out.length());
+  }
+#endif
+  
+  ArenaJsonDocument data = sensor.getDataAsJson();
+  data["seq"] = seq;
+  data["sample_seq"] = sampleSeq;
+  data["publish_ms"] = publishMs;
+  data["sample_ms"] = sampleMs;
+  if (synced) {
+    data["sync_tick"] = lastSampleTick;
+    data["sync_error_us"] = lastSampleErrorUs;
+  }
+  return mqttClient.publishSensorData(sensor.getTypeString(), sensor.getName(), data);
+}
+
+#if TELEMETRY_BATCHING
+void publishSensorBatch(SensorBase& sensor, uint8_t stream, TelemetryBatch& batch) {
+  // Without a link the batch keeps filling until there is one again
+  bool udp = usesUDP(sensor, stream);
+  if (udp ? !udpStream.isReady() : !mqttClient.isConnected()) {
+    return;
   }
+  
+  // The same framing on both transports, so the sequence runs across a switch between them
+  SensorCounters& counters = sensor.getCounters();
+  TelemetryDatagram header;
+  header.stream = stream;
+  header.session = streamSession;
+  header.sequence = counters.frames++;
+  header.writeHeader(batchBuffer);
+  
+  size_t length = telemetryCodec.encode(batch, batchBuffer + TelemetryDatagram::HEADER_SIZE,
+                                        sizeof(batchBuffer) - TelemetryDatagram::HEADER_SIZE,
+                                        true, TELEMETRY_BATCH_LZ);
+  length += TelemetryDatagram::HEADER_SIZE;
+  bool sent = length > TelemetryDatagram::HEADER_SIZE && (udp
+      ? udpStream.send(batchBuffer, length)
+      : mqttClient.publishSensorBatch(sensor.getTypeString(), sensor.getName(), batchBuffer, length));
+  if (sent) {
+    BootProfile::mark(BootPhase::FIRST_PUBLISH);
+  } else {
+    counters.publishFailures++;
+    Serial.printf("Failed to publish batch for sensor: %s\n", sensor.getName());
+  }
+  
+  // Telemetry favours fresh data: a batch that failed is not retried
+  batch.reset(batch.layout, batch.channels);
+}
+#endif
+
+bool usesUDP(SensorBase& sensor, uint8_t stream) {
+#if TELEMETRY_BATCHING
+  return sensor.getBatch() != nullptr && stream < UDP_STREAM_MAX &&
+         udpStream.isEnabled() && udpStream.isSelected(sensor.getName());
+#else
+  // Only batches go over UDP
+  return false;
+#endif
 }
 
 void publishStatusReport() {
@@ -171,7 +767,7 @@ void publishStatusReport() {
   }
   
   // Create comprehensive status report
-  DynamicJsonDocument statusDoc(2048);
+  statusDoc.clear();
   statusDoc["device_id"] = DEVICE_ID;
   statusDoc["firmware_version"] = FIRMWARE_VERSION;
   statusDoc["uptime"] = millis();
@@ -180,29 +776,182 @@ void publishStatusReport() {
   // WiFi status
   JsonObject wifi = statusDoc.createNestedObject("wifi");
   wifi["connected"] = wifiManager.isConnected();
-  wifi["ip"] = wifiManager.getLocalIP();
+  char ip[16];
+  wifiManager.getLocalIP(ip, sizeof(ip));
+  wifi["ip"] = ip;
   wifi["rssi"] = wifiManager.getSignalStrength();
   
   // MQTT status
   JsonObject mqtt = statusDoc.createNestedObject("mqtt");
   mqtt["connected"] = mqttClient.isConnected();
   mqtt["client_id"] = mqttClient.getClientId();
+  mqttClient.writeProtocolStatus(mqtt);
+  mqtt["snapshot_failures"] = statusReporter.getSnapshotFailures();
+  mqttClient.writeQueueStatus(mqtt.createNestedObject("queues"));
+  
+  // UDP telemetry transport
+  if (udpStream.isEnabled()) {
+    udpStream.writeStatus(statusDoc.createNestedObject("udp"));
+  }
   
-  // Memory status
+  // Memory status, including fragmentation and allocation telemetry
   JsonObject memory = statusDoc.createNestedObject("memory");
-  memory["free_heap"] = ESP.getFreeHeap();
-  memory["total_heap"] = ESP.getHeapSize();
+  HeapMonitor::writeStatus(memory);
+  JsonArena::writeStatus(memory.createNestedObject("json_arena"));
+  
+  // Adaptive sampling and publish rates
+  rateController.writeStatus(statusDoc.createNestedObject("rate"));
+  
+  // Cross-node sampling alignment
+  if (syncClock.isEnabled()) {
+    syncClock.writeStatus(statusDoc.createNestedObject("sync"));
+  }
+  
+  // Round trips through the broker
+  if (latencyProbe.isEnabled()) {
+    latencyProbe.writeStatus(statusDoc.createNestedObject("latency"));
+  }
+  
+  // Boot-phase timings and reset reason
+  BootProfile::writeStatus(statusDoc.createNestedObject("boot"));
+  
+  // I2C bus utilisation and error counters
+  JsonObject i2c = statusDoc.createNestedObject("i2c");
+  I2CBus0.writeStatus(i2c.createNestedObject("bus0"));
+  if (I2CBus1.isStarted()) {
+    I2CBus1.writeStatus(i2c.createNestedObject("bus1"));
+  }
+  
+  // Where each sensor's samples went, for loss accounting per stage
+  JsonObject streams = statusDoc.createNestedObject("streams");
+  sensorManager.forEach([&streams](SensorBase& sensor) {
+    sensor.writeCounters(streams.createNestedObject(sensor.getName()));
+  });
+  
+#if HISTORY_ENABLED
+  // History memory, depth and retrieval throughput
+  sampleHistory.writeStatus(statusDoc.createNestedObject("history"));
+#endif
+#if TRIGGER_ENABLED
+  triggerCapture.writeStatus(statusDoc.createNestedObject("trigger"));
+#endif
   
   // Sensor and device status
-  DynamicJsonDocument sensors = sensorManager.getStatusReport();
-  statusDoc["sensors"] = sensors;
+  sensorManager.getStatusReport(statusDoc.createNestedObject("sensors"));
+  deviceManager.getStatusReport(statusDoc.createNestedObject("devices"));
+  
+  // Sends a retained snapshot or only the fields that changed
+  statusReporter.report(statusDoc);
+}
+
+void publishConfig() {
+  if (!mqttClient.isConnected()) {
+    return;
+  }
+  configDoc.clear();
+  RuntimeConfig::writeValues(configDoc.to<JsonObject>());
+  mqttClient.publishConfig(configDoc);
+}
+
+void publishStreams() {
+  if (!mqttClient.isConnected()) {
+    return;
+  }
   
-  DynamicJsonDocument devices = deviceManager.getStatusReport();
-  statusDoc["devices"] = devices;
+  // Which transport and format each sensor's data uses; the id is the one in batch headers
+  streamsDoc.clear();
+  streamsDoc["device_id"] = DEVICE_ID;
+  streamsDoc["session"] = streamSession;
+  if (udpStream.isEnabled()) {
+    JsonObject collector = streamsDoc.createNestedObject("collector");
+    collector["host"] = RuntimeConfig::getString(ConfigParam::UDP_COLLECTOR);
+    collector["port"] = RuntimeConfig::getUInt(ConfigParam::UDP_PORT);
+  }
+  
+  JsonArray streams = streamsDoc.createNestedArray("streams");
+  uint8_t stream = 0;
+  sensorManager.forEach([&streams, &stream](SensorBase& sensor) {
+    uint8_t id = stream++;
+    JsonObject entry = streams.createNestedObject();
+    entry["id"] = id;
+    entry["name"] = sensor.getName();
+    entry["type"] = sensor.getTypeString();
+    entry["transport"] = usesUDP(sensor, id) ? "udp" : "mqtt";
+#if TELEMETRY_BATCHING
+    TelemetryBatch* batch = sensor.getBatch();
+    if (batch) {
+      entry["format"] = "batch";
+      entry["layout"] = batch->layout;
+      entry["channels"] = batch->channels;
+      return;
+    }
+#endif
+    entry["format"] = "json";
+  });
   
-  mqttClient.publishStatus(statusDoc);
+  if (mqttClient.publishStreams(streamsDoc)) {
+    streamsGeneration = RuntimeConfig::getGeneration();
+  }
 }
 
+void updateRates() {
+  float energy = 0.0f;
+  sensorManager.forEach([&energy](SensorBase& sensor) {
+    if (sensor.isReady() && sensor.getActivity() > energy) {
+      energy = sensor.getActivity();
+    }
+  });
+  rateController.updateMotion(energy);
+  
+  // Telemetry drops and send failures both mean the link can't keep up
+  PublishQueue::Stats telemetry = mqttClient.getQueueStats(PublishClass::TELEMETRY);
+  rateController.updateLink(wifiManager.isConnected(), wifiManager.getSignalStrength(),
+                            telemetry.dropped + telemetry.failed);
+  
+  // On the sync grid the interval rounds to whole ticks and the loop picks the
+  // ticks, so the sensors themselves read whenever they are updated
+  unsigned long interval = rateController.getSampleInterval();
+#if TRIGGER_ENABLED
+  fullRateHeld = triggerCapture.needsFullRate();
+  if (fullRateHeld) {
+    interval = TRIGGER_SAMPLE_INTERVAL_MS;
+  }
+#endif
+  unsigned long schedule = 0;
+  if (syncClock.isLocked()) {
+    uint32_t period = syncClock.getPeriodMs();
+    ticksPerSample = (interval + period / 2) / period;
+    if (ticksPerSample == 0) {
+      ticksPerSample = 1;
+    }
+    interval = period / 2;
+    schedule = ticksPerSample * period;
+  }
+  LEDAnimation::setSampleInterval(schedule > 0 ? schedule : interval);
+  
+  // Only motion sensors follow the adaptive sampling rate
+  sensorManager.forEach([interval, schedule](SensorBase& sensor) {
+    if (sensor.getType() == SensorType::IMU) {
+      sensor.setUpdateInterval(interval);
+      sensor.setScheduleInterval(schedule);
+    }
+  });
+}
+
+void setupI2C() {
+  // Both controllers are shared by every sensor on them, so they are started once here
+  if (!I2CBus0.begin(I2C_SDA_PIN, I2C_SCL_PIN)) {
+    Serial.println("Failed to start I2C0");
+  }
+  
+#if I2C1_SDA_PIN >= 0 && I2C1_SCL_PIN >= 0
+  if (!I2CBus1.begin(I2C1_SDA_PIN, I2C1_SCL_PIN)) {
+    Serial.println("Failed to start I2C1");
+  }
+#endif
+}
+
+#if !USE_STATIC_REGISTRY
 void setupSensors() {
   Serial.println("Setting up sensors...");
   
@@ -214,9 +963,21 @@ void setupSensors() {
     Serial.println("Failed to add IMU sensor to sensor manager");
   }
   
+  // Further IMUs: a second address, the second controller, or a TCA9548A channel
+  // e.g.: sensorManager.addSensor(std::make_shared<IMUSensor>("aux_imu", I2CBus0, MPU_ALT_ADDR));
+  //       sensorManager.addSensor(std::make_shared<IMUSensor>("arm_imu", I2CBus1, MPU6050_ADDR));
+  //       sensorManager.addSensor(std::make_shared<IMUSensor>("leg_imu", I2CBus0, MPU6050_ADDR, 2));
+  
+#if BME280_ENABLED
+  // Read split-phase, so its conversions don't hold up the IMU
+  if (!sensorManager.addSensor(std::make_shared<BME280Sensor>("environment"))) {
+    Serial.println("Failed to add environmental sensor to sensor manager");
+  }
+#endif
+  
   // Future sensors can be added here:
-  // e.g.: auto tempSensor = std::make_shared<TemperatureSensor>("temp_sensor");
-  // sensorManager.addSensor(tempSensor);
+  // e.g.: auto lightSensor = std::make_shared<LightSensor>("light_sensor");
+  // sensorManager.addSensor(lightSensor);
 }
 
 void setupDevices() {
@@ -233,4 +994,5 @@ void setupDevices() {
   // Future devices can be added here:
   // e.g.: auto relay = std::make_shared<RelayDevice>("main_relay", RELAY_PIN);
   // deviceManager.addDevice(relay);
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,262 @@
+#include "bme280_sensor.h"
+
+// osrs_t/osrs_p/osrs_h encoding: 1x = 1 up to 16x = 5
+static uint8_t oversamplingSetting(uint8_t factor) {
+    return factor >= 16 ? 5 : factor >= 8 ? 4 : factor >= 4 ? 3 : factor >= 2 ? 2 : 1;
+}
+
+BME280Sensor::BME280Sensor(const char* name, I2CBus& bus, uint8_t address, int8_t muxChannel)
+    : SensorBase(name, SensorType::ENVIRONMENT), _bus(bus), _chip(BME280Chip::UNKNOWN),
+      _oversampling(oversamplingSetting(BME280_OVERSAMPLING)), _conversionMs(0), _consecutiveFailures(0) {
+    // Fast mode; the chip also does 3.4 MHz, but the bus is shared with the IMUs
+    _device.address = address;
+    _device.frequency = 400000;
+    _device.muxChannel = muxChannel;
+    memset(&_calibration, 0, sizeof(_calibration));
+    memset(&_lastData, 0, sizeof(_lastData));
+    setUpdateInterval(BME280_READ_INTERVAL_MS);
+}
+
+bool BME280Sensor::begin() {
+    Serial.printf("Initializing environmental sensor %s (I2C%d, address 0x%02X, mux channel %d)...\n",
+                  _name, getBusId(), _device.address, _device.muxChannel);
+    
+    uint8_t chipId = 0;
+    if (!_bus.readRegisters(_device, REG_CHIP_ID, &chipId, 1)) {
+        Serial.println("No BME280 found at the expected I2C address");
+        _setStatus(SensorStatus::ERROR);
+        return false;
+    }
+    if (chipId == CHIP_ID_BME280) {
+        _chip = BME280Chip::BME280;
+    } else if (chipId == CHIP_ID_BMP280) {
+        _chip = BME280Chip::BMP280;
+    } else {
+        Serial.printf("Unknown chip id 0x%02X (expected 0x60 or 0x58)\n", chipId);
+        _setStatus(SensorStatus::ERROR);
+        return false;
+    }
+    
+    // Soft reset, then wait for the trimming parameters to be copied from NVM
+    _bus.writeRegister(_device, REG_RESET, 0xB6);
+    delay(2);
+    uint8_t status = STATUS_IM_UPDATE;
+    for (uint8_t i = 0; i < 10 && (status & STATUS_IM_UPDATE); i++) {
+        if (!_bus.readRegisters(_device, REG_STATUS, &status, 1)) {
+            status = STATUS_IM_UPDATE;
+        }
+        delay(1);
+    }
+    
+    if (!_readCalibration()) {
+        Serial.println("Failed to read BME280 calibration");
+        _setStatus(SensorStatus::ERROR);
+        return false;
+    }
+    
+    // Sleep mode with the IIR filter off, as recommended for forced-mode
+    // monitoring. ctrl_hum only takes effect with the next ctrl_meas write,
+    // which every conversion makes.
+    if ((_chip == BME280Chip::BME280 && !_bus.writeRegister(_device, REG_CTRL_HUM, _oversampling)) ||
+        !_bus.writeRegister(_device, REG_CONFIG, 0x00) ||
+        !_bus.writeRegister(_device, REG_CTRL_MEAS, 0x00)) {
+        Serial.println("Failed to configure BME280");
+        _setStatus(SensorStatus::ERROR);
+        return false;
+    }
+    
+    // Maximum measurement time from datasheet appendix B, in µs
+    uint32_t factor = 1 << (_oversampling - 1);
+    uint32_t measureUs = 1250 + 2300 * factor + (2300 * factor + 575);
+    if (_chip == BME280Chip::BME280) {
+        measureUs += 2300 * factor + 575;
+    }
+    _conversionMs = (measureUs + 999) / 1000;
+    
+    _setStatus(SensorStatus::READY);
+    Serial.printf("Detected %s at 0x%02X, %ux oversampling, %lu ms per conversion\n",
+                  getChipString(), _device.address, (unsigned)factor, _conversionMs);
+    return true;
+}
+
+bool BME280Sensor::readData() {
+    if (!isReady() || isConverting() || runConversion(millis()) == ConversionState::FAILED) {
+        return false;
+    }
+    
+    ConversionState state;
+    do {
+        delay(_conversionMs);
+        state = runConversion(millis());
+    } while (state == ConversionState::PENDING);
+    return state == ConversionState::DONE;
+}
+
+bool BME280Sensor::startConversion() {
+    if (!isReady()) {
+        return false;
+    }
+    
+    uint8_t ctrlMeas = (_oversampling << 5) | (_oversampling << 2) | MODE_FORCED;
+    if (!_bus.writeRegister(_device, REG_CTRL_MEAS, ctrlMeas)) {
+        return _fail();
+    }
+    return true;
+}
+
+ConversionState BME280Sensor::pollConversion() {
+    // Status, ctrl_meas and the data registers in one read: the chip drops back
+    // to sleep mode once the measurement is in the data registers
+    uint8_t block[STATUS_BLOCK_SIZE];
+    if (!_bus.readRegisters(_device, REG_STATUS, block, sizeof(block))) {
+        return _fail() ? ConversionState::PENDING : ConversionState::FAILED;
+    }
+    
+    if ((block[0] & STATUS_MEASURING) || (block[1] & 0x03) != 0) {
+        if (millis() - _conversionStart < CONVERSION_TIMEOUT_FACTOR * _conversionMs) {
+            return ConversionState::PENDING;
+        }
+        Serial.printf("BME280 %s conversion did not finish\n", _name);
+        _fail();
+        return ConversionState::FAILED;
+    }
+    
+    const uint8_t* data = block + 4;
+    int32_t rawPressure = ((uint32_t)data[0] << 12) | ((uint32_t)data[1] << 4) | (data[2] >> 4);
+    int32_t rawTemperature = ((uint32_t)data[3] << 12) | ((uint32_t)data[4] << 4) | (data[5] >> 4);
+    int32_t rawHumidity = ((uint32_t)data[6] << 8) | data[7];
+    
+    // 0x80000 is what a skipped measurement leaves behind
+    if (rawTemperature == 0x80000 || rawPressure == 0x80000) {
+        _fail();
+        return ConversionState::FAILED;
+    }
+    
+    int32_t tFine;
+    _lastData.temperature = _compensateTemperature(rawTemperature, tFine) / 100.0f;
+    _lastData.pressure = _compensatePressure(rawPressure, tFine) / 25600.0f; // Q24.8 Pa to hPa
+    if (_chip == BME280Chip::BME280) {
+        _lastData.humidity = _compensateHumidity(rawHumidity, tFine) / 1024.0f;
+    }
+    
+    _consecutiveFailures = 0;
+    return ConversionState::DONE;
+}
+
+ArenaJsonDocument BME280Sensor::getDataAsJson() {
+    ArenaJsonDocument doc(384);
+    
+    doc["sensor_name"] = _name;
+    doc["sensor_type"] = getTypeString();
+    doc["chip"] = getChipString();
+    doc["timestamp"] = _lastReading;
+    doc["device_id"] = DEVICE_ID;
+    
+    doc["temperature"] = _lastData.temperature;
+    doc["temperature_unit"] = "°C";
+    doc["pressure"] = _lastData.pressure;
+    doc["pressure_unit"] = "hPa";
+    if (_chip == BME280Chip::BME280) {
+        doc["humidity"] = _lastData.humidity;
+        doc["humidity_unit"] = "%RH";
+    }
+    
+    return doc;
+}
+
+const char* BME280Sensor::getChipString() const {
+    switch (_chip) {
+        case BME280Chip::BME280: return "BME280";
+        case BME280Chip::BMP280: return "BMP280";
+        default: return "Unknown";
+    }
+}
+
+bool BME280Sensor::_readCalibration() {
+    uint8_t raw[CALIB_00_SIZE];
+    if (!_bus.readRegisters(_device, REG_CALIB_00, raw, sizeof(raw))) {
+        return false;
+    }
+    
+    // Little-endian words from 0x88
+    Calibration& c = _calibration;
+    c.T1 = raw[0] | (raw[1] << 8);
+    c.T2 = (int16_t)(raw[2] | (raw[3] << 8));
+    c.T3 = (int16_t)(raw[4] | (raw[5] << 8));
+    c.P1 = raw[6] | (raw[7] << 8);
+    c.P2 = (int16_t)(raw[8] | (raw[9] << 8));
+    c.P3 = (int16_t)(raw[10] | (raw[11] << 8));
+    c.P4 = (int16_t)(raw[12] | (raw[13] << 8));
+    c.P5 = (int16_t)(raw[14] | (raw[15] << 8));
+    c.P6 = (int16_t)(raw[16] | (raw[17] << 8));
+    c.P7 = (int16_t)(raw[18] | (raw[19] << 8));
+    c.P8 = (int16_t)(raw[20] | (raw[21] << 8));
+    c.P9 = (int16_t)(raw[22] | (raw[23] << 8));
+    c.H1 = raw[25];
+    
+    if (_chip != BME280Chip::BME280) {
+        return true;
+    }
+    
+    uint8_t hum[CALIB_26_SIZE];
+    if (!_bus.readRegisters(_device, REG_CALIB_26, hum, sizeof(hum))) {
+        return false;
+    }
+    
+    // H4 and H5 are 12-bit values sharing 0xE5
+    c.H2 = (int16_t)(hum[0] | (hum[1] << 8));
+    c.H3 = hum[2];
+    c.H4 = (int16_t)((int8_t)hum[3] * 16 | (hum[4] & 0x0F));
+    c.H5 = (int16_t)((int8_t)hum[5] * 16 | (hum[4] >> 4));
+    c.H6 = (int8_t)hum[6];
+    return true;
+}
+
+bool BME280Sensor::_fail() {
+    // Returns whether the sensor is still in service
+    if (++_consecutiveFailures >= MAX_CONSECUTIVE_FAILURES) {
+        Serial.printf("BME280 %s failed %u times in a row, marking as failed\n", _name, _consecutiveFailures);
+        _setStatus(SensorStatus::ERROR);
+        return false;
+    }
+    return true;
+}
+
+int32_t BME280Sensor::_compensateTemperature(int32_t raw, int32_t& tFine) const {
+    const Calibration& c = _calibration;
+    int32_t var1 = ((((raw >> 3) - ((int32_t)c.T1 << 1))) * (int32_t)c.T2) >> 11;
+    int32_t var2 = (((((raw >> 4) - (int32_t)c.T1) * ((raw >> 4) - (int32_t)c.T1)) >> 12) * (int32_t)c.T3) >> 14;
+    tFine = var1 + var2;
+    return (tFine * 5 + 128) >> 8; // 0.01 °C
+}
+
+uint32_t BME280Sensor::_compensatePressure(int32_t raw, int32_t tFine) const {
+    const Calibration& c = _calibration;
+    int64_t var1 = (int64_t)tFine - 128000;
+    int64_t var2 = var1 * var1 * (int64_t)c.P6;
+    var2 = var2 + ((var1 * (int64_t)c.P5) << 17);
+    var2 = var2 + ((int64_t)c.P4 << 35);
+    var1 = ((var1 * var1 * (int64_t)c.P3) >> 8) + ((var1 * (int64_t)c.P2) << 12);
+    var1 = ((((int64_t)1 << 47) + var1) * (int64_t)c.P1) >> 33;
+    if (var1 == 0) {
+        return 0; // Avoids a division by zero on blank trimming data
+    }
+    int64_t pressure = 1048576 - raw;
+    pressure = (((pressure << 31) - var2) * 3125) / var1;
+    var1 = ((int64_t)c.P9 * (pressure >> 13) * (pressure >> 13)) >> 25;
+    var2 = ((int64_t)c.P8 * pressure) >> 19;
+    pressure = ((pressure + var1 + var2) >> 8) + ((int64_t)c.P7 << 4);
+    return (uint32_t)pressure; // Pa in Q24.8
+}
+
+uint32_t BME280Sensor::_compensateHumidity(int32_t raw, int32_t tFine) const {
+    const Calibration& c = _calibration;
+    int32_t v = tFine - 76800;
+    v = (((((raw << 14) - ((int32_t)c.H4 << 20) - ((int32_t)c.H5 * v)) + 16384) >> 15) *
+         (((((((v * (int32_t)c.H6) >> 10) * (((v * (int32_t)c.H3) >> 11) + 32768)) >> 10) + 2097152) *
+           (int32_t)c.H2 + 8192) >> 14));
+    v = v - (((((v >> 15) * (v >> 15)) >> 7) * (int32_t)c.H1) >> 4);
+    v = v < 0 ? 0 : v;
+    v = v > 419430400 ? 419430400 : v;
+    return (uint32_t)(v >> 12); // %RH in Q22.10
+}
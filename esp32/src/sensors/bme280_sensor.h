@@ -0,0 +1,95 @@
+#ifndef BME280_SENSOR_H
+#define BME280_SENSOR_H
+
+#include "sensor_base.h"
+#include "i2c_bus.h"
+#include "../config/config.h"
+
+enum class BME280Chip {
+    UNKNOWN,
+    BMP280, // Temperature and pressure only
+    BME280
+};
+
+// Bosch BME280 in forced mode: each read triggers one measurement and the chip
+// sleeps in between. The conversion runs split-phase (see SensorBase), so the
+// loop and any IMU on the same bus carry on while it completes. A BMP280 at the
+// same address is read the same way, without humidity.
+class BME280Sensor : public SensorBase {
+public:
+    BME280Sensor(const char* name = "environment", I2CBus& bus = I2CBus0, uint8_t address = BME280_ADDR,
+                 int8_t muxChannel = -1);
+    
+    bool begin() override;
+    // Blocks for the conversion; the registries use the split-phase calls instead
+    bool readData() override;
+    ArenaJsonDocument getDataAsJson() override;
+    int8_t getBusId() const override { return _bus.getId(); }
+    
+    unsigned long getConversionTime() const override { return _conversionMs; }
+    bool startConversion() override;
+    ConversionState pollConversion() override;
+    
+    BME280Chip getChip() const { return _chip; }
+    const char* getChipString() const;
+    
+    struct EnvironmentData {
+        float temperature; // °C
+        float pressure;    // hPa
+        float humidity;    // %RH, BME280 only
+    };
+    
+    EnvironmentData getLastReading() const { return _lastData; }
+    
+private:
+    // Factory trimming parameters, named as in the datasheet
+    struct Calibration {
+        uint16_t T1;
+        int16_t T2, T3;
+        uint16_t P1;
+        int16_t P2, P3, P4, P5, P6, P7, P8, P9;
+        uint8_t H1, H3;
+        int16_t H2, H4, H5;
+        int8_t H6;
+    };
+    
+    I2CBus& _bus;
+    I2CDevice _device;
+    BME280Chip _chip;
+    Calibration _calibration;
+    EnvironmentData _lastData;
+    uint8_t _oversampling;       // osrs_x register value, the same for every channel
+    unsigned long _conversionMs; // Maximum measurement time at that oversampling
+    uint8_t _consecutiveFailures;
+    
+    bool _readCalibration();
+    bool _fail();
+    
+    // Bosch's integer compensation; tFine carries the temperature into the others
+    int32_t _compensateTemperature(int32_t raw, int32_t& tFine) const;
+    uint32_t _compensatePressure(int32_t raw, int32_t tFine) const;
+    uint32_t _compensateHumidity(int32_t raw, int32_t tFine) const;
+    
+    static const uint8_t MAX_CONSECUTIVE_FAILURES = 5;
+    // A conversion still running after this many conversion times has hung
+    static const uint8_t CONVERSION_TIMEOUT_FACTOR = 4;
+    
+    static const uint8_t REG_CALIB_00 = 0x88; // T1..P9, then H1 at 0xA1
+    static const uint8_t REG_CHIP_ID = 0xD0;
+    static const uint8_t REG_RESET = 0xE0;
+    static const uint8_t REG_CALIB_26 = 0xE1; // H2..H6
+    static const uint8_t REG_CTRL_HUM = 0xF2;
+    static const uint8_t REG_STATUS = 0xF3;   // Status, ctrl_meas, config, then the data block
+    static const uint8_t REG_CTRL_MEAS = 0xF4;
+    static const uint8_t REG_CONFIG = 0xF5;
+    static const uint8_t CALIB_00_SIZE = 26;
+    static const uint8_t CALIB_26_SIZE = 7;
+    static const uint8_t STATUS_BLOCK_SIZE = 12; // 0xF3..0xFE
+    static const uint8_t CHIP_ID_BME280 = 0x60;
+    static const uint8_t CHIP_ID_BMP280 = 0x58;
+    static const uint8_t STATUS_MEASURING = 0x08;
+    static const uint8_t STATUS_IM_UPDATE = 0x01;
+    static const uint8_t MODE_FORCED = 0x01;
+};
+
+#endif // BME280_SENSOR_H
@@ -0,0 +1,258 @@
+#include "i2c_bus.h"
+#include "../config/config.h"
+#include "../utils/trace_buffer.h"
+#include <esp_timer.h>
+
+I2CBus I2CBus0(Wire, 0);
+I2CBus I2CBus1(Wire1, 1);
+
+I2CBus::I2CBus(TwoWire& wire, uint8_t id)
+    : _wire(wire), _id(id), _sda(-1), _scl(-1), _clock(I2C_DEFAULT_CLOCK_HZ),
+      _muxChannel(MUX_UNKNOWN), _queue(nullptr), _task(nullptr),
+      _reportedBusyMicros(0), _reportedAt(0) {
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+bool I2CBus::begin(int sda, int scl) {
+    if (isStarted()) {
+        return true;
+    }
+    
+    _sda = sda;
+    _scl = scl;
+    
+    // A slave left mid-transfer by a reset can hold SDA low from power-up
+    if (_isStuck()) {
+        Serial.printf("I2C%d: SDA held low at startup, recovering\n", _id);
+        _recover();
+    } else if (!_wire.begin(_sda, _scl, _clock)) {
+        Serial.printf("I2C%d: failed to start on SDA=%d, SCL=%d\n", _id, _sda, _scl);
+        return false;
+    }
+    _wire.setTimeOut(I2C_TIMEOUT_MS);
+    
+    _queue = xQueueCreate(8, sizeof(Transaction*));
+    if (_queue == nullptr) {
+        Serial.printf("I2C%d: failed to create transaction queue\n", _id);
+        return false;
+    }
+    
+    char taskName[16];
+    snprintf(taskName, sizeof(taskName), "i2c%d_bus", _id);
+    if (xTaskCreatePinnedToCore(_serviceTask, taskName, 3072, this, 5, &_task, 1) != pdPASS) {
+        Serial.printf("I2C%d: failed to start service task\n", _id);
+        vQueueDelete(_queue);
+        _queue = nullptr;
+        return false;
+    }
+    
+    _reportedAt = esp_timer_get_time();
+    Serial.printf("I2C%d initialized on SDA=%d, SCL=%d\n", _id, _sda, _scl);
+    return true;
+}
+
+bool I2CBus::probe(const I2CDevice& device) {
+    Transaction transaction;
+    transaction.device = &device;
+    transaction.writeLength = 0;
+    transaction.readBuffer = nullptr;
+    transaction.readLength = 0;
+    return _submit(transaction);
+}
+
+bool I2CBus::write(const I2CDevice& device, const uint8_t* data, size_t length) {
+    if (length > I2C_BUS_MAX_DEVICE_WRITE) {
+        Serial.printf("I2C%d: write of %u bytes exceeds limit\n", _id, (unsigned)length);
+        return false;
+    }
+    
+    Transaction transaction;
+    transaction.device = &device;
+    memcpy(transaction.writeData, data, length);
+    transaction.writeLength = length;
+    transaction.readBuffer = nullptr;
+    transaction.readLength = 0;
+    return _submit(transaction);
+}
+
+bool I2CBus::writeRegister(const I2CDevice& device, uint8_t reg, uint8_t value) {
+    uint8_t data[2] = { reg, value };
+    return write(device, data, sizeof(data));
+}
+
+bool I2CBus::readRegisters(const I2CDevice& device, uint8_t reg, uint8_t* buffer, size_t length) {
+    Transaction transaction;
+    transaction.device = &device;
+    transaction.writeData[0] = reg;
+    transaction.writeLength = 1;
+    transaction.readBuffer = buffer;
+    transaction.readLength = length;
+    return _submit(transaction);
+}
+
+void I2CBus::writeStatus(JsonObject bus) {
+    // Utilisation covers the time since the previous status report
+    int64_t now = esp_timer_get_time();
+    uint64_t busy = _stats.busyMicros;
+    int64_t elapsed = now - _reportedAt;
+    float utilization = elapsed > 0 ? (float)(busy - _reportedBusyMicros) * 100.0f / elapsed : 0.0f;
+    _reportedBusyMicros = busy;
+    _reportedAt = now;
+    
+    bus["started"] = isStarted();
+    bus["transactions"] = _stats.transactions;
+    bus["failures"] = _stats.failures;
+    bus["errors"] = _stats.errors;
+    bus["retries"] = _stats.retries;
+    bus["recoveries"] = _stats.recoveries;
+    bus["queue_peak"] = _stats.queuePeak;
+    bus["utilization"] = round(utilization * 10.0f) / 10.0f;
+}
+
+bool I2CBus::_submit(Transaction& transaction) {
+    if (!isStarted()) {
+        Serial.printf("I2C%d: bus not started\n", _id);
+        return false;
+    }
+    
+    // Completion semaphore lives on the caller's stack, so the hot path never allocates
+    StaticSemaphore_t doneBuffer;
+    transaction.done = xSemaphoreCreateBinaryStatic(&doneBuffer);
+    transaction.success = false;
+    
+    Transaction* pointer = &transaction;
+    xQueueSend(_queue, &pointer, portMAX_DELAY);
+    
+    uint32_t waiting = uxQueueMessagesWaiting(_queue);
+    if (waiting > _stats.queuePeak) {
+        _stats.queuePeak = waiting;
+    }
+    
+    // The service task always completes within its retry budget
+    xSemaphoreTake(transaction.done, portMAX_DELAY);
+    return transaction.success;
+}
+
+void I2CBus::_process(Transaction& transaction) {
+    const I2CDevice& device = *transaction.device;
+    int64_t start = esp_timer_get_time();
+    int64_t deadline = start + (int64_t)I2C_TRANSACTION_BUDGET_MS * 1000;
+    TRACE_BEGIN(TraceEvent::I2C_TRANSACTION, (uint16_t)_id << 8 | device.address);
+    
+    for (;;) {
+        if (_prepare(device) &&
+            _execute(device.address, transaction.writeData, transaction.writeLength,
+                     transaction.readBuffer, transaction.readLength)) {
+            transaction.success = true;
+            break;
+        }
+        
+        _stats.errors++;
+        _muxChannel = MUX_UNKNOWN;
+        if (_isStuck()) {
+            _recover();
+        }
+        
+        if (esp_timer_get_time() >= deadline) {
+            _stats.failures++;
+            break;
+        }
+        _stats.retries++;
+    }
+    
+    TRACE_END(TraceEvent::I2C_TRANSACTION, transaction.success);
+    _stats.transactions++;
+    _stats.busyMicros += esp_timer_get_time() - start;
+}
+
+bool I2CBus::_prepare(const I2CDevice& device) {
+    if (device.frequency != _clock) {
+        _wire.setClock(device.frequency);
+        _clock = device.frequency;
+    }
+    
+    if (device.muxChannel < 0 || device.muxChannel == _muxChannel) {
+        return true;
+    }
+    
+    uint8_t mask = (uint8_t)(1 << device.muxChannel);
+    if (!_execute(I2C_MUX_ADDR, &mask, 1, nullptr, 0)) {
+        return false;
+    }
+    _muxChannel = device.muxChannel;
+    return true;
+}
+
+bool I2CBus::_execute(uint8_t address, const uint8_t* writeData, size_t writeLength,
+                      uint8_t* readBuffer, size_t readLength) {
+    _wire.beginTransmission(address);
+    if (writeLength > 0) {
+        _wire.write(writeData, writeLength);
+    }
+    
+    // Repeated start between the register write and the read
+    if (_wire.endTransmission(readLength == 0) != 0) {
+        return false;
+    }
+    if (readLength == 0) {
+        return true;
+    }
+    
+    size_t received = _wire.requestFrom((uint16_t)address, readLength, true);
+    if (received != readLength) {
+        while (_wire.available()) {
+            _wire.read();
+        }
+        return false;
+    }
+    
+    for (size_t i = 0; i < readLength; i++) {
+        readBuffer[i] = _wire.read();
+    }
+    return true;
+}
+
+bool I2CBus::_isStuck() {
+    return _sda >= 0 && digitalRead(_sda) == LOW;
+}
+
+void I2CBus::_recover() {
+    _wire.end();
+    
+    // Clock out whatever byte the slave thinks it is sending until it lets go of SDA
+    pinMode(_sda, INPUT_PULLUP);
+    pinMode(_scl, OUTPUT_OPEN_DRAIN);
+    digitalWrite(_scl, HIGH);
+    for (int i = 0; i < 9 && digitalRead(_sda) == LOW; i++) {
+        digitalWrite(_scl, LOW);
+        delayMicroseconds(5);
+        digitalWrite(_scl, HIGH);
+        delayMicroseconds(5);
+    }
+    
+    // STOP condition: SDA rises while SCL is high
+    pinMode(_sda, OUTPUT_OPEN_DRAIN);
+    digitalWrite(_sda, LOW);
+    delayMicroseconds(5);
+    digitalWrite(_scl, HIGH);
+    delayMicroseconds(5);
+    digitalWrite(_sda, HIGH);
+    delayMicroseconds(5);
+    
+    _wire.begin(_sda, _scl, _clock);
+    _wire.setTimeOut(I2C_TIMEOUT_MS);
+    _muxChannel = MUX_UNKNOWN;
+    _stats.recoveries++;
+}
+
+void I2CBus::_serviceTask(void* parameter) {
+    I2CBus* bus = static_cast<I2CBus*>(parameter);
+    
+    for (;;) {
+        Transaction* transaction;
+        if (xQueueReceive(bus->_queue, &transaction, portMAX_DELAY) == pdPASS) {
+            bus->_process(*transaction);
+            xSemaphoreGive(transaction->done);
+        }
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <Wire.h>
+#include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+#define I2C_BUS_MAX_DEVICE_WRITE 16
+
+// How a driver reaches its chip: address, bus clock and optional mux channel
+struct I2CDevice {
+    uint8_t address;
+    uint32_t frequency;  // 100 kHz, 400 kHz or 1 MHz depending on the chip
+    int8_t muxChannel;   // TCA9548A channel, -1 when directly attached
+};
+
+// Owns one I2C controller. Drivers submit transactions from any task; a service
+// task runs them one at a time, switching the bus clock and mux channel per
+// device, retrying failures within I2C_TRANSACTION_BUDGET_MS and toggling SCL to
+// free a slave that is holding SDA low.
+class I2CBus {
+public:
+    struct Stats {
+        uint32_t transactions;
+        uint32_t failures;     // Transactions that ran out of retry budget
+        uint32_t errors;       // Failed attempts, including ones later retried
+        uint32_t retries;
+        uint32_t recoveries;
+        uint32_t queuePeak;
+        uint64_t busyMicros;
+    };
+    
+    I2CBus(TwoWire& wire, uint8_t id);
+    
+    bool begin(int sda, int scl);
+    bool isStarted() const { return _queue != nullptr; }
+    uint8_t getId() const { return _id; }
+    
+    // Blocking; return false once retries are exhausted
+    bool probe(const I2CDevice& device);
+    bool write(const I2CDevice& device, const uint8_t* data, size_t length);
+    bool writeRegister(const I2CDevice& device, uint8_t reg, uint8_t value);
+    bool readRegisters(const I2CDevice& device, uint8_t reg, uint8_t* buffer, size_t length);
+    
+    Stats getStats() const { return _stats; }
+    void writeStatus(JsonObject bus);
+    
+private:
+    struct Transaction {
+        const I2CDevice* device;
+        uint8_t writeData[I2C_BUS_MAX_DEVICE_WRITE];
+        size_t writeLength;
+        uint8_t* readBuffer;
+        size_t readLength;
+        bool success;
+        SemaphoreHandle_t done;
+    };
+    
+    TwoWire& _wire;
+    uint8_t _id;
+    int _sda;
+    int _scl;
+    uint32_t _clock;
+    int8_t _muxChannel;  // Currently selected, or MUX_UNKNOWN after an error
+    
+    QueueHandle_t _queue;
+    TaskHandle_t _task;
+    
+    Stats _stats;
+    uint64_t _reportedBusyMicros;
+    int64_t _reportedAt;
+    
+    bool _submit(Transaction& transaction);
+    void _process(Transaction& transaction);
+    bool _prepare(const I2CDevice& device);
+    bool _execute(uint8_t address, const uint8_t* writeData, size_t writeLength,
+                  uint8_t* readBuffer, size_t readLength);
+    bool _isStuck();
+    void _recover();
+    
+    static void _serviceTask(void* parameter);
+    
+    static const int8_t MUX_UNKNOWN = -2;
+};
+
+extern I2CBus I2CBus0;
+extern I2CBus I2CBus1;
+
+#endif // I2C_BUS_H
@@ -0,0 +1,58 @@
+#ifndef IMU_FRAME_H
+#define IMU_FRAME_H
+
+#include "../communication/json_writer.h"
+
+// IMUSensor::getDataAsJson() written straight to text (JSON_FAST_FRAMES), up
+// to but not including the closing brace so the publisher can append its own
+// fields. Any change to one layout must be made to the other; the host
+// benchmark checks they match byte for byte (see esp32/tools/json_bench.cpp).
+// A template over the reading so the benchmark can pass a struct of its own.
+template <class TReading>
+void writeIMUFrame(JsonWriter& out, const char* name, const char* imuType, const char* deviceId,
+                   bool metricAccel, bool hasMagnetometer, const TReading& data) {
+    out.raw("{\"sensor_name\":");
+    out.string(name);
+    out.raw(",\"sensor_type\":\"imu\",\"imu_type\":");
+    out.string(imuType);
+    out.raw(",\"timestamp\":");
+    out.uinteger(data.timestamp);
+    out.raw(",\"device_id\":");
+    out.string(deviceId);
+    
+    out.raw(",\"accelerometer\":{\"x\":");
+    out.number(data.accelX);
+    out.raw(",\"y\":");
+    out.number(data.accelY);
+    out.raw(",\"z\":");
+    out.number(data.accelZ);
+    if (metricAccel) {
+        out.raw(",\"unit\":\"m/s²\"}");
+    } else {
+        out.raw(",\"unit\":\"g\"}");
+    }
+    
+    out.raw(",\"gyroscope\":{\"x\":");
+    out.number(data.gyroX);
+    out.raw(",\"y\":");
+    out.number(data.gyroY);
+    out.raw(",\"z\":");
+    out.number(data.gyroZ);
+    out.raw(",\"unit\":\"°/s\"}");
+    
+    if (hasMagnetometer) {
+        out.raw(",\"magnetometer\":{\"x\":");
+        out.number(data.magX);
+        out.raw(",\"y\":");
+        out.number(data.magY);
+        out.raw(",\"z\":");
+        out.number(data.magZ);
+        out.raw(",\"unit\":\"µT\"}");
+    }
+    
+    out.raw(",\"temperature\":");
+    out.number(data.temperature);
+    out.raw(",\"temperature_unit\":\"°C\"");
+}
+
+#endif // IMU_FRAME_H
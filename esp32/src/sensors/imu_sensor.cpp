@@ -1,35 +1,57 @@
 #include "imu_sensor.h"
 #include "../config/config.h"
+#include "../utils/nvs_cache.h"
+#include "../utils/runtime_config.h"
+#include "imu_frame.h"
 
-IMUSensor::IMUSensor(const String& name) 
-    : SensorBase(name, SensorType::IMU), _imuType(IMUType::UNKNOWN), _address(MPU6050_ADDR) {
+static const float STANDARD_GRAVITY = 9.80665f;
+
+IMUSensor::IMUSensor(const char* name, I2CBus& bus, uint8_t address, int8_t muxChannel) 
+    : SensorBase(name, SensorType::IMU), _bus(bus), _imuType(IMUType::UNKNOWN),
+      _readFailures(0), _consecutiveFailures(0), _hasMagnetometer(false),
+      _accelLsbPerG(4096.0f), _gyroLsbPerDps(65.5f), _motionEnergy(0.0f) {
+    // The MPU family is specified for 400 kHz fast mode on I2C
+    _device.address = address;
+    _device.frequency = 400000;
+    _device.muxChannel = muxChannel;
     memset(&_lastData, 0, sizeof(_lastData));
+    _magAdjust[0] = _magAdjust[1] = _magAdjust[2] = AK8963_UT_PER_LSB;
+    memset(_fixedSample, 0, sizeof(_fixedSample));
+    _batch.reset(TELEMETRY_LAYOUT_IMU, 0);
 }
 
 bool IMUSensor::begin() {
-    Serial.println("Initializing IMU sensor...");
-    
-    // Initialize I2C if not already done
-    Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
-    Serial.printf("I2C initialized on SDA=%d, SCL=%d\n", I2C_SDA_PIN, I2C_SCL_PIN);
-    
-    // Scan for I2C devices
-    Serial.println("Scanning for I2C devices...");
-    byte deviceCount = 0;
-    for (byte address = 1; address < 127; address++) {
-        Wire.beginTransmission(address);
-        if (Wire.endTransmission() == 0) {
-            Serial.printf("I2C device found at address 0x%02X\n", address);
-            deviceCount++;
-            if (address == 0x68) {
-                _address = address;
+    Serial.printf("Initializing IMU sensor %s (I2C%d, address 0x%02X, mux channel %d)...\n",
+                  _name, getBusId(), _device.address, _device.muxChannel);
+    
+    // Only the expected addresses are probed. With IMU_ADDRESS_AUTO the address
+    // found on the last boot is tried first, then 0x68 and 0x69.
+    char cacheKey[16];
+    snprintf(cacheKey, sizeof(cacheKey), "imu.%s", _name);
+    
+    bool found = false;
+    if (_device.address != IMU_ADDRESS_AUTO) {
+        found = _bus.probe(_device);
+    } else {
+        DetectionCache cached;
+        uint8_t candidates[3] = { MPU6050_ADDR, MPU6050_ADDR, MPU_ALT_ADDR };
+        if (NVSCache::load(cacheKey, &cached, sizeof(cached))) {
+            candidates[0] = cached.address;
+        }
+        for (uint8_t i = 0; i < 3 && !found; i++) {
+            if (i > 0 && candidates[i] == candidates[0]) {
+                continue;
             }
+            _device.address = candidates[i];
+            found = _bus.probe(_device);
+        }
+        if (!found) {
+            _device.address = IMU_ADDRESS_AUTO;
         }
     }
-    Serial.printf("Found %d I2C device(s)\n", deviceCount);
     
-    if (deviceCount == 0) {
-        Serial.println("No I2C devices found!");
+    if (!found) {
+        Serial.println("No IMU found at the expected I2C address");
         _setStatus(SensorStatus::ERROR);
         return false;
     }
@@ -42,25 +64,23 @@ bool IMUSensor::begin() {
         return false;
     }
     
-    Serial.println("Detected IMU: " + getIMUTypeString());
+    Serial.printf("Detected IMU: %s at 0x%02X\n", getIMUTypeString(), _device.address);
     
-    // Initialise based on detected type
-    bool success = false;
-    if (_imuType == IMUType::MPU6050) {
-        success = _initializeMPU6050();
-    } else if (_imuType == IMUType::MPU6500 || _imuType == IMUType::MPU9250) {
-        success = _initializeMPU6500();
-    }
+    DetectionCache detected;
+    detected.address = _device.address;
+    NVSCache::store(cacheKey, &detected, sizeof(detected));
     
-    if (success) {
+    if (_initialize()) {
+        // Accel, gyro and temperature, plus the magnetometer where there is one
+        _batch.reset(TELEMETRY_LAYOUT_IMU, _hasMagnetometer ? 10 : 7);
         _setStatus(SensorStatus::READY);
         Serial.println("IMU sensor initialized successfully!");
-    } else {
-        _setStatus(SensorStatus::ERROR);
-        Serial.println("Failed to initialize IMU sensor");
+        return true;
     }
     
-    return success;
+    _setStatus(SensorStatus::ERROR);
+    Serial.println("Failed to initialize IMU sensor");
+    return false;
 }
 
 bool IMUSensor::readData() {
@@ -70,26 +90,41 @@ bool IMUSensor::readData() {
     
     _setStatus(SensorStatus::READING);
     
-    bool success = false;
-    if (_imuType == IMUType::MPU6050) {
-        success = _readMPU6050();
-    } else if (_imuType == IMUType::MPU6500 || _imuType == IMUType::MPU9250) {
-        success = _readMPU6500();
-    }
-    
-    if (success) {
+    unsigned long previousTimestamp = _lastData.timestamp;
+    if (_readMotion()) {
         _lastData.timestamp = millis();
+        _updateMotionEnergy(previousTimestamp);
+        
+#if TELEMETRY_BATCHING
+        // batch.samples can change at any time; a lowered size makes the batch full at once
+        _batch.capacity = RuntimeConfig::getUInt(ConfigParam::BATCH_SAMPLES);
+        
+        // A batch that was never sent (e.g. while offline) gives way to fresh samples
+        if (!_batch.add(_lastData.timestamp, _fixedSample)) {
+            _counters.overflows += _batch.count;
+            _batch.reset(_batch.layout, _batch.channels);
+            _batch.add(_lastData.timestamp, _fixedSample);
+        }
+#endif
         _lastReading = _lastData.timestamp;
+        _consecutiveFailures = 0;
         _setStatus(SensorStatus::READY);
-    } else {
-        _setStatus(SensorStatus::ERROR);
+        return true;
     }
     
-    return success;
+    // Keep the previous sample; only give up on the sensor after repeated failures
+    _readFailures++;
+    if (++_consecutiveFailures >= MAX_CONSECUTIVE_FAILURES) {
+        Serial.printf("IMU %s failed %u reads in a row, marking as failed\n", _name, _consecutiveFailures);
+        _setStatus(SensorStatus::ERROR);
+    } else {
+        _setStatus(SensorStatus::READY);
+    }
+    return false;
 }
 
-DynamicJsonDocument IMUSensor::getDataAsJson() {
-    DynamicJsonDocument doc(512);
+ArenaJsonDocument IMUSensor::getDataAsJson() {
+    ArenaJsonDocument doc(640);
     
     doc["sensor_name"] = _name;
     doc["sensor_type"] = getTypeString();
@@ -109,13 +144,35 @@ DynamicJsonDocument IMUSensor::getDataAsJson() {
     gyro["z"] = _lastData.gyroZ;
     gyro["unit"] = "°/s";
     
+    if (_hasMagnetometer) {
+        JsonObject mag = doc.createNestedObject("magnetometer");
+        mag["x"] = _lastData.magX;
+        mag["y"] = _lastData.magY;
+        mag["z"] = _lastData.magZ;
+        mag["unit"] = "µT";
+    }
+    
     doc["temperature"] = _lastData.temperature;
     doc["temperature_unit"] = "°C";
     
     return doc;
 }
 
-String IMUSensor::getIMUTypeString() const {
+bool IMUSensor::writeFrame(JsonWriter& out) const {
+    writeIMUFrame(out, _name, getIMUTypeString(), DEVICE_ID, _imuType == IMUType::MPU6050, _hasMagnetometer,
+                  _lastData);
+    return true;
+}
+
+TelemetryBatch* IMUSensor::getBatch() {
+#if TELEMETRY_BATCHING
+    return &_batch;
+#else
+    return nullptr;
+#endif
+}
+
+const char* IMUSensor::getIMUTypeString() const {
     switch (_imuType) {
         case IMUType::MPU6050: return "MPU6050";
         case IMUType::MPU6500: return "MPU6500";
@@ -125,133 +182,225 @@ String IMUSensor::getIMUTypeString() const {
 }
 
 IMUType IMUSensor::_detectIMUType() {
-    Wire.beginTransmission(_address);
-    Wire.write(MPU6500_WHO_AM_I);
-    Wire.endTransmission(false);
-    Wire.requestFrom((uint8_t)_address, (uint8_t)1);
-    
-    if (Wire.available()) {
-        uint8_t whoami = Wire.read();
-        Serial.printf("WHO_AM_I register: 0x%02X\n", whoami);
-        
-        switch (whoami) {
-            case 0x68: return IMUType::MPU6050;
-            case 0x70: return IMUType::MPU6500;
-            case 0x71: return IMUType::MPU9250;
-            default:
-                Serial.printf("Unknown WHO_AM_I value: 0x%02X\n", whoami);
-                return IMUType::UNKNOWN;
-        }
+    uint8_t whoami;
+    if (!_readRegisters(MPU_WHO_AM_I, &whoami, 1)) {
+        Serial.println("Failed to read WHO_AM_I register");
+        return IMUType::UNKNOWN;
     }
     
-    Serial.println("Failed to read WHO_AM_I register");
-    return IMUType::UNKNOWN;
+    Serial.printf("WHO_AM_I register: 0x%02X\n", whoami);
+    switch (whoami) {
+        case 0x68: return IMUType::MPU6050;
+        case 0x70: return IMUType::MPU6500;
+        case 0x71: return IMUType::MPU9250;
+        default:
+            Serial.printf("Unknown WHO_AM_I value: 0x%02X\n", whoami);
+            return IMUType::UNKNOWN;
+    }
 }
 
-bool IMUSensor::_initializeMPU6050() {
-    // Wake up the MPU6050
-    Wire.beginTransmission(_address);
-    Wire.write(MPU6500_PWR_MGMT_1);
-    Wire.write(0x00); // Wake up
-    Wire.endTransmission(true);
-    delay(100);
-    
-    if (!_mpu6050.begin(_address, &Wire)) {
-        Serial.println("Failed to initialize MPU6050 with Adafruit library");
+bool IMUSensor::_initialize() {
+    // Wake up; the MPU6050 datasheet recommends the gyro PLL as clock source
+    uint8_t clockSource = (_imuType == IMUType::MPU6050) ? 0x01 : 0x00;
+    if (!_writeRegister(MPU_PWR_MGMT_1, clockSource)) {
         return false;
     }
     
-    _mpu6050.setAccelerometerRange(MPU6050_RANGE_8_G);
-    _mpu6050.setGyroRange(MPU6050_RANGE_500_DEG);
-    _mpu6050.setFilterBandwidth(MPU6050_BAND_21_HZ);
+    // No settle delay: configuration registers are writable straight away, and
+    // the first ~35 ms of gyro output is merely noisy while the PLL locks
     
-    return true;
-}
-
-bool IMUSensor::_initializeMPU6500() {
-    // Wake up the device
-    if (!_writeMPU6500Register(MPU6500_PWR_MGMT_1, 0x00)) {
+    // Full scale from imu.accel_range_g and imu.gyro_range_dps; each FS_SEL step doubles the range
+    uint32_t accelRange = RuntimeConfig::getUInt(ConfigParam::ACCEL_RANGE);
+    uint8_t accelSelect = accelRange >= 16 ? 3 : accelRange >= 8 ? 2 : accelRange >= 4 ? 1 : 0;
+    if (!_writeRegister(MPU_ACCEL_CONFIG, accelSelect << 3)) {
         return false;
     }
-    delay(100);
+    _accelLsbPerG = 16384.0f / (1 << accelSelect);
     
-    // Configure accelerometer (+/- 8g)
-    if (!_writeMPU6500Register(MPU6500_ACCEL_CONFIG, 0x10)) {
+    uint32_t gyroRange = RuntimeConfig::getUInt(ConfigParam::GYRO_RANGE);
+    uint8_t gyroSelect = gyroRange >= 2000 ? 3 : gyroRange >= 1000 ? 2 : gyroRange >= 500 ? 1 : 0;
+    if (!_writeRegister(MPU_GYRO_CONFIG, gyroSelect << 3)) {
         return false;
     }
+    _gyroLsbPerDps = 131.0f / (1 << gyroSelect);
     
-    // Configure gyroscope (+/- 500 deg/s)
-    if (!_writeMPU6500Register(MPU6500_GYRO_CONFIG, 0x08)) {
+    // MPU6050: 21 Hz digital low-pass filter, as previously set through the Adafruit driver
+    if (_imuType == IMUType::MPU6050 && !_writeRegister(MPU_CONFIG, 0x04)) {
         return false;
     }
     
+    // A missing magnetometer leaves the 6-axis data usable
+    if (_imuType == IMUType::MPU9250) {
+        _hasMagnetometer = _initializeMagnetometer();
+        if (!_hasMagnetometer) {
+            Serial.println("AK8963 magnetometer not available, reading 6 axes only");
+        }
+    }
+    
     return true;
 }
 
-bool IMUSensor::_readMPU6050() {
-    sensors_event_t accel, gyro, temp;
-    _mpu6050.getEvent(&accel, &gyro, &temp);
+bool IMUSensor::_initializeMagnetometer() {
+    // The internal I2C master polls the AK8963 once per sample, so run at 100 Hz
+    // (41 Hz DLPF, 1 kHz / (1 + 9)) to match the magnetometer's own rate
+    if (!_writeRegister(MPU_CONFIG, 0x03) || !_writeRegister(MPU_SMPLRT_DIV, 9)) {
+        return false;
+    }
     
-    _lastData.accelX = accel.acceleration.x;
-    _lastData.accelY = accel.acceleration.y;
-    _lastData.accelZ = accel.acceleration.z;
+    // Enable the I2C master at 400 kHz; the AK8963 is then only reachable through it
+    if (!_writeRegister(MPU_USER_CTRL, 0x20) || !_writeRegister(MPU_I2C_MST_CTRL, 0x0D)) {
+        return false;
+    }
     
-    _lastData.gyroX = gyro.gyro.x * 180.0 / PI; // Convert to degrees/second
-    _lastData.gyroY = gyro.gyro.y * 180.0 / PI;
-    _lastData.gyroZ = gyro.gyro.z * 180.0 / PI;
+    _writeMagRegister(AK8963_CNTL2, 0x01); // Soft reset
     
-    _lastData.temperature = temp.temperature;
+    uint8_t whoami = 0;
+    if (!_readMagRegisters(AK8963_WIA, &whoami, 1) || whoami != 0x48) {
+        Serial.printf("AK8963 WIA register: 0x%02X (expected 0x48)\n", whoami);
+        _writeRegister(MPU_USER_CTRL, 0x00);
+        return false;
+    }
     
+    // Factory sensitivity adjustment, readable only in fuse ROM access mode
+    uint8_t asa[3];
+    if (!_writeMagRegister(AK8963_CNTL1, 0x00) ||
+        !_writeMagRegister(AK8963_CNTL1, 0x0F) ||
+        !_readMagRegisters(AK8963_ASAX, asa, sizeof(asa)) ||
+        !_writeMagRegister(AK8963_CNTL1, 0x00)) {
+        return false;
+    }
+    for (uint8_t i = 0; i < 3; i++) {
+        _magAdjust[i] = ((asa[i] - 128) * 0.5f / 128.0f + 1.0f) * AK8963_UT_PER_LSB;
+    }
+    
+    // 16-bit output, continuous measurement mode 2 (100 Hz)
+    if (!_writeMagRegister(AK8963_CNTL1, 0x16)) {
+        return false;
+    }
+    
+    // From now on SLV0 copies HXL..ST2 into EXT_SENS_DATA_00 every sample, right
+    // behind the gyro registers, so one burst read returns all nine axes.
+    // Reading ST2 as part of the block releases the AK8963 data latch.
+    if (!_writeRegister(MPU_I2C_SLV0_ADDR, AK8963_ADDR | 0x80) ||
+        !_writeRegister(MPU_I2C_SLV0_REG, AK8963_HXL) ||
+        !_writeRegister(MPU_I2C_SLV0_CTRL, 0x80 | AK8963_DATA_SIZE)) {
+        return false;
+    }
+    
+    Serial.printf("AK8963 magnetometer enabled (ASA %u/%u/%u)\n", asa[0], asa[1], asa[2]);
     return true;
 }
 
-bool IMUSensor::_readMPU6500() {
-    // Read accelerometer data
-    int16_t accelX = _readMPU6500Register16(MPU6500_ACCEL_XOUT_H);
-    int16_t accelY = _readMPU6500Register16(MPU6500_ACCEL_XOUT_H + 2);
-    int16_t accelZ = _readMPU6500Register16(MPU6500_ACCEL_XOUT_H + 4);
-    
-    // Read gyroscope data
-    int16_t gyroX = _readMPU6500Register16(MPU6500_GYRO_XOUT_H);
-    int16_t gyroY = _readMPU6500Register16(MPU6500_GYRO_XOUT_H + 2);
-    int16_t gyroZ = _readMPU6500Register16(MPU6500_GYRO_XOUT_H + 4);
-    
-    // Read temperature data
-    int16_t tempRaw = _readMPU6500Register16(MPU6500_TEMP_OUT_H);
+bool IMUSensor::_writeMagRegister(uint8_t reg, uint8_t value) {
+    // One-shot SLV0 write; the master performs it on the next sample
+    bool queued = _writeRegister(MPU_I2C_SLV0_ADDR, AK8963_ADDR) &&
+                  _writeRegister(MPU_I2C_SLV0_REG, reg) &&
+                  _writeRegister(MPU_I2C_SLV0_DO, value) &&
+                  _writeRegister(MPU_I2C_SLV0_CTRL, 0x81);
+    delay(AK8963_SETUP_DELAY_MS);
+    return queued;
+}
+
+bool IMUSensor::_readMagRegisters(uint8_t reg, uint8_t* buffer, size_t length) {
+    bool queued = _writeRegister(MPU_I2C_SLV0_ADDR, AK8963_ADDR | 0x80) &&
+                  _writeRegister(MPU_I2C_SLV0_REG, reg) &&
+                  _writeRegister(MPU_I2C_SLV0_CTRL, 0x80 | length);
+    delay(AK8963_SETUP_DELAY_MS);
+    return queued && _readRegisters(MPU_EXT_SENS_DATA_00, buffer, length);
+}
+
+void IMUSensor::_updateMotionEnergy(unsigned long previousTimestamp) {
+    // Dynamic acceleration is the deviation of |a| from 1 g, so orientation doesn't count
+    float accelScale = (_imuType == IMUType::MPU6050) ? 1.0f / STANDARD_GRAVITY : 1.0f;
+    float ax = _lastData.accelX * accelScale;
+    float ay = _lastData.accelY * accelScale;
+    float az = _lastData.accelZ * accelScale;
+    float dynamic = sqrtf(ax * ax + ay * ay + az * az) - 1.0f;
+    
+    float gx = _lastData.gyroX * DEG_TO_RAD;
+    float gy = _lastData.gyroY * DEG_TO_RAD;
+    float gz = _lastData.gyroZ * DEG_TO_RAD;
+    float energy = dynamic * dynamic + gx * gx + gy * gy + gz * gz;
+    
+    if (previousTimestamp == 0) {
+        _motionEnergy = energy;
+        return;
+    }
     
-    // Convert to physical units 
-    // Note: Should verify these conversions against datasheet
-    // but I'm a trusting person and believe everything on the internet is true.
+    // Exponential average weighted by the time since the previous sample
+    float dt = (float)(_lastData.timestamp - previousTimestamp);
+    _motionEnergy += (energy - _motionEnergy) * dt / (MOTION_ENERGY_TAU_MS + dt);
+}
+
+bool IMUSensor::_readMotion() {
+    // One burst read keeps accel, temperature, gyro and (via EXT_SENS_DATA)
+    // magnetometer from the same sample
+    uint8_t raw[MPU_MOTION_BLOCK_SIZE + AK8963_DATA_SIZE];
+    size_t length = MPU_MOTION_BLOCK_SIZE + (_hasMagnetometer ? AK8963_DATA_SIZE : 0);
+    if (!_readRegisters(MPU_ACCEL_XOUT_H, raw, length)) {
+        return false;
+    }
     
-    _lastData.accelX = accelX / 4096.0; // +/- 8g range: 4096 LSB/g
-    _lastData.accelY = accelY / 4096.0;
-    _lastData.accelZ = accelZ / 4096.0;
+    int16_t accelX = (int16_t)((raw[0] << 8) | raw[1]);
+    int16_t accelY = (int16_t)((raw[2] << 8) | raw[3]);
+    int16_t accelZ = (int16_t)((raw[4] << 8) | raw[5]);
+    int16_t tempRaw = (int16_t)((raw[6] << 8) | raw[7]);
+    int16_t gyroX = (int16_t)((raw[8] << 8) | raw[9]);
+    int16_t gyroY = (int16_t)((raw[10] << 8) | raw[11]);
+    int16_t gyroZ = (int16_t)((raw[12] << 8) | raw[13]);
+    
+    // Batches carry accel and gyro as raw counts, which are lossless
+    _fixedSample[0] = accelX;
+    _fixedSample[1] = accelY;
+    _fixedSample[2] = accelZ;
+    _fixedSample[3] = gyroX;
+    _fixedSample[4] = gyroY;
+    _fixedSample[5] = gyroZ;
+    
+    // The MPU6050 has always been reported in m/s²
+    float accelScale = 1.0f / _accelLsbPerG;
+    if (_imuType == IMUType::MPU6050) {
+        accelScale *= STANDARD_GRAVITY;
+    }
+    _lastData.accelX = accelX * accelScale;
+    _lastData.accelY = accelY * accelScale;
+    _lastData.accelZ = accelZ * accelScale;
     
-    _lastData.gyroX = gyroX / 65.5; // +/- 500°/s range: 65.5 LSB/degree/s
-    _lastData.gyroY = gyroY / 65.5;
-    _lastData.gyroZ = gyroZ / 65.5;
+    _lastData.gyroX = gyroX / _gyroLsbPerDps;
+    _lastData.gyroY = gyroY / _gyroLsbPerDps;
+    _lastData.gyroZ = gyroZ / _gyroLsbPerDps;
     
-    _lastData.temperature = (tempRaw / 333.87) + 21.0;
+    if (_imuType == IMUType::MPU6050) {
+        _lastData.temperature = tempRaw / 340.0f + 36.53f;
+    } else {
+        _lastData.temperature = tempRaw / 333.87f + 21.0f;
+    }
+    _fixedSample[6] = (int16_t)lroundf(_lastData.temperature * 100.0f); // 0.01 °C
+    
+    // AK8963 data is little-endian; on overflow (HOFL) keep the previous field
+    const uint8_t* mag = raw + MPU_MOTION_BLOCK_SIZE;
+    if (_hasMagnetometer && !(mag[6] & 0x08)) {
+        float magX = (int16_t)((mag[1] << 8) | mag[0]) * _magAdjust[0];
+        float magY = (int16_t)((mag[3] << 8) | mag[2]) * _magAdjust[1];
+        float magZ = (int16_t)((mag[5] << 8) | mag[4]) * _magAdjust[2];
         
+        // The AK8963 axes are rotated against the accel/gyro frame; report in the latter
+        _lastData.magX = magY;
+        _lastData.magY = magX;
+        _lastData.magZ = -magZ;
+        
+        _fixedSample[7] = (int16_t)lroundf(_lastData.magX * 10.0f); // 0.1 µT
+        _fixedSample[8] = (int16_t)lroundf(_lastData.magY * 10.0f);
+        _fixedSample[9] = (int16_t)lroundf(_lastData.magZ * 10.0f);
+    }
+    
     return true;
 }
 
-int16_t IMUSensor::_readMPU6500Register16(uint8_t reg) {
-    Wire.beginTransmission(_address);
-    Wire.write(reg);
-    Wire.endTransmission(false);
-    Wire.requestFrom((uint8_t)_address, (uint8_t)2);
-    
-    if (Wire.available() == 2) {
-        int16_t value = (Wire.read() << 8) | Wire.read();
-        return value;
-    }
-    return 0;
+bool IMUSensor::_readRegisters(uint8_t reg, uint8_t* buffer, size_t length) {
+    return _bus.readRegisters(_device, reg, buffer, length);
 }
 
-bool IMUSensor::_writeMPU6500Register(uint8_t reg, uint8_t value) {
-    Wire.beginTransmission(_address);
-    Wire.write(reg);
-    Wire.write(value);
-    return Wire.endTransmission(true) == 0;
+bool IMUSensor::_writeRegister(uint8_t reg, uint8_t value) {
+    return _bus.writeRegister(_device, reg, value);
 }
@@ -2,9 +2,11 @@
 #define IMU_SENSOR_H
 
 #include "sensor_base.h"
-#include <Wire.h>
-#include <Adafruit_MPU6050.h>
-#include <Adafruit_Sensor.h>
+#include "i2c_bus.h"
+#include "../communication/telemetry_codec.h"
+#include "../config/config.h"
+
+#define IMU_ADDRESS_AUTO 0
 
 enum class IMUType {
     UNKNOWN,
@@ -15,20 +17,37 @@ enum class IMUType {
 
 class IMUSensor : public SensorBase {
 public:
-    IMUSensor(const String& name = "IMU");
+    // An MPU-family IMU at 0x68 or 0x69 (AD0 high) on either I2C controller,
+    // optionally behind a TCA9548A mux channel (0-7, -1 for none). IMU_ADDRESS_AUTO
+    // accepts either address; give an explicit one when two IMUs share a bus.
+    // The bus itself is started by the caller.
+    IMUSensor(const char* name = "IMU", I2CBus& bus = I2CBus0, uint8_t address = IMU_ADDRESS_AUTO,
+              int8_t muxChannel = -1);
     
     bool begin() override;
     bool readData() override;
-    DynamicJsonDocument getDataAsJson() override;
+    ArenaJsonDocument getDataAsJson() override;
+    bool writeFrame(JsonWriter& out) const override;
+    int8_t getBusId() const override { return _bus.getId(); }
+    float getActivity() const override { return _motionEnergy; }
+    TelemetryBatch* getBatch() override;
+    const int16_t* getFixedSample(uint8_t& layout, uint8_t& channels) const override {
+        layout = TELEMETRY_LAYOUT_IMU;
+        channels = _batch.channels;
+        return _fixedSample;
+    }
     
     // IMU-specific methods
     IMUType getIMUType() const { return _imuType; }
-    String getIMUTypeString() const;
+    const char* getIMUTypeString() const;
+    uint32_t getReadFailures() const { return _readFailures; }
+    bool hasMagnetometer() const { return _hasMagnetometer; }
     
     // Raw data access
     struct IMUData {
         float accelX, accelY, accelZ;
         float gyroX, gyroY, gyroZ;
+        float magX, magY, magZ; // µT, MPU9250 only
         float temperature;
         unsigned long timestamp;
     };
@@ -36,29 +55,75 @@ public:
     IMUData getLastReading() const { return _lastData; }
     
 private:
-    Adafruit_MPU6050 _mpu6050;
+    // Address of the last successful detection, cached in NVS per sensor name.
+    // WHO_AM_I is read again on every boot, in case the part was swapped.
+    struct DetectionCache {
+        uint8_t address;
+    };
+    
+    I2CBus& _bus;
+    I2CDevice _device;
     IMUType _imuType;
     IMUData _lastData;
-    uint8_t _address;
+    uint32_t _readFailures;
+    uint8_t _consecutiveFailures;
+    bool _hasMagnetometer;
+    float _magAdjust[3]; // Sensitivity adjustment times µT per LSB, per axis
+    float _accelLsbPerG;  // From the full scale set at initialisation
+    float _gyroLsbPerDps;
+    float _motionEnergy; // Smoothed dynamic acceleration² (g²) plus angular rate² ((rad/s)²)
+    
+    // Latest sample in the TELEMETRY_LAYOUT_IMU fixed-point units, and the batch it goes into
+    int16_t _fixedSample[TELEMETRY_BATCH_MAX_CHANNELS];
+    TelemetryBatch _batch;
+    
+    void _updateMotionEnergy(unsigned long previousTimestamp);
     
     IMUType _detectIMUType();
-    bool _initializeMPU6050();
-    bool _initializeMPU6500();
-    bool _readMPU6050();
-    bool _readMPU6500();
+    bool _initialize();
+    bool _initializeMagnetometer();
+    bool _readMotion();
+    
+    // AK8963 access through the MPU9250's I2C master (setup only; these wait for the master)
+    bool _writeMagRegister(uint8_t reg, uint8_t value);
+    bool _readMagRegisters(uint8_t reg, uint8_t* buffer, size_t length);
+    
+    bool _readRegisters(uint8_t reg, uint8_t* buffer, size_t length);
+    bool _writeRegister(uint8_t reg, uint8_t value);
+    
+    // A few failed reads in a row are tolerated before the sensor is marked as failed
+    static const uint8_t MAX_CONSECUTIVE_FAILURES = 5;
+    
+    // Motion energy time constant, so the average means the same at any sample rate
+    static const uint16_t MOTION_ENERGY_TAU_MS = 500;
     
-    // MPU6500 raw I2C functions
-    int16_t _readMPU6500Register16(uint8_t reg);
-    bool _writeMPU6500Register(uint8_t reg, uint8_t value);
+    // Register map shared by the MPU6050 and MPU6500/9250
+    static const uint8_t MPU_SMPLRT_DIV = 0x19;
+    static const uint8_t MPU_CONFIG = 0x1A;
+    static const uint8_t MPU_GYRO_CONFIG = 0x1B;
+    static const uint8_t MPU_ACCEL_CONFIG = 0x1C;
+    static const uint8_t MPU_ACCEL_XOUT_H = 0x3B; // Accel, temperature and gyro follow in one 14-byte block
+    static const uint8_t MPU_I2C_MST_CTRL = 0x24;
+    static const uint8_t MPU_I2C_SLV0_ADDR = 0x25;
+    static const uint8_t MPU_I2C_SLV0_REG = 0x26;
+    static const uint8_t MPU_I2C_SLV0_CTRL = 0x27;
+    static const uint8_t MPU_EXT_SENS_DATA_00 = 0x49; // Directly follows GYRO_ZOUT_L
+    static const uint8_t MPU_I2C_SLV0_DO = 0x63;
+    static const uint8_t MPU_USER_CTRL = 0x6A;
+    static const uint8_t MPU_PWR_MGMT_1 = 0x6B;
+    static const uint8_t MPU_WHO_AM_I = 0x75;
+    static const uint8_t MPU_MOTION_BLOCK_SIZE = 14;
     
-    // Register addresses for MPU6500
-    static const uint8_t MPU6500_PWR_MGMT_1 = 0x6B;
-    static const uint8_t MPU6500_ACCEL_CONFIG = 0x1C;
-    static const uint8_t MPU6500_GYRO_CONFIG = 0x1B;
-    static const uint8_t MPU6500_ACCEL_XOUT_H = 0x3B;
-    static const uint8_t MPU6500_GYRO_XOUT_H = 0x43;
-    static const uint8_t MPU6500_TEMP_OUT_H = 0x41;
-    static const uint8_t MPU6500_WHO_AM_I = 0x75;
+    // AK8963 magnetometer inside the MPU9250, on its auxiliary bus
+    static const uint8_t AK8963_ADDR = 0x0C;
+    static const uint8_t AK8963_WIA = 0x00;
+    static const uint8_t AK8963_HXL = 0x03;
+    static const uint8_t AK8963_CNTL1 = 0x0A;
+    static const uint8_t AK8963_CNTL2 = 0x0B;
+    static const uint8_t AK8963_ASAX = 0x10;
+    static const uint8_t AK8963_DATA_SIZE = 7;         // HXL..HZH plus ST2
+    static const uint8_t AK8963_SETUP_DELAY_MS = 12;   // Just over one 100 Hz sample
+    static constexpr float AK8963_UT_PER_LSB = 0.15f; // 16-bit output
 };
 
 #endif // IMU_SENSOR_H
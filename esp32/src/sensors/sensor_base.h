@@ -2,6 +2,10 @@
 #define SENSOR_BASE_H
 
 #include <ArduinoJson.h>
+#include "../utils/json_arena.h"
+
+struct TelemetryBatch;
+class JsonWriter;
 
 enum class SensorType {
     IMU,
@@ -9,6 +13,7 @@ enum class SensorType {
     HUMIDITY,
     LIGHT,
     PRESSURE,
+    ENVIRONMENT, // Combined temperature, humidity and pressure
     UNKNOWN
 };
 
@@ -19,46 +24,188 @@ enum class SensorStatus {
     READING
 };
 
+// Outcome of one step of a split-phase read
+enum class ConversionState {
+    PENDING,
+    DONE,
+    FAILED
+};
+
+// Where a sensor's samples went, so consumers can work out loss per stage.
+// Counts are in samples except frames and publishFailures, which count frames
+// (one JSON message or one batch).
+struct SensorCounters {
+    uint32_t frames;          // Frames sent or attempted; the next frame's sequence number
+    uint32_t samples;         // Samples acquired
+    uint32_t overruns;        // Whole scheduled intervals that went by without a read
+    uint32_t readErrors;      // Failed reads
+    uint32_t overflows;       // Samples dropped from a full buffer before they were sent
+    uint32_t suppressed;      // Samples replaced by a newer one before they were published
+    uint32_t publishFailures; // Frames the transport refused
+    uint32_t lastPublished;   // samples at the last JSON frame
+};
+
 class SensorBase {
 public:
-    SensorBase(const String& name, SensorType type) 
-        : _name(name), _type(type), _status(SensorStatus::UNINITIALIZED) {}
+    // Names are interned: pass a string literal or other static-lifetime string
+    SensorBase(const char* name, SensorType type) 
+        : _name(name), _type(type), _status(SensorStatus::UNINITIALIZED), _lastReading(0),
+          _updateInterval(1000), _scheduleInterval(0), _counters(), _lastAttempt(0), _attemptInterval(0),
+          _converting(false), _conversionStart(0) {}
     
     virtual ~SensorBase() = default;
     
     // Pure virtual functions that must be implemented by derived classes
     virtual bool begin() = 0;
     virtual bool readData() = 0;
-    virtual DynamicJsonDocument getDataAsJson() = 0;
+    virtual ArenaJsonDocument getDataAsJson() = 0;
+    
+    // Common interface (non-virtual so registries can inline them)
+    bool isReady() const { return _status == SensorStatus::READY; }
+    SensorStatus getStatus() const { return _status; }
+    const char* getStatusString() const { return _sensorStatusToString(_status); }
+    const char* getName() const { return _name; }
+    SensorType getType() const { return _type; }
+    const char* getTypeString() const { return _sensorTypeToString(_type); }
+    unsigned long getLastReadingTime() const { return _lastReading; }
+    
+    // Optional override for custom update intervals; defaults to 1 second
+    virtual unsigned long getUpdateInterval() const { return _updateInterval; }
+    void setUpdateInterval(unsigned long intervalMs) { _updateInterval = intervalMs; }
+    
+    // The interval reads are actually scheduled on, when the caller picks the
+    // times itself (the sync grid); 0 when it is the update interval
+    unsigned long getScheduleInterval() const { return _scheduleInterval > 0 ? _scheduleInterval : getUpdateInterval(); }
+    void setScheduleInterval(unsigned long intervalMs) { _scheduleInterval = intervalMs; }
     
-    // Common interface
-    virtual bool isReady() const { return _status == SensorStatus::READY; }
-    virtual SensorStatus getStatus() const { return _status; }
-    virtual String getName() const { return _name; }
-    virtual SensorType getType() const { return _type; }
-    virtual String getTypeString() const { return _sensorTypeToString(_type); }
+    // Short-term activity for the adaptive rate controller (g² + (rad/s)² for
+    // IMUs); 0 for sensors that can't tell
+    virtual float getActivity() const { return 0.0f; }
     
-    // Optional override for custom update intervals
-    virtual unsigned long getUpdateInterval() const { return 1000; } // Default 1 second
+    // Samples collected since the last batch publish, for sensors that batch
+    // (see TELEMETRY_BATCHING); null for sensors published as JSON frames
+    virtual TelemetryBatch* getBatch() { return nullptr; }
+    
+    // The latest sample in the batch encoding (see TelemetryCodec), whether or
+    // not batching is on; null for sensors without one. Used by SampleHistory.
+    virtual const int16_t* getFixedSample(uint8_t& layout, uint8_t& channels) const { return nullptr; }
+    
+    // The getDataAsJson() frame written straight to text, without the closing
+    // brace; false for sensors without a specialised writer (see JSON_FAST_FRAMES)
+    virtual bool writeFrame(JsonWriter& out) const { return false; }
+    
+    // Counters are updated by the registries on each read, by the sensor for
+    // its own buffers, and by the publisher for each frame
+    SensorCounters& getCounters() { return _counters; }
+    const SensorCounters& getCounters() const { return _counters; }
+    
+    // Called by the registries after every scheduled read, with the time it
+    // started. Gaps are measured between attempts, so a failed read is not
+    // counted again as an overrun, and against the longer of the schedules
+    // before and after, so a rate change is not one either.
+    void countRead(bool success, unsigned long attemptTime) {
+        unsigned long interval = getScheduleInterval();
+        if (_attemptInterval > interval) {
+            interval = _attemptInterval;
+        }
+        unsigned long elapsed = attemptTime - _lastAttempt;
+        if (_lastAttempt != 0 && interval > 0 && elapsed >= 2 * interval) {
+            _counters.overruns += elapsed / interval - 1;
+        }
+        _lastAttempt = attemptTime;
+        _attemptInterval = getScheduleInterval();
+        
+        if (success) {
+            _counters.samples++;
+        } else {
+            _counters.readErrors++;
+        }
+    }
+    
+    void writeCounters(JsonObject stream) const {
+        stream["frames"] = _counters.frames;
+        stream["samples"] = _counters.samples;
+        stream["overruns"] = _counters.overruns;
+        stream["read_errors"] = _counters.readErrors;
+        stream["overflows"] = _counters.overflows;
+        stream["suppressed"] = _counters.suppressed;
+        stream["publish_failures"] = _counters.publishFailures;
+    }
+    
+    // Split-phase reads, for sensors whose conversions take long enough to stall
+    // the loop (environmental sensors need 10-100 ms). A sensor that reports a
+    // conversion time is not read with readData(): the registries call
+    // startConversion() when it is due, then pollConversion() once the time has
+    // passed, and again on later updates while it returns PENDING. Neither may
+    // block, and pollConversion() must give up eventually.
+    virtual unsigned long getConversionTime() const { return 0; }
+    virtual bool startConversion() { return false; }
+    virtual ConversionState pollConversion() { return ConversionState::FAILED; }
+    
+    bool isConverting() const { return _converting; }
+    bool isConversionDue(unsigned long now) const { return now - _conversionStart >= getConversionTime(); }
+    unsigned long getConversionStart() const { return _conversionStart; }
+    
+    // One step of a split-phase read, called by the registries when the sensor
+    // is due (to start) or its conversion is (to poll). The reading time is when
+    // the conversion started, so slow sensors keep to their interval.
+    ConversionState runConversion(unsigned long now) {
+        if (!_converting) {
+            _conversionStart = now;
+            if (!startConversion()) {
+                return ConversionState::FAILED;
+            }
+            _converting = true;
+            return ConversionState::PENDING;
+        }
+        
+        ConversionState state = pollConversion();
+        if (state != ConversionState::PENDING) {
+            _converting = false;
+            if (state == ConversionState::DONE) {
+                _lastReading = _conversionStart;
+            }
+        }
+        return state;
+    }
+    
+    // I2C controller the sensor is on, or -1 if it uses no shared bus.
+    // Sensors on different controllers are read in parallel.
+    virtual int8_t getBusId() const { return -1; }
     
 protected:
-    String _name;
+    const char* _name;
     SensorType _type;
     SensorStatus _status;
     unsigned long _lastReading;
+    unsigned long _updateInterval;
+    unsigned long _scheduleInterval;
+    SensorCounters _counters;
+    unsigned long _lastAttempt;     // Start of the last read, for overruns
+    unsigned long _attemptInterval; // Schedule it was made on
+    bool _converting;
+    unsigned long _conversionStart;
     
     void _setStatus(SensorStatus status) { _status = status; }
     
-    friend class SensorManager; // Allow SensorManager to access _lastReading
-    
 private:
-    String _sensorTypeToString(SensorType type) const {
+    static const char* _sensorStatusToString(SensorStatus status) {
+        switch (status) {
+            case SensorStatus::READY: return "ready";
+            case SensorStatus::ERROR: return "error";
+            case SensorStatus::READING: return "reading";
+            default: return "uninitialized";
+        }
+    }
+    
+    static const char* _sensorTypeToString(SensorType type) {
         switch (type) {
             case SensorType::IMU: return "imu";
             case SensorType::TEMPERATURE: return "temperature";
             case SensorType::HUMIDITY: return "humidity";
             case SensorType::LIGHT: return "light";
             case SensorType::PRESSURE: return "pressure";
+            case SensorType::ENVIRONMENT: return "environment";
             default: return "unknown";
         }
     }
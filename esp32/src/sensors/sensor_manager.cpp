@@ -1,11 +1,18 @@
 #include "sensor_manager.h"
 #include "../config/config.h"
+#include "../utils/trace_buffer.h"
 
-SensorManager::SensorManager() : _lastUpdate(0) {
+SensorManager::SensorManager() : _lastUpdate(0), _readerCount(0), _readersDone(nullptr) {
     _sensors.reserve(8); // Reserve space for typical sensor count
 }
 
 SensorManager::~SensorManager() {
+    for (uint8_t i = 0; i < _readerCount; i++) {
+        vTaskDelete(_readers[i].task);
+    }
+    if (_readersDone) {
+        vEventGroupDelete(_readersDone);
+    }
     _sensors.clear();
 }
 
@@ -15,11 +22,13 @@ bool SensorManager::begin() {
     bool allSuccess = true;
     for (auto& sensor : _sensors) {
         if (!sensor->begin()) {
-            Serial.printf("Failed to initialize sensor: %s\n", sensor->getName().c_str());
+            Serial.printf("Failed to initialize sensor: %s\n", sensor->getName());
             allSuccess = false;
         }
     }
     
+    _startBusReaders();
+    
     Serial.printf("Sensor Manager initialized with %d sensors\n", _sensors.size());
     return allSuccess;
 }
@@ -27,11 +36,22 @@ bool SensorManager::begin() {
 void SensorManager::update() {
     unsigned long now = millis();
     
-    for (auto& sensor : _sensors) {
-        if (_shouldUpdateSensor(sensor)) {
-            if (!sensor->readData()) {
-                Serial.printf("Failed to read data from sensor: %s\n", sensor->getName().c_str());
-            }
+    // Kick the other buses, read the first bus here, then wait for the rest so
+    // callers still see a complete set of readings when update() returns
+    EventBits_t allReaders = (1 << _readerCount) - 1;
+    if (_readerCount > 0) {
+        xEventGroupClearBits(_readersDone, allReaders);
+        for (uint8_t i = 0; i < _readerCount; i++) {
+            xTaskNotifyGive(_readers[i].task);
+        }
+    }
+    
+    _readSensors(-1);
+    
+    if (_readerCount > 0) {
+        EventBits_t done = xEventGroupWaitBits(_readersDone, allReaders, pdTRUE, pdTRUE, pdMS_TO_TICKS(1000));
+        if ((done & allReaders) != allReaders) {
+            Serial.println("Sensor bus reader timed out");
         }
     }
     
@@ -46,44 +66,44 @@ bool SensorManager::addSensor(std::shared_ptr<SensorBase> sensor) {
     
     // Check for duplicate names
     for (const auto& existingSensor : _sensors) {
-        if (existingSensor->getName() == sensor->getName()) {
-            Serial.printf("Sensor with name '%s' already exists\n", sensor->getName().c_str());
+        if (strcmp(existingSensor->getName(), sensor->getName()) == 0) {
+            Serial.printf("Sensor with name '%s' already exists\n", sensor->getName());
             return false;
         }
     }
     
     _sensors.push_back(sensor);
-    Serial.printf("Added sensor: %s (%s)\n", sensor->getName().c_str(), sensor->getTypeString().c_str());
+    Serial.printf("Added sensor: %s (%s)\n", sensor->getName(), sensor->getTypeString());
     return true;
 }
 
-bool SensorManager::removeSensor(const String& name) {
+bool SensorManager::removeSensor(const char* name) {
     auto it = std::find_if(_sensors.begin(), _sensors.end(),
-        [&name](const std::shared_ptr<SensorBase>& sensor) {
-            return sensor->getName() == name;
+        [name](const std::shared_ptr<SensorBase>& sensor) {
+            return strcmp(sensor->getName(), name) == 0;
         });
     
     if (it != _sensors.end()) {
-        Serial.printf("Removed sensor: %s\n", (*it)->getName().c_str());
+        Serial.printf("Removed sensor: %s\n", (*it)->getName());
         _sensors.erase(it);
         return true;
     }
     
-    Serial.printf("Sensor not found: %s\n", name.c_str());
+    Serial.printf("Sensor not found: %s\n", name);
     return false;
 }
 
-std::shared_ptr<SensorBase> SensorManager::getSensor(const String& name) {
+std::shared_ptr<SensorBase> SensorManager::getSensor(const char* name) {
     for (auto& sensor : _sensors) {
-        if (sensor->getName() == name) {
+        if (strcmp(sensor->getName(), name) == 0) {
             return sensor;
         }
     }
     return nullptr;
 }
 
-std::vector<DynamicJsonDocument> SensorManager::getAllSensorData() {
-    std::vector<DynamicJsonDocument> allData;
+std::vector<ArenaJsonDocument> SensorManager::getAllSensorData() {
+    std::vector<ArenaJsonDocument> allData;
     allData.reserve(_sensors.size());
     
     for (auto& sensor : _sensors) {
@@ -95,46 +115,148 @@ std::vector<DynamicJsonDocument> SensorManager::getAllSensorData() {
     return allData;
 }
 
-DynamicJsonDocument SensorManager::getSensorData(const String& name) {
+ArenaJsonDocument SensorManager::getSensorData(const char* name) {
     auto sensor = getSensor(name);
     if (sensor && sensor->isReady()) {
         return sensor->getDataAsJson();
     }
     
-    DynamicJsonDocument emptyDoc(128);
-    emptyDoc["error"] = "Sensor not found or not ready: " + name;
+    ArenaJsonDocument emptyDoc(128);
+    emptyDoc["error"] = String("Sensor not found or not ready: ") + name;
     return emptyDoc;
 }
 
-DynamicJsonDocument SensorManager::getStatusReport() {
-    DynamicJsonDocument doc(1024);
+void SensorManager::getStatusReport(JsonObject report) {
+    report["sensor_count"] = _sensors.size();
+    report["last_update"] = _lastUpdate;
+    report["timestamp"] = millis();
     
-    doc["sensor_count"] = _sensors.size();
-    doc["last_update"] = _lastUpdate;
-    doc["timestamp"] = millis();
-    
-    JsonArray sensorsArray = doc.createNestedArray("sensors");
+    JsonArray sensorsArray = report.createNestedArray("sensors");
     for (auto& sensor : _sensors) {
         JsonObject sensorInfo = sensorsArray.createNestedObject();
         sensorInfo["name"] = sensor->getName();
         sensorInfo["type"] = sensor->getTypeString();
-        sensorInfo["status"] = (sensor->getStatus() == SensorStatus::READY) ? "ready" :
-                              (sensor->getStatus() == SensorStatus::ERROR) ? "error" :
-                              (sensor->getStatus() == SensorStatus::READING) ? "reading" : "uninitialized";
+        sensorInfo["status"] = sensor->getStatusString();
         sensorInfo["update_interval"] = sensor->getUpdateInterval();
     }
+}
+
+void SensorManager::_startBusReaders() {
+    if (_readerCount > 0) {
+        return;
+    }
     
-    return doc;
+    // Only buses beyond the first need a task of their own
+    int8_t firstBus = -1;
+    for (auto& sensor : _sensors) {
+        int8_t busId = sensor->getBusId();
+        if (busId < 0 || busId == firstBus || _hasBusReader(busId)) {
+            continue;
+        }
+        if (firstBus < 0) {
+            firstBus = busId;
+            continue;
+        }
+        if (_readerCount >= SENSOR_MANAGER_MAX_BUSES) {
+            break;
+        }
+        
+        BusReader& reader = _readers[_readerCount];
+        reader.manager = this;
+        reader.busId = busId;
+        reader.task = nullptr;
+        
+        char taskName[16];
+        snprintf(taskName, sizeof(taskName), "i2c%d_reader", busId);
+        
+        // Higher priority than the loop so it starts as soon as it is notified;
+        // it spends most of its time blocked on the I2C driver
+        if (xTaskCreatePinnedToCore(_busReaderTask, taskName, 4096, &reader, 2, &reader.task, 1) != pdPASS) {
+            Serial.printf("Failed to start reader task for I2C%d, reading it inline\n", busId);
+            continue;
+        }
+        _readerCount++;
+        Serial.printf("Started reader task for I2C%d\n", busId);
+    }
+    
+    if (_readerCount > 0 && _readersDone == nullptr) {
+        _readersDone = xEventGroupCreate();
+    }
+}
+
+void SensorManager::_readSensors(int8_t busId) {
+    // busId -1 reads every sensor without a reader task of its own. One-step
+    // reads go first, so starting or collecting a conversion never delays them.
+    for (uint8_t pass = 0; pass < 2; pass++) {
+        uint8_t stream = 0;
+        for (auto& sensor : _sensors) {
+            uint8_t id = stream++;
+            int8_t sensorBus = sensor->getBusId();
+            bool mine = busId < 0 ? !_hasBusReader(sensorBus) : sensorBus == busId;
+            bool splitPhase = sensor->getConversionTime() > 0;
+            if (mine && splitPhase == (pass == 1)) {
+                _readSensor(*sensor, id, splitPhase);
+            }
+        }
+    }
+}
+
+void SensorManager::_readSensor(SensorBase& sensor, uint8_t stream, bool splitPhase) {
+    // A conversion under way is collected as soon as it is due, whatever the interval
+    bool converting = splitPhase && sensor.isConverting();
+    if (converting ? !sensor.isConversionDue(millis()) : !_shouldUpdateSensor(sensor)) {
+        return;
+    }
+    
+    unsigned long now = millis();
+    bool success;
+    TRACE_BEGIN(TraceEvent::SENSOR_READ, stream);
+    if (splitPhase) {
+        ConversionState state = sensor.runConversion(now);
+        TRACE_END(TraceEvent::SENSOR_READ, state != ConversionState::FAILED);
+        if (state == ConversionState::PENDING) {
+            return;
+        }
+        success = state == ConversionState::DONE;
+    } else {
+        success = sensor.readData();
+        TRACE_END(TraceEvent::SENSOR_READ, success);
+    }
+    if (!success) {
+        Serial.printf("Failed to read data from sensor: %s\n", sensor.getName());
+    }
+    sensor.countRead(success, splitPhase ? sensor.getConversionStart() : now);
+}
+
+bool SensorManager::_hasBusReader(int8_t busId) const {
+    for (uint8_t i = 0; i < _readerCount; i++) {
+        if (_readers[i].busId == busId) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SensorManager::_busReaderTask(void* parameter) {
+    BusReader* reader = static_cast<BusReader*>(parameter);
+    SensorManager* manager = reader->manager;
+    EventBits_t bit = 1 << (reader - manager->_readers);
+    
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        manager->_readSensors(reader->busId);
+        xEventGroupSetBits(manager->_readersDone, bit);
+    }
 }
 
-bool SensorManager::_shouldUpdateSensor(std::shared_ptr<SensorBase> sensor) {
-    if (!sensor->isReady()) {
+bool SensorManager::_shouldUpdateSensor(const SensorBase& sensor) {
+    if (!sensor.isReady()) {
         return false;
     }
     
     unsigned long now = millis();
-    unsigned long interval = sensor->getUpdateInterval();
+    unsigned long interval = sensor.getUpdateInterval();
     
     // Check if enough time has passed since last reading
-    return (now - sensor->_lastReading) >= interval;
+    return (now - sensor.getLastReadingTime()) >= interval;
 }
@@ -3,8 +3,13 @@
 
 #include <vector>
 #include <memory>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/event_groups.h>
 #include "sensor_base.h"
 
+#define SENSOR_MANAGER_MAX_BUSES 2 // One per ESP32 I2C controller
+
 class SensorManager {
 public:
     SensorManager();
@@ -15,26 +20,51 @@ public:
     
     // Sensor management
     bool addSensor(std::shared_ptr<SensorBase> sensor);
-    bool removeSensor(const String& name);
-    std::shared_ptr<SensorBase> getSensor(const String& name);
+    bool removeSensor(const char* name);
+    std::shared_ptr<SensorBase> getSensor(const char* name);
     
     // Data collection
-    std::vector<DynamicJsonDocument> getAllSensorData();
-    DynamicJsonDocument getSensorData(const String& name);
+    std::vector<ArenaJsonDocument> getAllSensorData();
+    ArenaJsonDocument getSensorData(const char* name);
     
-    // Status reporting
-    DynamicJsonDocument getStatusReport();
+    // Status reporting (written into the caller's document to avoid a heap copy)
+    void getStatusReport(JsonObject report);
     size_t getSensorCount() const { return _sensors.size(); }
     
     // Iteration support
     std::vector<std::shared_ptr<SensorBase>>::iterator sensors_begin() { return _sensors.begin(); }
     std::vector<std::shared_ptr<SensorBase>>::iterator sensors_end() { return _sensors.end(); }
     
+    // Same shape as StaticSensorRegistry::forEach, so main.cpp works with either
+    template <typename Visitor>
+    void forEach(Visitor visitor) {
+        for (auto& sensor : _sensors) {
+            visitor(*sensor);
+        }
+    }
+    
 private:
+    // Reader task for one I2C controller; the loop task reads bus 0 itself
+    struct BusReader {
+        SensorManager* manager;
+        int8_t busId;
+        TaskHandle_t task;
+    };
+    
     std::vector<std::shared_ptr<SensorBase>> _sensors;
     unsigned long _lastUpdate;
     
-    bool _shouldUpdateSensor(std::shared_ptr<SensorBase> sensor);
+    BusReader _readers[SENSOR_MANAGER_MAX_BUSES];
+    uint8_t _readerCount;
+    EventGroupHandle_t _readersDone;
+    
+    bool _shouldUpdateSensor(const SensorBase& sensor);
+    void _startBusReaders();
+    void _readSensors(int8_t busId);
+    void _readSensor(SensorBase& sensor, uint8_t stream, bool splitPhase);
+    bool _hasBusReader(int8_t busId) const;
+    
+    static void _busReaderTask(void* parameter);
 };
 
 #endif // SENSOR_MANAGER_H
@@ -0,0 +1,133 @@
+#ifndef STATIC_SENSOR_REGISTRY_H
+#define STATIC_SENSOR_REGISTRY_H
+
+#include <tuple>
+#include <type_traits>
+#include "sensor_base.h"
+#include "../utils/trace_buffer.h"
+
+// Compile-time alternative to SensorManager. The sensor set is fixed by the
+// template arguments and held by reference to statically allocated sensors,
+// so there is no heap, no reference counting, and the update loop unrolls
+// into direct (inlinable) calls on each concrete sensor type.
+//
+//   IMUSensor mainImu("main_imu");
+//   StaticSensorRegistry<IMUSensor> sensorManager(mainImu);
+template <typename... Sensors>
+class StaticSensorRegistry {
+public:
+    explicit StaticSensorRegistry(Sensors&... sensors) : _sensors(sensors...), _lastUpdate(0) {}
+    
+    bool begin() {
+        Serial.println("Initializing static sensor registry...");
+        bool allSuccess = _begin<0>();
+        Serial.printf("Static sensor registry initialized with %u sensors\n", (unsigned)getSensorCount());
+        return allSuccess;
+    }
+    
+    void update() {
+        unsigned long now = millis();
+        // One-step reads first, so starting or collecting a conversion never delays them
+        _update<0>(now, false);
+        _update<0>(now, true);
+        _lastUpdate = now;
+    }
+    
+    // Visits every sensor; the visitor receives the concrete sensor type
+    template <typename Visitor>
+    void forEach(Visitor visitor) {
+        _forEach<0>(visitor);
+    }
+    
+    void getStatusReport(JsonObject report) {
+        report["sensor_count"] = getSensorCount();
+        report["last_update"] = _lastUpdate;
+        report["timestamp"] = millis();
+        
+        JsonArray sensorsArray = report.createNestedArray("sensors");
+        forEach([&sensorsArray](SensorBase& sensor) {
+            JsonObject sensorInfo = sensorsArray.createNestedObject();
+            sensorInfo["name"] = sensor.getName();
+            sensorInfo["type"] = sensor.getTypeString();
+            sensorInfo["status"] = sensor.getStatusString();
+            sensorInfo["update_interval"] = sensor.getUpdateInterval();
+        });
+    }
+    
+    static constexpr size_t getSensorCount() { return sizeof...(Sensors); }
+    
+private:
+    std::tuple<Sensors&...> _sensors;
+    unsigned long _lastUpdate;
+    
+    template <size_t I>
+    using SensorAt = typename std::tuple_element<I, std::tuple<Sensors...>>::type;
+    
+    template <size_t I>
+    typename std::enable_if<I == sizeof...(Sensors), bool>::type _begin() { return true; }
+    
+    template <size_t I>
+    typename std::enable_if<I < sizeof...(Sensors), bool>::type _begin() {
+        typedef SensorAt<I> SensorT;
+        SensorT& sensor = std::get<I>(_sensors);
+        bool success = sensor.SensorT::begin();
+        if (!success) {
+            Serial.printf("Failed to initialize sensor: %s\n", sensor.getName());
+        }
+        return _begin<I + 1>() && success;
+    }
+    
+    template <size_t I>
+    typename std::enable_if<I == sizeof...(Sensors)>::type _update(unsigned long, bool) {}
+    
+    template <size_t I>
+    typename std::enable_if<I < sizeof...(Sensors)>::type _update(unsigned long now, bool splitPass) {
+        // Qualified calls bypass the vtable so each read is a direct call
+        typedef SensorAt<I> SensorT;
+        SensorT& sensor = std::get<I>(_sensors);
+        bool splitPhase = sensor.SensorT::getConversionTime() > 0;
+        if (splitPhase == splitPass) {
+            _read<SensorT>(sensor, I, now, splitPhase);
+        }
+        _update<I + 1>(now, splitPass);
+    }
+    
+    template <typename SensorT>
+    void _read(SensorT& sensor, uint8_t stream, unsigned long now, bool splitPhase) {
+        // A conversion under way is collected as soon as it is due, whatever the interval
+        unsigned long interval = sensor.SensorT::getUpdateInterval();
+        bool converting = splitPhase && sensor.isConverting();
+        if (converting ? !sensor.isConversionDue(now) : !sensor.isReady() || now - sensor.getLastReadingTime() < interval) {
+            return;
+        }
+        
+        bool success;
+        TRACE_BEGIN(TraceEvent::SENSOR_READ, stream);
+        if (splitPhase) {
+            ConversionState state = sensor.runConversion(now);
+            TRACE_END(TraceEvent::SENSOR_READ, state != ConversionState::FAILED);
+            if (state == ConversionState::PENDING) {
+                return;
+            }
+            success = state == ConversionState::DONE;
+        } else {
+            success = sensor.SensorT::readData();
+            TRACE_END(TraceEvent::SENSOR_READ, success);
+        }
+        if (!success) {
+            Serial.printf("Failed to read data from sensor: %s\n", sensor.getName());
+        }
+        sensor.countRead(success, splitPhase ? sensor.getConversionStart() : now);
+    }
+    
+    template <size_t I, typename Visitor>
+    typename std::enable_if<I == sizeof...(Sensors)>::type _forEach(Visitor&) {}
+    
+    template <size_t I, typename Visitor>
+    typename std::enable_if<I < sizeof...(Sensors)>::type _forEach(Visitor& visitor) {
+        visitor(std::get<I>(_sensors));
+        _forEach<I + 1>(visitor);
+    }
+};
+
+#endif // STATIC_SENSOR_REGISTRY_H
@@ -0,0 +1,56 @@
+#include "boot_profile.h"
+#include <esp_system.h>
+
+// Static member initialisation
+uint32_t BootProfile::_marks[(uint8_t)BootPhase::COUNT] = {};
+bool BootProfile::_fastConnect = false;
+
+void BootProfile::mark(BootPhase phase) {
+    uint8_t index = (uint8_t)phase;
+    if (_marks[index] != 0) {
+        return;
+    }
+    
+    // Zero means "not reached", so a mark at 0 ms is stored as 1
+    uint32_t now = millis();
+    _marks[index] = now > 0 ? now : 1;
+    Serial.printf("Boot: %s at %u ms\n", _phaseToString(phase), _marks[index]);
+}
+
+void BootProfile::writeStatus(JsonObject boot) {
+    boot["reset_reason"] = _resetReasonToString();
+    boot["fast_connect"] = _fastConnect;
+    
+    for (uint8_t i = 0; i < (uint8_t)BootPhase::COUNT; i++) {
+        if (_marks[i] != 0) {
+            boot[_phaseToString((BootPhase)i)] = _marks[i];
+        }
+    }
+}
+
+const char* BootProfile::_phaseToString(BootPhase phase) {
+    switch (phase) {
+        case BootPhase::I2C_READY: return "i2c_ms";
+        case BootPhase::SENSORS_READY: return "sensors_ms";
+        case BootPhase::FIRST_SAMPLE: return "first_sample_ms";
+        case BootPhase::WIFI_CONNECTED: return "wifi_ms";
+        case BootPhase::MQTT_CONNECTED: return "mqtt_ms";
+        case BootPhase::FIRST_PUBLISH: return "first_publish_ms";
+        default: return "unknown_ms";
+    }
+}
+
+const char* BootProfile::_resetReasonToString() {
+    switch (esp_reset_reason()) {
+        case ESP_RST_POWERON: return "power_on";
+        case ESP_RST_EXT: return "external";
+        case ESP_RST_SW: return "software";
+        case ESP_RST_PANIC: return "panic";
+        case ESP_RST_INT_WDT:
+        case ESP_RST_TASK_WDT:
+        case ESP_RST_WDT: return "watchdog";
+        case ESP_RST_DEEPSLEEP: return "deep_sleep";
+        case ESP_RST_BROWNOUT: return "brownout";
+        default: return "unknown";
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef BOOT_PROFILE_H
+#define BOOT_PROFILE_H
+
+#include <ArduinoJson.h>
+
+enum class BootPhase : uint8_t {
+    I2C_READY,
+    SENSORS_READY,
+    FIRST_SAMPLE,
+    WIFI_CONNECTED,
+    MQTT_CONNECTED,
+    FIRST_PUBLISH,
+    COUNT
+};
+
+// Milliseconds from reset to each boot milestone, reported in the status snapshot
+class BootProfile {
+public:
+    // Only the first mark of each phase is kept, so callers can mark unconditionally
+    static void mark(BootPhase phase);
+    static bool has(BootPhase phase) { return _marks[(uint8_t)phase] != 0; }
+    static uint32_t get(BootPhase phase) { return _marks[(uint8_t)phase]; }
+    
+    static void setFastConnect(bool used) { _fastConnect = used; }
+    
+    static void writeStatus(JsonObject boot);
+    
+private:
+    static uint32_t _marks[(uint8_t)BootPhase::COUNT];
+    static bool _fastConnect;
+    
+    static const char* _phaseToString(BootPhase phase);
+    static const char* _resetReasonToString();
+};
+
+#endif // BOOT_PROFILE_H
@@ -0,0 +1,222 @@
+#include "heap_monitor.h"
+#include "../config/config.h"
+#include <esp_heap_caps.h>
+#include <esp_spi_flash.h>
+
+#ifndef HEAP_STEADY_STATE_GUARD
+#define HEAP_STEADY_STATE_GUARD HEAP_GUARD_OFF
+#endif
+
+// Static member initialisation
+void* HeapMonitor::_loopTask = nullptr;
+volatile bool HeapMonitor::_steadyState = false;
+const char* volatile HeapMonitor::_currentLabel = nullptr;
+volatile bool HeapMonitor::_currentExempt = false;
+volatile uint32_t HeapMonitor::_allocations = 0;
+volatile uint32_t HeapMonitor::_frees = 0;
+volatile uint32_t HeapMonitor::_bytesAllocated = 0;
+volatile uint32_t HeapMonitor::_steadyStateAllocations = 0;
+HeapMonitor::Site HeapMonitor::_sites[HEAP_MONITOR_MAX_SITES];
+uint8_t HeapMonitor::_siteCount = 0;
+uint32_t HeapMonitor::_unattributed = 0;
+
+void HeapMonitor::begin() {
+    _loopTask = xTaskGetCurrentTaskHandle();
+    Serial.printf("Heap monitor started: free=%u, largest block=%u\n",
+                  heap_caps_get_free_size(MALLOC_CAP_8BIT),
+                  heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+}
+
+void HeapMonitor::markSteadyState() {
+    _steadyState = true;
+    Stats stats = getStats();
+    Serial.printf("Heap steady state: %u allocations during startup, free=%u, min free=%u\n",
+                  stats.allocations, stats.freeHeap, stats.minFreeHeap);
+}
+
+void HeapMonitor::update() {
+#if HEAP_STEADY_STATE_GUARD == HEAP_GUARD_LOG
+    // Formatted into static storage: a Serial.printf line this long would
+    // allocate, and that allocation would be reported on the next pass
+    static char line[160];
+    for (uint8_t i = 0; i < _siteCount; i++) {
+        Site& site = _sites[i];
+        if (site.steadyCount != site.reportedCount) {
+            int length = snprintf(line, sizeof(line),
+                                  "HEAP GUARD: %u steady-state allocation(s) at %s (caller 0x%08x, %u bytes total)\n",
+                                  site.steadyCount - site.reportedCount,
+                                  site.label ? site.label : "<unlabelled>",
+                                  (unsigned)site.caller, site.bytes);
+            if (length > 0) {
+                Serial.write((const uint8_t*)line, length < (int)sizeof(line) ? length : sizeof(line) - 1);
+            }
+            site.reportedCount = site.steadyCount;
+        }
+    }
+#endif
+}
+
+HeapMonitor::Stats HeapMonitor::getStats() {
+    Stats stats;
+    stats.allocations = _allocations;
+    stats.frees = _frees;
+    stats.bytesAllocated = _bytesAllocated;
+    stats.steadyStateAllocations = _steadyStateAllocations;
+    stats.freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    stats.minFreeHeap = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    stats.largestFreeBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    stats.fragmentation = stats.freeHeap > 0
+        ? (uint8_t)(100 - (uint64_t)stats.largestFreeBlock * 100 / stats.freeHeap)
+        : 0;
+    return stats;
+}
+
+void HeapMonitor::writeStatus(JsonObject memory) {
+    Stats stats = getStats();
+    memory["free_heap"] = stats.freeHeap;
+    memory["total_heap"] = ESP.getHeapSize();
+    memory["min_free_heap"] = stats.minFreeHeap;
+    memory["largest_free_block"] = stats.largestFreeBlock;
+    memory["fragmentation"] = stats.fragmentation;
+    
+    JsonObject allocations = memory.createNestedObject("allocations");
+    allocations["count"] = stats.allocations;
+    allocations["frees"] = stats.frees;
+    allocations["bytes"] = stats.bytesAllocated;
+    allocations["steady_state"] = stats.steadyStateAllocations;
+    allocations["unattributed"] = _unattributed;
+    
+    // Only sites that allocated after startup are interesting in the field
+    JsonArray sites = allocations.createNestedArray("sites");
+    for (uint8_t i = 0; i < _siteCount; i++) {
+        const Site& site = _sites[i];
+        if (site.steadyCount == 0) {
+            continue;
+        }
+        JsonObject entry = sites.createNestedObject();
+        if (site.label) {
+            entry["label"] = site.label;
+        }
+        entry["caller"] = (uint32_t)site.caller;
+        entry["count"] = site.count;
+        entry["steady_count"] = site.steadyCount;
+        entry["bytes"] = site.bytes;
+    }
+}
+
+HeapMonitor::Scope::Scope(const char* label, bool exempt)
+    : _previousLabel(nullptr), _previousExempt(false), _active(false) {
+    // Attribution is tracked for the loop task only
+    if (_loopTask == nullptr || xTaskGetCurrentTaskHandle() != _loopTask) {
+        return;
+    }
+    _active = true;
+    _previousLabel = _currentLabel;
+    _previousExempt = _currentExempt;
+    _currentLabel = label;
+    _currentExempt = _currentExempt || exempt;
+}
+
+HeapMonitor::Scope::~Scope() {
+    if (_active) {
+        _currentLabel = _previousLabel;
+        _currentExempt = _previousExempt;
+    }
+}
+
+void IRAM_ATTR HeapMonitor::_recordAllocation(size_t size, void* caller) {
+    __atomic_add_fetch(&_allocations, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&_bytesAllocated, (uint32_t)size, __ATOMIC_RELAXED);
+    
+    // WiFi, lwIP and timer tasks allocate constantly by design; only the loop
+    // task is expected to be allocation-free once running. With the flash
+    // cache off (during flash writes, e.g. NVS) only IRAM code may run, so
+    // those allocations are counted but not attributed.
+    if (_loopTask == nullptr || !spi_flash_cache_enabled() || xPortInIsrContext() ||
+        xTaskGetCurrentTaskHandle() != _loopTask) {
+        return;
+    }
+    
+    Site* site = _findSite(_currentLabel, (uintptr_t)caller);
+    if (site) {
+        site->count++;
+        site->bytes += size;
+    } else {
+        _unattributed++;
+    }
+    
+    if (!_steadyState || _currentExempt) {
+        return;
+    }
+    
+    __atomic_add_fetch(&_steadyStateAllocations, 1, __ATOMIC_RELAXED);
+    if (site) {
+        site->steadyCount++;
+    }
+    
+#if HEAP_STEADY_STATE_GUARD == HEAP_GUARD_ASSERT
+    // ROM printf does not touch the heap, unlike Serial
+    ets_printf("HEAP GUARD: steady-state allocation of %u bytes at %s (caller %p)\n",
+               (unsigned)size, _currentLabel ? _currentLabel : "<unlabelled>", caller);
+    abort();
+#endif
+}
+
+void IRAM_ATTR HeapMonitor::_recordFree() {
+    __atomic_add_fetch(&_frees, 1, __ATOMIC_RELAXED);
+}
+
+HeapMonitor::Site* IRAM_ATTR HeapMonitor::_findSite(const char* label, uintptr_t caller) {
+    // Labelled allocations aggregate per label; unlabelled ones per call site
+    for (uint8_t i = 0; i < _siteCount; i++) {
+        Site& site = _sites[i];
+        if (label ? site.label == label : (site.label == nullptr && site.caller == caller)) {
+            return &site;
+        }
+    }
+    
+    if (_siteCount >= HEAP_MONITOR_MAX_SITES) {
+        return nullptr;
+    }
+    
+    Site& site = _sites[_siteCount++];
+    site.label = label;
+    site.caller = caller;
+    site.count = 0;
+    site.bytes = 0;
+    site.steadyCount = 0;
+    site.reportedCount = 0;
+    return &site;
+}
+
+// Linker wrappers, enabled by -Wl,--wrap=malloc etc. in platformio.ini
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+void* IRAM_ATTR __wrap_malloc(size_t size) {
+    HeapMonitor::_recordAllocation(size, __builtin_return_address(0));
+    return __real_malloc(size);
+}
+
+void* IRAM_ATTR __wrap_calloc(size_t count, size_t size) {
+    HeapMonitor::_recordAllocation(count * size, __builtin_return_address(0));
+    return __real_calloc(count, size);
+}
+
+void* IRAM_ATTR __wrap_realloc(void* ptr, size_t size) {
+    if (size > 0) {
+        HeapMonitor::_recordAllocation(size, __builtin_return_address(0));
+    }
+    return __real_realloc(ptr, size);
+}
+
+void IRAM_ATTR __wrap_free(void* ptr) {
+    if (ptr) {
+        HeapMonitor::_recordFree();
+    }
+    __real_free(ptr);
+}
+}
@@ -0,0 +1,89 @@
+#ifndef HEAP_MONITOR_H
+#define HEAP_MONITOR_H
+
+#include <ArduinoJson.h>
+
+// Steady-state guard modes for HEAP_STEADY_STATE_GUARD
+#define HEAP_GUARD_OFF 0
+#define HEAP_GUARD_LOG 1
+#define HEAP_GUARD_ASSERT 2
+
+#define HEAP_MONITOR_MAX_SITES 16
+
+// Heap telemetry for long-running nodes. Counts every malloc/calloc/realloc/free
+// routed through the linker wrappers (see -Wl,--wrap in platformio.ini), tracks
+// fragmentation and the low-water mark, and attributes allocations made on the
+// Arduino loop task to named sites so steady-state churn can be found and removed.
+class HeapMonitor {
+public:
+    struct Stats {
+        uint32_t allocations;
+        uint32_t frees;
+        uint32_t bytesAllocated;
+        uint32_t steadyStateAllocations;
+        uint32_t freeHeap;
+        uint32_t minFreeHeap;
+        uint32_t largestFreeBlock;
+        uint8_t fragmentation; // Percent of free heap not usable as one block
+    };
+    
+    struct Site {
+        const char* label;   // Active HEAP_SITE label, or null
+        uintptr_t caller;    // Return address of the allocating call (for addr2line)
+        uint32_t count;
+        uint32_t bytes;
+        uint32_t steadyCount;
+        uint32_t reportedCount;
+    };
+    
+    // Call first thing in setup(); records the loop task for attribution
+    static void begin();
+    
+    // Call at the end of setup(); from here on loop task allocations are suspect
+    static void markSteadyState();
+    static bool isSteadyState() { return _steadyState; }
+    
+    // Emits deferred guard reports (logging from inside malloc is not safe)
+    static void update();
+    
+    static Stats getStats();
+    static void writeStatus(JsonObject memory);
+    
+    // RAII attribution scope; exempt scopes are counted but never trip the guard
+    class Scope {
+    public:
+        explicit Scope(const char* label, bool exempt = false);
+        ~Scope();
+        
+    private:
+        const char* _previousLabel;
+        bool _previousExempt;
+        bool _active;
+    };
+    
+    // Hooks for the malloc wrappers
+    static void _recordAllocation(size_t size, void* caller);
+    static void _recordFree();
+    
+private:
+    static void* _loopTask;
+    static volatile bool _steadyState;
+    static const char* volatile _currentLabel;
+    static volatile bool _currentExempt;
+    
+    static volatile uint32_t _allocations;
+    static volatile uint32_t _frees;
+    static volatile uint32_t _bytesAllocated;
+    static volatile uint32_t _steadyStateAllocations;
+    
+    static Site _sites[HEAP_MONITOR_MAX_SITES];
+    static uint8_t _siteCount;
+    static uint32_t _unattributed;
+    
+    static Site* _findSite(const char* label, uintptr_t caller);
+};
+
+#define HEAP_SITE(label) HeapMonitor::Scope _heapSite(label)
+#define HEAP_SITE_EXEMPT(label) HeapMonitor::Scope _heapSite(label, true)
+
+#endif // HEAP_MONITOR_H
@@ -0,0 +1,68 @@
+#ifndef HISTORY_FORMAT_H
+#define HISTORY_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Kept free of Arduino dependencies so the host tools can build it as is
+// (see esp32/tools/history_decode.cpp).
+
+// One chunk of a history transfer (see utils/sample_history.h). Each chunk is
+// complete in itself, so a lost chunk only loses its own samples. Layout,
+// little-endian:
+//
+//   0  u32  magic "LHST"
+//   4  u8   version (1)
+//   5  u8   stream id, as announced on MQTT_TOPIC_STREAMS
+//   6  u16  request id, echoed from the request
+//   8  u16  chunk index
+//   10 u8   flags: FLAG_LAST, FLAG_LOST
+//   11 u8   batch count
+//   12 batches, each a u16 length followed by a TelemetryCodec batch
+struct HistoryChunkHeader {
+    static const uint32_t MAGIC = 0x5453484C; // "LHST"
+    static const uint8_t VERSION = 1;
+    static const size_t SIZE = 12;
+    static const uint8_t FLAG_LAST = 0x01; // The transfer ends with this chunk
+    static const uint8_t FLAG_LOST = 0x02; // Samples just before this chunk were overwritten before they were sent
+    
+    uint8_t stream;
+    uint16_t requestId;
+    uint16_t chunkIndex;
+    uint8_t flags;
+    uint8_t batchCount;
+    
+    void write(uint8_t* out) const {
+        out[0] = MAGIC & 0xFF;
+        out[1] = (MAGIC >> 8) & 0xFF;
+        out[2] = (MAGIC >> 16) & 0xFF;
+        out[3] = MAGIC >> 24;
+        out[4] = VERSION;
+        out[5] = stream;
+        out[6] = requestId & 0xFF;
+        out[7] = requestId >> 8;
+        out[8] = chunkIndex & 0xFF;
+        out[9] = chunkIndex >> 8;
+        out[10] = flags;
+        out[11] = batchCount;
+    }
+    
+    // False on a short chunk, a wrong magic or an unknown version
+    bool read(const uint8_t* in, size_t length) {
+        if (length < SIZE) {
+            return false;
+        }
+        uint32_t magic = in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+        if (magic != MAGIC || in[4] != VERSION) {
+            return false;
+        }
+        stream = in[5];
+        requestId = in[6] | (uint16_t)(in[7] << 8);
+        chunkIndex = in[8] | (uint16_t)(in[9] << 8);
+        flags = in[10];
+        batchCount = in[11];
+        return true;
+    }
+};
+
+#endif // HISTORY_FORMAT_H
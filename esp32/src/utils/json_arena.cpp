@@ -0,0 +1,173 @@
+#include "json_arena.h"
+#include "heap_monitor.h"
+#include "../config/config.h"
+#include <esp_heap_caps.h>
+
+// Every block starts with its size, for reallocate(), and the offset of the
+// block below it, so freeing the top block can give back any freed under it
+struct JsonArenaBlock {
+    uint32_t size;
+    uint32_t previous;
+};
+
+#define JSON_ARENA_NO_BLOCK 0xFFFFFFFFu
+#define JSON_ARENA_FREED 0x80000000u
+#define JSON_ARENA_ALIGN(size) (((size) + 7) & ~(size_t)7)
+
+// Static member initialisation
+uint8_t* JsonArena::_buffer = nullptr;
+size_t JsonArena::_capacity = 0;
+size_t JsonArena::_used = 0;
+uint32_t JsonArena::_lastBlock = JSON_ARENA_NO_BLOCK;
+uint16_t JsonArena::_live = 0;
+void* JsonArena::_loopTask = nullptr;
+size_t JsonArena::_passFallback = 0;
+size_t JsonArena::_passPeak = 0;
+size_t JsonArena::_highWater = 0;
+uint32_t JsonArena::_fallbacks = 0;
+uint32_t JsonArena::_grown = 0;
+uint32_t JsonArena::_busyResets = 0;
+
+bool JsonArena::begin() {
+    _loopTask = xTaskGetCurrentTaskHandle();
+    _buffer = (uint8_t*)heap_caps_malloc(JSON_ARENA_BYTES, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!_buffer) {
+        Serial.printf("JSON arena: failed to allocate %u bytes\n", (unsigned)JSON_ARENA_BYTES);
+        return false;
+    }
+    _capacity = JSON_ARENA_BYTES;
+    Serial.printf("JSON arena: %u bytes\n", (unsigned)_capacity);
+    return true;
+}
+
+void* JsonArena::allocate(size_t size) {
+    if (_buffer == nullptr || xTaskGetCurrentTaskHandle() != _loopTask) {
+        return malloc(size);
+    }
+    
+    size_t needed = sizeof(JsonArenaBlock) + JSON_ARENA_ALIGN(size);
+    if (_used + needed > _capacity) {
+        // Counted towards this pass's demand, so the next reset can make room
+        _fallbacks++;
+        _passFallback += needed;
+        _notePeak();
+        return malloc(size);
+    }
+    
+    JsonArenaBlock* header = (JsonArenaBlock*)(_buffer + _used);
+    header->size = size;
+    header->previous = _lastBlock;
+    _lastBlock = _used;
+    _used += needed;
+    _live++;
+    _notePeak();
+    return header + 1;
+}
+
+void JsonArena::deallocate(void* block) {
+    if (block == nullptr) {
+        return;
+    }
+    if (!_owns(block)) {
+        free(block);
+        return;
+    }
+    
+    ((JsonArenaBlock*)block - 1)->size |= JSON_ARENA_FREED;
+    _live--;
+    
+    // Documents usually go in reverse order, which rewinds the arena as they do
+    while (_lastBlock != JSON_ARENA_NO_BLOCK) {
+        JsonArenaBlock* top = (JsonArenaBlock*)(_buffer + _lastBlock);
+        if (!(top->size & JSON_ARENA_FREED)) {
+            break;
+        }
+        _used = _lastBlock;
+        _lastBlock = top->previous;
+    }
+}
+
+void* JsonArena::reallocate(void* block, size_t size) {
+    if (block == nullptr) {
+        return allocate(size);
+    }
+    if (!_owns(block)) {
+        return realloc(block, size);
+    }
+    
+    JsonArenaBlock* header = (JsonArenaBlock*)block - 1;
+    uint32_t offset = (uint8_t*)header - _buffer;
+    size_t end = offset + sizeof(JsonArenaBlock) + JSON_ARENA_ALIGN(size);
+    if (offset == _lastBlock && end <= _capacity) {
+        // The top block grows or shrinks where it is
+        header->size = size;
+        _used = end;
+        _notePeak();
+        return block;
+    }
+    if (size <= header->size) {
+        return block;
+    }
+    
+    void* moved = allocate(size);
+    if (moved) {
+        memcpy(moved, block, header->size);
+    }
+    deallocate(block);
+    return moved;
+}
+
+void JsonArena::reset() {
+    if (_buffer == nullptr) {
+        return;
+    }
+    if (_passPeak > _highWater) {
+        _highWater = _passPeak;
+    }
+    
+    if (_live > 0) {
+        // The pass's peak carries over, so the arena can still grow at the next reset
+        _busyResets++;
+    } else {
+        // Only with nothing left in the arena can it move
+        if (_passPeak > _capacity && _capacity < JSON_ARENA_MAX_BYTES) {
+            size_t capacity = (_passPeak + 255) & ~(size_t)255;
+            if (capacity > JSON_ARENA_MAX_BYTES) {
+                capacity = JSON_ARENA_MAX_BYTES;
+            }
+            HEAP_SITE_EXEMPT("json.arena");
+            uint8_t* buffer = (uint8_t*)heap_caps_malloc(capacity, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+            if (buffer) {
+                heap_caps_free(_buffer);
+                _buffer = buffer;
+                _capacity = capacity;
+                _grown++;
+                Serial.printf("JSON arena grown to %u bytes\n", (unsigned)capacity);
+            }
+        }
+        _used = 0;
+        _lastBlock = JSON_ARENA_NO_BLOCK;
+        _passPeak = 0;
+    }
+    _passFallback = 0;
+}
+
+void JsonArena::writeStatus(JsonObject arena) {
+    arena["capacity_bytes"] = _capacity;
+    arena["max_bytes"] = JSON_ARENA_MAX_BYTES;
+    arena["high_water_bytes"] = _highWater;
+    arena["fallbacks"] = _fallbacks;
+    arena["grown"] = _grown;
+    arena["busy_resets"] = _busyResets;
+}
+
+bool JsonArena::_owns(const void* block) {
+    return _buffer != nullptr && block >= _buffer && block < _buffer + _capacity;
+}
+
+void JsonArena::_notePeak() {
+    size_t demand = _used + _passFallback;
+    if (demand > _passPeak) {
+        _passPeak = demand;
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef JSON_ARENA_H
+#define JSON_ARENA_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Bump allocator for the short-lived JSON documents built on the loop task
+// (sensor frames, device status, JsonHelper responses). Documents take their
+// pool from one buffer and freeing is a no-op, except that the most recent
+// block is given back; reset() at the end of each loop pass rewinds the whole
+// arena. Blocks that don't fit, and any requested from another task, come from
+// the heap instead. A pass that needed more than the arena is remembered, and
+// the next reset regrows it to that high-water mark (up to JSON_ARENA_MAX_BYTES),
+// so after the first few passes the document churn no longer reaches the heap.
+class JsonArena {
+public:
+    // Call from the loop task; allocates JSON_ARENA_BYTES
+    static bool begin();
+    
+    static void* allocate(size_t size);
+    static void deallocate(void* block);
+    static void* reallocate(void* block, size_t size);
+    
+    // End of a loop pass: rewinds the arena once no document is left in it
+    static void reset();
+    
+    static void writeStatus(JsonObject arena);
+    
+private:
+    static uint8_t* _buffer;
+    static size_t _capacity;
+    static size_t _used;
+    static uint32_t _lastBlock;   // Offset of the topmost block's header
+    static uint16_t _live;        // Blocks handed out and not yet freed
+    static void* _loopTask;
+    
+    static size_t _passFallback;  // Bytes that went to the heap this pass
+    static size_t _passPeak;      // Arena plus heap bytes this pass needed at most
+    static size_t _highWater;     // Largest pass peak since boot
+    static uint32_t _fallbacks;   // Blocks that went to the heap because the arena was full
+    static uint32_t _grown;
+    static uint32_t _busyResets;  // Resets skipped because a document outlived its pass
+    
+    static bool _owns(const void* block);
+    static void _notePeak();
+};
+
+// ArduinoJson allocator over the arena
+struct JsonArenaAllocator {
+    void* allocate(size_t size) { return JsonArena::allocate(size); }
+    void deallocate(void* block) { JsonArena::deallocate(block); }
+    void* reallocate(void* block, size_t size) { return JsonArena::reallocate(block, size); }
+};
+
+// Drop-in for DynamicJsonDocument in anything built and released within one loop pass
+typedef BasicJsonDocument<JsonArenaAllocator> ArenaJsonDocument;
+
+#endif // JSON_ARENA_H
@@ -1,8 +1,8 @@
 #include "json_helper.h"
 #include "../config/config.h"
 
-DynamicJsonDocument JsonHelper::createSystemStatus(const String& status, const String& message) {
-    DynamicJsonDocument doc(512);
+ArenaJsonDocument JsonHelper::createSystemStatus(const String& status, const String& message) {
+    ArenaJsonDocument doc(512);
     doc["status"] = status;
     doc["device_id"] = DEVICE_ID;
     doc["firmware_version"] = FIRMWARE_VERSION;
@@ -16,8 +16,8 @@ DynamicJsonDocument JsonHelper::createSystemStatus(const String& status, const S
     return doc;
 }
 
-DynamicJsonDocument JsonHelper::createErrorResponse(const String& error, const String& context) {
-    DynamicJsonDocument doc(256);
+ArenaJsonDocument JsonHelper::createErrorResponse(const String& error, const String& context) {
+    ArenaJsonDocument doc(256);
     doc["error"] = error;
     doc["device_id"] = DEVICE_ID;
     doc["timestamp"] = millis();
@@ -29,8 +29,8 @@ DynamicJsonDocument JsonHelper::createErrorResponse(const String& error, const S
     return doc;
 }
 
-DynamicJsonDocument JsonHelper::createSuccessResponse(const String& message) {
-    DynamicJsonDocument doc(256);
+ArenaJsonDocument JsonHelper::createSuccessResponse(const String& message) {
+    ArenaJsonDocument doc(256);
     doc["success"] = true;
     doc["device_id"] = DEVICE_ID;
     doc["timestamp"] = millis();
@@ -43,12 +43,12 @@ DynamicJsonDocument JsonHelper::createSuccessResponse(const String& message) {
 }
 
 bool JsonHelper::isValidJson(const String& jsonString) {
-    DynamicJsonDocument doc(256);
+    ArenaJsonDocument doc(256);
     DeserializationError error = deserializeJson(doc, jsonString);
     return error == DeserializationError::Ok;
 }
 
-bool JsonHelper::parseJson(const String& jsonString, DynamicJsonDocument& doc) {
+bool JsonHelper::parseJson(const String& jsonString, JsonDocument& doc) {
     DeserializationError error = deserializeJson(doc, jsonString);
     if (error) {
         Serial.printf("JSON parse error: %s\n", error.c_str());
@@ -57,30 +57,30 @@ bool JsonHelper::parseJson(const String& jsonString, DynamicJsonDocument& doc) {
     return true;
 }
 
-String JsonHelper::prettify(const DynamicJsonDocument& doc) {
+String JsonHelper::prettify(const JsonDocument& doc) {
     String output;
     serializeJsonPretty(doc, output);
     return output;
 }
 
-size_t JsonHelper::getJsonSize(const DynamicJsonDocument& doc) {
+size_t JsonHelper::getJsonSize(const JsonDocument& doc) {
     return measureJson(doc);
 }
 
-DynamicJsonDocument JsonHelper::createLEDCommand(bool state) {
-    DynamicJsonDocument doc(128);
+ArenaJsonDocument JsonHelper::createLEDCommand(bool state) {
+    ArenaJsonDocument doc(128);
     doc["state"] = state;
     return doc;
 }
 
-DynamicJsonDocument JsonHelper::createLEDCommand(uint8_t brightness) {
-    DynamicJsonDocument doc(128);
+ArenaJsonDocument JsonHelper::createLEDCommand(uint8_t brightness) {
+    ArenaJsonDocument doc(128);
     doc["brightness"] = brightness;
     return doc;
 }
 
-DynamicJsonDocument JsonHelper::createLEDBlinkCommand(unsigned long onTime, unsigned long offTime, int cycles) {
-    DynamicJsonDocument doc(256);
+ArenaJsonDocument JsonHelper::createLEDBlinkCommand(unsigned long onTime, unsigned long offTime, int cycles) {
+    ArenaJsonDocument doc(256);
     JsonObject blink = doc.createNestedObject("blink");
     blink["on_time"] = onTime;
     blink["off_time"] = offTime;
@@ -2,26 +2,27 @@
 #define JSON_HELPER_H
 
 #include <ArduinoJson.h>
+#include "json_arena.h"
 
 class JsonHelper {
 public:
     // Create standardized JSON documents
-    static DynamicJsonDocument createSystemStatus(const String& status, const String& message = "");
-    static DynamicJsonDocument createErrorResponse(const String& error, const String& context = "");
-    static DynamicJsonDocument createSuccessResponse(const String& message = "");
+    static ArenaJsonDocument createSystemStatus(const String& status, const String& message = "");
+    static ArenaJsonDocument createErrorResponse(const String& error, const String& context = "");
+    static ArenaJsonDocument createSuccessResponse(const String& message = "");
     
     // JSON validation and parsing
     static bool isValidJson(const String& jsonString);
-    static bool parseJson(const String& jsonString, DynamicJsonDocument& doc);
+    static bool parseJson(const String& jsonString, JsonDocument& doc);
     
     // JSON utilities
-    static String prettify(const DynamicJsonDocument& doc);
-    static size_t getJsonSize(const DynamicJsonDocument& doc);
+    static String prettify(const JsonDocument& doc);
+    static size_t getJsonSize(const JsonDocument& doc);
     
     // Device command helpers
-    static DynamicJsonDocument createLEDCommand(bool state);
-    static DynamicJsonDocument createLEDCommand(uint8_t brightness);
-    static DynamicJsonDocument createLEDBlinkCommand(unsigned long onTime, unsigned long offTime, int cycles = -1);
+    static ArenaJsonDocument createLEDCommand(bool state);
+    static ArenaJsonDocument createLEDCommand(uint8_t brightness);
+    static ArenaJsonDocument createLEDBlinkCommand(unsigned long onTime, unsigned long offTime, int cycles = -1);
     
 private:
     static const size_t JSON_BUFFER_SIZE = 1024;
@@ -0,0 +1,40 @@
+#include "nvs_cache.h"
+
+// Static member initialisation
+Preferences NVSCache::_preferences;
+bool NVSCache::_open = false;
+
+bool NVSCache::begin() {
+    if (!_open) {
+        _open = _preferences.begin("bootcache", false);
+        if (!_open) {
+            Serial.println("Failed to open NVS boot cache");
+        }
+    }
+    return _open;
+}
+
+bool NVSCache::load(const char* key, void* data, size_t length) {
+    if (!begin() || _preferences.getBytesLength(key) != length) {
+        return false;
+    }
+    return _preferences.getBytes(key, data, length) == length;
+}
+
+bool NVSCache::store(const char* key, const void* data, size_t length) {
+    if (!begin()) {
+        return false;
+    }
+    
+    uint8_t current[64];
+    if (length <= sizeof(current) && load(key, current, length) && memcmp(current, data, length) == 0) {
+        return true;
+    }
+    return _preferences.putBytes(key, data, length) == length;
+}
+
+void NVSCache::remove(const char* key) {
+    if (begin() && _preferences.isKey(key)) {
+        _preferences.remove(key);
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef NVS_CACHE_H
+#define NVS_CACHE_H
+
+#include <Preferences.h>
+
+// Small binary values kept in NVS across reboots so the next boot can skip
+// discovery (WiFi scan, DHCP, IMU detection). Stores are skipped when the value
+// is unchanged, so calling store() on every boot costs no flash wear.
+class NVSCache {
+public:
+    static bool begin();
+    
+    // Returns false if the key is missing or was stored with a different size
+    static bool load(const char* key, void* data, size_t length);
+    static bool store(const char* key, const void* data, size_t length);
+    static void remove(const char* key);
+    
+private:
+    static Preferences _preferences;
+    static bool _open;
+};
+
+#endif // NVS_CACHE_H
@@ -0,0 +1,116 @@
+#include "rate_controller.h"
+#include "runtime_config.h"
+#include "../config/config.h"
+
+// Publish backoff by signal strength, strongest first
+struct RssiTier {
+    int minRssi;
+    uint8_t backoff;
+};
+
+static const RssiTier RSSI_TIERS[] = {
+    { -67, 1 },
+    { -75, 2 },
+    { -85, 4 },
+};
+static const uint8_t RSSI_WEAKEST_BACKOFF = 8;
+
+static const unsigned long FAILURE_WINDOW_MS = 5000;
+static const float RSSI_SMOOTHING = 0.1f; // Per loop; roughly a one-second average
+
+RateController::RateController()
+    : _active(false), _quietSince(0), _rssi(0.0f), _rssiValid(false),
+      _failureBackoff(1), _lastFailures(0), _windowStart(0) {
+}
+
+void RateController::updateMotion(float energy) {
+    unsigned long now = millis();
+    
+    if (energy >= RuntimeConfig::getFloat(ConfigParam::MOTION_ACTIVE)) {
+        if (!_active) {
+            Serial.printf("Motion detected (energy %.3f), sampling every %lu ms\n",
+                         energy, (unsigned long)RuntimeConfig::getUInt(ConfigParam::ACTIVE_SAMPLE_INTERVAL));
+        }
+        _active = true;
+        _quietSince = 0;
+        return;
+    }
+    
+    // Hysteresis: only a sustained quiet spell slows sampling down again
+    if (!_active || energy > RuntimeConfig::getFloat(ConfigParam::MOTION_QUIET)) {
+        _quietSince = 0;
+        return;
+    }
+    if (_quietSince == 0) {
+        _quietSince = now;
+    } else if (now - _quietSince >= RuntimeConfig::getUInt(ConfigParam::MOTION_HOLD)) {
+        Serial.printf("Motion settled, sampling every %lu ms\n",
+                      (unsigned long)RuntimeConfig::getUInt(ConfigParam::SAMPLE_INTERVAL));
+        _active = false;
+        _quietSince = 0;
+    }
+}
+
+void RateController::updateLink(bool connected, int rssi, uint32_t failures) {
+    unsigned long now = millis();
+    
+    if (connected && rssi < 0) {
+        _rssi = _rssiValid ? _rssi + RSSI_SMOOTHING * (rssi - _rssi) : rssi;
+        _rssiValid = true;
+    } else if (!connected) {
+        _rssiValid = false;
+    }
+    
+    if (now - _windowStart < FAILURE_WINDOW_MS) {
+        return;
+    }
+    _windowStart = now;
+    
+    if (failures != _lastFailures) {
+        if (_failureBackoff < RuntimeConfig::getUInt(ConfigParam::MAX_BACKOFF)) {
+            _failureBackoff *= 2;
+        }
+    } else if (_failureBackoff > 1) {
+        _failureBackoff /= 2;
+    }
+    _lastFailures = failures;
+}
+
+unsigned long RateController::getSampleInterval() const {
+    return RuntimeConfig::getUInt(_active ? ConfigParam::ACTIVE_SAMPLE_INTERVAL : ConfigParam::SAMPLE_INTERVAL);
+}
+
+unsigned long RateController::getPublishInterval() const {
+#if TELEMETRY_BATCHING
+    // Batches carry every sample, so only the batch cadence backs off
+    return (unsigned long)RuntimeConfig::getUInt(ConfigParam::BATCH_INTERVAL) * getBackoff();
+#else
+    return getSampleInterval() * getBackoff();
+#endif
+}
+
+uint8_t RateController::getBackoff() const {
+    uint16_t backoff = (uint16_t)_rssiBackoff() * _failureBackoff;
+    uint32_t maxBackoff = RuntimeConfig::getUInt(ConfigParam::MAX_BACKOFF);
+    return backoff > maxBackoff ? maxBackoff : backoff;
+}
+
+void RateController::writeStatus(JsonObject rate) const {
+    rate["mode"] = _active ? "active" : "idle";
+    rate["sample_ms"] = getSampleInterval();
+    rate["publish_ms"] = getPublishInterval();
+    rate["backoff"] = getBackoff();
+}
+
+uint8_t RateController::_rssiBackoff() const {
+    if (!_rssiValid) {
+        return 1;
+    }
+    
+    for (const RssiTier& tier : RSSI_TIERS) {
+        if (_rssi >= tier.minRssi) {
+            return tier.backoff;
+        }
+    }
+    return RSSI_WEAKEST_BACKOFF;
+}
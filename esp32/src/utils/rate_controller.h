@@ -0,0 +1,49 @@
+#ifndef RATE_CONTROLLER_H
+#define RATE_CONTROLLER_H
+
+#include <ArduinoJson.h>
+
+// Chooses the sampling and telemetry publish intervals at runtime.
+//
+// Sampling switches to SENSOR_ACTIVE_INTERVAL_MS while the short-term motion
+// energy is above MOTION_ENERGY_ACTIVE, and back to SENSOR_READ_INTERVAL_MS once
+// it has stayed below MOTION_ENERGY_QUIET for MOTION_QUIET_HOLD_MS.
+//
+// Publishing follows sampling, multiplied by a backoff from link quality: a
+// factor from the smoothed RSSI, doubled for each evaluation window with
+// failed or dropped publishes and halved for each clean one. Setting
+// SENSOR_ACTIVE_INTERVAL_MS to SENSOR_READ_INTERVAL_MS and RATE_MAX_BACKOFF
+// to 1 gives a fixed rate.
+//
+// All of these are the defaults of RuntimeConfig parameters and are read on
+// every call, so changes made over the config topic apply straight away.
+class RateController {
+public:
+    RateController();
+    
+    // Call once per loop with the largest activity among the sensors
+    void updateMotion(float energy);
+    
+    // Call once per loop; failures is a running total of failed or dropped publishes
+    void updateLink(bool connected, int rssi, uint32_t failures);
+    
+    bool isActive() const { return _active; }
+    unsigned long getSampleInterval() const;
+    unsigned long getPublishInterval() const;
+    uint8_t getBackoff() const;
+    
+    void writeStatus(JsonObject rate) const;
+    
+private:
+    bool _active;
+    unsigned long _quietSince;
+    float _rssi;              // Smoothed dBm
+    bool _rssiValid;
+    uint8_t _failureBackoff;
+    uint32_t _lastFailures;
+    unsigned long _windowStart;
+    
+    uint8_t _rssiBackoff() const;
+};
+
+#endif // RATE_CONTROLLER_H
@@ -0,0 +1,378 @@
+#include "runtime_config.h"
+#include "../config/config.h"
+#include "../communication/telemetry_codec.h"
+#include <math.h>
+
+static char mqttServer[CONFIG_STRING_MAX];
+static char udpCollector[CONFIG_STRING_MAX];
+static char udpStreams[CONFIG_STRING_MAX];
+
+static bool isAccelRange(float value) {
+    return value == 2 || value == 4 || value == 8 || value == 16;
+}
+
+static bool isGyroRange(float value) {
+    return value == 250 || value == 500 || value == 1000 || value == 2000;
+}
+
+// Indexed by ConfigParam
+static const ConfigSpec SPECS[] = {
+    { "sensor.interval_ms", "smp_idle", ConfigType::UINT, 10, 600000, SENSOR_READ_INTERVAL_MS, nullptr, nullptr, nullptr, 0 },
+    { "sensor.active_interval_ms", "smp_active", ConfigType::UINT, 5, 60000, SENSOR_ACTIVE_INTERVAL_MS, nullptr, nullptr, nullptr, 0 },
+    { "motion.active", "mot_active", ConfigType::FLOAT, 0.0001f, 100, MOTION_ENERGY_ACTIVE, nullptr, nullptr, nullptr, 0 },
+    { "motion.quiet", "mot_quiet", ConfigType::FLOAT, 0, 100, MOTION_ENERGY_QUIET, nullptr, nullptr, nullptr, 0 },
+    { "motion.hold_ms", "mot_hold", ConfigType::UINT, 0, 600000, MOTION_QUIET_HOLD_MS, nullptr, nullptr, nullptr, 0 },
+    { "rate.max_backoff", "max_backoff", ConfigType::UINT, 1, 64, RATE_MAX_BACKOFF, nullptr, nullptr, nullptr, 0 },
+    { "status.interval_ms", "stat_int", ConfigType::UINT, 1000, 3600000, STATUS_REPORT_INTERVAL_MS, nullptr, nullptr, nullptr, 0 },
+    { "status.snapshot_ms", "stat_snap", ConfigType::UINT, 10000, 86400000, STATUS_SNAPSHOT_INTERVAL_MS, nullptr, nullptr, nullptr, 0 },
+    { "status.deadband_scale", "stat_dband", ConfigType::FLOAT, 0, 100, 1.0f, nullptr, nullptr, nullptr, 0 },
+    { "batch.samples", "batch_samples", ConfigType::UINT, 1, TELEMETRY_BATCH_MAX_SAMPLES, TELEMETRY_BATCH_MAX_SAMPLES, nullptr, nullptr, nullptr, 0 },
+    { "batch.interval_ms", "batch_int", ConfigType::UINT, 50, 600000, TELEMETRY_BATCH_INTERVAL_MS, nullptr, nullptr, nullptr, 0 },
+    { "mqtt.telemetry_bps", "tlm_bps", ConfigType::UINT, 0, 1000000, MQTT_RATE_TELEMETRY_BPS, nullptr, nullptr, nullptr, 0 },
+    { "imu.accel_range_g", "imu_accel", ConfigType::UINT, 2, 16, IMU_ACCEL_RANGE_G, nullptr, nullptr, isAccelRange, CONFIG_FLAG_RESTART },
+    { "imu.gyro_range_dps", "imu_gyro", ConfigType::UINT, 250, 2000, IMU_GYRO_RANGE_DPS, nullptr, nullptr, isGyroRange, CONFIG_FLAG_RESTART },
+    { "mqtt.server", "mqtt_server", ConfigType::STRING, 1, CONFIG_STRING_MAX - 1, 0, MQTT_SERVER, mqttServer, nullptr, CONFIG_FLAG_RESTART },
+    { "mqtt.port", "mqtt_port", ConfigType::UINT, 1, 65535, MQTT_PORT, nullptr, nullptr, nullptr, CONFIG_FLAG_RESTART },
+    { "udp.collector", "udp_host", ConfigType::STRING, 0, CONFIG_STRING_MAX - 1, 0, UDP_COLLECTOR_HOST, udpCollector, nullptr, 0 },
+    { "udp.port", "udp_port", ConfigType::UINT, 1, 65535, UDP_COLLECTOR_PORT, nullptr, nullptr, nullptr, 0 },
+    { "udp.streams", "udp_streams", ConfigType::STRING, 0, CONFIG_STRING_MAX - 1, 0, UDP_STREAM_SENSORS, udpStreams, nullptr, 0 },
+    { "trigger.mode", "trg_mode", ConfigType::UINT, 0, 3, TRIGGER_MODE, nullptr, nullptr, nullptr, 0 },
+    { "trigger.channel", "trg_channel", ConfigType::UINT, 0, TELEMETRY_BATCH_MAX_CHANNELS - 1, TRIGGER_CHANNEL, nullptr, nullptr, nullptr, 0 },
+    { "trigger.level", "trg_level", ConfigType::UINT, 1, 65535, TRIGGER_LEVEL, nullptr, nullptr, nullptr, 0 },
+    { "trigger.pre_ms", "trg_pre", ConfigType::UINT, 0, 60000, TRIGGER_PRE_MS, nullptr, nullptr, nullptr, 0 },
+    { "trigger.post_ms", "trg_post", ConfigType::UINT, 0, 60000, TRIGGER_POST_MS, nullptr, nullptr, nullptr, 0 },
+};
+
+static_assert(sizeof(SPECS) / sizeof(SPECS[0]) == (size_t)ConfigParam::COUNT, "SPECS must match ConfigParam");
+
+// Static member initialisation
+std::atomic<uint32_t> RuntimeConfig::_values[(size_t)ConfigParam::COUNT];
+std::atomic<uint32_t> RuntimeConfig::_generation(0);
+Preferences RuntimeConfig::_preferences;
+bool RuntimeConfig::_open = false;
+
+static uint32_t floatToWord(float value) {
+    uint32_t word;
+    memcpy(&word, &value, sizeof(word));
+    return word;
+}
+
+static float wordToFloat(uint32_t word) {
+    float value;
+    memcpy(&value, &word, sizeof(value));
+    return value;
+}
+
+static float wordToNumber(const ConfigSpec& spec, uint32_t word) {
+    return spec.type == ConfigType::FLOAT ? wordToFloat(word) : (float)word;
+}
+
+void RuntimeConfig::begin() {
+    _open = _preferences.begin("config", false);
+    if (!_open) {
+        Serial.println("Failed to open NVS config, using defaults");
+    }
+    
+    uint8_t overrides = 0;
+    for (size_t i = 0; i < (size_t)ConfigParam::COUNT; i++) {
+        const ConfigSpec& spec = SPECS[i];
+        bool stored = _open && _preferences.isKey(spec.nvsKey);
+        
+        if (spec.type == ConfigType::STRING) {
+            strlcpy(spec.text, spec.defaultString, CONFIG_STRING_MAX);
+            if (stored) {
+                char text[CONFIG_STRING_MAX];
+                size_t length = _preferences.getString(spec.nvsKey, text, sizeof(text));
+                // getString counts the terminator
+                if (length > spec.minimum && length <= spec.maximum + 1) {
+                    strlcpy(spec.text, text, CONFIG_STRING_MAX);
+                    overrides++;
+                }
+            }
+            continue;
+        }
+        
+        uint32_t word = _defaultWord(spec);
+        if (stored) {
+            uint32_t value = _preferences.getUInt(spec.nvsKey, word);
+            if (_inRange(spec, wordToNumber(spec, value))) {
+                word = value;
+                overrides++;
+            } else {
+                Serial.printf("Ignoring out-of-range stored config %s\n", spec.key);
+            }
+        }
+        _values[i].store(word, std::memory_order_relaxed);
+    }
+    
+    // A stored pair that no longer makes sense falls back to the defaults
+    if (getFloat(ConfigParam::MOTION_QUIET) > getFloat(ConfigParam::MOTION_ACTIVE)) {
+        _values[(size_t)ConfigParam::MOTION_ACTIVE].store(floatToWord(MOTION_ENERGY_ACTIVE));
+        _values[(size_t)ConfigParam::MOTION_QUIET].store(floatToWord(MOTION_ENERGY_QUIET));
+    }
+    
+    _generation.fetch_add(1, std::memory_order_release);
+    if (overrides > 0) {
+        Serial.printf("Loaded %u config override(s) from NVS\n", overrides);
+    }
+}
+
+float RuntimeConfig::getFloat(ConfigParam param) {
+    return wordToFloat(getUInt(param));
+}
+
+const char* RuntimeConfig::getString(ConfigParam param) {
+    const ConfigSpec& spec = SPECS[(size_t)param];
+    return spec.type == ConfigType::STRING ? spec.text : "";
+}
+
+bool RuntimeConfig::apply(JsonObjectConst changes, JsonObject result) {
+    // Validate everything against a staged copy before touching live values
+    uint32_t staged[(size_t)ConfigParam::COUNT];
+    bool changed[(size_t)ConfigParam::COUNT] = {};
+    const char* stagedText[(size_t)ConfigParam::COUNT] = {};
+    for (size_t i = 0; i < (size_t)ConfigParam::COUNT; i++) {
+        staged[i] = _values[i].load(std::memory_order_relaxed);
+    }
+    
+    for (JsonPairConst pair : changes) {
+        const char* key = pair.key().c_str();
+        const ConfigSpec* spec = find(key);
+        const char* error = nullptr;
+        uint32_t word = 0;
+        
+        if (spec == nullptr) {
+            error = "unknown parameter";
+        } else if (_validate(*spec, pair.value(), word, error)) {
+            size_t index = spec - SPECS;
+            changed[index] = true;
+            if (spec->type == ConfigType::STRING) {
+                stagedText[index] = pair.value().isNull() ? spec->defaultString : pair.value().as<const char*>();
+            } else {
+                staged[index] = word;
+            }
+        }
+        
+        if (error) {
+            result["status"] = "rejected";
+            result["key"] = pair.key();
+            result["error"] = error;
+            return false;
+        }
+    }
+    
+    if (wordToFloat(staged[(size_t)ConfigParam::MOTION_QUIET]) >
+        wordToFloat(staged[(size_t)ConfigParam::MOTION_ACTIVE])) {
+        result["status"] = "rejected";
+        result["key"] = SPECS[(size_t)ConfigParam::MOTION_QUIET].key;
+        result["error"] = "must not exceed motion.active";
+        return false;
+    }
+    
+    // Restart parameters are only stored: their live value is the one the
+    // hardware and connection were set up with (e.g. the IMU ranges, which
+    // consumers need to scale raw counts), so it must not move before a restart
+    bool restartRequired = false;
+    uint8_t count = 0;
+    for (size_t i = 0; i < (size_t)ConfigParam::COUNT; i++) {
+        if (!changed[i]) {
+            continue;
+        }
+        const ConfigSpec& spec = SPECS[i];
+        bool restart = (spec.flags & CONFIG_FLAG_RESTART) != 0;
+        if (spec.type == ConfigType::STRING) {
+            char stored[CONFIG_STRING_MAX];
+            const char* current = spec.text;
+            if (restart) {
+                _storedText(spec, stored);
+                current = stored;
+            }
+            if (strcmp(current, stagedText[i]) == 0) {
+                continue;
+            }
+            if (!restart) {
+                strlcpy(spec.text, stagedText[i], CONFIG_STRING_MAX);
+            }
+            _persist(spec, 0, stagedText[i]);
+        } else {
+            uint32_t current = restart ? _storedWord(spec) : _values[i].load(std::memory_order_relaxed);
+            if (current == staged[i]) {
+                continue;
+            }
+            if (!restart) {
+                _values[i].store(staged[i], std::memory_order_release);
+            }
+            _persist(spec, staged[i], nullptr);
+        }
+        restartRequired |= restart;
+        count++;
+    }
+    
+    if (count > 0) {
+        _generation.fetch_add(1, std::memory_order_release);
+        Serial.printf("Applied %u config change(s)%s\n", count, restartRequired ? ", restart required" : "");
+    }
+    
+    result["status"] = "applied";
+    result["changed"] = count;
+    result["restart_required"] = restartRequired;
+    return true;
+}
+
+void RuntimeConfig::writeValues(JsonObject values) {
+    JsonObject pending;
+    for (size_t i = 0; i < (size_t)ConfigParam::COUNT; i++) {
+        _writeValue((ConfigParam)i, values);
+        
+        const ConfigSpec& spec = SPECS[i];
+        if ((spec.flags & CONFIG_FLAG_RESTART) == 0) {
+            continue;
+        }
+        char stored[CONFIG_STRING_MAX];
+        bool differs;
+        if (spec.type == ConfigType::STRING) {
+            _storedText(spec, stored);
+            differs = strcmp(stored, spec.text) != 0;
+        } else {
+            differs = _storedWord(spec) != getUInt((ConfigParam)i);
+        }
+        if (!differs) {
+            continue;
+        }
+        if (pending.isNull()) {
+            pending = values.createNestedObject("pending");
+        }
+        if (spec.type == ConfigType::STRING) {
+            pending[spec.key] = (char*)stored; // char* is copied into the document
+        } else {
+            pending[spec.key] = _storedWord(spec);
+        }
+    }
+}
+
+const ConfigSpec* RuntimeConfig::find(const char* key) {
+    for (const ConfigSpec& spec : SPECS) {
+        if (strcmp(spec.key, key) == 0) {
+            return &spec;
+        }
+    }
+    return nullptr;
+}
+
+bool RuntimeConfig::_validate(const ConfigSpec& spec, JsonVariantConst value, uint32_t& word, const char*& error) {
+    if (value.isNull()) {
+        word = _defaultWord(spec);
+        return true;
+    }
+    
+    switch (spec.type) {
+        case ConfigType::UINT:
+            if (!value.is<uint32_t>()) {
+                error = "expected a non-negative integer";
+                return false;
+            }
+            word = value.as<uint32_t>();
+            if (!_inRange(spec, (float)word)) {
+                error = "out of range";
+                return false;
+            }
+            return true;
+        
+        case ConfigType::FLOAT:
+            if (!value.is<float>()) {
+                error = "expected a number";
+                return false;
+            }
+            if (!_inRange(spec, value.as<float>())) {
+                error = "out of range";
+                return false;
+            }
+            word = floatToWord(value.as<float>());
+            return true;
+        
+        case ConfigType::STRING: {
+            if (!value.is<const char*>()) {
+                error = "expected a string";
+                return false;
+            }
+            size_t length = strlen(value.as<const char*>());
+            if (length < spec.minimum || length > spec.maximum) {
+                error = "invalid length";
+                return false;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+bool RuntimeConfig::_inRange(const ConfigSpec& spec, float value) {
+    // Written so that NaN fails
+    if (!(value >= spec.minimum && value <= spec.maximum)) {
+        return false;
+    }
+    return spec.isAllowed == nullptr || spec.isAllowed(value);
+}
+
+uint32_t RuntimeConfig::_defaultWord(const ConfigSpec& spec) {
+    return spec.type == ConfigType::FLOAT ? floatToWord(spec.defaultValue) : (uint32_t)spec.defaultValue;
+}
+
+uint32_t RuntimeConfig::_storedWord(const ConfigSpec& spec) {
+    // What begin() would load: the NVS value if valid, else the default
+    uint32_t word = _defaultWord(spec);
+    if (_open && _preferences.isKey(spec.nvsKey)) {
+        uint32_t value = _preferences.getUInt(spec.nvsKey, word);
+        if (_inRange(spec, wordToNumber(spec, value))) {
+            word = value;
+        }
+    }
+    return word;
+}
+
+void RuntimeConfig::_storedText(const ConfigSpec& spec, char* text) {
+    strlcpy(text, spec.defaultString, CONFIG_STRING_MAX);
+    if (_open && _preferences.isKey(spec.nvsKey)) {
+        char stored[CONFIG_STRING_MAX];
+        size_t length = _preferences.getString(spec.nvsKey, stored, sizeof(stored));
+        if (length > spec.minimum && length <= spec.maximum + 1) {
+            strlcpy(text, stored, CONFIG_STRING_MAX);
+        }
+    }
+}
+
+void RuntimeConfig::_persist(const ConfigSpec& spec, uint32_t word, const char* text) {
+    if (!_open) {
+        return;
+    }
+    
+    // Defaults are not stored, so a later firmware default still takes effect
+    bool isDefault = spec.type == ConfigType::STRING
+        ? strcmp(text, spec.defaultString) == 0
+        : word == _defaultWord(spec);
+    
+    if (isDefault) {
+        if (_preferences.isKey(spec.nvsKey)) {
+            _preferences.remove(spec.nvsKey);
+        }
+    } else if (spec.type == ConfigType::STRING) {
+        _preferences.putString(spec.nvsKey, text);
+    } else {
+        _preferences.putUInt(spec.nvsKey, word);
+    }
+}
+
+void RuntimeConfig::_writeValue(ConfigParam param, JsonObject values) {
+    const ConfigSpec& spec = SPECS[(size_t)param];
+    switch (spec.type) {
+        case ConfigType::UINT:
+            values[spec.key] = getUInt(param);
+            break;
+        case ConfigType::FLOAT:
+            values[spec.key] = getFloat(param);
+            break;
+        case ConfigType::STRING:
+            values[spec.key] = (const char*)spec.text;
+            break;
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef RUNTIME_CONFIG_H
+#define RUNTIME_CONFIG_H
+
+#include <atomic>
+#include <ArduinoJson.h>
+#include <Preferences.h>
+
+#define CONFIG_STRING_MAX 64
+
+// Parameters that can be changed at runtime over MQTT_TOPIC_CONFIG_SET. The
+// defaults are the config.h values; changes are persisted in NVS and override
+// them from the next boot on.
+enum class ConfigParam : uint8_t {
+    SAMPLE_INTERVAL,
+    ACTIVE_SAMPLE_INTERVAL,
+    MOTION_ACTIVE,
+    MOTION_QUIET,
+    MOTION_HOLD,
+    MAX_BACKOFF,
+    STATUS_INTERVAL,
+    SNAPSHOT_INTERVAL,
+    DEADBAND_SCALE,
+    BATCH_SAMPLES,
+    BATCH_INTERVAL,
+    TELEMETRY_RATE,
+    ACCEL_RANGE,
+    GYRO_RANGE,
+    BROKER_HOST,
+    BROKER_PORT,
+    UDP_COLLECTOR,
+    UDP_PORT,
+    UDP_STREAMS,
+    TRIGGER_CONDITION,
+    TRIGGER_SOURCE,
+    TRIGGER_THRESHOLD,
+    TRIGGER_PRE,
+    TRIGGER_POST,
+    COUNT
+};
+
+enum class ConfigType : uint8_t {
+    UINT,
+    FLOAT,
+    STRING
+};
+
+// Stored straight away, but only takes effect at the next startup; until then
+// the live value stays the one in use
+#define CONFIG_FLAG_RESTART 0x01
+
+struct ConfigSpec {
+    const char* key;      // Name on the config topic
+    const char* nvsKey;   // NVS limits keys to 15 characters
+    ConfigType type;
+    float minimum;        // Numeric range, or string length for STRING
+    float maximum;
+    float defaultValue;
+    const char* defaultString;
+    char* text;           // Storage for STRING values
+    bool (*isAllowed)(float value); // Optional further check, e.g. discrete ranges
+    uint8_t flags;
+};
+
+// Typed parameter table with validation and NVS persistence.
+//
+// Numeric values are held as one 32-bit atomic word each (floats by their bit
+// pattern), so sensor reader tasks and the loop read them without locking and
+// always see either the old or the new value. Writes only happen on the loop
+// task, from the MQTT callback. String values are read on the loop task only.
+class RuntimeConfig {
+public:
+    // Loads the defaults, then whatever valid overrides are stored in NVS
+    static void begin();
+    
+    static uint32_t getUInt(ConfigParam param) {
+        return _values[(size_t)param].load(std::memory_order_relaxed);
+    }
+    static float getFloat(ConfigParam param);
+    static const char* getString(ConfigParam param);
+    
+    // Incremented by every applied change, so consumers can refresh derived state
+    static uint32_t getGeneration() { return _generation.load(std::memory_order_acquire); }
+    
+    // Applies an object of key/value pairs all-or-nothing; null restores the
+    // default. Writes the outcome (status, error, key, restart_required) into result.
+    static bool apply(JsonObjectConst changes, JsonObject result);
+    
+    // Value in use of every parameter, keyed by name, and under "pending" any
+    // restart parameter whose stored value is waiting for the next startup
+    static void writeValues(JsonObject values);
+    
+    static const ConfigSpec* find(const char* key);
+    
+private:
+    static std::atomic<uint32_t> _values[(size_t)ConfigParam::COUNT];
+    static std::atomic<uint32_t> _generation;
+    static Preferences _preferences;
+    static bool _open;
+    
+    static bool _validate(const ConfigSpec& spec, JsonVariantConst value, uint32_t& word, const char*& error);
+    static bool _inRange(const ConfigSpec& spec, float value);
+    static uint32_t _defaultWord(const ConfigSpec& spec);
+    static uint32_t _storedWord(const ConfigSpec& spec);
+    static void _storedText(const ConfigSpec& spec, char* text);
+    static void _persist(const ConfigSpec& spec, uint32_t word, const char* text);
+    static void _writeValue(ConfigParam param, JsonObject values);
+};
+
+#endif // RUNTIME_CONFIG_H
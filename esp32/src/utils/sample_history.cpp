@@ -0,0 +1,199 @@
+#include "sample_history.h"
+#include <esp_heap_caps.h>
+
+SampleHistory::SampleHistory(HistoryChunkWriter& writer)
+    : _ringCount(0), _psram(false), _budget(0), _allocated(0), _transfers(0), _failedTransfers(0),
+      _bytesSent(0), _throughput(0), _writer(writer) {
+    memset(&_transfer, 0, sizeof(_transfer));
+}
+
+bool SampleHistory::addStream(uint8_t stream, const char* name, uint8_t layout, uint8_t channels) {
+    if (_ringCount >= HISTORY_MAX_STREAMS || channels == 0 || channels > TELEMETRY_BATCH_MAX_CHANNELS) {
+        Serial.printf("No history for %s: stream limit reached or bad channel count\n", name);
+        return false;
+    }
+    
+    Ring& ring = _rings[_ringCount++];
+    ring.name = name;
+    ring.stream = stream;
+    ring.layout = layout;
+    ring.channels = channels;
+    ring.lastSamples = 0;
+    return true;
+}
+
+bool SampleHistory::begin() {
+    if (_ringCount == 0) {
+        return true;
+    }
+    
+    // External RAM where the module has it; otherwise a smaller share of internal RAM
+    _psram = ESP.getPsramSize() > 0;
+    _budget = _psram ? HISTORY_PSRAM_BYTES : HISTORY_RAM_BYTES;
+    uint32_t caps = _psram ? MALLOC_CAP_SPIRAM : (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    size_t share = _budget / _ringCount;
+    
+    bool allAllocated = true;
+    for (uint8_t i = 0; i < _ringCount; i++) {
+        Ring& ring = _rings[i];
+        size_t recordSize = sizeof(uint32_t) + ring.channels * sizeof(int16_t);
+        if (!ring.samples.allocate(share / recordSize, ring.layout, ring.channels, caps)) {
+            Serial.printf("History for %s: failed to allocate %u bytes\n", ring.name, (unsigned)share);
+            allAllocated = false;
+            continue;
+        }
+        _allocated += ring.samples.getBytes();
+        Serial.printf("History for %s: %u samples in %s\n", ring.name, ring.samples.getDepth(),
+                      _psram ? "PSRAM" : "RAM");
+    }
+    return allAllocated;
+}
+
+void SampleHistory::capture(uint8_t stream, SensorBase& sensor) {
+    for (uint8_t i = 0; i < _ringCount; i++) {
+        Ring& ring = _rings[i];
+        if (ring.stream != stream) {
+            continue;
+        }
+        
+        uint32_t samples = sensor.getCounters().samples;
+        if (samples == ring.lastSamples) {
+            return;
+        }
+        ring.lastSamples = samples;
+        
+        uint8_t layout;
+        uint8_t channels;
+        const int16_t* sample = sensor.getFixedSample(layout, channels);
+        if (sample) {
+            ring.samples.push(sensor.getLastReadingTime(), sample);
+        }
+        return;
+    }
+}
+
+bool SampleHistory::beginTransfer(uint16_t requestId, const char* name, uint32_t fromMs, uint32_t toMs,
+                                  const char*& error) {
+    if (_transfer.active) {
+        error = "transfer in progress";
+        return false;
+    }
+    
+    // Without a name, the first stream
+    int8_t found = -1;
+    for (uint8_t i = 0; i < _ringCount && found < 0; i++) {
+        if (name == nullptr || strcmp(_rings[i].name, name) == 0) {
+            found = i;
+        }
+    }
+    if (found < 0 || _rings[found].samples.getDepth() == 0) {
+        error = "no history for sensor";
+        return false;
+    }
+    
+    const SampleRing& ring = _rings[found].samples;
+    uint32_t first = ring.lowerBound(ring.getOldest(), ring.getEnd(), fromMs);
+    uint32_t end = ring.lowerBound(first, ring.getEnd(), toMs + 1);
+    if (first == end) {
+        error = "no samples in range";
+        return false;
+    }
+    
+    memset(&_transfer, 0, sizeof(_transfer));
+    _transfer.active = true;
+    _transfer.ring = found;
+    _transfer.requestId = requestId;
+    _transfer.fromMs = ring.timestampAt(first);
+    _transfer.toMs = ring.timestampAt(end - 1);
+    _transfer.next = first;
+    _transfer.end = end;
+    _transfer.samples = end - first;
+    _transfer.startedAt = millis();
+    return true;
+}
+
+const uint8_t* SampleHistory::buildChunk(size_t& length) {
+    const Ring& ring = _rings[_transfer.ring];
+    HistoryChunkHeader header;
+    header.stream = ring.stream;
+    header.requestId = _transfer.requestId;
+    header.chunkIndex = _transfer.chunks;
+    header.flags = 0;
+    
+    // Recording doesn't wait for the transfer: skip what has been overwritten since
+    uint32_t oldest = ring.samples.getOldest();
+    if (_transfer.next < oldest) {
+        uint32_t resume = oldest < _transfer.end ? oldest : _transfer.end;
+        _transfer.lost += resume - _transfer.next;
+        _transfer.next = resume;
+        header.flags |= HistoryChunkHeader::FLAG_LOST;
+    }
+    
+    uint32_t first = _transfer.next;
+    const uint8_t* chunk = _writer.build(ring.samples, header, _transfer.next, _transfer.end, length);
+    _transfer.sent += _transfer.next - first;
+    _transfer.chunks++;
+    _transfer.bytes += length;
+    return chunk;
+}
+
+void SampleHistory::endTransfer(bool completed) {
+    if (!_transfer.active) {
+        return;
+    }
+    _transfer.active = false;
+    _transfer.completed = completed;
+    _transfer.durationMs = millis() - _transfer.startedAt;
+    _bytesSent += _transfer.bytes;
+    
+    // From the request to the last chunk handed over, so it includes the rate limit
+    if (completed) {
+        _transfers++;
+        unsigned long duration = _transfer.durationMs > 0 ? _transfer.durationMs : 1;
+        _throughput = (uint64_t)_transfer.bytes * 1000 / duration;
+    } else {
+        _failedTransfers++;
+    }
+}
+
+void SampleHistory::writeTransfer(JsonObject ack) const {
+    ack["id"] = _transfer.requestId;
+    ack["type"] = "history";
+    ack["sensor"] = _rings[_transfer.ring].name;
+    if (_transfer.active) {
+        ack["status"] = "accepted";
+        ack["from_ms"] = _transfer.fromMs;
+        ack["to_ms"] = _transfer.toMs;
+        ack["samples"] = _transfer.samples;
+        return;
+    }
+    
+    ack["status"] = _transfer.completed ? "complete" : "failed";
+    ack["samples"] = _transfer.sent;
+    ack["lost"] = _transfer.lost;
+    ack["chunks"] = _transfer.chunks;
+    ack["bytes"] = _transfer.bytes;
+    ack["ms"] = _transfer.durationMs;
+}
+
+void SampleHistory::writeStatus(JsonObject history) const {
+    history["memory"] = _psram ? "psram" : "ram";
+    history["budget_bytes"] = _budget;
+    history["allocated_bytes"] = _allocated;
+    history["transfers"] = _transfers;
+    history["failed_transfers"] = _failedTransfers;
+    history["sent_bytes"] = _bytesSent;
+    history["throughput_bps"] = _throughput;
+    
+    JsonObject streams = history.createNestedObject("streams");
+    for (uint8_t i = 0; i < _ringCount; i++) {
+        const SampleRing& samples = _rings[i].samples;
+        JsonObject stream = streams.createNestedObject(_rings[i].name);
+        stream["depth"] = samples.getDepth();
+        
+        // Time covered right now, which follows the sampling rate
+        uint32_t oldest = samples.getOldest();
+        uint32_t end = samples.getEnd();
+        stream["span_ms"] = end - oldest > 1 ? samples.timestampAt(end - 1) - samples.timestampAt(oldest) : 0;
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef SAMPLE_HISTORY_H
+#define SAMPLE_HISTORY_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "sample_ring.h"
+#include "../sensors/sensor_base.h"
+#include "../config/config.h"
+
+#define HISTORY_MAX_STREAMS 4
+
+// Full-rate history of each sensor's fixed-point samples (see
+// SensorBase::getFixedSample), so the seconds before an alarm can still be
+// fetched while telemetry goes out at the summary rate. Every stream gets an
+// equal share of HISTORY_PSRAM_BYTES in PSRAM, or of HISTORY_RAM_BYTES on
+// boards without it, allocated once at setup.
+//
+// A transfer turns the requested time range into ring positions and encodes
+// the samples into chunks (see history_format.h) one at a time, as the caller
+// has room to send them. Recording carries on meanwhile; samples that are
+// overwritten before their chunk is built are skipped and flagged as lost.
+// Used from the loop task only.
+class SampleHistory {
+public:
+    explicit SampleHistory(HistoryChunkWriter& writer);
+    
+    // Streams are added before begin(), once the sensors know their channel count
+    bool addStream(uint8_t stream, const char* name, uint8_t layout, uint8_t channels);
+    bool begin();
+    
+    // Appends the sensor's latest sample if it has taken one since the last call
+    void capture(uint8_t stream, SensorBase& sensor);
+    
+    // Starts a transfer of the samples taken from fromMs to toMs (inclusive,
+    // millis()). Returns false with an error message if it can't.
+    bool beginTransfer(uint16_t requestId, const char* name, uint32_t fromMs, uint32_t toMs, const char*& error);
+    bool isTransferring() const { return _transfer.active; }
+    // Builds the next chunk in the writer's buffer; the last one carries FLAG_LAST
+    const uint8_t* buildChunk(size_t& length);
+    // Every sample in the range has gone into a chunk
+    bool isTransferComplete() const { return _transfer.next >= _transfer.end; }
+    // Ends the transfer, counting it as failed unless every chunk went out
+    void endTransfer(bool completed);
+    
+    // The transfer as accepted, and its outcome once it has ended
+    void writeTransfer(JsonObject ack) const;
+    // Memory budget, depth per stream and retrieval throughput
+    void writeStatus(JsonObject history) const;
+    
+private:
+    struct Ring {
+        const char* name;
+        uint8_t stream;
+        uint8_t layout;
+        uint8_t channels;
+        SampleRing samples;
+        uint32_t lastSamples; // Sensor sample count at the last capture
+    };
+    
+    struct Transfer {
+        bool active;
+        bool completed;
+        uint8_t ring;
+        uint16_t requestId;
+        uint32_t fromMs;
+        uint32_t toMs;
+        uint32_t next; // Ring position of the next sample to send
+        uint32_t end;  // One past the last
+        uint32_t samples;
+        uint32_t sent;
+        uint32_t lost;
+        uint16_t chunks;
+        uint32_t bytes;
+        unsigned long startedAt;
+        unsigned long durationMs;
+    };
+    
+    Ring _rings[HISTORY_MAX_STREAMS];
+    uint8_t _ringCount;
+    bool _psram;
+    size_t _budget;
+    size_t _allocated;
+    
+    Transfer _transfer;
+    uint32_t _transfers;
+    uint32_t _failedTransfers;
+    uint32_t _bytesSent;
+    uint32_t _throughput; // Bytes per second of the last completed transfer
+    
+    HistoryChunkWriter& _writer;
+};
+
+#endif // SAMPLE_HISTORY_H
@@ -0,0 +1,86 @@
+#include "sample_ring.h"
+#include <esp_heap_caps.h>
+
+SampleRing::SampleRing()
+    : _records(nullptr), _depth(0), _written(0), _layout(0), _channels(0), _recordSize(0) {
+}
+
+bool SampleRing::allocate(uint32_t depth, uint8_t layout, uint8_t channels, uint32_t caps) {
+    _layout = layout;
+    _channels = channels;
+    _recordSize = sizeof(uint32_t) + channels * sizeof(int16_t);
+    _records = depth > 0 ? (uint8_t*)heap_caps_malloc((size_t)depth * _recordSize, caps) : nullptr;
+    _depth = _records ? depth : 0;
+    _written = 0;
+    return _records != nullptr;
+}
+
+void SampleRing::push(uint32_t timestamp, const int16_t* sample) {
+    if (_depth == 0) {
+        return;
+    }
+    uint8_t* record = _records + (_written % _depth) * _recordSize;
+    memcpy(record, &timestamp, sizeof(timestamp));
+    memcpy(record + sizeof(timestamp), sample, _channels * sizeof(int16_t));
+    _written++;
+}
+
+uint32_t SampleRing::timestampAt(uint32_t position) const {
+    uint32_t timestamp;
+    memcpy(&timestamp, _records + (position % _depth) * _recordSize, sizeof(timestamp));
+    return timestamp;
+}
+
+void SampleRing::sampleAt(uint32_t position, uint32_t& timestamp, int16_t* values) const {
+    const uint8_t* record = _records + (position % _depth) * _recordSize;
+    memcpy(&timestamp, record, sizeof(timestamp));
+    memcpy(values, record + sizeof(timestamp), _channels * sizeof(int16_t));
+}
+
+uint32_t SampleRing::lowerBound(uint32_t begin, uint32_t end, uint32_t ms) const {
+    // Timestamps only increase; compared as differences so millis() wrap is harmless
+    while (begin < end) {
+        uint32_t middle = begin + (end - begin) / 2;
+        if ((int32_t)(timestampAt(middle) - ms) < 0) {
+            begin = middle + 1;
+        } else {
+            end = middle;
+        }
+    }
+    return begin;
+}
+
+const uint8_t* HistoryChunkWriter::build(const SampleRing& ring, HistoryChunkHeader& header, uint32_t& next,
+                                         uint32_t end, size_t& length) {
+    // As many batches as fit; the first always does
+    size_t used = HistoryChunkHeader::SIZE;
+    int16_t values[TELEMETRY_BATCH_MAX_CHANNELS];
+    header.batchCount = 0;
+    while (next < end && header.batchCount < 255) {
+        _batch.reset(ring.getLayout(), ring.getChannels());
+        uint32_t position = next;
+        while (position < end && !_batch.isFull()) {
+            uint32_t timestamp;
+            ring.sampleAt(position, timestamp, values);
+            _batch.add(timestamp, values);
+            position++;
+        }
+        
+        size_t encoded = _codec.encode(_batch, _chunk + used + 2, sizeof(_chunk) - used - 2);
+        if (encoded == 0) {
+            break;
+        }
+        _chunk[used] = encoded & 0xFF;
+        _chunk[used + 1] = encoded >> 8;
+        used += 2 + encoded;
+        header.batchCount++;
+        next = position;
+    }
+    
+    if (next >= end) {
+        header.flags |= HistoryChunkHeader::FLAG_LAST;
+    }
+    header.write(_chunk);
+    length = used;
+    return _chunk;
+}
@@ -0,0 +1,63 @@
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <Arduino.h>
+#include "history_format.h"
+#include "../communication/telemetry_codec.h"
+
+// Ring of fixed-point samples (see SensorBase::getFixedSample), each a u32
+// timestamp and the channel values. Positions count records since the last
+// clear(), so a position stays valid until the ring has wrapped past it.
+// Shared by the sample history and triggered capture; loop task only.
+class SampleRing {
+public:
+    SampleRing();
+    
+    // One allocation for the life of the ring, in the heap_caps memory given
+    bool allocate(uint32_t depth, uint8_t layout, uint8_t channels, uint32_t caps);
+    
+    void push(uint32_t timestamp, const int16_t* sample);
+    void clear() { _written = 0; }
+    
+    uint32_t getDepth() const { return _depth; }
+    uint8_t getLayout() const { return _layout; }
+    uint8_t getChannels() const { return _channels; }
+    size_t getBytes() const { return (size_t)_depth * _recordSize; }
+    // Next position to be written, and the oldest one still held
+    uint32_t getEnd() const { return _written; }
+    uint32_t getOldest() const { return _written > _depth ? _written - _depth : 0; }
+    
+    uint32_t timestampAt(uint32_t position) const;
+    void sampleAt(uint32_t position, uint32_t& timestamp, int16_t* values) const;
+    // First position in [begin, end) whose timestamp is at or after ms
+    uint32_t lowerBound(uint32_t begin, uint32_t end, uint32_t ms) const;
+    
+private:
+    uint8_t* _records;
+    uint32_t _depth;
+    uint32_t _written;
+    uint8_t _layout;
+    uint8_t _channels;
+    uint8_t _recordSize;
+};
+
+// Chunk size: one MQTT packet with the topic and MQTT 5 properties
+#define HISTORY_CHUNK_SIZE 1792
+
+// Packs ring ranges into history chunks (see history_format.h) in one shared
+// buffer. Holds no state between chunks, so any number of senders can share
+// it as long as each chunk is published before the next is built.
+class HistoryChunkWriter {
+public:
+    // Fills the chunk with batches from next towards end, advancing next;
+    // header.batchCount is set here and FLAG_LAST once next reaches end
+    const uint8_t* build(const SampleRing& ring, HistoryChunkHeader& header, uint32_t& next, uint32_t end,
+                         size_t& length);
+                         
+private:
+    TelemetryCodec _codec;
+    TelemetryBatch _batch;
+    uint8_t _chunk[HISTORY_CHUNK_SIZE];
+};
+
+#endif // SAMPLE_RING_H
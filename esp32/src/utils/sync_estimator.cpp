@@ -0,0 +1,70 @@
+#include "sync_estimator.h"
+
+SyncEstimator::SyncEstimator() {
+    reset();
+}
+
+void SyncEstimator::reset() {
+    _count = 0;
+    _next = 0;
+    _exchanges = 0;
+}
+
+bool SyncEstimator::addExchange(int64_t t1, int64_t t2, int64_t t3, int64_t t4) {
+    int64_t delay = (t4 - t1) - (t3 - t2);
+    if (delay < 0 || t4 < t1 || t3 < t2) {
+        return false;
+    }
+    
+    Exchange& exchange = _window[_next];
+    exchange.localUs = t1 + (t4 - t1) / 2;
+    exchange.offsetUs = ((t2 - t1) + (t3 - t4)) / 2;
+    exchange.delayUs = delay > UINT32_MAX ? UINT32_MAX : (uint32_t)delay;
+    
+    _next = (_next + 1) % SYNC_ESTIMATOR_WINDOW;
+    if (_count < SYNC_ESTIMATOR_WINDOW) {
+        _count++;
+    }
+    _exchanges++;
+    return true;
+}
+
+int64_t SyncEstimator::getOffset(int64_t localUs) const {
+    const Exchange* best = _best(localUs);
+    return best ? best->offsetUs : 0;
+}
+
+uint32_t SyncEstimator::getDelay(int64_t localUs) const {
+    const Exchange* best = _best(localUs);
+    return best ? best->delayUs : 0;
+}
+
+uint32_t SyncEstimator::getErrorBound(int64_t localUs) const {
+    const Exchange* best = _best(localUs);
+    return best ? _bound(*best, localUs) : UINT32_MAX;
+}
+
+int64_t SyncEstimator::toLocal(int64_t coordinatorUs) const {
+    // The offset barely changes over the difference, so one refinement is plenty
+    int64_t localUs = coordinatorUs - getOffset(coordinatorUs);
+    return coordinatorUs - getOffset(localUs);
+}
+
+const SyncEstimator::Exchange* SyncEstimator::_best(int64_t localUs) const {
+    const Exchange* best = nullptr;
+    uint32_t bestBound = UINT32_MAX;
+    for (uint8_t i = 0; i < _count; i++) {
+        uint32_t bound = _bound(_window[i], localUs);
+        if (best == nullptr || bound < bestBound) {
+            best = &_window[i];
+            bestBound = bound;
+        }
+    }
+    return best;
+}
+
+uint32_t SyncEstimator::_bound(const Exchange& exchange, int64_t localUs) {
+    int64_t age = localUs > exchange.localUs ? localUs - exchange.localUs : exchange.localUs - localUs;
+    int64_t bound = exchange.delayUs / 2 + age * MAX_DRIFT_PPM / 1000000;
+    return bound > UINT32_MAX ? UINT32_MAX : (uint32_t)bound;
+}
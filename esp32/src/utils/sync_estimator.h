@@ -0,0 +1,60 @@
+#ifndef SYNC_ESTIMATOR_H
+#define SYNC_ESTIMATOR_H
+
+#include <stdint.h>
+
+// Kept free of Arduino dependencies so the host tools can build it as is
+// (see esp32/tools/sync_sim.cpp).
+
+#define SYNC_ESTIMATOR_WINDOW 8
+
+// Offset between the local clock and the coordinator's, from two-way
+// exchanges through the broker (NTP-style):
+//
+//   t1 local send, t2 coordinator receive, t3 coordinator send, t4 local receive
+//   offset = ((t2 - t1) + (t3 - t4)) / 2      delay = (t4 - t1) - (t3 - t2)
+//
+// However asymmetric the two paths are, the true offset lies within delay / 2
+// of the estimate, so the exchange with the smallest delay in the window is
+// used. Its bound then grows with age by the worst-case drift of two crystals;
+// the exchange with the smallest bound now is the one that is used.
+class SyncEstimator {
+public:
+    // Two ±20 ppm crystals, worst case
+    static const uint32_t MAX_DRIFT_PPM = 40;
+    
+    SyncEstimator();
+    
+    void reset();
+    
+    // All times in µs; returns false for an exchange that can't be right (negative delay)
+    bool addExchange(int64_t t1, int64_t t2, int64_t t3, int64_t t4);
+    
+    bool isValid() const { return _count > 0; }
+    uint32_t getExchangeCount() const { return _exchanges; }
+    
+    // Best estimate at the given local time
+    int64_t getOffset(int64_t localUs) const;
+    uint32_t getDelay(int64_t localUs) const;
+    uint32_t getErrorBound(int64_t localUs) const;
+    
+    int64_t toCoordinator(int64_t localUs) const { return localUs + getOffset(localUs); }
+    int64_t toLocal(int64_t coordinatorUs) const;
+    
+private:
+    struct Exchange {
+        int64_t localUs;  // Midpoint of t1 and t4
+        int64_t offsetUs;
+        uint32_t delayUs;
+    };
+    
+    Exchange _window[SYNC_ESTIMATOR_WINDOW];
+    uint8_t _count;
+    uint8_t _next;
+    uint32_t _exchanges;
+    
+    const Exchange* _best(int64_t localUs) const;
+    static uint32_t _bound(const Exchange& exchange, int64_t localUs);
+};
+
+#endif // SYNC_ESTIMATOR_H
@@ -0,0 +1,172 @@
+#include "trace_buffer.h"
+#include <esp_timer.h>
+#include <freertos/task.h>
+
+static_assert(TRACE_RING_SIZE <= 255 * TRACE_CHUNK_RECORDS, "A dump must fit in 255 chunks");
+
+// Static member initialisation
+TraceRecord TraceBuffer::_records[TRACE_RING_SIZE];
+uint32_t TraceBuffer::_written = 0;
+portMUX_TYPE TraceBuffer::_lock = portMUX_INITIALIZER_UNLOCKED;
+void* TraceBuffer::_tasks[TRACE_MAX_TASKS];
+char TraceBuffer::_taskNames[TRACE_MAX_TASKS][TRACE_TASK_NAME_MAX];
+uint8_t TraceBuffer::_taskCount = 0;
+volatile bool TraceBuffer::_dumping = false;
+uint32_t TraceBuffer::_dumpStart = 0;
+uint32_t TraceBuffer::_dumpRecords = 0;
+uint8_t TraceBuffer::_dumpChunks = 0;
+uint16_t TraceBuffer::_dumpId = 0;
+uint64_t TraceBuffer::_dumpTimeUs = 0;
+uint8_t TraceBuffer::_chunk[TRACE_CHUNK_SIZE];
+
+void TraceBuffer::record(TraceEvent event, TracePhase phase, uint16_t arg) {
+    // Events during a dump are not kept: the ring holds what led up to it
+    if (_dumping) {
+        return;
+    }
+    
+    // Timestamped under the lock, so records are in time order across cores
+    portENTER_CRITICAL_SAFE(&_lock);
+    _append((uint8_t)event, phase, _taskSlot(), arg);
+    portEXIT_CRITICAL_SAFE(&_lock);
+}
+
+bool TraceBuffer::beginDump() {
+    if (_dumping) {
+        return false;
+    }
+    
+    portENTER_CRITICAL(&_lock);
+    _closeOpenSpans();
+    _dumping = true;
+    _dumpRecords = _written < TRACE_RING_SIZE ? _written : TRACE_RING_SIZE;
+    _dumpStart = _written - _dumpRecords;
+    portEXIT_CRITICAL(&_lock);
+    
+    // An empty dump is still one chunk, so the requester gets an answer
+    _dumpChunks = _dumpRecords > 0 ? (_dumpRecords + TRACE_CHUNK_RECORDS - 1) / TRACE_CHUNK_RECORDS : 1;
+    _dumpId++;
+    _dumpTimeUs = esp_timer_get_time();
+    return true;
+}
+
+const uint8_t* TraceBuffer::buildChunk(uint8_t index, size_t& length) {
+    uint32_t first = (uint32_t)index * TRACE_CHUNK_RECORDS;
+    uint32_t count = first < _dumpRecords ? _dumpRecords - first : 0;
+    if (count > TRACE_CHUNK_RECORDS) {
+        count = TRACE_CHUNK_RECORDS;
+    }
+    
+    TraceChunkHeader header;
+    header.chunkIndex = index;
+    header.chunkCount = _dumpChunks;
+    header.taskCount = _taskCount;
+    header.dumpId = _dumpId;
+    header.recordCount = count;
+    header.overwritten = _dumpStart;
+    header.dumpTimeUs = _dumpTimeUs;
+    header.write(_chunk);
+    
+    uint8_t* out = _chunk + TraceChunkHeader::SIZE;
+    memcpy(out, _taskNames, _taskCount * TRACE_TASK_NAME_MAX);
+    out += _taskCount * TRACE_TASK_NAME_MAX;
+    for (uint32_t i = 0; i < count; i++) {
+        _records[(_dumpStart + first + i) % TRACE_RING_SIZE].write(out);
+        out += TraceRecord::SIZE;
+    }
+    
+    length = out - _chunk;
+    return _chunk;
+}
+
+void TraceBuffer::endDump() {
+    _dumping = false;
+}
+
+void TraceBuffer::dumpToSerial() {
+    if (!beginDump()) {
+        Serial.println("Trace dump already running");
+        return;
+    }
+    
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    char line[6 + 2 * 64 + 1];
+    memcpy(line, "TRACE ", 6);
+    for (uint8_t chunk = 0; chunk < _dumpChunks; chunk++) {
+        size_t length;
+        const uint8_t* data = buildChunk(chunk, length);
+        for (size_t offset = 0; offset < length; offset += 64) {
+            size_t part = length - offset < 64 ? length - offset : 64;
+            char* out = line + 6;
+            for (size_t i = 0; i < part; i++) {
+                *out++ = HEX_DIGITS[data[offset + i] >> 4];
+                *out++ = HEX_DIGITS[data[offset + i] & 0x0F];
+            }
+            *out = '\0';
+            Serial.println(line);
+        }
+    }
+    Serial.printf("Trace dump %u: %u records in %u chunks\n", _dumpId, _dumpRecords, _dumpChunks);
+    endDump();
+}
+
+void TraceBuffer::_append(uint8_t event, TracePhase phase, uint8_t task, uint16_t arg) {
+    TraceRecord& record = _records[_written % TRACE_RING_SIZE];
+    record.timestamp = (uint32_t)esp_timer_get_time();
+    record.event = event;
+    record.flags = TraceRecord::makeFlags(phase, xPortGetCoreID(), task);
+    record.arg = arg;
+    _written++;
+}
+
+void TraceBuffer::_closeOpenSpans() {
+    // Called under the lock. The task asking for the dump is inside spans of
+    // its own (the MQTT loop and the command that asked), whose END records
+    // would never make it into the frozen ring; end them now, innermost first.
+    uint8_t task = _taskSlot();
+    uint32_t available = _written < TRACE_RING_SIZE ? _written : TRACE_RING_SIZE;
+    uint32_t scan = available < TRACE_CLOSE_SCAN ? available : TRACE_CLOSE_SCAN;
+    uint8_t open[TRACE_CLOSE_MAX];
+    uint8_t openCount = 0;
+    uint32_t unmatched = 0; // END records seen whose BEGIN is further back
+    for (uint32_t i = 1; i <= scan && openCount < TRACE_CLOSE_MAX; i++) {
+        const TraceRecord& record = _records[(_written - i) % TRACE_RING_SIZE];
+        if (record.getTask() != task) {
+            continue;
+        }
+        if (record.getPhase() == TracePhase::END) {
+            unmatched++;
+        } else if (record.getPhase() == TracePhase::BEGIN) {
+            if (unmatched > 0) {
+                unmatched--;
+            } else {
+                open[openCount++] = record.event;
+            }
+        }
+    }
+    for (uint8_t i = 0; i < openCount; i++) {
+        _append(open[i], TracePhase::END, task, 1);
+    }
+}
+
+uint8_t TraceBuffer::_taskSlot() {
+    // Called under the lock; slots are never freed, so a handful of long-lived tasks fill them
+    void* task = xTaskGetCurrentTaskHandle();
+    for (uint8_t i = 0; i < _taskCount; i++) {
+        if (_tasks[i] == task) {
+            return i;
+        }
+    }
+    if (_taskCount == TRACE_MAX_TASKS) {
+        return TRACE_MAX_TASKS - 1;
+    }
+    
+    uint8_t slot = _taskCount++;
+    _tasks[slot] = task;
+    if (slot == TRACE_MAX_TASKS - 1) {
+        strlcpy(_taskNames[slot], "other", TRACE_TASK_NAME_MAX);
+    } else {
+        strlcpy(_taskNames[slot], pcTaskGetName((TaskHandle_t)task), TRACE_TASK_NAME_MAX);
+    }
+    return slot;
+}
@@ -0,0 +1,83 @@
+#ifndef TRACE_BUFFER_H
+#define TRACE_BUFFER_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include "trace_format.h"
+#include "../config/config.h"
+
+// Spans left open by the task asking for a dump are closed from its newest
+// TRACE_CLOSE_SCAN records, at most TRACE_CLOSE_MAX of them
+#define TRACE_CLOSE_SCAN 256
+#define TRACE_CLOSE_MAX 4
+
+// Records per dump chunk: small enough for one MQTT packet with the header and task names
+#define TRACE_CHUNK_RECORDS 128
+#define TRACE_CHUNK_SIZE (TraceChunkHeader::SIZE + TRACE_MAX_TASKS * TRACE_TASK_NAME_MAX + \
+                          TRACE_CHUNK_RECORDS * TraceRecord::SIZE)
+
+// With tracing compiled out nothing is recorded, and dumps come back empty
+#if TRACE_ENABLED
+#define TRACE_RING_SIZE TRACE_BUFFER_EVENTS
+#else
+#define TRACE_RING_SIZE 1
+#endif
+
+// Event trace for timeline analysis of stalls and latency spikes: a ring of
+// TRACE_BUFFER_EVENTS 8-byte records with µs timestamps, core and task, written
+// from any task through the TRACE_* macros at about a microsecond each. The
+// oldest records are overwritten. A dump freezes the ring, so it shows the
+// moments before it was asked for, and is sent in self-contained chunks
+// (see trace_format.h). esp32/tools/trace_convert.cpp turns a dump into
+// Chrome/Perfetto trace JSON.
+class TraceBuffer {
+public:
+    static void record(TraceEvent event, TracePhase phase, uint16_t arg);
+    
+    // Freezes the ring for a dump, first ending the spans the calling task is
+    // inside so its own request does not show as unfinished; false while a dump
+    // is already running
+    static bool beginDump();
+    static uint8_t getChunkCount() { return _dumpChunks; }
+    // Builds the given chunk of the running dump in a shared buffer
+    static const uint8_t* buildChunk(uint8_t index, size_t& length);
+    static void endDump();
+    static bool isDumping() { return _dumping; }
+    
+    // Whole dump as "TRACE <hex>" lines; the hex of all lines together is the
+    // concatenated chunks, as from MQTT
+    static void dumpToSerial();
+    
+private:
+    static TraceRecord _records[TRACE_RING_SIZE];
+    static uint32_t _written; // Records since boot; the next goes at _written % TRACE_RING_SIZE
+    static portMUX_TYPE _lock;
+    
+    static void* _tasks[TRACE_MAX_TASKS];
+    static char _taskNames[TRACE_MAX_TASKS][TRACE_TASK_NAME_MAX];
+    static uint8_t _taskCount;
+    
+    static volatile bool _dumping;
+    static uint32_t _dumpStart;   // Index of the oldest record in the dump
+    static uint32_t _dumpRecords;
+    static uint8_t _dumpChunks;
+    static uint16_t _dumpId;
+    static uint64_t _dumpTimeUs;
+    static uint8_t _chunk[TRACE_CHUNK_SIZE];
+    
+    static uint8_t _taskSlot();
+    static void _append(uint8_t event, TracePhase phase, uint8_t task, uint16_t arg);
+    static void _closeOpenSpans();
+};
+
+#if TRACE_ENABLED
+#define TRACE_BEGIN(event, arg) TraceBuffer::record(event, TracePhase::BEGIN, arg)
+#define TRACE_END(event, success) TraceBuffer::record(event, TracePhase::END, (success) ? 1 : 0)
+#define TRACE_INSTANT(event, arg) TraceBuffer::record(event, TracePhase::INSTANT, arg)
+#else
+#define TRACE_BEGIN(event, arg) do {} while (0)
+#define TRACE_END(event, success) do { (void)(success); } while (0)
+#define TRACE_INSTANT(event, arg) do {} while (0)
+#endif
+
+#endif // TRACE_BUFFER_H
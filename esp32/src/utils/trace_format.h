@@ -0,0 +1,161 @@
+#ifndef TRACE_FORMAT_H
+#define TRACE_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Kept free of Arduino dependencies so the host tools can build it as is
+// (see esp32/tools/trace_convert.cpp).
+
+// What a trace record marks. Spans have a BEGIN and an END record; the END
+// record's arg is 1 on success and 0 on failure where the event can fail.
+enum class TraceEvent : uint8_t {
+    SENSOR_READ,     // Span; arg: stream id
+    I2C_TRANSACTION, // Span; arg: bus << 8 | 7-bit address
+    MQTT_CONNECT,    // Span
+    MQTT_PUBLISH,    // Span around the socket write; arg: payload bytes
+    MQTT_LOOP,       // Span
+    WIFI_EVENT,      // Instant; arg: the Arduino WiFi event id
+    COMMAND,         // Span around handling one incoming message; arg: payload bytes
+    COUNT
+};
+
+enum class TracePhase : uint8_t {
+    BEGIN,
+    END,
+    INSTANT
+};
+
+#define TRACE_MAX_TASKS 8     // Task slots per dump; the last one collects any further tasks
+#define TRACE_TASK_NAME_MAX 16 // configMAX_TASK_NAME_LEN, terminator included
+
+// One 8-byte record, little-endian:
+//
+//   0  u32  timestamp, low 32 bits of esp_timer_get_time() (µs)
+//   4  u8   event (TraceEvent)
+//   5  u8   flags: bits 0-1 phase (TracePhase), bit 2 core, bits 3-5 task slot
+//   6  u16  arg
+struct TraceRecord {
+    uint32_t timestamp;
+    uint8_t event;
+    uint8_t flags;
+    uint16_t arg;
+    
+    static const size_t SIZE = 8;
+    
+    TracePhase getPhase() const { return (TracePhase)(flags & 0x03); }
+    uint8_t getCore() const { return (flags >> 2) & 0x01; }
+    uint8_t getTask() const { return (flags >> 3) & 0x07; }
+    
+    static uint8_t makeFlags(TracePhase phase, uint8_t core, uint8_t task) {
+        return (uint8_t)phase | (uint8_t)((core & 0x01) << 2) | (uint8_t)((task & 0x07) << 3);
+    }
+    
+    void write(uint8_t* out) const {
+        out[0] = timestamp & 0xFF;
+        out[1] = (timestamp >> 8) & 0xFF;
+        out[2] = (timestamp >> 16) & 0xFF;
+        out[3] = timestamp >> 24;
+        out[4] = event;
+        out[5] = flags;
+        out[6] = arg & 0xFF;
+        out[7] = arg >> 8;
+    }
+    
+    void read(const uint8_t* in) {
+        timestamp = in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+        event = in[4];
+        flags = in[5];
+        arg = in[6] | (uint16_t)(in[7] << 8);
+    }
+};
+
+// A dump is sent as one or more chunks, each complete in itself so a lost
+// chunk only loses its own records. Chunk layout, little-endian:
+//
+//   0  u32  magic "LTRC"
+//   4  u8   version (1)
+//   5  u8   chunk index
+//   6  u8   chunk count
+//   7  u8   task count
+//   8  u16  dump id, counting dumps since boot
+//   10 u16  record count in this chunk
+//   12 u32  records overwritten since boot, at the time of the dump
+//   16 u64  esp_timer_get_time() at the dump (µs), to widen record timestamps
+//   24 task names, TRACE_TASK_NAME_MAX bytes each, null-padded
+//   .. records, oldest first
+struct TraceChunkHeader {
+    static const uint32_t MAGIC = 0x4352544C; // "LTRC"
+    static const uint8_t VERSION = 1;
+    static const size_t SIZE = 24;
+    
+    uint8_t chunkIndex;
+    uint8_t chunkCount;
+    uint8_t taskCount;
+    uint16_t dumpId;
+    uint16_t recordCount;
+    uint32_t overwritten;
+    uint64_t dumpTimeUs;
+    
+    size_t getChunkSize() const {
+        return SIZE + taskCount * TRACE_TASK_NAME_MAX + recordCount * TraceRecord::SIZE;
+    }
+    
+    void write(uint8_t* out) const {
+        _u32(out, MAGIC);
+        out[4] = VERSION;
+        out[5] = chunkIndex;
+        out[6] = chunkCount;
+        out[7] = taskCount;
+        out[8] = dumpId & 0xFF;
+        out[9] = dumpId >> 8;
+        out[10] = recordCount & 0xFF;
+        out[11] = recordCount >> 8;
+        _u32(out + 12, overwritten);
+        _u32(out + 16, (uint32_t)dumpTimeUs);
+        _u32(out + 20, (uint32_t)(dumpTimeUs >> 32));
+    }
+    
+    // False on a short chunk, a wrong magic or an unknown version
+    bool read(const uint8_t* in, size_t length) {
+        if (length < SIZE || _r32(in) != MAGIC || in[4] != VERSION) {
+            return false;
+        }
+        chunkIndex = in[5];
+        chunkCount = in[6];
+        taskCount = in[7];
+        dumpId = in[8] | (uint16_t)(in[9] << 8);
+        recordCount = in[10] | (uint16_t)(in[11] << 8);
+        overwritten = _r32(in + 12);
+        dumpTimeUs = _r32(in + 16) | ((uint64_t)_r32(in + 20) << 32);
+        return taskCount <= TRACE_MAX_TASKS && length >= getChunkSize();
+    }
+    
+private:
+    static void _u32(uint8_t* out, uint32_t value) {
+        out[0] = value & 0xFF;
+        out[1] = (value >> 8) & 0xFF;
+        out[2] = (value >> 16) & 0xFF;
+        out[3] = value >> 24;
+    }
+    
+    static uint32_t _r32(const uint8_t* in) {
+        return in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+    }
+};
+
+inline const char* traceEventName(uint8_t event) {
+    switch ((TraceEvent)event) {
+        case TraceEvent::SENSOR_READ: return "sensor.read";
+        case TraceEvent::I2C_TRANSACTION: return "i2c";
+        case TraceEvent::MQTT_CONNECT: return "mqtt.connect";
+        case TraceEvent::MQTT_PUBLISH: return "mqtt.publish";
+        case TraceEvent::MQTT_LOOP: return "mqtt.loop";
+        case TraceEvent::WIFI_EVENT: return "wifi.event";
+        case TraceEvent::COMMAND: return "command";
+        default: return "unknown";
+    }
+}
+
+#endif // TRACE_FORMAT_H
@@ -0,0 +1,200 @@
+#include "trigger_capture.h"
+#include "runtime_config.h"
+#include <esp_heap_caps.h>
+
+TriggerCapture::TriggerCapture(HistoryChunkWriter& writer)
+    : _writer(writer), _name(nullptr), _stream(0), _lastSamples(0), _configGeneration(0),
+      _mode(TriggerMode::OFF), _channel(0), _level(0), _preMs(0), _postMs(0),
+      _havePrevious(false), _wasAbove(false), _previousValue(0), _previousMs(0),
+      _state(TriggerState::ARMED), _triggerMs(0), _triggerValue(0), _first(0), _next(0), _end(0),
+      _truncated(false), _burst(0), _chunks(0), _triggers(0), _missed(0), _bursts(0), _lastBurstSamples(0) {
+}
+
+bool TriggerCapture::begin(uint8_t stream, const char* name, uint8_t layout, uint8_t channels) {
+    _stream = stream;
+    _name = name;
+    
+    // Internal RAM: the buffer is small and written on every sample
+    if (!_samples.allocate(TRIGGER_BUFFER_SAMPLES, layout, channels, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)) {
+        Serial.printf("Triggered capture for %s: failed to allocate the buffer\n", name);
+        return false;
+    }
+    _arm();
+    Serial.printf("Triggered capture on %s: %u samples, mode %s\n", name, (unsigned)TRIGGER_BUFFER_SAMPLES,
+                  getModeString(_mode));
+    return true;
+}
+
+void TriggerCapture::capture(uint8_t stream, SensorBase& sensor) {
+    if (stream != _stream || _samples.getDepth() == 0) {
+        return;
+    }
+    uint32_t samples = sensor.getCounters().samples;
+    if (samples == _lastSamples) {
+        return;
+    }
+    _lastSamples = samples;
+    
+    uint8_t layout;
+    uint8_t channels;
+    const int16_t* sample = sensor.getFixedSample(layout, channels);
+    if (!sample) {
+        return;
+    }
+    if (_state == TriggerState::ARMED && RuntimeConfig::getGeneration() != _configGeneration) {
+        _refreshConfig();
+    }
+    
+    // Checked on every sample, whatever the state, so edges are never seen twice
+    uint32_t timestamp = sensor.getLastReadingTime();
+    bool fired = _check(timestamp, sample);
+    if (_state == TriggerState::SENDING) {
+        _missed += fired;
+        return;
+    }
+    
+    _samples.push(timestamp, sample);
+    if (_state == TriggerState::ARMED) {
+        if (!fired) {
+            return;
+        }
+        _triggers++;
+        _triggerMs = timestamp;
+        _first = _samples.lowerBound(_samples.getOldest(), _samples.getEnd() - 1, timestamp - _preMs);
+        _state = TriggerState::POST;
+    } else {
+        _missed += fired;
+    }
+    
+    // Freeze once the post-trigger window is in, or before it would overwrite the pre-trigger window
+    bool full = _samples.getEnd() - _first >= _samples.getDepth();
+    if (timestamp - _triggerMs < _postMs && !full) {
+        return;
+    }
+    _truncated = timestamp - _triggerMs < _postMs;
+    _next = _first;
+    _end = _samples.getEnd();
+    _chunks = 0;
+    _burst++;
+    _state = TriggerState::SENDING;
+}
+
+const uint8_t* TriggerCapture::buildChunk(size_t& length) {
+    HistoryChunkHeader header;
+    header.stream = _stream;
+    header.requestId = _burst;
+    header.chunkIndex = _chunks++;
+    header.flags = 0;
+    return _writer.build(_samples, header, _next, _end, length);
+}
+
+void TriggerCapture::restartBurst() {
+    _next = _first;
+    _chunks = 0;
+}
+
+void TriggerCapture::endBurst() {
+    _bursts++;
+    _lastBurstSamples = _end - _first;
+    _arm();
+}
+
+void TriggerCapture::writeEvent(JsonObject event) const {
+    event["type"] = "trigger";
+    event["id"] = _burst;
+    event["sensor"] = _name;
+    event["mode"] = getModeString(_mode);
+    event["channel"] = _channel;
+    event["level"] = _level;
+    event["value"] = _triggerValue;
+    event["trigger_ms"] = _triggerMs;
+    event["from_ms"] = _samples.timestampAt(_first);
+    event["to_ms"] = _samples.timestampAt(_end - 1);
+    event["samples"] = _end - _first;
+    event["truncated"] = _truncated;
+}
+
+void TriggerCapture::writeStatus(JsonObject trigger) const {
+    static const char* const STATES[] = { "armed", "post", "sending" };
+    trigger["mode"] = getModeString(_mode);
+    trigger["state"] = STATES[(size_t)_state];
+    trigger["depth"] = _samples.getDepth();
+    trigger["triggers"] = _triggers;
+    trigger["missed"] = _missed;
+    trigger["bursts"] = _bursts;
+    if (_bursts > 0) {
+        trigger["last_samples"] = _lastBurstSamples;
+    }
+}
+
+const char* TriggerCapture::getModeString(TriggerMode mode) {
+    switch (mode) {
+        case TriggerMode::THRESHOLD: return "threshold";
+        case TriggerMode::SLOPE: return "slope";
+        case TriggerMode::MAGNITUDE: return "magnitude";
+        default: return "off";
+    }
+}
+
+void TriggerCapture::_refreshConfig() {
+    _configGeneration = RuntimeConfig::getGeneration();
+    _mode = (TriggerMode)RuntimeConfig::getUInt(ConfigParam::TRIGGER_CONDITION);
+    _channel = RuntimeConfig::getUInt(ConfigParam::TRIGGER_SOURCE);
+    _level = RuntimeConfig::getUInt(ConfigParam::TRIGGER_THRESHOLD);
+    _preMs = RuntimeConfig::getUInt(ConfigParam::TRIGGER_PRE);
+    _postMs = RuntimeConfig::getUInt(ConfigParam::TRIGGER_POST);
+    _havePrevious = false;
+    _wasAbove = false;
+    
+    // Magnitude takes the channel and the two after it, e.g. 0 for accel, 3 for gyro
+    uint8_t lastChannel = _channel + (_mode == TriggerMode::MAGNITUDE ? 2 : 0);
+    if (_mode != TriggerMode::OFF && lastChannel >= _samples.getChannels()) {
+        Serial.printf("Trigger channel %u is out of range for %s; trigger off\n", _channel, _name);
+        _mode = TriggerMode::OFF;
+    }
+}
+
+bool TriggerCapture::_check(uint32_t timestamp, const int16_t* sample) {
+    // Integer arithmetic on the fixed-point values only; the square root is for the event
+    bool above = false;
+    int32_t value = sample[_channel];
+    switch (_mode) {
+        case TriggerMode::THRESHOLD:
+            above = (uint32_t)abs(value) >= _level;
+            break;
+        case TriggerMode::SLOPE:
+            if (_havePrevious) {
+                uint32_t elapsed = timestamp - _previousMs > 0 ? timestamp - _previousMs : 1;
+                above = (uint64_t)abs(value - _previousValue) >= (uint64_t)_level * elapsed;
+            }
+            break;
+        case TriggerMode::MAGNITUDE: {
+            int32_t y = sample[_channel + 1];
+            int32_t z = sample[_channel + 2];
+            uint32_t squared = (uint32_t)(value * value) + (uint32_t)(y * y) + (uint32_t)(z * z);
+            above = squared >= _level * _level;
+            if (above && !_wasAbove) {
+                value = (int32_t)sqrtf((float)squared);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    
+    bool fired = above && !_wasAbove;
+    if (fired && _state == TriggerState::ARMED) {
+        _triggerValue = _mode == TriggerMode::SLOPE ? value - _previousValue : value;
+    }
+    _wasAbove = above;
+    _previousValue = sample[_channel];
+    _previousMs = timestamp;
+    _havePrevious = true;
+    return fired;
+}
+
+void TriggerCapture::_arm() {
+    _refreshConfig();
+    _samples.clear();
+    _state = TriggerState::ARMED;
+}
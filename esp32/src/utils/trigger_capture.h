@@ -0,0 +1,101 @@
+#ifndef TRIGGER_CAPTURE_H
+#define TRIGGER_CAPTURE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "sample_ring.h"
+#include "../sensors/sensor_base.h"
+#include "../config/config.h"
+
+// Values of trigger.mode
+enum class TriggerMode : uint8_t {
+    OFF,
+    THRESHOLD, // |channel| rises to trigger.level
+    SLOPE,     // |channel change| reaches trigger.level per ms between two samples
+    MAGNITUDE  // Vector magnitude of the channel and the two after it rises to trigger.level
+};
+
+enum class TriggerState : uint8_t {
+    ARMED,   // Filling the pre-trigger window and checking every sample
+    POST,    // Triggered; filling the post-trigger window
+    SENDING  // Frozen until the burst has gone out, then re-armed
+};
+
+// Oscilloscope-style capture on one IMU: every sample is checked against the
+// trigger.* condition as it is captured, which is a few integer operations,
+// so acquisition timing is unaffected. On a trigger, trigger.pre_ms before it
+// and trigger.post_ms after it are frozen at the read rate and published
+// as one burst: a JSON event, then the samples as history chunks (see
+// history_format.h) with the burst number as the request id. Triggers while
+// a burst is being captured or sent are counted as missed. Loop task only.
+class TriggerCapture {
+public:
+    explicit TriggerCapture(HistoryChunkWriter& writer);
+    
+    bool begin(uint8_t stream, const char* name, uint8_t layout, uint8_t channels);
+    
+    // Checks and records the sensor's latest sample if it has taken one since the last call
+    void capture(uint8_t stream, SensorBase& sensor);
+    
+    // A shock is over in a few ms, and only the samples read are checked: while
+    // a condition is set and no burst is going out, the IMU must run flat out
+    bool needsFullRate() const { return _mode != TriggerMode::OFF && _state != TriggerState::SENDING; }
+    
+    bool hasBurst() const { return _state == TriggerState::SENDING; }
+    // Builds the next chunk of the burst in the writer's buffer
+    const uint8_t* buildChunk(size_t& length);
+    bool isBurstComplete() const { return _next >= _end; }
+    // Sends the burst again from its first chunk, e.g. after a reconnect
+    void restartBurst();
+    // Re-arms once every chunk has gone out
+    void endBurst();
+    
+    // The trigger and the frozen window, sent ahead of the chunks
+    void writeEvent(JsonObject event) const;
+    void writeStatus(JsonObject trigger) const;
+    
+    static const char* getModeString(TriggerMode mode);
+    
+private:
+    SampleRing _samples;
+    HistoryChunkWriter& _writer;
+    const char* _name;
+    uint8_t _stream;
+    uint32_t _lastSamples;
+    uint32_t _configGeneration;
+    
+    // Condition, refreshed from RuntimeConfig when it changes; applies from the next arming
+    TriggerMode _mode;
+    uint8_t _channel;
+    uint32_t _level;
+    uint32_t _preMs;
+    uint32_t _postMs;
+    
+    // Previous sample, for edges and slopes
+    bool _havePrevious;
+    bool _wasAbove;
+    int16_t _previousValue;
+    uint32_t _previousMs;
+    
+    TriggerState _state;
+    uint32_t _triggerMs;
+    int32_t _triggerValue;
+    uint32_t _first; // Ring position where the pre-trigger window starts
+    uint32_t _next;  // Next position to send
+    uint32_t _end;
+    bool _truncated; // The post-trigger window was cut short by the buffer size
+    
+    uint16_t _burst;  // Number of the current or last burst; the chunks' request id
+    uint16_t _chunks;
+    uint32_t _triggers;
+    uint32_t _missed;
+    uint32_t _bursts;
+    uint32_t _lastBurstSamples;
+    
+    void _refreshConfig();
+    // True on the sample where the condition starts to hold
+    bool _check(uint32_t timestamp, const int16_t* sample);
+    void _arm();
+};
+
+#endif // TRIGGER_CAPTURE_H
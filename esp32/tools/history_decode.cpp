@@ -0,0 +1,211 @@
+// Host decoder for sample history transfers (see src/utils/sample_history.h)
+// to CSV, one row per sample. Also reports chunks that never arrived and
+// samples the node had overwritten before it could send them.
+//
+// Build and run from esp32/:
+//   g++ -O2 -std=gnu++11 -Isrc tools/history_decode.cpp src/communication/telemetry_codec.cpp -o history_decode
+//   mosquitto_sub -t liminal/status/esp32-001/history > history.bin &
+//   mosquitto_pub -t liminal/commands/esp32-001/history -m '{"id":7,"last_ms":10000}'
+//   ./history_decode history.bin samples.csv
+//
+// The input is the chunks as published, back to back; anything between them,
+// such as mosquitto_sub's newlines, is skipped. With several transfers in the
+// input the last one is decoded, or the one given with --id N.
+//
+// Columns are the stream id, the sample time in ms of device uptime, then the
+// channels in the fixed-point units of the stream's layout (see the README).
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "utils/history_format.h"
+#include "communication/telemetry_codec.h"
+
+struct Transfer {
+    uint16_t id = 0;
+    uint8_t stream = 0;
+    int lastIndex = -1; // Index of the chunk with FLAG_LAST, once seen
+    uint32_t lostFlags = 0;
+    std::map<uint16_t, std::vector<TelemetryBatch>> chunks; // By index, so repeats and order don't matter
+};
+
+static bool readFile(const char* path, std::vector<uint8_t>& data) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return false;
+    }
+    uint8_t buffer[4096];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.insert(data.end(), buffer, buffer + length);
+    }
+    fclose(file);
+    return true;
+}
+
+// Decodes the chunk at offset into its batches; returns its size, or 0 if the
+// bytes there are not a whole, valid chunk
+static size_t parseChunk(TelemetryCodec& codec, const std::vector<uint8_t>& data, size_t offset,
+                         HistoryChunkHeader& header, std::vector<TelemetryBatch>& batches) {
+    if (!header.read(data.data() + offset, data.size() - offset)) {
+        return 0;
+    }
+    size_t position = offset + HistoryChunkHeader::SIZE;
+    batches.clear();
+    for (uint8_t i = 0; i < header.batchCount; i++) {
+        if (position + 2 > data.size()) {
+            return 0;
+        }
+        size_t length = data[position] | (data[position + 1] << 8);
+        position += 2;
+        TelemetryBatch batch;
+        if (position + length > data.size() || !codec.decode(data.data() + position, length, batch)) {
+            return 0;
+        }
+        batches.push_back(batch);
+        position += length;
+    }
+    return position - offset;
+}
+
+static std::map<uint16_t, Transfer> parseChunks(const std::vector<uint8_t>& data, std::vector<uint16_t>& order) {
+    static TelemetryCodec codec;
+    std::map<uint16_t, Transfer> transfers;
+    std::vector<TelemetryBatch> batches;
+    size_t offset = 0;
+    while (offset + HistoryChunkHeader::SIZE <= data.size()) {
+        HistoryChunkHeader header;
+        size_t size = parseChunk(codec, data, offset, header, batches);
+        if (size == 0) {
+            offset++; // Resynchronise on the next magic
+            continue;
+        }
+        
+        if (!transfers.count(header.requestId)) {
+            order.push_back(header.requestId);
+        }
+        Transfer& transfer = transfers[header.requestId];
+        transfer.id = header.requestId;
+        transfer.stream = header.stream;
+        if (header.flags & HistoryChunkHeader::FLAG_LAST) {
+            transfer.lastIndex = header.chunkIndex;
+        }
+        if ((header.flags & HistoryChunkHeader::FLAG_LOST) && !transfer.chunks.count(header.chunkIndex)) {
+            transfer.lostFlags++;
+        }
+        transfer.chunks[header.chunkIndex] = batches;
+        offset += size;
+    }
+    return transfers;
+}
+
+int main(int argc, char** argv) {
+    const char* inputPath = nullptr;
+    const char* outputPath = nullptr;
+    int wantedId = -1;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--id" && hasValue) wantedId = atoi(argv[++i]);
+        else if (arg[0] != '-' && !inputPath) inputPath = argv[i];
+        else if (arg[0] != '-' && !outputPath) outputPath = argv[i];
+        else {
+            fprintf(stderr, "Unknown option %s (see the top of history_decode.cpp)\n", arg.c_str());
+            return 2;
+        }
+    }
+    if (!inputPath || !outputPath) {
+        fprintf(stderr, "Usage: history_decode [--id N] input output.csv\n");
+        return 2;
+    }
+    
+    std::vector<uint8_t> data;
+    if (!readFile(inputPath, data)) {
+        return 1;
+    }
+    
+    std::vector<uint16_t> order;
+    std::map<uint16_t, Transfer> transfers = parseChunks(data, order);
+    if (transfers.empty()) {
+        fprintf(stderr, "No history chunks found in %s\n", inputPath);
+        return 1;
+    }
+    if (transfers.size() > 1) {
+        printf("%u transfers in the input:", (unsigned)transfers.size());
+        for (uint16_t id : order) {
+            printf(" %u", id);
+        }
+        printf("\n");
+    }
+    uint16_t transferId = wantedId >= 0 ? (uint16_t)wantedId : order.back();
+    if (!transfers.count(transferId)) {
+        fprintf(stderr, "No transfer %d in the input\n", wantedId);
+        return 1;
+    }
+    const Transfer& transfer = transfers[transferId];
+    
+    // Without the last chunk the end of the range is unknown; count up to the highest seen
+    int lastIndex = transfer.lastIndex >= 0 ? transfer.lastIndex : transfer.chunks.rbegin()->first;
+    std::vector<int> missing;
+    for (int i = 0; i <= lastIndex; i++) {
+        if (!transfer.chunks.count(i)) {
+            missing.push_back(i);
+        }
+    }
+    
+    FILE* out = fopen(outputPath, "w");
+    if (!out) {
+        perror(outputPath);
+        return 1;
+    }
+    uint8_t channels = transfer.chunks.begin()->second.empty() ? 0 : transfer.chunks.begin()->second[0].channels;
+    fprintf(out, "stream,timestamp_ms");
+    for (uint8_t c = 0; c < channels; c++) {
+        fprintf(out, ",ch%u", c);
+    }
+    fprintf(out, "\n");
+    
+    uint64_t samples = 0;
+    uint32_t firstMs = 0;
+    uint32_t lastMs = 0;
+    for (const auto& chunk : transfer.chunks) {
+        for (const TelemetryBatch& batch : chunk.second) {
+            for (uint16_t s = 0; s < batch.count; s++) {
+                if (samples++ == 0) {
+                    firstMs = batch.timestamps[s];
+                }
+                lastMs = batch.timestamps[s];
+                fprintf(out, "%u,%u", transfer.stream, batch.timestamps[s]);
+                for (uint8_t c = 0; c < batch.channels; c++) {
+                    fprintf(out, ",%d", batch.values[s][c]);
+                }
+                fprintf(out, "\n");
+            }
+        }
+    }
+    fclose(out);
+    
+    printf("Transfer %u, stream %u: %u of %d chunks, %llu samples from %u to %u ms\n", transfer.id,
+           transfer.stream, (unsigned)transfer.chunks.size(), lastIndex + 1, (unsigned long long)samples,
+           firstMs, lastMs);
+    if (transfer.lastIndex < 0) {
+        printf("The last chunk is missing; later chunks may be too\n");
+    }
+    if (!missing.empty()) {
+        printf("Missing chunks:");
+        for (int index : missing) {
+            printf(" %d", index);
+        }
+        printf("\n");
+    }
+    if (transfer.lostFlags > 0) {
+        printf("%u chunks follow samples the node overwrote before sending; its ack has the count\n",
+               transfer.lostFlags);
+    }
+    return missing.empty() && transfer.lastIndex >= 0 ? 0 : 1;
+}
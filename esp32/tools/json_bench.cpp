@@ -0,0 +1,231 @@
+// Host benchmark and byte-compatibility check for the specialised sensor frame
+// writer (JSON_FAST_FRAMES, see src/communication/json_writer.h) against the
+// ArduinoJson path it replaces.
+//
+// Build and run from esp32/ after a PlatformIO build has fetched ArduinoJson:
+//   g++ -O2 -std=gnu++11 -Isrc -I.pio/libdeps/esp32dev/ArduinoJson/src tools/json_bench.cpp src/communication/json_writer.cpp -o json_bench
+//   ./json_bench [frames]
+//
+// First every float bit pattern in a wide sweep, then a set of random IMU
+// frames in each variant (MPU6050 or not, magnetometer or not, on the sync
+// grid or not), is written both ways and compared byte for byte. Then both
+// ways are timed on the same frames. Exits non-zero on any difference.
+//
+// Times are host times. Expect the ESP32 to be one to two orders of magnitude
+// slower, and the gap to be wider there: it has no double-precision FPU, so
+// ArduinoJson's float formatting is all software.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <ArduinoJson.h>
+#include "communication/json_writer.h"
+#include "sensors/imu_frame.h"
+
+// Same fields as IMUSensor::IMUData
+struct Reading {
+    float accelX, accelY, accelZ;
+    float gyroX, gyroY, gyroZ;
+    float magX, magY, magZ;
+    float temperature;
+    uint32_t timestamp;
+};
+
+struct Frame {
+    Reading reading;
+    bool metricAccel;
+    bool hasMagnetometer;
+    bool synced;
+    uint32_t seq;
+    uint32_t sampleSeq;
+    uint32_t publishMs;
+    uint32_t sampleMs;
+    uint32_t syncTick;
+    uint32_t syncErrorUs;
+};
+
+static const char* NAME = "main_imu";
+static const char* DEVICE = "esp32-001";
+
+// As IMUSensor::getDataAsJson() and publishSensorFrame() build it
+static size_t writeDocument(const Frame& frame, char* buffer, size_t capacity) {
+    const Reading& data = frame.reading;
+    DynamicJsonDocument doc(640);
+    doc["sensor_name"] = NAME;
+    doc["sensor_type"] = "imu";
+    doc["imu_type"] = frame.metricAccel ? "MPU6050" : "MPU9250";
+    doc["timestamp"] = data.timestamp;
+    doc["device_id"] = DEVICE;
+    
+    JsonObject accel = doc.createNestedObject("accelerometer");
+    accel["x"] = data.accelX;
+    accel["y"] = data.accelY;
+    accel["z"] = data.accelZ;
+    accel["unit"] = frame.metricAccel ? "m/s²" : "g";
+    
+    JsonObject gyro = doc.createNestedObject("gyroscope");
+    gyro["x"] = data.gyroX;
+    gyro["y"] = data.gyroY;
+    gyro["z"] = data.gyroZ;
+    gyro["unit"] = "°/s";
+    
+    if (frame.hasMagnetometer) {
+        JsonObject mag = doc.createNestedObject("magnetometer");
+        mag["x"] = data.magX;
+        mag["y"] = data.magY;
+        mag["z"] = data.magZ;
+        mag["unit"] = "µT";
+    }
+    
+    doc["temperature"] = data.temperature;
+    doc["temperature_unit"] = "°C";
+    
+    doc["seq"] = frame.seq;
+    doc["sample_seq"] = frame.sampleSeq;
+    doc["publish_ms"] = frame.publishMs;
+    doc["sample_ms"] = frame.sampleMs;
+    if (frame.synced) {
+        doc["sync_tick"] = frame.syncTick;
+        doc["sync_error_us"] = frame.syncErrorUs;
+    }
+    return serializeJson(doc, buffer, capacity);
+}
+
+static size_t writeFast(const Frame& frame, char* buffer, size_t capacity) {
+    JsonWriter out(buffer, capacity);
+    writeIMUFrame(out, NAME, frame.metricAccel ? "MPU6050" : "MPU9250", DEVICE, frame.metricAccel,
+                  frame.hasMagnetometer, frame.reading);
+    out.raw(",\"seq\":");
+    out.uinteger(frame.seq);
+    out.raw(",\"sample_seq\":");
+    out.uinteger(frame.sampleSeq);
+    out.raw(",\"publish_ms\":");
+    out.uinteger(frame.publishMs);
+    out.raw(",\"sample_ms\":");
+    out.uinteger(frame.sampleMs);
+    if (frame.synced) {
+        out.raw(",\"sync_tick\":");
+        out.uinteger(frame.syncTick);
+        out.raw(",\"sync_error_us\":");
+        out.uinteger(frame.syncErrorUs);
+    }
+    out.raw('}');
+    return out.overflowed() ? 0 : out.length();
+}
+
+// Every float formatting path: plain, exponent, subnormal, zero, NaN, infinity
+static bool checkNumbers(std::mt19937& rng) {
+    char expected[64];
+    char actual[64];
+    uint32_t mismatches = 0;
+    uint64_t checked = 0;
+    for (uint64_t i = 0; i < 20000000; i++) {
+        // Half random bit patterns, half a stride through every exponent
+        uint32_t bits = (i & 1) ? rng() : (uint32_t)(i * 2147 + (i >> 1));
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        
+        StaticJsonDocument<16> doc;
+        doc.set(value);
+        size_t expectedLength = serializeJson(doc, expected, sizeof(expected));
+        JsonWriter out(actual, sizeof(actual));
+        out.number(value);
+        checked++;
+        if (out.length() != expectedLength || memcmp(actual, expected, expectedLength) != 0) {
+            if (mismatches++ < 10) {
+                printf("0x%08x: ArduinoJson %.*s, writer %.*s\n", bits, (int)expectedLength, expected,
+                       (int)out.length(), actual);
+            }
+        }
+    }
+    printf("Numbers: %llu checked, %u different\n", (unsigned long long)checked, mismatches);
+    return mismatches == 0;
+}
+
+static std::vector<Frame> makeFrames(std::mt19937& rng, size_t count) {
+    // Sensor noise around rest plus occasional large motion, as on a real node
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    std::vector<Frame> frames(count);
+    for (size_t i = 0; i < count; i++) {
+        Frame& frame = frames[i];
+        float motion = (i % 50 < 5) ? 40.0f : 1.0f;
+        Reading& data = frame.reading;
+        data.accelX = noise(rng) * 0.02f * motion;
+        data.accelY = noise(rng) * 0.02f * motion;
+        data.accelZ = 1.0f + noise(rng) * 0.02f * motion;
+        data.gyroX = noise(rng) * 0.5f * motion;
+        data.gyroY = noise(rng) * 0.5f * motion;
+        data.gyroZ = noise(rng) * 0.5f * motion;
+        data.magX = 20.0f + noise(rng) * 0.6f;
+        data.magY = -5.0f + noise(rng) * 0.6f;
+        data.magZ = 42.0f + noise(rng) * 0.6f;
+        data.temperature = 27.5f + noise(rng) * 0.05f;
+        data.timestamp = 1000 + (uint32_t)i * 20;
+        frame.metricAccel = (i & 1) != 0;
+        if (frame.metricAccel) {
+            data.accelX *= 9.80665f;
+            data.accelY *= 9.80665f;
+            data.accelZ *= 9.80665f;
+        }
+        frame.hasMagnetometer = (i & 2) != 0;
+        frame.synced = (i & 4) != 0;
+        frame.seq = (uint32_t)i;
+        frame.sampleSeq = (uint32_t)i * 2 + 1;
+        frame.publishMs = 100;
+        frame.sampleMs = 20;
+        frame.syncTick = 50000 + (uint32_t)i;
+        frame.syncErrorUs = 150 + (uint32_t)(i % 200);
+    }
+    return frames;
+}
+
+template <class TWrite>
+static double timeFrames(const std::vector<Frame>& frames, TWrite write, size_t& bytes) {
+    static char buffer[1024];
+    bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < 10; pass++) {
+        for (const Frame& frame : frames) {
+            bytes += write(frame, buffer, sizeof(buffer));
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / (frames.size() * 10);
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    std::mt19937 rng(12345);
+    
+    bool numbersMatch = checkNumbers(rng);
+    
+    std::vector<Frame> frames = makeFrames(rng, count);
+    char expected[1024];
+    char actual[1024];
+    uint32_t mismatches = 0;
+    for (const Frame& frame : frames) {
+        size_t expectedLength = writeDocument(frame, expected, sizeof(expected));
+        size_t actualLength = writeFast(frame, actual, sizeof(actual));
+        if (actualLength != expectedLength || memcmp(actual, expected, expectedLength) != 0) {
+            if (mismatches++ < 3) {
+                printf("Frame %u differs:\n  ArduinoJson %.*s\n  writer      %.*s\n", frame.seq,
+                       (int)expectedLength, expected, (int)actualLength, actual);
+            }
+        }
+    }
+    printf("Frames: %u checked, %u different\n", (unsigned)frames.size(), mismatches);
+    
+    size_t documentBytes;
+    size_t fastBytes;
+    double documentNs = timeFrames(frames, writeDocument, documentBytes);
+    double fastNs = timeFrames(frames, writeFast, fastBytes);
+    printf("ArduinoJson: %8.1f ns/frame\n", documentNs);
+    printf("JsonWriter:  %8.1f ns/frame (%.1fx faster, %.0f bytes/frame)\n", fastNs, documentNs / fastNs,
+           (double)fastBytes / (frames.size() * 10));
+    
+    return numbersMatch && mismatches == 0 ? 0 : 1;
+}
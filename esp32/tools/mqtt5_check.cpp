@@ -0,0 +1,315 @@
+// Host check of the firmware's MQTT 5 codec against a real broker: connects
+// as a publisher and a subscriber, publishes telemetry the way MQTTClient
+// does over MQTT 5 (topic alias after the first message, message expiry,
+// "schema" user property) and checks what the subscriber receives. It also
+// reports the bytes per message against the same publish over 3.1.1.
+//
+// Build and run from esp32/:
+//   g++ -O2 -std=gnu++11 -Isrc tools/mqtt5_check.cpp src/communication/mqtt5_codec.cpp -o mqtt5_check
+//   ./mqtt5_check --broker localhost:1883
+//   ./mqtt5_check --broker localhost:1884 --expect-legacy   # against a 3.1.1-only broker
+//
+// Options: --count N messages (200), --payload N bytes each (48).
+//
+// Checks, each reported as PASS or FAIL (exit status 1 if any fail):
+//   - the broker accepts MQTT 5 and grants topic aliases
+//   - every message arrives, in order, under its full topic, with its
+//     payload, the schema property and a remaining expiry no longer than sent
+//   - a retained message published with a 1 s expiry is gone after 2 s
+// With --expect-legacy, only that the broker's answer to an MQTT 5 CONNECT is
+// one the firmware treats as "fall back to 3.1.1".
+
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "communication/mqtt5_codec.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("%s  %s\n", ok ? "PASS" : "FAIL", what);
+    if (!ok) {
+        failures++;
+    }
+}
+
+// Blocking MQTT connection using the firmware's codec
+class Connection {
+public:
+    ~Connection() {
+        if (_fd >= 0) {
+            close(_fd);
+        }
+    }
+    
+    bool open(const std::string& host, const std::string& port) {
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo* result = nullptr;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0 || !result) {
+            fprintf(stderr, "Cannot resolve %s\n", host.c_str());
+            return false;
+        }
+        _fd = socket(result->ai_family, result->ai_socktype, 0);
+        bool ok = _fd >= 0 && ::connect(_fd, result->ai_addr, result->ai_addrlen) == 0;
+        freeaddrinfo(result);
+        if (!ok) {
+            perror("connect");
+            return false;
+        }
+        int one = 1;
+        setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return true;
+    }
+    
+    bool send(const uint8_t* data, size_t length) {
+        if (length == 0) {
+            return false;
+        }
+        _sent += length;
+        return ::send(_fd, data, length, 0) == (ssize_t)length;
+    }
+    
+    // Next whole packet; false on timeout or a closed connection
+    bool receive(std::vector<uint8_t>& packet, size_t& headerLength, int timeoutMs) {
+        Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+        while (true) {
+            size_t packetLength;
+            int framed = MQTT5Codec::frame(_rx.data(), _rx.size(), headerLength, packetLength);
+            if (framed < 0) {
+                return false;
+            }
+            if (framed > 0) {
+                packet.assign(_rx.begin(), _rx.begin() + packetLength);
+                _rx.erase(_rx.begin(), _rx.begin() + packetLength);
+                return true;
+            }
+            
+            int remaining = (int)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            struct pollfd waiting = { _fd, POLLIN, 0 };
+            if (remaining <= 0 || poll(&waiting, 1, remaining) <= 0) {
+                return false;
+            }
+            uint8_t buffer[4096];
+            ssize_t received = recv(_fd, buffer, sizeof(buffer), 0);
+            if (received <= 0) {
+                _closed = true;
+                return false;
+            }
+            _rx.insert(_rx.end(), buffer, buffer + received);
+        }
+    }
+    
+    bool isClosed() const { return _closed; }
+    size_t getSentBytes() const { return _sent; }
+    
+private:
+    int _fd = -1;
+    std::vector<uint8_t> _rx;
+    bool _closed = false;
+    size_t _sent = 0;
+};
+
+static bool connectV5(Connection& connection, const std::string& host, const std::string& port,
+                      const char* clientId, MQTT5Connack& connack) {
+    if (!connection.open(host, port)) {
+        return false;
+    }
+    MQTT5Connect request;
+    memset(&request, 0, sizeof(request));
+    request.clientId = clientId;
+    request.keepAliveSeconds = 30;
+    request.maximumPacketSize = 2048;
+    
+    uint8_t buffer[256];
+    if (!connection.send(buffer, MQTT5Codec::encodeConnect(request, buffer, sizeof(buffer)))) {
+        return false;
+    }
+    std::vector<uint8_t> packet;
+    size_t headerLength;
+    return connection.receive(packet, headerLength, 5000) && packet[0] == MQTT5Codec::CONNACK &&
+           MQTT5Codec::decodeConnack(packet.data() + headerLength, packet.size() - headerLength, connack);
+}
+
+static bool subscribe(Connection& connection, const char* filter) {
+    uint8_t buffer[256];
+    if (!connection.send(buffer, MQTT5Codec::encodeSubscribe(1, filter, 0, buffer, sizeof(buffer)))) {
+        return false;
+    }
+    std::vector<uint8_t> packet;
+    size_t headerLength;
+    // SUBACK: packet id, properties, then the granted QoS
+    return connection.receive(packet, headerLength, 5000) && packet[0] == MQTT5Codec::SUBACK &&
+           packet.back() < 0x80;
+}
+
+static bool publish(Connection& connection, const char* topic, uint16_t alias, uint32_t expiry,
+                    const char* schema, const std::string& payload, bool retain) {
+    MQTT5Publish message;
+    memset(&message, 0, sizeof(message));
+    message.topic = topic;
+    message.topicAlias = alias;
+    message.messageExpiry = expiry;
+    message.userKey = schema ? "schema" : nullptr;
+    message.userValue = schema;
+    message.payload = (const uint8_t*)payload.data();
+    message.payloadLength = payload.size();
+    message.retain = retain;
+    
+    uint8_t buffer[4096];
+    return connection.send(buffer, MQTT5Codec::encodePublish(message, buffer, sizeof(buffer)));
+}
+
+static std::string makePayload(int index, int size) {
+    char text[32];
+    snprintf(text, sizeof(text), "%06d:", index);
+    std::string payload = text;
+    while ((int)payload.size() < size) {
+        payload += (char)('a' + payload.size() % 26);
+    }
+    payload.resize(size);
+    return payload;
+}
+
+int main(int argc, char** argv) {
+    std::string broker = "localhost:1883";
+    int count = 200;
+    int payloadSize = 48;
+    bool expectLegacy = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--broker" && hasValue) broker = argv[++i];
+        else if (arg == "--count" && hasValue) count = atoi(argv[++i]);
+        else if (arg == "--payload" && hasValue) payloadSize = atoi(argv[++i]);
+        else if (arg == "--expect-legacy") expectLegacy = true;
+        else {
+            fprintf(stderr, "Unknown option %s (see the top of mqtt5_check.cpp)\n", arg.c_str());
+            return 2;
+        }
+    }
+    size_t colon = broker.rfind(':');
+    std::string host = colon == std::string::npos ? broker : broker.substr(0, colon);
+    std::string port = colon == std::string::npos ? "1883" : broker.substr(colon + 1);
+    if (payloadSize < 8) {
+        payloadSize = 8;
+    }
+    
+    // Same classification as MQTT5Session::connect
+    if (expectLegacy) {
+        Connection connection;
+        MQTT5Connack connack;
+        bool answered = connectV5(connection, host, port, "liminal-check-legacy", connack);
+        bool fallback = answered ? (connack.legacy || connack.reasonCode == MQTT5Codec::REASON_UNSUPPORTED_PROTOCOL)
+                                 : connection.isClosed();
+        check(fallback, "MQTT 5 CONNECT is refused in a way that triggers the 3.1.1 fallback");
+        return failures > 0 ? 1 : 0;
+    }
+    
+    char base[64];
+    snprintf(base, sizeof(base), "liminal/check/%d", (int)getpid());
+    std::string topic = std::string(base) + "/sensors/esp32-001/imu/main_imu";
+    std::string filter = std::string(base) + "/#";
+    
+    Connection subscriber;
+    MQTT5Connack subscriberAck;
+    if (!connectV5(subscriber, host, port, "liminal-check-sub", subscriberAck) || subscriberAck.reasonCode != 0) {
+        check(false, "subscriber connects with MQTT 5");
+        return 1;
+    }
+    check(subscribe(subscriber, filter.c_str()), "subscriber subscribes");
+    
+    Connection publisher;
+    MQTT5Connack connack;
+    bool connected = connectV5(publisher, host, port, "liminal-check-pub", connack);
+    check(connected && !connack.legacy && connack.reasonCode == 0, "publisher connects with MQTT 5");
+    if (!connected) {
+        return 1;
+    }
+    printf("      broker grants %u topic aliases, max packet %u, retain %s\n", connack.topicAliasMaximum,
+           connack.maximumPacketSize, connack.retainAvailable ? "yes" : "no");
+    check(connack.topicAliasMaximum > 0, "broker grants topic aliases");
+    uint16_t alias = connack.topicAliasMaximum > 0 ? 1 : 0;
+    
+    // The first message sets up the alias, the rest use it alone
+    size_t before = publisher.getSentBytes();
+    for (int i = 0; i < count; i++) {
+        bool first = i == 0;
+        publish(publisher, first || alias == 0 ? topic.c_str() : "", alias, 10, "sensor/1",
+                makePayload(i, payloadSize), false);
+    }
+    size_t sent = publisher.getSentBytes() - before;
+    
+    // A 3.1.1 QoS 0 publish: fixed header, topic with length, payload
+    size_t legacyBody = 2 + topic.size() + payloadSize;
+    size_t legacy = MQTT5Codec::headerSize(legacyBody) + legacyBody;
+    printf("      %.1f bytes per message over MQTT 5 (aliased, with expiry and schema), %zu over 3.1.1\n",
+           (double)sent / count, legacy);
+    
+    int received = 0;
+    bool inOrder = true;
+    bool topicsOk = true;
+    bool payloadsOk = true;
+    bool schemaOk = true;
+    bool expiryOk = true;
+    std::vector<uint8_t> packet;
+    size_t headerLength;
+    while (received < count && subscriber.receive(packet, headerLength, 3000)) {
+        if ((packet[0] & 0xF0) != MQTT5Codec::PUBLISH) {
+            continue;
+        }
+        MQTT5Publish message;
+        if (!MQTT5Codec::decodePublish(packet[0], packet.data() + headerLength, packet.size() - headerLength, message)) {
+            payloadsOk = false;
+            continue;
+        }
+        std::string receivedTopic(message.topic, message.topicLength);
+        std::string payload((const char*)message.payload, message.payloadLength);
+        topicsOk &= receivedTopic == topic;
+        inOrder &= atoi(payload.c_str()) == received;
+        payloadsOk &= payload == makePayload(atoi(payload.c_str()), payloadSize);
+        schemaOk &= message.userKey != nullptr && std::string(message.userKey, message.userKeyLength) == "schema" &&
+                    std::string(message.userValue, message.userValueLength) == "sensor/1";
+        expiryOk &= message.messageExpiry > 0 && message.messageExpiry <= 10;
+        received++;
+    }
+    printf("      received %d of %d\n", received, count);
+    check(received == count, "every message arrives");
+    check(inOrder, "messages arrive in order");
+    check(topicsOk, "aliased messages arrive under their full topic");
+    check(payloadsOk, "payloads arrive intact");
+    check(schemaOk, "schema user property is forwarded");
+    check(expiryOk, "message expiry is forwarded, counting down");
+    
+    // A retained message past its expiry must not be handed to new subscribers
+    std::string expiring = std::string(base) + "/expiring";
+    publish(publisher, expiring.c_str(), 0, 1, "status/1", "stale", true);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+    Connection late;
+    MQTT5Connack lateAck;
+    bool lateConnected = connectV5(late, host, port, "liminal-check-late", lateAck) &&
+                         subscribe(late, expiring.c_str());
+    bool stale = late.receive(packet, headerLength, 1000) && (packet[0] & 0xF0) == MQTT5Codec::PUBLISH;
+    check(lateConnected && !stale, "expired retained message is not delivered");
+    
+    // Clear the retained topic in case the broker kept it
+    publish(publisher, expiring.c_str(), 0, 0, nullptr, "", true);
+    
+    printf("%s\n", failures == 0 ? "All checks passed" : "Some checks failed");
+    return failures > 0 ? 1 : 0;
+}
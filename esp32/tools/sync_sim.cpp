@@ -0,0 +1,532 @@
+// Host simulation of synchronised sampling: one coordinator and several
+// follower nodes, each with its own clock offset and crystal drift, running
+// the firmware's SyncEstimator on the same beacon/request/response exchange.
+// It reports how far each follower's idea of the shared grid is from the
+// truth, and whether that error stayed within the bound the node reports.
+//
+// Build and run from esp32/:
+//   g++ -O2 -std=gnu++11 -Isrc tools/sync_sim.cpp src/utils/sync_estimator.cpp -o sync_sim
+//   ./sync_sim                                   # simulated broker
+//   ./sync_sim --broker localhost:1883           # through a real broker
+//   ./sync_sim --broker localhost:1883 --external-coordinator
+//
+// Options: --nodes N (4), --seconds S (120), --beacon-ms MS (2000),
+// --delay-ms MS and --jitter-ms MS (per broker hop: fixed part and
+// exponential mean, 3 and 8), --spikes P (fraction of hops delayed by
+// 50-300 ms, 0.05), --seed N.
+//
+// With --broker, the nodes are separate MQTT connections exchanging the
+// firmware's JSON messages on the firmware's topics (MQTT_TOPIC_BASE
+// "liminal"), so the network delay is real and the clocks are simulated.
+// With --external-coordinator a real node (SYNC_MODE 2) coordinates: the
+// truth is then unknown, so only the reported bounds are shown.
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "utils/sync_estimator.h"
+
+static const char* TOPIC_BEACON = "liminal/sync/beacon";
+static const char* TOPIC_REQUEST = "liminal/sync/request";
+static const char* TOPIC_RESPONSE = "liminal/sync/response";
+
+struct Options {
+    int nodes = 4;
+    double seconds = 120;
+    double beaconMs = 2000;
+    double delayMs = 3;
+    double jitterMs = 8;
+    double spikes = 0.05;
+    unsigned seed = 1;
+    std::string broker;
+    bool externalCoordinator = false;
+};
+
+// A node's clock against true time: a boot offset plus crystal drift
+struct SimClock {
+    int64_t offsetUs;
+    double ppm;
+    
+    int64_t local(int64_t trueUs) const { return offsetUs + (int64_t)llround(trueUs * (1.0 + ppm * 1e-6)); }
+};
+
+// Offset error samples for one follower
+struct Stats {
+    std::vector<double> errors; // µs, absolute
+    std::vector<double> bounds;
+    size_t violations = 0;
+    size_t unlocked = 0;
+    
+    void add(int64_t error, uint32_t bound, bool locked) {
+        if (!locked) {
+            unlocked++;
+            return;
+        }
+        errors.push_back(std::fabs((double)error));
+        bounds.push_back(bound);
+        if (std::llabs(error) > bound) {
+            violations++;
+        }
+    }
+};
+
+static double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, (size_t)(p * values.size()))];
+}
+
+static double mean(const std::vector<double>& values) {
+    double sum = 0;
+    for (double value : values) {
+        sum += value;
+    }
+    return values.empty() ? 0 : sum / values.size();
+}
+
+static void printReport(const std::vector<Stats>& stats, bool truthKnown, uint32_t periodUs) {
+    printf("\n%-6s %8s %10s %10s %10s %12s %10s %9s\n",
+           "node", "samples", "err_mean", "err_p99", "err_max", "bound_mean", "violations", "unlocked");
+    for (size_t i = 0; i < stats.size(); i++) {
+        const Stats& s = stats[i];
+        if (truthKnown) {
+            printf("%-6zu %8zu %9.0fus %9.0fus %9.0fus %11.0fus %10zu %9zu\n", i + 1, s.errors.size(),
+                   mean(s.errors), percentile(s.errors, 0.99), percentile(s.errors, 1.0),
+                   mean(s.bounds), s.violations, s.unlocked);
+        } else {
+            printf("%-6zu %8zu %10s %10s %10s %11.0fus %10s %9zu\n", i + 1, s.bounds.size(),
+                   "-", "-", "-", mean(s.bounds), "-", s.unlocked);
+        }
+    }
+    printf("\nLocked means a bound under half the %u ms grid period.\n", periodUs / 1000);
+}
+
+// ---------------------------------------------------------------------------
+// Simulated broker: each hop is a fixed delay plus exponential jitter, with
+// occasional spikes, and each end polls MQTT every few ms as the loop does
+
+static int runSimulated(const Options& options, uint32_t periodUs) {
+    std::mt19937 rng(options.seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::exponential_distribution<double> jitter(1.0 / (options.jitterMs * 1000.0));
+    
+    auto hop = [&]() -> int64_t {
+        double delay = options.delayMs * 1000.0 + jitter(rng);
+        if (uniform(rng) < options.spikes) {
+            delay += 50000.0 + uniform(rng) * 250000.0;
+        }
+        return (int64_t)delay;
+    };
+    auto poll = [&]() -> int64_t { return (int64_t)(uniform(rng) * 5000.0); };
+    auto makeClock = [&]() -> SimClock {
+        return SimClock{ (int64_t)(uniform(rng) * 3600e6), (uniform(rng) * 2.0 - 1.0) * 20.0 };
+    };
+    
+    SimClock coordinator = makeClock();
+    std::vector<SimClock> clocks;
+    std::vector<SyncEstimator> estimators(options.nodes);
+    std::vector<Stats> stats(options.nodes);
+    for (int i = 0; i < options.nodes; i++) {
+        clocks.push_back(makeClock());
+    }
+    
+    int64_t beaconUs = (int64_t)(options.beaconMs * 1000.0);
+    int64_t endUs = (int64_t)(options.seconds * 1e6);
+    
+    for (int node = 0; node < options.nodes; node++) {
+        const SimClock& clock = clocks[node];
+        SyncEstimator& estimator = estimators[node];
+        
+        // Exchanges complete at known true times; evaluate every 100 ms in between
+        int64_t nextEval = 0;
+        for (int64_t beacon = 0; beacon < endUs; beacon += beaconUs) {
+            int64_t sent = beacon + hop() + hop() + poll(); // Beacon reaches the follower
+            int64_t atCoordinator = sent + hop() + hop() + poll();
+            int64_t replied = atCoordinator + 200;
+            int64_t received = replied + hop() + hop() + poll();
+            
+            while (nextEval < std::min(received, endUs)) {
+                int64_t local = clock.local(nextEval);
+                int64_t truth = coordinator.local(nextEval) - local;
+                uint32_t bound = estimator.getErrorBound(local);
+                stats[node].add(estimator.getOffset(local) - truth, bound,
+                                estimator.isValid() && bound < periodUs / 2);
+                nextEval += 100000;
+            }
+            
+            // Lost when the reply comes after the next beacon
+            if (received - sent < beaconUs) {
+                estimator.addExchange(clock.local(sent), coordinator.local(atCoordinator),
+                                      coordinator.local(replied), clock.local(received));
+            }
+        }
+    }
+    
+    printf("Simulated broker: %d followers, %.0f s, beacons every %.0f ms, hops %.1f ms + exp(%.1f ms), %.0f%% spikes\n",
+           options.nodes, options.seconds, options.beaconMs, options.delayMs, options.jitterMs, options.spikes * 100);
+    printReport(stats, true, periodUs);
+    
+    size_t violations = 0;
+    for (const Stats& s : stats) {
+        violations += s.violations;
+    }
+    return violations == 0 ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// Minimal MQTT 3.1.1 client (QoS 0 only), enough to put the nodes on a broker
+
+class MiniMqtt {
+public:
+    typedef std::function<void(const std::string& topic, const std::string& payload)> Handler;
+    
+    ~MiniMqtt() {
+        if (_fd >= 0) {
+            close(_fd);
+        }
+    }
+    
+    bool connect(const std::string& host, int port, const std::string& clientId) {
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* result = nullptr;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) {
+            fprintf(stderr, "Cannot resolve %s\n", host.c_str());
+            return false;
+        }
+        for (addrinfo* entry = result; entry && _fd < 0; entry = entry->ai_next) {
+            _fd = socket(entry->ai_family, entry->ai_socktype, entry->ai_protocol);
+            if (_fd >= 0 && ::connect(_fd, entry->ai_addr, entry->ai_addrlen) != 0) {
+                close(_fd);
+                _fd = -1;
+            }
+        }
+        freeaddrinfo(result);
+        if (_fd < 0) {
+            fprintf(stderr, "Cannot connect to %s:%d\n", host.c_str(), port);
+            return false;
+        }
+        
+        // Small messages would otherwise wait on Nagle and delayed ACKs
+        int noDelay = 1;
+        setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        
+        std::string body;
+        _string(body, "MQTT");
+        body += '\x04';           // Protocol level 3.1.1
+        body += '\x02';           // Clean session
+        body += '\0';
+        body += '\x3C';           // 60 s keepalive
+        _string(body, clientId);
+        if (!_send(0x10, body)) {
+            return false;
+        }
+        
+        // CONNACK
+        uint8_t type;
+        std::string packet;
+        return _read(type, packet, true) && type == 0x20 && packet.size() >= 2 && packet[1] == 0;
+    }
+    
+    bool subscribe(const std::string& topic) {
+        std::string body;
+        body += '\0';
+        body += (char)++_packetId;
+        _string(body, topic);
+        body += '\0';
+        return _send(0x82, body);
+    }
+    
+    bool publish(const std::string& topic, const std::string& payload) {
+        std::string body;
+        _string(body, topic);
+        body += payload;
+        return _send(0x30, body);
+    }
+    
+    int fd() const { return _fd; }
+    
+    // Reads what is available and dispatches complete PUBLISH packets
+    bool poll(const Handler& handler) {
+        uint8_t type;
+        std::string packet;
+        while (_read(type, packet, false)) {
+            if ((type & 0xF0) != 0x30 || packet.size() < 2) {
+                continue;
+            }
+            size_t topicLength = ((uint8_t)packet[0] << 8) | (uint8_t)packet[1];
+            size_t offset = 2 + topicLength + (((type >> 1) & 3) ? 2 : 0);
+            if (offset <= packet.size()) {
+                handler(packet.substr(2, topicLength), packet.substr(offset));
+            }
+        }
+        return _fd >= 0;
+    }
+    
+    bool ping() { return _send(0xC0, std::string()); }
+    
+private:
+    int _fd = -1;
+    uint8_t _packetId = 0;
+    std::string _rx;
+    
+    static void _string(std::string& out, const std::string& value) {
+        out += (char)(value.size() >> 8);
+        out += (char)(value.size() & 0xFF);
+        out += value;
+    }
+    
+    bool _send(uint8_t type, const std::string& body) {
+        std::string packet(1, (char)type);
+        size_t length = body.size();
+        do {
+            uint8_t byte = length % 128;
+            length /= 128;
+            packet += (char)(length ? byte | 0x80 : byte);
+        } while (length);
+        packet += body;
+        return _fd >= 0 && ::send(_fd, packet.data(), packet.size(), 0) == (ssize_t)packet.size();
+    }
+    
+    bool _read(uint8_t& type, std::string& packet, bool block) {
+        for (;;) {
+            // Fixed header: type, then a 1-4 byte remaining length
+            size_t length = 0, multiplier = 1, index = 1;
+            bool complete = false;
+            while (index < _rx.size() && index <= 4) {
+                uint8_t byte = _rx[index++];
+                length += (byte & 0x7F) * multiplier;
+                multiplier *= 128;
+                if (!(byte & 0x80)) {
+                    complete = true;
+                    break;
+                }
+            }
+            if (complete && _rx.size() >= index + length) {
+                type = _rx[0];
+                packet = _rx.substr(index, length);
+                _rx.erase(0, index + length);
+                return true;
+            }
+            
+            if (!block) {
+                fd_set fds;
+                FD_ZERO(&fds);
+                FD_SET(_fd, &fds);
+                timeval timeout = {0, 0};
+                if (select(_fd + 1, &fds, nullptr, nullptr, &timeout) <= 0) {
+                    return false;
+                }
+            }
+            char buffer[2048];
+            ssize_t received = recv(_fd, buffer, sizeof(buffer), 0);
+            if (received <= 0) {
+                close(_fd);
+                _fd = -1;
+                return false;
+            }
+            _rx.append(buffer, received);
+        }
+    }
+};
+
+static bool jsonInt(const std::string& json, const char* key, int64_t& value) {
+    std::string pattern = std::string("\"") + key + "\"";
+    size_t at = json.find(pattern);
+    if (at == std::string::npos) {
+        return false;
+    }
+    at = json.find(':', at + pattern.size());
+    if (at == std::string::npos) {
+        return false;
+    }
+    value = strtoll(json.c_str() + at + 1, nullptr, 10);
+    return true;
+}
+
+static bool jsonString(const std::string& json, const char* key, std::string& value) {
+    std::string pattern = std::string("\"") + key + "\":\"";
+    size_t at = json.find(pattern);
+    if (at == std::string::npos) {
+        return false;
+    }
+    size_t end = json.find('"', at + pattern.size());
+    value = json.substr(at + pattern.size(), end - at - pattern.size());
+    return end != std::string::npos;
+}
+
+static int runBroker(const Options& options, uint32_t periodUs) {
+    std::string host = options.broker;
+    int port = 1883;
+    size_t colon = host.rfind(':');
+    if (colon != std::string::npos) {
+        port = atoi(host.c_str() + colon + 1);
+        host = host.substr(0, colon);
+    }
+    
+    std::mt19937 rng(options.seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    auto start = std::chrono::steady_clock::now();
+    auto trueNow = [&]() -> int64_t {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    };
+    auto makeClock = [&]() -> SimClock {
+        return SimClock{ (int64_t)(uniform(rng) * 3600e6), (uniform(rng) * 2.0 - 1.0) * 20.0 };
+    };
+    
+    struct Follower {
+        std::string id;
+        SimClock clock;
+        MiniMqtt mqtt;
+        SyncEstimator estimator;
+        int64_t requestUs = 0;
+        int64_t sequence = 0;
+        bool pending = false;
+    };
+    
+    SimClock coordinatorClock = makeClock();
+    MiniMqtt coordinator;
+    if (!options.externalCoordinator) {
+        if (!coordinator.connect(host, port, "sync-sim-coordinator") || !coordinator.subscribe(TOPIC_REQUEST)) {
+            return 1;
+        }
+    }
+    
+    std::vector<Follower> followers(options.nodes);
+    for (int i = 0; i < options.nodes; i++) {
+        Follower& follower = followers[i];
+        follower.id = "sync-sim-" + std::to_string(i + 1);
+        follower.clock = makeClock();
+        if (!follower.mqtt.connect(host, port, follower.id) ||
+            !follower.mqtt.subscribe(TOPIC_BEACON) ||
+            !follower.mqtt.subscribe(std::string(TOPIC_RESPONSE) + "/" + follower.id)) {
+            return 1;
+        }
+    }
+    printf("Broker %s:%d: %d followers, %.0f s%s\n", host.c_str(), port, options.nodes, options.seconds,
+           options.externalCoordinator ? ", external coordinator" : "");
+    
+    std::vector<Stats> stats(options.nodes);
+    int64_t beaconUs = (int64_t)(options.beaconMs * 1000.0);
+    int64_t endUs = (int64_t)(options.seconds * 1e6);
+    int64_t nextBeacon = 0, nextEval = 0, nextPing = 30000000, beaconSequence = 0;
+    char payload[160];
+    
+    while (trueNow() < endUs) {
+        // Coordinator: beacons and replies, stamped with its simulated clock
+        if (!options.externalCoordinator) {
+            if (trueNow() >= nextBeacon) {
+                int64_t now = coordinatorClock.local(trueNow());
+                snprintf(payload, sizeof(payload), "{\"seq\":%lld,\"period_us\":%u,\"t\":%lld}",
+                         (long long)++beaconSequence, periodUs, (long long)now);
+                coordinator.publish(TOPIC_BEACON, payload);
+                nextBeacon += beaconUs;
+            }
+            coordinator.poll([&](const std::string&, const std::string& request) {
+                int64_t t2 = coordinatorClock.local(trueNow());
+                std::string node;
+                int64_t sequence, t1;
+                if (jsonString(request, "node", node) && jsonInt(request, "seq", sequence) && jsonInt(request, "t1", t1)) {
+                    snprintf(payload, sizeof(payload), "{\"seq\":%lld,\"t1\":%lld,\"t2\":%lld,\"t3\":%lld}",
+                             (long long)sequence, (long long)t1, (long long)t2,
+                             (long long)coordinatorClock.local(trueNow()));
+                    coordinator.publish(std::string(TOPIC_RESPONSE) + "/" + node, payload);
+                }
+            });
+        }
+        
+        // Followers: the same steps as SyncClock
+        for (Follower& follower : followers) {
+            follower.mqtt.poll([&](const std::string& topic, const std::string& message) {
+                int64_t now = follower.clock.local(trueNow());
+                if (topic == TOPIC_BEACON) {
+                    follower.requestUs = follower.clock.local(trueNow());
+                    snprintf(payload, sizeof(payload), "{\"node\":\"%s\",\"seq\":%lld,\"t1\":%lld}",
+                             follower.id.c_str(), (long long)++follower.sequence, (long long)follower.requestUs);
+                    follower.pending = follower.mqtt.publish(TOPIC_REQUEST, payload);
+                    return;
+                }
+                int64_t sequence, t1, t2, t3;
+                if (follower.pending && jsonInt(message, "seq", sequence) && sequence == follower.sequence &&
+                    jsonInt(message, "t1", t1) && t1 == follower.requestUs &&
+                    jsonInt(message, "t2", t2) && jsonInt(message, "t3", t3)) {
+                    follower.pending = false;
+                    follower.estimator.addExchange(t1, t2, t3, now);
+                }
+            });
+        }
+        
+        int64_t now = trueNow();
+        if (now >= nextEval) {
+            for (int i = 0; i < options.nodes; i++) {
+                Follower& follower = followers[i];
+                int64_t local = follower.clock.local(now);
+                int64_t truth = coordinatorClock.local(now) - local;
+                uint32_t bound = follower.estimator.getErrorBound(local);
+                stats[i].add(follower.estimator.getOffset(local) - truth, bound,
+                             follower.estimator.isValid() && bound < periodUs / 2);
+            }
+            nextEval += 100000;
+        }
+        if (now >= nextPing) {
+            coordinator.ping();
+            for (Follower& follower : followers) {
+                follower.mqtt.ping();
+            }
+            nextPing += 30000000;
+        }
+        
+        usleep(500);
+    }
+    
+    printReport(stats, !options.externalCoordinator, periodUs);
+    
+    size_t violations = 0;
+    for (const Stats& s : stats) {
+        violations += s.violations;
+    }
+    return violations == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : "";
+        if (arg == "--nodes") { options.nodes = atoi(value); i++; }
+        else if (arg == "--seconds") { options.seconds = atof(value); i++; }
+        else if (arg == "--beacon-ms") { options.beaconMs = atof(value); i++; }
+        else if (arg == "--delay-ms") { options.delayMs = atof(value); i++; }
+        else if (arg == "--jitter-ms") { options.jitterMs = atof(value); i++; }
+        else if (arg == "--spikes") { options.spikes = atof(value); i++; }
+        else if (arg == "--seed") { options.seed = atoi(value); i++; }
+        else if (arg == "--broker") { options.broker = value; i++; }
+        else if (arg == "--external-coordinator") { options.externalCoordinator = true; }
+        else {
+            fprintf(stderr, "Unknown option %s (see the comment at the top of sync_sim.cpp)\n", arg.c_str());
+            return 2;
+        }
+    }
+    
+    // The firmware default grid (SYNC_PERIOD_MS)
+    const uint32_t periodUs = 50000;
+    return options.broker.empty() ? runSimulated(options, periodUs) : runBroker(options, periodUs);
+}
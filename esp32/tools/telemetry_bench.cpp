@@ -0,0 +1,236 @@
+// Host benchmark for the telemetry batch codec: compression ratio and encode
+// time per batch on a recorded IMU stream, and size against the JSON frames
+// the batches replace (written by the firmware's own frame writer).
+//
+// Build and run from esp32/ after a PlatformIO build has fetched ArduinoJson:
+//   g++ -O2 -std=gnu++11 -Isrc -I.pio/libdeps/esp32dev/ArduinoJson/src tools/telemetry_bench.cpp src/communication/telemetry_codec.cpp src/communication/json_writer.cpp -o telemetry_bench
+//   ./telemetry_bench recording.csv
+//
+// The recording is CSV with one sample per line in the IMU batch layout's
+// fixed-point units (see README, "Telemetry Batches"):
+//   timestamp_ms,ax,ay,az,gx,gy,gz,temp[,mx,my,mz]
+// Lines starting with '#' are skipped. Without a file, a synthetic 50 Hz
+// stream (sensor noise plus intermittent motion) is used instead; use a real
+// recording for numbers that mean anything. Samples are converted back to
+// the IMU's float units at the default ranges (±8 g, ±500 °/s) for the JSON
+// frames; 7 channels are taken as an MPU6050 (m/s²), 10 as an MPU9250 (g).
+//
+// Times are host times. Expect the ESP32 to be one to two orders of magnitude
+// slower; the relative cost of each stage carries over.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "communication/telemetry_codec.h"
+#include "communication/json_writer.h"
+#include "sensors/imu_frame.h"
+
+struct Sample {
+    uint32_t timestamp;
+    int16_t values[TELEMETRY_BATCH_MAX_CHANNELS];
+};
+
+static bool loadRecording(const char* path, std::vector<Sample>& samples, uint8_t& channels) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return false;
+    }
+    
+    char line[256];
+    channels = 0;
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        
+        Sample sample = {};
+        char* cursor = line;
+        sample.timestamp = strtoul(cursor, &cursor, 10);
+        uint8_t count = 0;
+        while (*cursor == ',' && count < TELEMETRY_BATCH_MAX_CHANNELS) {
+            sample.values[count++] = (int16_t)strtol(cursor + 1, &cursor, 10);
+        }
+        if (channels == 0) {
+            channels = count;
+        }
+        if (count != channels) {
+            fprintf(stderr, "Inconsistent channel count on line: %s", line);
+            fclose(file);
+            return false;
+        }
+        samples.push_back(sample);
+    }
+    
+    fclose(file);
+    return !samples.empty();
+}
+
+static void synthesize(std::vector<Sample>& samples, uint8_t& channels) {
+    std::mt19937 rng(42);
+    std::normal_distribution<float> accelNoise(0.0f, 4.0f);  // ~1 mg at 4096 LSB/g
+    std::normal_distribution<float> gyroNoise(0.0f, 3.0f);   // ~0.05 °/s at 65.5 LSB/(°/s)
+    std::normal_distribution<float> magNoise(0.0f, 2.0f);
+    
+    channels = 10;
+    for (uint32_t i = 0; i < 30000; i++) {
+        float t = i * 0.02f;
+        bool moving = fmodf(t, 60.0f) > 45.0f; // 15 s of motion per minute
+        float motion = moving ? sinf(t * 6.0f) : 0.0f;
+        
+        Sample sample = {};
+        sample.timestamp = 1000 + i * 20 + (rng() % 3); // Loop jitter
+        sample.values[0] = (int16_t)(600 * motion + accelNoise(rng));
+        sample.values[1] = (int16_t)(-300 * motion + accelNoise(rng));
+        sample.values[2] = (int16_t)(4096 + 400 * motion + accelNoise(rng));
+        sample.values[3] = (int16_t)(2000 * motion + gyroNoise(rng));
+        sample.values[4] = (int16_t)(-1500 * motion + gyroNoise(rng));
+        sample.values[5] = (int16_t)(800 * motion + gyroNoise(rng));
+        sample.values[6] = (int16_t)(2850 + (i / 3000));
+        sample.values[7] = (int16_t)(220 + 50 * motion + magNoise(rng));
+        sample.values[8] = (int16_t)(-80 + 30 * motion + magNoise(rng));
+        sample.values[9] = (int16_t)(-410 + magNoise(rng));
+        samples.push_back(sample);
+    }
+}
+
+// Defaults of imu.accel_range_g and imu.gyro_range_dps, as in IMUSensor
+static const float ACCEL_LSB_PER_G = 4096.0f;
+static const float GYRO_LSB_PER_DPS = 65.5f;
+static const float STANDARD_GRAVITY = 9.80665f;
+
+// Same fields as IMUSensor::IMUData
+struct Reading {
+    float accelX, accelY, accelZ;
+    float gyroX, gyroY, gyroZ;
+    float magX, magY, magZ;
+    float temperature;
+    uint32_t timestamp;
+};
+
+// The JSON frame the firmware would publish for this sample without batching:
+// the IMU's fields, then the ones publishSensorFrame() adds (unsynced)
+static size_t jsonSize(const Sample& sample, uint8_t channels, uint32_t seq) {
+    bool mpu6050 = channels <= 7;
+    float accelScale = (mpu6050 ? STANDARD_GRAVITY : 1.0f) / ACCEL_LSB_PER_G;
+    Reading data;
+    data.accelX = sample.values[0] * accelScale;
+    data.accelY = sample.values[1] * accelScale;
+    data.accelZ = sample.values[2] * accelScale;
+    data.gyroX = sample.values[3] / GYRO_LSB_PER_DPS;
+    data.gyroY = sample.values[4] / GYRO_LSB_PER_DPS;
+    data.gyroZ = sample.values[5] / GYRO_LSB_PER_DPS;
+    data.temperature = sample.values[6] / 100.0f;
+    data.magX = sample.values[7] / 10.0f;
+    data.magY = sample.values[8] / 10.0f;
+    data.magZ = sample.values[9] / 10.0f;
+    data.timestamp = sample.timestamp;
+    
+    static char buffer[768];
+    JsonWriter out(buffer, sizeof(buffer));
+    writeIMUFrame(out, "main_imu", mpu6050 ? "MPU6050" : "MPU9250", "esp32-001", mpu6050, !mpu6050, data);
+    out.raw(",\"seq\":");
+    out.uinteger(seq);
+    out.raw(",\"sample_seq\":");
+    out.uinteger(seq);
+    out.raw(",\"publish_ms\":100,\"sample_ms\":20}");
+    return out.length();
+}
+
+int main(int argc, char** argv) {
+    std::vector<Sample> samples;
+    uint8_t channels = 0;
+    
+    if (argc > 1) {
+        if (!loadRecording(argv[1], samples, channels)) {
+            return 1;
+        }
+        printf("Recording: %s, %zu samples, %u channels\n", argv[1], samples.size(), channels);
+    } else {
+        synthesize(samples, channels);
+        printf("Synthetic stream: %zu samples, %u channels (pass a CSV recording for real data)\n",
+               samples.size(), channels);
+    }
+    
+    // Measured once: the same frames whatever the batching
+    size_t jsonTotal = 0;
+    for (size_t i = 0; i < samples.size(); i++) {
+        jsonTotal += jsonSize(samples[i], channels, (uint32_t)i);
+    }
+    printf("JSON frames: %.1f bytes/sample on average\n", (double)jsonTotal / samples.size());
+    
+    static TelemetryCodec codec;
+    static TelemetryBatch batch;
+    static TelemetryBatch decoded;
+    static uint8_t encoded[TelemetryCodec::MAX_ENCODED_SIZE];
+    
+    struct Mode {
+        const char* name;
+        bool delta;
+        bool lz;
+    };
+    const Mode modes[] = {
+        { "raw i16", false, false },
+        { "raw i16 + LZ", false, true },
+        { "delta varint", true, false },
+        { "delta varint + LZ", true, true },
+    };
+    const uint16_t batchSizes[] = { 8, 16, 32 };
+    
+    printf("\n%-20s %6s %10s %10s %8s %10s %8s\n",
+           "mode", "batch", "in bytes", "out bytes", "ratio", "vs JSON", "us/batch");
+    
+    for (uint16_t batchSize : batchSizes) {
+        for (const Mode& mode : modes) {
+            size_t inputBytes = 0;
+            size_t outputBytes = 0;
+            size_t jsonBytes = 0;
+            size_t batches = 0;
+            double encodeSeconds = 0.0;
+            
+            for (size_t start = 0; start + batchSize <= samples.size(); start += batchSize) {
+                batch.reset(TELEMETRY_LAYOUT_IMU, channels);
+                for (uint16_t i = 0; i < batchSize; i++) {
+                    batch.add(samples[start + i].timestamp, samples[start + i].values);
+                }
+                
+                auto begin = std::chrono::steady_clock::now();
+                size_t length = codec.encode(batch, encoded, sizeof(encoded), mode.delta, mode.lz);
+                encodeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+                
+                if (length == 0 || !codec.decode(encoded, length, decoded) ||
+                    decoded.count != batch.count ||
+                    memcmp(decoded.timestamps, batch.timestamps, batch.count * sizeof(uint32_t)) != 0) {
+                    fprintf(stderr, "Round trip failed (%s, batch %zu)\n", mode.name, batches);
+                    return 1;
+                }
+                for (uint16_t i = 0; i < batch.count; i++) {
+                    if (memcmp(decoded.values[i], batch.values[i], channels * sizeof(int16_t)) != 0) {
+                        fprintf(stderr, "Round trip failed (%s, batch %zu)\n", mode.name, batches);
+                        return 1;
+                    }
+                }
+                
+                // Baseline: a u32 timestamp and i16 per channel, per sample
+                inputBytes += batchSize * (4 + channels * 2);
+                outputBytes += length;
+                for (uint16_t i = 0; i < batchSize; i++) {
+                    jsonBytes += jsonSize(samples[start + i], channels, (uint32_t)(start + i));
+                }
+                batches++;
+            }
+            
+            printf("%-20s %6u %10zu %10zu %7.2fx %9.1fx %8.2f\n",
+                   mode.name, batchSize, inputBytes, outputBytes,
+                   (double)inputBytes / outputBytes, (double)jsonBytes / outputBytes,
+                   encodeSeconds * 1e6 / batches);
+        }
+    }
+    
+    return 0;
+}
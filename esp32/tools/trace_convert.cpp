@@ -0,0 +1,359 @@
+// Host converter for trace dumps (see src/utils/trace_buffer.h) to the Chrome
+// trace event JSON that chrome://tracing and ui.perfetto.dev open. Also prints
+// a summary of span durations per event and any span still open at the dump,
+// which is where a stalled node was stuck.
+//
+// Build and run from esp32/:
+//   g++ -O2 -std=gnu++11 -Isrc tools/trace_convert.cpp -o trace_convert
+//   mosquitto_pub -t liminal/commands/esp32-001/trace -n
+//   mosquitto_sub -t liminal/status/esp32-001/trace -C 8 > dump.bin   # -C: the chunk count
+//   ./trace_convert dump.bin trace.json
+//   ./trace_convert serial.log trace.json   # a Serial capture after typing "trace"
+//
+// The input is either the chunks as published, back to back (anything between
+// them, such as mosquitto_sub's newlines, is skipped), or text containing the
+// "TRACE <hex>" lines of a Serial dump. With several dumps in the input the
+// last one is converted, or the one given with --dump N. --name sets the
+// process name shown in the viewer (default "liminal").
+//
+// Spans become complete ("X") events on one track per task, with the core in
+// their args; WiFi events become instants. Timestamps are µs of device uptime.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "utils/trace_format.h"
+
+struct Dump {
+    uint16_t id = 0;
+    uint8_t chunkCount = 0;
+    uint32_t overwritten = 0;
+    uint64_t dumpTimeUs = 0;
+    std::vector<std::string> tasks;
+    std::map<uint8_t, std::vector<TraceRecord>> chunks; // By index, so repeats and order don't matter
+};
+
+struct OpenSpan {
+    uint8_t event;
+    uint64_t start;
+    uint16_t arg;
+    uint8_t core;
+};
+
+struct EventSummary {
+    uint64_t count = 0;
+    uint64_t totalUs = 0;
+    uint64_t maxUs = 0;
+    uint64_t maxAt = 0;
+    uint64_t failures = 0;
+};
+
+static bool readFile(const char* path, std::vector<uint8_t>& data) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return false;
+    }
+    uint8_t buffer[4096];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.insert(data.end(), buffer, buffer + length);
+    }
+    fclose(file);
+    return true;
+}
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// The bytes of every "TRACE <hex>" line, in order; false if there are none
+static bool decodeSerial(const std::vector<uint8_t>& text, std::vector<uint8_t>& data) {
+    std::string all(text.begin(), text.end());
+    size_t position = 0;
+    bool found = false;
+    while ((position = all.find("TRACE ", position)) != std::string::npos) {
+        position += 6;
+        while (position + 1 < all.size() && hexValue(all[position]) >= 0 && hexValue(all[position + 1]) >= 0) {
+            data.push_back((uint8_t)(hexValue(all[position]) << 4 | hexValue(all[position + 1])));
+            position += 2;
+            found = true;
+        }
+    }
+    return found;
+}
+
+static std::map<uint16_t, Dump> parseChunks(const std::vector<uint8_t>& data, std::vector<uint16_t>& order) {
+    std::map<uint16_t, Dump> dumps;
+    size_t position = 0;
+    while (position + TraceChunkHeader::SIZE <= data.size()) {
+        TraceChunkHeader header;
+        if (!header.read(data.data() + position, data.size() - position)) {
+            position++; // Resynchronise on the next magic
+            continue;
+        }
+        
+        Dump& dump = dumps[header.dumpId];
+        if (dump.chunkCount == 0) {
+            order.push_back(header.dumpId);
+        }
+        dump.id = header.dumpId;
+        dump.chunkCount = header.chunkCount;
+        dump.overwritten = header.overwritten;
+        dump.dumpTimeUs = header.dumpTimeUs;
+        
+        const uint8_t* in = data.data() + position + TraceChunkHeader::SIZE;
+        dump.tasks.clear();
+        for (uint8_t i = 0; i < header.taskCount; i++) {
+            const char* name = (const char*)in + i * TRACE_TASK_NAME_MAX;
+            dump.tasks.push_back(std::string(name, strnlen(name, TRACE_TASK_NAME_MAX)));
+        }
+        in += header.taskCount * TRACE_TASK_NAME_MAX;
+        
+        std::vector<TraceRecord>& records = dump.chunks[header.chunkIndex];
+        records.resize(header.recordCount);
+        for (uint16_t i = 0; i < header.recordCount; i++) {
+            records[i].read(in + i * TraceRecord::SIZE);
+        }
+        position += header.getChunkSize();
+    }
+    return dumps;
+}
+
+static std::string escape(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        if ((unsigned char)c >= 0x20) {
+            out += c;
+        }
+    }
+    return out;
+}
+
+static const char* wifiEventName(uint16_t id) {
+    // arduino_event_id_t in the ESP32 Arduino core 2.x
+    static const char* const NAMES[] = {
+        "wifi_ready", "scan_done", "sta_start", "sta_stop", "sta_connected",
+        "sta_disconnected", "sta_authmode_change", "sta_got_ip", "sta_got_ip6", "sta_lost_ip"
+    };
+    return id < sizeof(NAMES) / sizeof(NAMES[0]) ? NAMES[id] : nullptr;
+}
+
+static void writeArgs(FILE* out, uint8_t event, uint16_t arg, uint8_t core) {
+    fprintf(out, "\"core\":%u", core);
+    switch ((TraceEvent)event) {
+        case TraceEvent::SENSOR_READ:
+            fprintf(out, ",\"stream\":%u", arg);
+            break;
+        case TraceEvent::I2C_TRANSACTION:
+            fprintf(out, ",\"bus\":%u,\"address\":\"0x%02x\"", arg >> 8, arg & 0xFF);
+            break;
+        case TraceEvent::MQTT_PUBLISH:
+        case TraceEvent::COMMAND:
+            fprintf(out, ",\"bytes\":%u", arg);
+            break;
+        case TraceEvent::WIFI_EVENT: {
+            const char* name = wifiEventName(arg);
+            fprintf(out, ",\"event\":%u", arg);
+            if (name) {
+                fprintf(out, ",\"name\":\"%s\"", name);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* inputPath = nullptr;
+    const char* outputPath = nullptr;
+    std::string processName = "liminal";
+    int wantedDump = -1;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--dump" && hasValue) wantedDump = atoi(argv[++i]);
+        else if (arg == "--name" && hasValue) processName = argv[++i];
+        else if (arg[0] != '-' && !inputPath) inputPath = argv[i];
+        else if (arg[0] != '-' && !outputPath) outputPath = argv[i];
+        else {
+            fprintf(stderr, "Unknown option %s (see the top of trace_convert.cpp)\n", arg.c_str());
+            return 2;
+        }
+    }
+    if (!inputPath || !outputPath) {
+        fprintf(stderr, "Usage: trace_convert [--dump N] [--name NAME] input output.json\n");
+        return 2;
+    }
+    
+    std::vector<uint8_t> raw;
+    if (!readFile(inputPath, raw)) {
+        return 1;
+    }
+    std::vector<uint8_t> data;
+    if (!decodeSerial(raw, data)) {
+        data.swap(raw);
+    }
+    
+    std::vector<uint16_t> order;
+    std::map<uint16_t, Dump> dumps = parseChunks(data, order);
+    if (dumps.empty()) {
+        fprintf(stderr, "No trace chunks found in %s\n", inputPath);
+        return 1;
+    }
+    if (dumps.size() > 1) {
+        printf("%u dumps in the input:", (unsigned)dumps.size());
+        for (uint16_t id : order) {
+            printf(" %u", id);
+        }
+        printf("\n");
+    }
+    uint16_t dumpId = wantedDump >= 0 ? (uint16_t)wantedDump : order.back();
+    if (!dumps.count(dumpId)) {
+        fprintf(stderr, "No dump %d in the input\n", wantedDump);
+        return 1;
+    }
+    const Dump& dump = dumps[dumpId];
+    
+    std::vector<TraceRecord> records;
+    for (const auto& chunk : dump.chunks) {
+        records.insert(records.end(), chunk.second.begin(), chunk.second.end());
+    }
+    printf("Dump %u: %u of %u chunks, %u records, %u overwritten before it\n", dump.id,
+           (unsigned)dump.chunks.size(), dump.chunkCount, (unsigned)records.size(), dump.overwritten);
+    if (dump.chunks.size() < dump.chunkCount) {
+        printf("Missing chunks: spans across the gap are shown as unfinished or begin-lost\n");
+    }
+    
+    FILE* out = fopen(outputPath, "w");
+    if (!out) {
+        perror(outputPath);
+        return 1;
+    }
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"%s\"}}",
+            escape(processName).c_str());
+    for (size_t i = 0; i < dump.tasks.size(); i++) {
+        fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                (unsigned)i, escape(dump.tasks[i]).c_str());
+    }
+    
+    // Records hold the low 32 bits of the µs clock; widen them back from the dump time
+    uint64_t firstUs = 0;
+    std::map<uint8_t, std::vector<OpenSpan>> open; // Per task
+    std::map<uint8_t, EventSummary> summary;
+    uint64_t beginLost = 0;
+    for (size_t i = 0; i < records.size(); i++) {
+        const TraceRecord& record = records[i];
+        uint64_t us = dump.dumpTimeUs - (uint32_t)((uint32_t)dump.dumpTimeUs - record.timestamp);
+        if (i == 0) {
+            firstUs = us;
+        }
+        uint8_t task = record.getTask();
+        uint8_t core = record.getCore();
+        const char* name = traceEventName(record.event);
+        
+        switch (record.getPhase()) {
+            case TracePhase::BEGIN:
+                open[task].push_back({ record.event, us, record.arg, core });
+                break;
+            
+            case TracePhase::END: {
+                std::vector<OpenSpan>& stack = open[task];
+                auto it = std::find_if(stack.rbegin(), stack.rend(),
+                                       [&record](const OpenSpan& span) { return span.event == record.event; });
+                OpenSpan span;
+                bool found = it != stack.rend();
+                if (found) {
+                    span = *it;
+                    stack.erase(std::next(it).base());
+                } else {
+                    // Its BEGIN was overwritten or in a missing chunk
+                    span = { record.event, firstUs, 0, core };
+                    beginLost++;
+                }
+                
+                uint64_t duration = us - span.start;
+                EventSummary& stats = summary[record.event];
+                stats.count++;
+                stats.totalUs += duration;
+                if (duration > stats.maxUs) {
+                    stats.maxUs = duration;
+                    stats.maxAt = span.start;
+                }
+                if (record.arg == 0) {
+                    stats.failures++;
+                }
+                
+                fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,"
+                        "\"pid\":1,\"tid\":%u,\"args\":{", name, name, (unsigned long long)span.start,
+                        (unsigned long long)duration, task);
+                writeArgs(out, record.event, span.arg, span.core);
+                fprintf(out, ",\"ok\":%s%s}}", record.arg ? "true" : "false", found ? "" : ",\"begin_lost\":true");
+                break;
+            }
+            
+            case TracePhase::INSTANT:
+                fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%llu,"
+                        "\"pid\":1,\"tid\":%u,\"args\":{", name, name, (unsigned long long)us, task);
+                writeArgs(out, record.event, record.arg, core);
+                fprintf(out, "}}");
+                summary[record.event].count++;
+                break;
+        }
+    }
+    
+    // Still open when the dump froze the buffer: the likeliest place a stall was
+    std::vector<std::pair<uint8_t, OpenSpan>> unfinished;
+    for (const auto& task : open) {
+        for (const OpenSpan& span : task.second) {
+            unfinished.push_back(std::make_pair(task.first, span));
+            const char* name = traceEventName(span.event);
+            fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,"
+                    "\"pid\":1,\"tid\":%u,\"args\":{", name, name, (unsigned long long)span.start,
+                    (unsigned long long)(dump.dumpTimeUs - span.start), task.first);
+            writeArgs(out, span.event, span.arg, span.core);
+            fprintf(out, ",\"unfinished\":true}}");
+        }
+    }
+    fprintf(out, "\n]}\n");
+    fclose(out);
+    
+    if (!records.empty()) {
+        printf("Covers %.3f s before the dump\n", (dump.dumpTimeUs - firstUs) / 1e6);
+    }
+    printf("\n%-14s %8s %10s %10s %14s %8s\n", "event", "count", "mean_us", "max_us", "max_at_s", "failed");
+    for (const auto& entry : summary) {
+        const EventSummary& stats = entry.second;
+        if ((TraceEvent)entry.first == TraceEvent::WIFI_EVENT) {
+            printf("%-14s %8llu\n", traceEventName(entry.first), (unsigned long long)stats.count);
+            continue;
+        }
+        printf("%-14s %8llu %10.0f %10llu %14.6f %8llu\n", traceEventName(entry.first),
+               (unsigned long long)stats.count, stats.count ? (double)stats.totalUs / stats.count : 0.0,
+               (unsigned long long)stats.maxUs, stats.maxAt / 1e6, (unsigned long long)stats.failures);
+    }
+    if (beginLost > 0) {
+        printf("%llu spans had lost their begin record\n", (unsigned long long)beginLost);
+    }
+    for (const auto& entry : unfinished) {
+        const std::string& task = entry.first < dump.tasks.size() ? dump.tasks[entry.first] : "?";
+        printf("Unfinished at the dump: %s on %s since %.6f s (%.0f ms)\n", traceEventName(entry.second.event),
+               task.c_str(), entry.second.start / 1e6, (dump.dumpTimeUs - entry.second.start) / 1e3);
+    }
+    printf("\nWrote %s\n", outputPath);
+    return 0;
+}
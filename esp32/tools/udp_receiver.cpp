@@ -0,0 +1,382 @@
+// Host receiver for UDP telemetry (see src/communication/udp_stream.h):
+// decodes every datagram with the firmware's codec and reports throughput
+// and loss per stream from the sequence numbers.
+//
+// Build and run from esp32/:
+//   g++ -O2 -std=gnu++11 -pthread -Isrc tools/udp_receiver.cpp src/communication/telemetry_codec.cpp -o udp_receiver
+//   ./udp_receiver --port 5005                  # collector for real nodes (udp.collector)
+//   ./udp_receiver --send 127.0.0.1:5005        # synthetic node, for testing a collector
+//   ./udp_receiver --selftest                   # both over loopback, with injected loss
+//
+// Options: --port N (5005), --seconds S (0 = until interrupted; 5 for
+// --send and --selftest), --report-ms MS (5000), --max-loss P (fail above
+// this loss fraction). For --send: --rate N batches per second (500),
+// --samples N per batch (32), --drop P (fraction of datagrams skipped,
+// consuming their sequence numbers as a failed send would), --seed N.
+//
+// A stream is one (sender address, session, stream id). Loss counts gaps in
+// the sequence; datagrams arriving behind the highest sequence seen count as
+// late and fill their gap. The exit status is 1 if any stream exceeded
+// --max-loss or a datagram failed to decode; --selftest also requires the
+// measured loss to match what was injected.
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+
+#include "communication/telemetry_codec.h"
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options {
+    int port = 5005;
+    double seconds = 0;
+    double reportMs = 5000;
+    double maxLoss = 1.0;
+    std::string send;
+    double rate = 500;
+    int samples = 32;
+    double drop = 0;
+    unsigned seed = 1;
+    bool selftest = false;
+};
+
+struct StreamStats {
+    uint32_t nextSequence = 0; // One past the highest seen
+    uint64_t received = 0;
+    uint64_t bytes = 0;
+    uint64_t samples = 0;
+    uint64_t lost = 0;
+    uint64_t late = 0;
+    uint64_t decodeErrors = 0;
+    Clock::time_point first;
+    Clock::time_point last;
+};
+
+// Sender address and port, session, stream id
+typedef std::tuple<uint32_t, uint16_t, uint16_t, uint8_t> StreamKey;
+
+struct SendResult {
+    uint64_t sent = 0;
+    uint64_t dropped = 0;
+};
+
+static double seconds(Clock::duration duration) {
+    return std::chrono::duration<double>(duration).count();
+}
+
+static void printHeader() {
+    printf("%-21s %7s %6s %10s %9s %9s %10s %8s %6s %6s\n", "sender", "session", "stream", "datagrams",
+           "per s", "kB/s", "samples/s", "lost", "loss%", "late");
+}
+
+static void printStream(const StreamKey& key, const StreamStats& stats) {
+    char sender[32];
+    struct in_addr address;
+    address.s_addr = std::get<0>(key);
+    snprintf(sender, sizeof(sender), "%s:%u", inet_ntoa(address), std::get<1>(key));
+    
+    double elapsed = seconds(stats.last - stats.first);
+    // Rates need a span; a single datagram has none
+    double perSecond = elapsed > 0 ? (stats.received - 1) / elapsed : 0;
+    double kbPerSecond = elapsed > 0 ? stats.bytes * (stats.received - 1) / (double)stats.received / elapsed / 1000 : 0;
+    double samplesPerSecond = elapsed > 0 ? stats.samples * (stats.received - 1) / (double)stats.received / elapsed : 0;
+    double loss = (double)stats.lost / (stats.received + stats.lost);
+    printf("%-21s %7u %6u %10llu %9.1f %9.1f %10.0f %8llu %6.2f %6llu", sender, std::get<2>(key), std::get<3>(key),
+           (unsigned long long)stats.received, perSecond, kbPerSecond, samplesPerSecond,
+           (unsigned long long)stats.lost, loss * 100, (unsigned long long)stats.late);
+    if (stats.decodeErrors > 0) {
+        printf("  %llu undecodable", (unsigned long long)stats.decodeErrors);
+    }
+    printf("\n");
+}
+
+static int openSocket(int port) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    
+    // Large enough that the receiver itself is not where datagrams get lost
+    int size = 8 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Receives until the deadline (none if seconds is 0), or until idle for
+// idleSeconds after the first datagram when that is set
+static std::map<StreamKey, StreamStats> receive(int fd, const Options& options, double idleSeconds) {
+    std::map<StreamKey, StreamStats> streams;
+    TelemetryCodec codec;
+    TelemetryBatch batch;
+    uint8_t buffer[2048];
+    
+    Clock::time_point start = Clock::now();
+    Clock::time_point lastReport = start;
+    Clock::time_point lastDatagram = start;
+    bool any = false;
+    
+    while (true) {
+        Clock::time_point now = Clock::now();
+        if (options.seconds > 0 && seconds(now - start) >= options.seconds) {
+            break;
+        }
+        if (idleSeconds > 0 && any && seconds(now - lastDatagram) >= idleSeconds) {
+            break;
+        }
+        if (options.reportMs > 0 && seconds(now - lastReport) * 1000 >= options.reportMs && !streams.empty()) {
+            lastReport = now;
+            printHeader();
+            for (const auto& entry : streams) {
+                printStream(entry.first, entry.second);
+            }
+            printf("\n");
+        }
+        
+        struct pollfd waiting = { fd, POLLIN, 0 };
+        if (poll(&waiting, 1, 100) <= 0) {
+            continue;
+        }
+        
+        struct sockaddr_in sender;
+        socklen_t senderLength = sizeof(sender);
+        ssize_t length = recvfrom(fd, buffer, sizeof(buffer), 0, (struct sockaddr*)&sender, &senderLength);
+        if (length <= 0) {
+            continue;
+        }
+        now = Clock::now();
+        lastDatagram = now;
+        any = true;
+        
+        TelemetryDatagram header;
+        if (!header.readHeader(buffer, length)) {
+            fprintf(stderr, "Ignoring %zd-byte datagram with no valid header\n", length);
+            continue;
+        }
+        
+        StreamKey key(sender.sin_addr.s_addr, ntohs(sender.sin_port), header.session, header.stream);
+        auto found = streams.find(key);
+        if (found == streams.end()) {
+            // Counting starts at the first datagram seen, so joining late is not loss
+            found = streams.emplace(key, StreamStats()).first;
+            found->second.nextSequence = header.sequence;
+            found->second.first = now;
+        }
+        StreamStats& stats = found->second;
+        
+        stats.received++;
+        stats.bytes += length;
+        stats.last = now;
+        if (header.sequence >= stats.nextSequence) {
+            stats.lost += header.sequence - stats.nextSequence;
+            stats.nextSequence = header.sequence + 1;
+        } else {
+            stats.late++;
+            if (stats.lost > 0) {
+                stats.lost--;
+            }
+        }
+        
+        if (codec.decode(buffer + TelemetryDatagram::HEADER_SIZE, length - TelemetryDatagram::HEADER_SIZE, batch)) {
+            stats.samples += batch.count;
+        } else {
+            stats.decodeErrors++;
+        }
+    }
+    return streams;
+}
+
+static bool resolve(const std::string& target, struct sockaddr_in& address) {
+    size_t colon = target.rfind(':');
+    if (colon == std::string::npos) {
+        fprintf(stderr, "Expected host:port, got %s\n", target.c_str());
+        return false;
+    }
+    std::string host = target.substr(0, colon);
+    
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    struct addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), target.c_str() + colon + 1, &hints, &result) != 0 || !result) {
+        fprintf(stderr, "Cannot resolve %s\n", target.c_str());
+        return false;
+    }
+    memcpy(&address, result->ai_addr, sizeof(address));
+    freeaddrinfo(result);
+    return true;
+}
+
+// A synthetic node: IMU-layout batches of noisy samples 1 ms apart, sent as
+// the firmware frames them
+static SendResult sendStream(const std::string& target, const Options& options) {
+    SendResult result;
+    struct sockaddr_in address;
+    if (!resolve(target, address)) {
+        return result;
+    }
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return result;
+    }
+    
+    std::mt19937 random(options.seed);
+    std::normal_distribution<double> noise(0, 40);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    TelemetryCodec codec;
+    TelemetryBatch batch;
+    uint8_t datagram[TelemetryDatagram::MAX_SIZE];
+    TelemetryDatagram header;
+    header.stream = 0;
+    header.session = (random() & 0xFFFE) + 1;
+    header.sequence = 0;
+    
+    const int16_t base[7] = { 0, 0, 4096, 0, 0, 0, 2500 };
+    uint32_t timestamp = 0;
+    double duration = options.seconds > 0 ? options.seconds : 5;
+    uint64_t count = std::max<uint64_t>(2, llround(duration * options.rate));
+    Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / options.rate));
+    Clock::time_point next = Clock::now();
+    
+    for (uint64_t i = 0; i < count; i++) {
+        batch.reset(TELEMETRY_LAYOUT_IMU, 7);
+        batch.capacity = options.samples;
+        int16_t sample[TELEMETRY_BATCH_MAX_CHANNELS];
+        while (!batch.isFull()) {
+            for (int channel = 0; channel < 7; channel++) {
+                sample[channel] = (int16_t)(base[channel] + lround(noise(random)));
+            }
+            batch.add(timestamp++, sample);
+        }
+        
+        size_t length = codec.encode(batch, datagram + TelemetryDatagram::HEADER_SIZE,
+                                     sizeof(datagram) - TelemetryDatagram::HEADER_SIZE);
+        header.writeHeader(datagram);
+        header.sequence++;
+        // The first and last always go, so every skip falls inside what a receiver sees
+        if (i > 0 && i + 1 < count && uniform(random) < options.drop) {
+            result.dropped++;
+        } else if (sendto(fd, datagram, TelemetryDatagram::HEADER_SIZE + length, 0,
+                          (struct sockaddr*)&address, sizeof(address)) > 0) {
+            result.sent++;
+        }
+        
+        next += period;
+        std::this_thread::sleep_until(next);
+    }
+    
+    close(fd);
+    return result;
+}
+
+static bool report(const std::map<StreamKey, StreamStats>& streams, double maxLoss) {
+    bool ok = true;
+    printHeader();
+    for (const auto& entry : streams) {
+        printStream(entry.first, entry.second);
+        const StreamStats& stats = entry.second;
+        if ((double)stats.lost / (stats.received + stats.lost) > maxLoss || stats.decodeErrors > 0) {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--port" && hasValue) options.port = atoi(argv[++i]);
+        else if (arg == "--seconds" && hasValue) options.seconds = atof(argv[++i]);
+        else if (arg == "--report-ms" && hasValue) options.reportMs = atof(argv[++i]);
+        else if (arg == "--max-loss" && hasValue) options.maxLoss = atof(argv[++i]);
+        else if (arg == "--send" && hasValue) options.send = argv[++i];
+        else if (arg == "--rate" && hasValue) options.rate = atof(argv[++i]);
+        else if (arg == "--samples" && hasValue) options.samples = atoi(argv[++i]);
+        else if (arg == "--drop" && hasValue) options.drop = atof(argv[++i]);
+        else if (arg == "--seed" && hasValue) options.seed = atoi(argv[++i]);
+        else if (arg == "--selftest") options.selftest = true;
+        else {
+            fprintf(stderr, "Unknown option %s (see the top of udp_receiver.cpp)\n", arg.c_str());
+            return 2;
+        }
+    }
+    if (options.samples < 1 || options.samples > TELEMETRY_BATCH_MAX_SAMPLES || options.rate <= 0) {
+        fprintf(stderr, "--samples must be 1-%d and --rate positive\n", TELEMETRY_BATCH_MAX_SAMPLES);
+        return 2;
+    }
+    
+    if (!options.send.empty()) {
+        SendResult result = sendStream(options.send, options);
+        printf("Sent %llu datagrams, skipped %llu\n", (unsigned long long)result.sent, (unsigned long long)result.dropped);
+        return 0;
+    }
+    
+    int fd = openSocket(options.port);
+    if (fd < 0) {
+        return 1;
+    }
+    
+    if (!options.selftest) {
+        printf("Listening on UDP port %d\n", options.port);
+        std::map<StreamKey, StreamStats> streams = receive(fd, options, 0);
+        close(fd);
+        return report(streams, options.maxLoss) ? 0 : 1;
+    }
+    
+    // Loopback: everything the sender skipped must show up as loss, and nothing else
+    if (options.drop == 0) {
+        options.drop = 0.02;
+    }
+    Options receiving = options;
+    receiving.seconds = 0;
+    receiving.reportMs = 0;
+    SendResult result;
+    std::thread sender([&result, &options]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        result = sendStream("127.0.0.1:" + std::to_string(options.port), options);
+    });
+    std::map<StreamKey, StreamStats> streams = receive(fd, receiving, 1.0);
+    sender.join();
+    close(fd);
+    
+    bool ok = report(streams, options.maxLoss) && streams.size() == 1;
+    if (ok) {
+        const StreamStats& stats = streams.begin()->second;
+        printf("\nSent %llu, skipped %llu; received %llu, measured loss %llu\n",
+               (unsigned long long)result.sent, (unsigned long long)result.dropped,
+               (unsigned long long)stats.received, (unsigned long long)stats.lost);
+        ok = stats.received == result.sent && stats.lost == result.dropped && stats.late == 0;
+    }
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}